@@ -0,0 +1,721 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Microbenchmarks of the client internals that sit on every request's
+ * path, each run through the microbench harness:
+ *   recordio/   serializing and deserializing the primitive types
+ *   encode/     a request record and its header into an exactly sized
+ *               send buffer, the way the client encodes them
+ *   decode/     the same bytes back into a record, and freeing it
+ *   queue/      the send and completion queues, with their locks
+ *   watchers/   registering, triggering and delivering watches
+ *   addrvec/    the server address list
+ * Give a name, or part of one, to run only those; -h lists the options.
+ */
+
+#include "zk_adaptor.h"
+#include "zk_hashtable.h"
+#include "addrvec.h"
+#include "microbench.h"
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct mb_options options;
+
+static char path[] = "/app/service/config/node-0000000042";
+/* the chroot of a handle that sees the path above as client_path */
+static char chroot[] = "/app";
+static char client_path[] = "/service/config/node-0000000042";
+static char data[1024];
+
+/* recordio */
+
+/* values written per archive; decoding amortizes creating one over them */
+#define BATCH 256
+
+static void bench_oa_int(void *arg, long n)
+{
+    char buf[BATCH * 4];
+    struct fixed_oarchive oa;
+    int32_t v = 42;
+    long i;
+    for (i = 0; i < n; i++) {
+        if (i % BATCH == 0)
+            init_fixed_oarchive(&oa, buf, sizeof(buf));
+        oa.oa.serialize_Int(&oa.oa, "v", &v);
+    }
+    MB_CONSUME(buf[0]);
+}
+
+static void bench_oa_long(void *arg, long n)
+{
+    char buf[BATCH * 8];
+    struct fixed_oarchive oa;
+    int64_t v = 0x123456789abcdefLL;
+    long i;
+    for (i = 0; i < n; i++) {
+        if (i % BATCH == 0)
+            init_fixed_oarchive(&oa, buf, sizeof(buf));
+        oa.oa.serialize_Long(&oa.oa, "v", &v);
+    }
+    MB_CONSUME(buf[0]);
+}
+
+static void bench_oa_string(void *arg, long n)
+{
+    char buf[BATCH * sizeof(path)];
+    struct fixed_oarchive oa;
+    char *s = path;
+    long i;
+    for (i = 0; i < n; i++) {
+        if (i % BATCH == 0)
+            init_fixed_oarchive(&oa, buf, sizeof(buf));
+        oa.oa.serialize_String(&oa.oa, "v", &s);
+    }
+    MB_CONSUME(buf[0]);
+}
+
+static void bench_oa_buffer(void *arg, long n)
+{
+    struct buffer b = {sizeof(data), data};
+    struct fixed_oarchive oa;
+    char *buf = malloc(sizeof(data) + 4);
+    long i;
+    for (i = 0; i < n; i++) {
+        init_fixed_oarchive(&oa, buf, sizeof(data) + 4);
+        oa.oa.serialize_Buffer(&oa.oa, "v", &b);
+    }
+    MB_CONSUME(buf[0]);
+    free(buf);
+}
+
+/* the growing archive the client used before fixed_oarchive */
+static void bench_oa_growing(void *arg, long n)
+{
+    char *s = path;
+    int32_t v = 42;
+    long i;
+    for (i = 0; i < n; i++) {
+        struct oarchive *oa = create_buffer_oarchive();
+        oa->serialize_Int(oa, "xid", &v);
+        oa->serialize_Int(oa, "type", &v);
+        oa->serialize_String(oa, "path", &s);
+        oa->serialize_Int(oa, "watch", &v);
+        MB_CONSUME(get_buffer_len(oa));
+        close_buffer_oarchive(&oa, 1);
+    }
+}
+
+struct encoded {
+    char *buf;
+    int len;
+};
+
+static void encode_batch(struct encoded *e, int kind)
+{
+    struct oarchive *oa = create_buffer_oarchive();
+    struct buffer b = {64, data};
+    int32_t v = 42;
+    int64_t l = 0x123456789abcdefLL;
+    char *s = path;
+    int i;
+    for (i = 0; i < BATCH; i++) {
+        switch (kind) {
+        case 'i': oa->serialize_Int(oa, "v", &v); break;
+        case 'l': oa->serialize_Long(oa, "v", &l); break;
+        case 's': oa->serialize_String(oa, "v", &s); break;
+        case 'b': oa->serialize_Buffer(oa, "v", &b); break;
+        }
+    }
+    e->len = get_buffer_len(oa);
+    e->buf = malloc(e->len);
+    memcpy(e->buf, get_buffer(oa), e->len);
+    close_buffer_oarchive(&oa, 1);
+}
+
+static void bench_ia_int(void *arg, long n)
+{
+    struct encoded *e = arg;
+    struct iarchive *ia = 0;
+    int32_t v;
+    long i;
+    for (i = 0; i < n; i++) {
+        if (i % BATCH == 0) {
+            if (ia)
+                close_buffer_iarchive(&ia);
+            ia = create_buffer_iarchive(e->buf, e->len);
+        }
+        ia->deserialize_Int(ia, "v", &v);
+        MB_CONSUME(v);
+    }
+    close_buffer_iarchive(&ia);
+}
+
+static void bench_ia_long(void *arg, long n)
+{
+    struct encoded *e = arg;
+    struct iarchive *ia = 0;
+    int64_t v;
+    long i;
+    for (i = 0; i < n; i++) {
+        if (i % BATCH == 0) {
+            if (ia)
+                close_buffer_iarchive(&ia);
+            ia = create_buffer_iarchive(e->buf, e->len);
+        }
+        ia->deserialize_Long(ia, "v", &v);
+        MB_CONSUME(v);
+    }
+    close_buffer_iarchive(&ia);
+}
+
+static void bench_ia_string(void *arg, long n)
+{
+    struct encoded *e = arg;
+    struct iarchive *ia = 0;
+    char *v;
+    long i;
+    for (i = 0; i < n; i++) {
+        if (i % BATCH == 0) {
+            if (ia)
+                close_buffer_iarchive(&ia);
+            ia = create_buffer_iarchive(e->buf, e->len);
+        }
+        ia->deserialize_String(ia, "v", &v);
+        MB_CONSUME(v[0]);
+        deallocate_String(&v);
+    }
+    close_buffer_iarchive(&ia);
+}
+
+static void bench_ia_buffer(void *arg, long n)
+{
+    struct encoded *e = arg;
+    struct iarchive *ia = 0;
+    struct buffer v;
+    long i;
+    for (i = 0; i < n; i++) {
+        if (i % BATCH == 0) {
+            if (ia)
+                close_buffer_iarchive(&ia);
+            ia = create_buffer_iarchive(e->buf, e->len);
+        }
+        ia->deserialize_Buffer(ia, "v", &v);
+        MB_CONSUME(v.buff);
+        deallocate_Buffer(&v);
+    }
+    close_buffer_iarchive(&ia);
+}
+
+static void run_recordio(void)
+{
+    struct encoded e;
+    const char *kinds = "ilsb";
+    mb_fn decoders[] = {bench_ia_int, bench_ia_long, bench_ia_string,
+            bench_ia_buffer};
+    const char *names[] = {"recordio/deserialize_int",
+            "recordio/deserialize_long", "recordio/deserialize_string",
+            "recordio/deserialize_buffer64"};
+    int i;
+
+    mb_run(&options, "recordio/serialize_int", bench_oa_int, 0, 0);
+    mb_run(&options, "recordio/serialize_long", bench_oa_long, 0, 0);
+    mb_run(&options, "recordio/serialize_string", bench_oa_string, 0, 0);
+    mb_run(&options, "recordio/serialize_buffer1k", bench_oa_buffer, 0, 0);
+    mb_run(&options, "recordio/buffer_oarchive", bench_oa_growing, 0, 0);
+    for (i = 0; kinds[i]; i++) {
+        encode_batch(&e, kinds[i]);
+        mb_run(&options, names[i], decoders[i], &e, 0);
+        free(e.buf);
+    }
+}
+
+/* requests */
+
+struct request_case {
+    struct RequestHeader h;
+    int with_header;    /* ConnectRequest and the header alone go without */
+    void *req;
+    struct encoded e;
+};
+
+/*
+ * Encodes as the client's own request encoders do: a counting pass, one
+ * allocation of the exact size and a pass that fills it. Decoding creates
+ * an archive over the bytes, deserializes the header and record and frees
+ * what that allocated.
+ */
+#define DEFINE_REQUEST_BENCH(record)                                       \
+static char *encode_##record(struct request_case *c, int *len)             \
+{                                                                          \
+    struct fixed_oarchive oa;                                              \
+    char *buf;                                                             \
+    init_fixed_oarchive(&oa, 0, 0);                                        \
+    if (c->with_header)                                                    \
+        serialize_RequestHeader(&oa.oa, "header", &c->h);                  \
+    serialize_##record(&oa.oa, "req", c->req);                             \
+    *len = oa.off;                                                         \
+    buf = malloc(*len);                                                    \
+    init_fixed_oarchive(&oa, buf, *len);                                   \
+    if (c->with_header)                                                    \
+        serialize_RequestHeader(&oa.oa, "header", &c->h);                  \
+    serialize_##record(&oa.oa, "req", c->req);                             \
+    assert(oa.off == *len);                                                \
+    return buf;                                                            \
+}                                                                          \
+static void bench_encode_##record(void *arg, long n)                       \
+{                                                                          \
+    struct request_case *c = arg;                                          \
+    int len;                                                               \
+    long i;                                                                \
+    for (i = 0; i < n; i++) {                                              \
+        char *buf = encode_##record(c, &len);                              \
+        MB_CONSUME(buf[0]);                                                \
+        free(buf);                                                         \
+    }                                                                      \
+}                                                                          \
+static void bench_decode_##record(void *arg, long n)                       \
+{                                                                          \
+    struct request_case *c = arg;                                          \
+    long i;                                                                \
+    for (i = 0; i < n; i++) {                                              \
+        struct iarchive *ia = create_buffer_iarchive(c->e.buf, c->e.len);  \
+        struct RequestHeader h;                                            \
+        struct record v;                                                   \
+        memset(&v, 0, sizeof(v));                                          \
+        if (c->with_header)                                                \
+            deserialize_RequestHeader(ia, "header", &h);                   \
+        deserialize_##record(ia, "req", &v);                               \
+        MB_CONSUME(&v);                                                    \
+        deallocate_##record(&v);                                           \
+        close_buffer_iarchive(&ia);                                        \
+    }                                                                      \
+}                                                                          \
+static void run_##record(int32_t op, int with_header, struct record *req)  \
+{                                                                          \
+    struct request_case c;                                                 \
+    c.h.xid = 42;                                                          \
+    c.h.type = op;                                                         \
+    c.with_header = with_header;                                           \
+    c.req = req;                                                           \
+    c.e.buf = encode_##record(&c, &c.e.len);                               \
+    mb_run(&options, "encode/" #record, bench_encode_##record, &c, 0);     \
+    mb_run(&options, "decode/" #record, bench_decode_##record, &c, 0);     \
+    free(c.e.buf);                                                         \
+}
+
+DEFINE_REQUEST_BENCH(RequestHeader)
+DEFINE_REQUEST_BENCH(ConnectRequest)
+DEFINE_REQUEST_BENCH(GetDataRequest)
+DEFINE_REQUEST_BENCH(SetDataRequest)
+DEFINE_REQUEST_BENCH(ReconfigRequest)
+DEFINE_REQUEST_BENCH(CreateRequest)
+DEFINE_REQUEST_BENCH(Create2Request)
+DEFINE_REQUEST_BENCH(DeleteRequest)
+DEFINE_REQUEST_BENCH(ExistsRequest)
+DEFINE_REQUEST_BENCH(GetChildrenRequest)
+DEFINE_REQUEST_BENCH(GetChildren2Request)
+DEFINE_REQUEST_BENCH(CheckVersionRequest)
+DEFINE_REQUEST_BENCH(SyncRequest)
+DEFINE_REQUEST_BENCH(GetACLRequest)
+DEFINE_REQUEST_BENCH(SetACLRequest)
+DEFINE_REQUEST_BENCH(GetMaxChildrenRequest)
+DEFINE_REQUEST_BENCH(SetMaxChildrenRequest)
+DEFINE_REQUEST_BENCH(GetSASLRequest)
+DEFINE_REQUEST_BENCH(SetSASLRequest)
+DEFINE_REQUEST_BENCH(MultiHeader)
+DEFINE_REQUEST_BENCH(AuthPacket)
+DEFINE_REQUEST_BENCH(SetWatches)
+
+/* a request of a handle with a chroot, which is written in front of the
+ * client's path as the path is serialized */
+static void bench_encode_chroot(void *arg, long n)
+{
+    struct GetDataRequest req = {client_path, 1};
+    struct RequestHeader h = {42, ZOO_GETDATA_OP};
+    struct fixed_oarchive oa;
+    long i;
+    for (i = 0; i < n; i++) {
+        char *buf;
+        int len;
+        init_fixed_oarchive(&oa, 0, 0);
+        oa.path_prefix = chroot;
+        oa.path_prefix_len = sizeof(chroot) - 1;
+        serialize_RequestHeader(&oa.oa, "header", &h);
+        serialize_GetDataRequest(&oa.oa, "req", &req);
+        len = oa.off;
+        buf = malloc(len);
+        init_fixed_oarchive(&oa, buf, len);
+        oa.path_prefix = chroot;
+        oa.path_prefix_len = sizeof(chroot) - 1;
+        serialize_RequestHeader(&oa.oa, "header", &h);
+        serialize_GetDataRequest(&oa.oa, "req", &req);
+        assert(oa.off == len);
+        MB_CONSUME(buf[0]);
+        free(buf);
+    }
+}
+
+static void run_requests(void)
+{
+    char *watches[] = {path, path, path, path};
+    char passwd[16] = {0};
+    char scheme[] = "digest";
+    char auth[] = "user:password";
+    char joining[] = "server.4=10.0.0.4:2888:3888:participant;2181";
+    char leaving[] = "3";
+    struct buffer small = {64, data};
+    struct buffer token = {32, data};
+    struct RequestHeader ping = {-2, ZOO_PING_OP};
+    struct ConnectRequest connect = {0, 0x100000042LL, 30000, 0,
+            {sizeof(passwd), passwd}};
+    struct GetDataRequest get = {path, 1};
+    struct SetDataRequest set = {path, {sizeof(data), data}, -1};
+    struct ReconfigRequest reconfig = {joining, leaving, 0, -1};
+    struct CreateRequest create = {path, small, ZOO_OPEN_ACL_UNSAFE,
+            ZOO_SEQUENCE};
+    struct Create2Request create2 = {path, small, ZOO_OPEN_ACL_UNSAFE,
+            ZOO_SEQUENCE};
+    struct DeleteRequest del = {path, -1};
+    struct ExistsRequest exists = {path, 1};
+    struct GetChildrenRequest children = {path, 1};
+    struct GetChildren2Request children2 = {path, 1};
+    struct CheckVersionRequest check = {path, 3};
+    struct SyncRequest sync = {path};
+    struct GetACLRequest getacl = {path};
+    struct SetACLRequest setacl = {path, ZOO_OPEN_ACL_UNSAFE, -1};
+    struct GetMaxChildrenRequest getmax = {path};
+    struct SetMaxChildrenRequest setmax = {path, 100};
+    struct GetSASLRequest getsasl = {token};
+    struct SetSASLRequest setsasl = {token};
+    struct MultiHeader multi = {ZOO_CREATE_OP, 0, -1};
+    struct AuthPacket authp = {0, scheme, {sizeof(auth) - 1, auth}};
+    struct SetWatches setwatches = {0x100000042LL, {4, watches},
+            {4, watches}, {4, watches}};
+
+    run_RequestHeader(0, 0, &ping);
+    run_ConnectRequest(0, 0, &connect);
+    run_GetDataRequest(ZOO_GETDATA_OP, 1, &get);
+    run_SetDataRequest(ZOO_SETDATA_OP, 1, &set);
+    run_ReconfigRequest(ZOO_RECONFIG_OP, 1, &reconfig);
+    run_CreateRequest(ZOO_CREATE_OP, 1, &create);
+    run_Create2Request(ZOO_CREATE2_OP, 1, &create2);
+    run_DeleteRequest(ZOO_DELETE_OP, 1, &del);
+    run_ExistsRequest(ZOO_EXISTS_OP, 1, &exists);
+    run_GetChildrenRequest(ZOO_GETCHILDREN_OP, 1, &children);
+    run_GetChildren2Request(ZOO_GETCHILDREN2_OP, 1, &children2);
+    run_CheckVersionRequest(ZOO_CHECK_OP, 1, &check);
+    run_SyncRequest(ZOO_SYNC_OP, 1, &sync);
+    run_GetACLRequest(ZOO_GETACL_OP, 1, &getacl);
+    run_SetACLRequest(ZOO_SETACL_OP, 1, &setacl);
+    /* the client has no op codes for these */
+    run_GetMaxChildrenRequest(0, 1, &getmax);
+    run_SetMaxChildrenRequest(0, 1, &setmax);
+    run_GetSASLRequest(0, 1, &getsasl);
+    run_SetSASLRequest(0, 1, &setsasl);
+    run_MultiHeader(ZOO_MULTI_OP, 1, &multi);
+    run_AuthPacket(ZOO_SETAUTH_OP, 1, &authp);
+    run_SetWatches(ZOO_SETWATCHES_OP, 1, &setwatches);
+    mb_run(&options, "encode/GetDataRequest_chroot", bench_encode_chroot, 0,
+            0);
+}
+
+/* queues */
+
+/* entries kept on a queue, so that the benchmarks don't only exercise the
+ * empty queue case */
+#define QUEUE_DEPTH 64
+
+static void bench_buffer_queue(void *arg, long n)
+{
+    buffer_head_t *list = arg;
+    long i;
+    for (i = 0; i < n; i++)
+        queue_buffer(list, dequeue_buffer(list), 0);
+}
+
+static void bench_completion_queue(void *arg, long n)
+{
+    completion_head_t *list = arg;
+    long i;
+    for (i = 0; i < n; i++)
+        queue_completion(list, dequeue_completion(list), 0);
+}
+
+/* what each request costs: an entry created when it is sent and destroyed
+ * when its reply has been processed */
+static void bench_completion_entry(void *arg, long n)
+{
+    completion_head_t *list = arg;
+    long i;
+    for (i = 0; i < n; i++) {
+        queue_completion(list, create_completion_entry(i, COMPLETION_VOID, 0,
+                0, 0, 0), 0);
+        destroy_completion_entry(dequeue_completion(list));
+    }
+}
+
+static void run_queues(void)
+{
+    buffer_head_t buffers;
+    completion_head_t completions;
+    buffer_list_t b[QUEUE_DEPTH];
+    int i;
+
+    memset(&buffers, 0, sizeof(buffers));
+    memset(&completions, 0, sizeof(completions));
+    memset(b, 0, sizeof(b));
+#ifdef THREADED
+    pthread_mutex_init(&buffers.lock, 0);
+    pthread_mutex_init(&completions.lock, 0);
+    pthread_cond_init(&completions.cond, 0);
+#endif
+    for (i = 0; i < QUEUE_DEPTH; i++) {
+        queue_buffer(&buffers, &b[i], 0);
+        queue_completion(&completions,
+                create_completion_entry(i, COMPLETION_VOID, 0, 0, 0, 0), 0);
+    }
+    mb_run(&options, "queue/buffer", bench_buffer_queue, &buffers, 0);
+    mb_run(&options, "queue/completion", bench_completion_queue,
+            &completions, 0);
+    mb_run(&options, "queue/completion_entry", bench_completion_entry,
+            &completions, 0);
+    for (i = 0; i < QUEUE_DEPTH; i++)
+        destroy_completion_entry(dequeue_completion(&completions));
+#ifdef THREADED
+    pthread_mutex_destroy(&buffers.lock);
+    pthread_mutex_destroy(&completions.lock);
+    pthread_cond_destroy(&completions.cond);
+#endif
+}
+
+/* watchers */
+
+#define PATHS 1024
+
+struct watch_bench {
+    zhandle_t zh;
+    char *paths[PATHS];
+    /* as checking the paths works them out, for nothing */
+    unsigned int hashes[PATHS];
+    long delivered;
+};
+
+static void count_watcher(zhandle_t *zh, int type, int state,
+        const char *path, void *ctx)
+{
+    ((struct watch_bench *)ctx)->delivered++;
+}
+
+static zk_hashtable *node_checker(zhandle_t *zh, int rc)
+{
+    return zh->active_node_watchers;
+}
+
+/* a watch set by zoo_wget(), which the reply moves to the active table */
+static void activate(struct watch_bench *w, int i)
+{
+    watcher_registration_t reg;
+    reg.watcher = count_watcher;
+    reg.context = w;
+    reg.checker = node_checker;
+    reg.path = w->paths[i];
+    reg.hash = w->hashes[i];
+    activateWatcher(&w->zh, &reg, ZOK);
+}
+
+static void bench_watch_cycle(void *arg, long n)
+{
+    struct watch_bench *w = arg;
+    long i;
+    for (i = 0; i < n; i++) {
+        char *path = w->paths[i % PATHS];
+        watcher_object_list_t *list;
+        activate(w, i % PATHS);
+        list = collectWatchers(&w->zh, ZOO_CHANGED_EVENT, path);
+        deliverWatchers(&w->zh, ZOO_CHANGED_EVENT, ZOO_CONNECTED_STATE, path,
+                &list);
+    }
+}
+
+/* the same watch set again while it is still active */
+static void bench_watch_duplicate(void *arg, long n)
+{
+    struct watch_bench *w = arg;
+    long i;
+    for (i = 0; i < n; i++)
+        activate(w, i % PATHS);
+}
+
+/* an event for a path that nobody is watching */
+static void bench_watch_miss(void *arg, long n)
+{
+    struct watch_bench *w = arg;
+    char miss[] = "/app/service/config/not-watched";
+    long i;
+    for (i = 0; i < n; i++) {
+        watcher_object_list_t *list = collectWatchers(&w->zh,
+                ZOO_CHANGED_EVENT, miss);
+        deliverWatchers(&w->zh, ZOO_CHANGED_EVENT, ZOO_CONNECTED_STATE, miss,
+                &list);
+    }
+}
+
+static void run_watchers(void)
+{
+    struct watch_bench *w = calloc(1, sizeof(*w));
+    int i;
+
+    w->zh.active_node_watchers = create_zk_hashtable();
+    w->zh.active_exist_watchers = create_zk_hashtable();
+    w->zh.active_child_watchers = create_zk_hashtable();
+    for (i = 0; i < PATHS; i++) {
+        w->paths[i] = malloc(sizeof(path) + 8);
+        sprintf(w->paths[i], "%s/%05d", path, i);
+        w->hashes[i] = zk_path_hash(w->paths[i]);
+    }
+    mb_run(&options, "watchers/activate+trigger", bench_watch_cycle, w, 0);
+    /* delivered to a handle chrooted at the paths' first node */
+    w->zh.chroot = chroot;
+    mb_run(&options, "watchers/activate+trigger_chroot", bench_watch_cycle,
+            w, 0);
+    w->zh.chroot = 0;
+    for (i = 0; i < PATHS; i++)
+        activate(w, i);
+    mb_run(&options, "watchers/activate_duplicate", bench_watch_duplicate, w,
+            0);
+    mb_run(&options, "watchers/trigger_unwatched", bench_watch_miss, w, 0);
+
+    destroy_zk_hashtable(w->zh.active_node_watchers);
+    destroy_zk_hashtable(w->zh.active_exist_watchers);
+    destroy_zk_hashtable(w->zh.active_child_watchers);
+    for (i = 0; i < PATHS; i++)
+        free(w->paths[i]);
+    free(w);
+}
+
+/* addrvec */
+
+/* a typical ensemble, as resolved by getaddrinfo() */
+#define SERVERS 5
+
+struct addr_bench {
+    struct sockaddr_storage addrs[SERVERS];
+    addrvec_t avec;
+    addrvec_t copy;
+};
+
+static void bench_addrvec_build(void *arg, long n)
+{
+    struct addr_bench *a = arg;
+    long i;
+    int j;
+    for (i = 0; i < n; i++) {
+        addrvec_t avec;
+        addrvec_init(&avec);
+        addrvec_alloc(&avec);
+        for (j = 0; j < SERVERS; j++)
+            addrvec_append(&avec, &a->addrs[j]);
+        MB_CONSUME(avec.count);
+        addrvec_free(&avec);
+    }
+}
+
+/* the worst case, the address that is last in the list */
+static void bench_addrvec_contains(void *arg, long n)
+{
+    struct addr_bench *a = arg;
+    long i;
+    for (i = 0; i < n; i++)
+        MB_CONSUME(addrvec_contains(&a->avec, &a->addrs[SERVERS - 1]));
+}
+
+static void bench_addrvec_next(void *arg, long n)
+{
+    struct addr_bench *a = arg;
+    struct sockaddr_storage next;
+    long i;
+    for (i = 0; i < n; i++) {
+        addrvec_next(&a->avec, &next);
+        MB_CONSUME(next.ss_family);
+    }
+}
+
+static void bench_addrvec_shuffle(void *arg, long n)
+{
+    struct addr_bench *a = arg;
+    long i;
+    for (i = 0; i < n; i++)
+        addrvec_shuffle(&a->avec);
+}
+
+static void bench_addrvec_eq(void *arg, long n)
+{
+    struct addr_bench *a = arg;
+    long i;
+    for (i = 0; i < n; i++)
+        MB_CONSUME(addrvec_eq(&a->avec, &a->copy));
+}
+
+static void run_addrvec(void)
+{
+    struct addr_bench a;
+    int i;
+
+    memset(&a, 0, sizeof(a));
+    addrvec_init(&a.avec);
+    addrvec_init(&a.copy);
+    addrvec_alloc(&a.avec);
+    addrvec_alloc(&a.copy);
+    for (i = 0; i < SERVERS; i++) {
+        struct sockaddr_in *in = (struct sockaddr_in *)&a.addrs[i];
+        in->sin_family = AF_INET;
+        in->sin_port = htons(2181);
+        in->sin_addr.s_addr = htonl(0x0a000001 + i);
+        addrvec_append(&a.avec, &a.addrs[i]);
+        addrvec_append(&a.copy, &a.addrs[i]);
+    }
+    mb_run(&options, "addrvec/build", bench_addrvec_build, &a, 0);
+    mb_run(&options, "addrvec/contains", bench_addrvec_contains, &a, 0);
+    mb_run(&options, "addrvec/next", bench_addrvec_next, &a, 0);
+    mb_run(&options, "addrvec/shuffle", bench_addrvec_shuffle, &a, 0);
+    /* shuffling leaves the two in a different order, which eq allows */
+    mb_run(&options, "addrvec/eq", bench_addrvec_eq, &a, 0);
+    addrvec_free(&a.avec);
+    addrvec_free(&a.copy);
+}
+
+int main(int argc, char **argv)
+{
+    if (mb_init(&options, argc, argv) != 0)
+        return 1;
+    memset(data, 'x', sizeof(data));
+    zoo_set_debug_level(ZOO_LOG_LEVEL_ERROR);
+
+    run_recordio();
+    run_requests();
+    run_queues();
+    run_watchers();
+    run_addrvec();
+    return 0;
+}
@@ -0,0 +1,130 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures xid generation from many threads:
+ *   global      one process-wide counter, as get_xid() used to be
+ *   shared      every thread allocating xids from the same handle
+ *   per-handle  every thread on its own handle
+ *   per-handle+io  as above, with a second thread per handle updating the
+ *               IO thread's timestamps the whole time
+ * The last two should scale with the number of threads; "per-handle+io"
+ * only does if the xid is on a different cache line from the IO fields.
+ */
+
+#include "zk_adaptor.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_THREADS 256
+
+static volatile int32_t global_xid;
+static volatile int stop_io;
+
+struct worker {
+    pthread_t thread;
+    zhandle_t *zh;      /* 0 for the global counter */
+    long ops;
+};
+
+static void *xid_worker(void *arg)
+{
+    struct worker *w = arg;
+    long i;
+    if (w->zh) {
+        for (i = 0; i < w->ops; i++)
+            get_xid(w->zh);
+    } else {
+        for (i = 0; i < w->ops; i++)
+            fetch_and_add(&global_xid, 1);
+    }
+    return 0;
+}
+
+static void *io_writer(void *arg)
+{
+    zhandle_t *zh = arg;
+    while (!stop_io) {
+        zh->last_send.tv_usec++;
+        zh->last_recv.tv_usec++;
+    }
+    return 0;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run(const char *name, int threads, long ops, int per_handle,
+        int with_io)
+{
+    struct worker w[MAX_THREADS];
+    pthread_t io[MAX_THREADS];
+    zhandle_t *zh[MAX_THREADS];
+    double start, elapsed;
+    int i, handles = per_handle ? threads : 1;
+
+    for (i = 0; i < handles; i++)
+        zh[i] = calloc(1, sizeof(zhandle_t));
+    stop_io = 0;
+    for (i = 0; with_io && i < handles; i++)
+        pthread_create(&io[i], 0, io_writer, zh[i]);
+
+    start = now_ns();
+    for (i = 0; i < threads; i++) {
+        w[i].zh = strcmp(name, "global") == 0 ? 0 : zh[per_handle ? i : 0];
+        w[i].ops = ops;
+        pthread_create(&w[i].thread, 0, xid_worker, &w[i]);
+    }
+    for (i = 0; i < threads; i++)
+        pthread_join(w[i].thread, 0);
+    elapsed = now_ns() - start;
+
+    stop_io = 1;
+    for (i = 0; with_io && i < handles; i++)
+        pthread_join(io[i], 0);
+    for (i = 0; i < handles; i++)
+        free(zh[i]);
+
+    printf("%-16s %3d threads %8.2f ns/op %10.2f Mxid/s\n", name, threads,
+            elapsed / ops, threads * ops / elapsed * 1e3);
+}
+
+int main(int argc, char **argv)
+{
+    int threads = argc > 1 ? atoi(argv[1]) : 8;
+    long ops = argc > 2 ? atol(argv[2]) : 10000000;
+
+    if (threads <= 0 || threads > MAX_THREADS || ops <= 0) {
+        fprintf(stderr, "USAGE: %s [threads (1-%d)] [xids per thread]\n",
+                argv[0], MAX_THREADS);
+        return 1;
+    }
+    run("global", threads, ops, 0, 0);
+    run("shared", threads, ops, 0, 0);
+    run("per-handle", threads, ops, 1, 0);
+    run("per-handle+io", threads, ops, 1, 1);
+    return 0;
+}
@@ -0,0 +1,182 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "microbench.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_REPETITIONS 1000
+
+volatile uint64_t mb_sink;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double median(double *v, int count)
+{
+    qsort(v, count, sizeof(*v), compare_doubles);
+    return count % 2 ? v[count / 2] : (v[count / 2 - 1] + v[count / 2]) / 2;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "USAGE: %s [-r repetitions] [-w warmup] [-t ms] [-l] [-j] "
+            "[filter]\n"
+            "  -r  measured repetitions (default 15)\n"
+            "  -w  unmeasured repetitions before them (default 3)\n"
+            "  -t  target milliseconds per repetition (default 20)\n"
+            "  -l  list the benchmarks\n"
+            "  -j  print one JSON object per benchmark\n"
+            "  filter  run only benchmarks whose name contains it\n", prog);
+}
+
+int mb_init(struct mb_options *o, int argc, char **argv)
+{
+    int c;
+
+    o->repetitions = 15;
+    o->warmup = 3;
+    o->rep_ms = 20;
+    o->filter = 0;
+    o->list = 0;
+    o->json = 0;
+    while ((c = getopt(argc, argv, "r:w:t:ljh")) != -1) {
+        switch (c) {
+        case 'r':
+            o->repetitions = atoi(optarg);
+            break;
+        case 'w':
+            o->warmup = atoi(optarg);
+            break;
+        case 't':
+            o->rep_ms = atof(optarg);
+            break;
+        case 'l':
+            o->list = 1;
+            break;
+        case 'j':
+            o->json = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (optind < argc)
+        o->filter = argv[optind++];
+    if (optind < argc || o->repetitions < 1 ||
+            o->repetitions > MAX_REPETITIONS || o->warmup < 0 ||
+            o->rep_ms <= 0) {
+        usage(argv[0]);
+        return -1;
+    }
+    if (!o->list && !o->json)
+        printf("%-36s %10s %10s %10s %18s %10s\n", "benchmark", "ops/rep",
+                "median ns", "min ns", "mean ns", "cycles");
+    return 0;
+}
+
+/* the number of operations that takes about ms milliseconds */
+static long calibrate(mb_fn fn, void *arg, double ms)
+{
+    long n = 1;
+    double elapsed;
+
+    for (;;) {
+        double start = now_ns();
+        fn(arg, n);
+        elapsed = now_ns() - start;
+        /* a tenth of the target is enough to extrapolate from */
+        if (elapsed >= ms * 1e5 || n >= 1000000000L)
+            break;
+        n *= elapsed < ms * 1e4 ? 10 : 2;
+    }
+    n = (long)(n * (ms * 1e6 / elapsed));
+    return n > 0 ? n : 1;
+}
+
+int mb_run(const struct mb_options *o, const char *name, mb_fn fn, void *arg,
+        struct mb_result *result)
+{
+    double ns[MAX_REPETITIONS], cycles[MAX_REPETITIONS];
+    double sum = 0, sq = 0;
+    struct mb_result r;
+    int i;
+
+    if (o->filter && strstr(name, o->filter) == 0)
+        return 0;
+    if (o->list) {
+        printf("%s\n", name);
+        return 1;
+    }
+
+    r.n = calibrate(fn, arg, o->rep_ms);
+    for (i = 0; i < o->warmup; i++)
+        fn(arg, r.n);
+    for (i = 0; i < o->repetitions; i++) {
+        double start = now_ns();
+        uint64_t start_cycles = mb_cycles();
+        fn(arg, r.n);
+        cycles[i] = (double)(mb_cycles() - start_cycles) / r.n;
+        ns[i] = (now_ns() - start) / r.n;
+        sum += ns[i];
+        sq += ns[i] * ns[i];
+    }
+    r.mean_ns = sum / o->repetitions;
+    r.stddev_ns = o->repetitions > 1 ?
+        sqrt(fmax(0, (sq - sum * r.mean_ns) / (o->repetitions - 1))) : 0;
+    r.median_ns = median(ns, o->repetitions);
+    r.min_ns = ns[0];   /* median() sorted them */
+    r.median_cycles = median(cycles, o->repetitions);
+
+    if (o->json) {
+        printf("{\"benchmark\":\"%s\",\"ops_per_rep\":%ld,\"repetitions\":%d,"
+                "\"median_ns\":%.3f,\"min_ns\":%.3f,\"mean_ns\":%.3f,"
+                "\"stddev_ns\":%.3f,\"median_cycles\":%.1f}\n", name, r.n,
+                o->repetitions, r.median_ns, r.min_ns, r.mean_ns, r.stddev_ns,
+                r.median_cycles);
+    } else {
+        char mean[32], cyc[16];
+        snprintf(mean, sizeof(mean), "%.2f +-%.2f", r.mean_ns, r.stddev_ns);
+        if (r.median_cycles > 0)
+            snprintf(cyc, sizeof(cyc), "%.1f", r.median_cycles);
+        else
+            snprintf(cyc, sizeof(cyc), "-");
+        printf("%-36s %10ld %10.2f %10.2f %18s %10s\n", name, r.n,
+                r.median_ns, r.min_ns, mean, cyc);
+    }
+    fflush(stdout);
+    if (result)
+        *result = r;
+    return 1;
+}
@@ -0,0 +1,89 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MICROBENCH_H_
+#define MICROBENCH_H_
+
+/*
+ * A small harness for timing client internals in a tight loop.
+ *
+ * A benchmark is a function that performs its operation n times. The
+ * harness picks n so that one repetition takes about rep_ms, runs some
+ * unmeasured warmup repetitions and then the measured ones, and reports
+ * the median, minimum, mean and standard deviation of the time per
+ * operation across repetitions, along with the median in cycles where
+ * the CPU has a usable cycle counter.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*mb_fn)(void *arg, long n);
+
+struct mb_options {
+    int repetitions;        /* measured repetitions */
+    int warmup;             /* unmeasured repetitions before them */
+    double rep_ms;          /* target duration of one repetition */
+    const char *filter;     /* run only benchmarks whose name contains it */
+    int list;               /* print the names instead of running */
+    int json;               /* one JSON object per benchmark */
+};
+
+struct mb_result {
+    long n;                 /* operations per repetition */
+    double median_ns;       /* all per operation */
+    double min_ns;
+    double mean_ns;
+    double stddev_ns;
+    double median_cycles;   /* 0 if there is no cycle counter */
+};
+
+/* Fills in the defaults and parses the command line. Returns 0, or -1
+ * after printing usage. */
+int mb_init(struct mb_options *o, int argc, char **argv);
+
+/* Times fn(arg, n) as above and prints the result. Returns 1 if it ran,
+ * 0 if the filter skipped it. */
+int mb_run(const struct mb_options *o, const char *name, mb_fn fn, void *arg,
+        struct mb_result *result);
+
+/* Keeps the compiler from discarding a value that is otherwise unused. */
+extern volatile uint64_t mb_sink;
+#define MB_CONSUME(x) (mb_sink += (uint64_t)(uintptr_t)(x))
+
+/* The cycle counter, or 0 if there is none. On x86 this is the TSC, which
+ * counts at a constant reference rate rather than the current clock. */
+static inline uint64_t mb_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t lo, hi;
+    __asm__ __volatile__("lfence; rdtsc" : "=a"(lo), "=d"(hi) : : "memory");
+    return ((uint64_t)hi << 32) | lo;
+#else
+    return 0;
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*MICROBENCH_H_*/
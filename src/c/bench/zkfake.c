@@ -0,0 +1,1658 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "zkfake.h"
+
+#include <zookeeper.h>
+#include <proto.h>
+#include <recordio.h>
+#include <zookeeper.jute.h>
+#include "zk_adaptor.h"
+#include "hashtable/hashtable.h"
+#include "hashtable/hashtable_itr.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define MAX_FRAME (64 * 1024 * 1024)
+#define IO_CHUNK (64 * 1024)
+
+#define WATCH_DATA 0
+#define WATCH_CHILD 1
+#define MASK_DATA (1 << WATCH_DATA)
+#define MASK_CHILD (1 << WATCH_CHILD)
+
+struct znode {
+    char *path;
+    const char *name;           /* last path component, inside path */
+    char *data;
+    int32_t len;                /* -1 for a NULL value */
+    struct Stat stat;
+    struct znode *parent;
+    struct znode **kids;
+    int nkids;
+    int kids_cap;
+};
+
+/* connection ids watching a path, for data (and existence) and children */
+struct watchset {
+    int64_t *ids[2];
+    int n[2];
+    int cap[2];
+};
+
+struct session {
+    int64_t id;
+    char passwd[16];
+    int timeout;
+    struct conn *conn;          /* NULL while disconnected */
+    struct timeval expires;     /* when disconnected */
+    struct session *next;
+};
+
+/* the end of a reply held back by the injected latency */
+struct mark {
+    int end;
+    struct timeval due;
+};
+
+struct conn {
+    int fd;
+    int64_t id;
+    int dead;
+    int closing;                /* close once the output is flushed */
+    struct session *sess;       /* NULL until the handshake */
+    char *in;
+    int in_len;
+    int in_cap;
+    char *out;
+    int out_len;
+    int out_cap;
+    int out_sent;
+    int out_ready;              /* output that may be sent now */
+    struct mark *marks;
+    int mark_head;
+    int nmarks;
+    int marks_cap;
+    struct conn *next;
+};
+
+struct event {
+    char *path;
+    int type;
+    int mask;
+};
+
+/* how to take back one change of a transaction */
+struct undo {
+    int op;
+    struct znode *node;
+    struct Stat stat;
+    struct Stat parent_stat;
+    char *data;
+    int32_t len;
+};
+
+enum reply_kind {
+    R_NONE, R_CONNECT, R_CREATE, R_CREATE2, R_STAT, R_DATA, R_CHILDREN,
+    R_CHILDREN2, R_ACL, R_SYNC, R_EVENT, R_MULTI
+};
+
+struct result {
+    int kind;
+    int op;                     /* multi: the operation's type */
+    int err;                    /* multi: the operation's result */
+    char *owned;                /* freed once the reply is written */
+    union {
+        struct ConnectResponse connect;
+        struct Create2Response create;
+        struct Stat stat;
+        struct GetDataResponse data;
+        struct GetChildren2Response children;
+        struct GetACLResponse acl;
+        struct SyncResponse sync;
+        struct WatcherEvent event;
+    } u;
+};
+
+struct zkfake {
+    pthread_mutex_t lock;
+    pthread_t thread;
+    int listen_fd;
+    int port;
+    int wake[2];
+    /* guarded by lock */
+    struct zkfake_options opts;
+    int stop;
+    int drop_all;
+    int expire_all;
+    struct zkfake_stats stats;
+
+    /* owned by the server thread */
+    struct zkfake_options cur;
+    struct zkfake_stats counters;
+    struct timeval now;
+    struct hashtable *nodes;
+    struct hashtable *watches;
+    struct znode *root;
+    struct conn *conns;
+    struct session *sessions;
+    int64_t next_conn_id;
+    int64_t next_session_id;
+    int64_t zxid;
+    int64_t txn_zxid;
+    struct undo *undo;
+    int nundo;
+    int undo_cap;
+    struct event *events;
+    int nevents;
+    int events_cap;
+    struct result *mres;
+    int nmres;
+    int mres_cap;
+    char **names;
+    int names_cap;
+    struct pollfd *pfds;
+    int pfds_cap;
+    struct conn **pconns;
+    int pconns_cap;
+};
+
+static struct ACL open_acl = { 0x1f, { "world", "anyone" } };
+
+static int grow(void *p, int *cap, int need, size_t size)
+{
+    void **ptr = p;
+    int ncap = *cap ? *cap : 8;
+    void *n;
+    if (need <= *cap)
+        return 0;
+    while (ncap < need)
+        ncap *= 2;
+    n = realloc(*ptr, ncap * size);
+    if (n == 0)
+        return -1;
+    *ptr = n;
+    *cap = ncap;
+    return 0;
+}
+
+static unsigned int path_hash(void *str)
+{
+    unsigned int hash = 5381;
+    int c;
+    const char *cstr = (const char *)str;
+    while ((c = *cstr++))
+        hash = ((hash << 5) + hash) + c;
+    return hash;
+}
+
+static int path_equal(void *key1, void *key2)
+{
+    return strcmp((const char *)key1, (const char *)key2) == 0;
+}
+
+static int timeval_before(const struct timeval *a, const struct timeval *b)
+{
+    return a->tv_sec < b->tv_sec ||
+            (a->tv_sec == b->tv_sec && a->tv_usec < b->tv_usec);
+}
+
+static void timeval_add_us(struct timeval *tv, int64_t us)
+{
+    us += tv->tv_usec;
+    tv->tv_sec += us / 1000000;
+    tv->tv_usec = us % 1000000;
+}
+
+static int64_t now_ms(zkfake_t *fz)
+{
+    return (int64_t)fz->now.tv_sec * 1000 + fz->now.tv_usec / 1000;
+}
+
+static double random01(zkfake_t *fz)
+{
+    return rand_r(&fz->cur.seed) / (RAND_MAX + 1.0);
+}
+
+/* the tree */
+
+static struct znode *node_new(const char *path, const char *data, int32_t len)
+{
+    struct znode *n = calloc(1, sizeof(*n));
+    if (n == 0)
+        return 0;
+    n->path = strdup(path);
+    if (len > 0)
+        n->data = malloc(len);
+    if (n->path == 0 || (len > 0 && n->data == 0)) {
+        free(n->path);
+        free(n);
+        return 0;
+    }
+    n->name = strrchr(n->path, '/') + 1;
+    if (len > 0)
+        memcpy(n->data, data, len);
+    n->len = len;
+    return n;
+}
+
+static void node_free(struct znode *n)
+{
+    free(n->path);
+    free(n->data);
+    free(n->kids);
+    free(n);
+}
+
+static void node_free_tree(struct znode *n)
+{
+    int i;
+    for (i = 0; i < n->nkids; i++)
+        node_free_tree(n->kids[i]);
+    node_free(n);
+}
+
+static struct znode *node_find(zkfake_t *fz, const char *path)
+{
+    return hashtable_search(fz->nodes, (void *)path);
+}
+
+/* the parent of a path that hasn't necessarily been created */
+static struct znode *parent_of(zkfake_t *fz, char *path)
+{
+    char *slash = strrchr(path, '/');
+    struct znode *p;
+    if (slash == 0)
+        return 0;
+    if (slash == path)
+        return fz->root;
+    *slash = '\0';
+    p = node_find(fz, path);
+    *slash = '/';
+    return p;
+}
+
+static int node_link(zkfake_t *fz, struct znode *parent, struct znode *n)
+{
+    char *key = strdup(n->path);
+    if (key == 0 || grow(&parent->kids, &parent->kids_cap, parent->nkids + 1,
+            sizeof(*parent->kids)) < 0 ||
+            !hashtable_insert(fz->nodes, key, n)) {
+        free(key);
+        return -1;
+    }
+    parent->kids[parent->nkids++] = n;
+    n->parent = parent;
+    return 0;
+}
+
+static void node_unlink(zkfake_t *fz, struct znode *n)
+{
+    struct znode *p = n->parent;
+    int i;
+    for (i = 0; i < p->nkids; i++) {
+        if (p->kids[i] == n) {
+            p->kids[i] = p->kids[--p->nkids];
+            break;
+        }
+    }
+    hashtable_remove(fz->nodes, n->path);
+}
+
+/* transactions: every write logs how to undo it and the events it causes;
+ * the events go out on commit, and an abort rolls the tree back */
+
+static void txn_begin(zkfake_t *fz)
+{
+    fz->nundo = 0;
+    fz->nevents = 0;
+    fz->txn_zxid = fz->zxid;
+}
+
+static int txn_log(zkfake_t *fz, int op, struct znode *n)
+{
+    struct undo *u;
+    if (grow(&fz->undo, &fz->undo_cap, fz->nundo + 1, sizeof(*fz->undo)) < 0)
+        return -1;
+    u = &fz->undo[fz->nundo++];
+    u->op = op;
+    u->node = n;
+    u->stat = n->stat;
+    u->parent_stat = n->parent ? n->parent->stat : n->stat;
+    u->data = n->data;
+    u->len = n->len;
+    return 0;
+}
+
+static void queue_event(zkfake_t *fz, const char *path, int type, int mask)
+{
+    struct event *e;
+    char *p = strdup(path);
+    if (p == 0 || grow(&fz->events, &fz->events_cap, fz->nevents + 1,
+            sizeof(*fz->events)) < 0) {
+        free(p);
+        return;
+    }
+    e = &fz->events[fz->nevents++];
+    e->path = p;
+    e->type = type;
+    e->mask = mask;
+}
+
+static struct conn *conn_find(zkfake_t *fz, int64_t id)
+{
+    struct conn *c;
+    for (c = fz->conns; c; c = c->next)
+        if (c->id == id)
+            return c->dead ? 0 : c;
+    return 0;
+}
+
+static void send_event(zkfake_t *fz, struct conn *c, int type,
+        const char *path);
+
+static int watching(struct watchset *ws, int which, int64_t id)
+{
+    int i;
+    for (i = 0; i < ws->n[which]; i++)
+        if (ws->ids[which][i] == id)
+            return 1;
+    return 0;
+}
+
+static void fire_events(zkfake_t *fz)
+{
+    int i, w, k;
+    for (i = 0; i < fz->nevents; i++) {
+        struct event *e = &fz->events[i];
+        struct watchset *ws = hashtable_search(fz->watches, e->path);
+        if (ws) {
+            for (w = 0; w < 2; w++) {
+                if (!(e->mask & (1 << w)))
+                    continue;
+                for (k = 0; k < ws->n[w]; k++) {
+                    int64_t id = ws->ids[w][k];
+                    struct conn *c;
+                    /* a connection watching both gets one event */
+                    if (w == WATCH_CHILD && (e->mask & MASK_DATA) &&
+                            watching(ws, WATCH_DATA, id))
+                        continue;
+                    if ((c = conn_find(fz, id)) != 0)
+                        send_event(fz, c, e->type, e->path);
+                }
+            }
+            for (w = 0; w < 2; w++)
+                if (e->mask & (1 << w))
+                    ws->n[w] = 0;
+            if (ws->n[WATCH_DATA] == 0 && ws->n[WATCH_CHILD] == 0) {
+                hashtable_remove(fz->watches, e->path);
+                free(ws->ids[WATCH_DATA]);
+                free(ws->ids[WATCH_CHILD]);
+                free(ws);
+            }
+        }
+        free(e->path);
+    }
+    fz->nevents = 0;
+}
+
+static void txn_commit(zkfake_t *fz)
+{
+    int i;
+    for (i = 0; i < fz->nundo; i++) {
+        struct undo *u = &fz->undo[i];
+        if (u->op == ZOO_DELETE_OP)
+            node_free(u->node);
+        else if (u->op == ZOO_SETDATA_OP)
+            free(u->data);
+    }
+    fz->nundo = 0;
+    fire_events(fz);
+}
+
+static void txn_abort(zkfake_t *fz)
+{
+    int i;
+    for (i = fz->nundo - 1; i >= 0; i--) {
+        struct undo *u = &fz->undo[i];
+        struct znode *n = u->node;
+        switch (u->op) {
+        case ZOO_CREATE_OP:
+            node_unlink(fz, n);
+            n->parent->stat = u->parent_stat;
+            node_free(n);
+            break;
+        case ZOO_DELETE_OP:
+            node_link(fz, n->parent, n);
+            n->parent->stat = u->parent_stat;
+            break;
+        case ZOO_SETDATA_OP:
+            free(n->data);
+            n->data = u->data;
+            n->len = u->len;
+            n->stat = u->stat;
+            break;
+        }
+    }
+    fz->nundo = 0;
+    for (i = 0; i < fz->nevents; i++)
+        free(fz->events[i].path);
+    fz->nevents = 0;
+    fz->zxid = fz->txn_zxid;
+}
+
+/* the operations; each returns a ZooKeeper error code */
+
+static int check_version(struct znode *n, int version)
+{
+    return version == -1 || version == n->stat.version ? ZOK : ZBADVERSION;
+}
+
+static int op_create(zkfake_t *fz, int64_t owner, char *path,
+        struct buffer *data, int flags, struct znode **out)
+{
+    struct znode *parent, *n;
+    char *full = path;
+    if (path[0] != '/' || path[1] == '\0')
+        return ZBADARGUMENTS;
+    if ((parent = parent_of(fz, path)) == 0)
+        return ZNONODE;
+    if (parent->stat.ephemeralOwner)
+        return ZNOCHILDRENFOREPHEMERALS;
+    if (flags & ZOO_SEQUENCE) {
+        size_t len = strlen(path);
+        if ((full = malloc(len + 11)) == 0)
+            return ZSYSTEMERROR;
+        sprintf(full, "%s%010d", path, parent->stat.cversion);
+    }
+    if (node_find(fz, full)) {
+        if (full != path)
+            free(full);
+        return ZNODEEXISTS;
+    }
+    n = node_new(full, data->buff, data->len);
+    if (full != path)
+        free(full);
+    if (n == 0)
+        return ZSYSTEMERROR;
+    fz->zxid++;
+    n->stat.czxid = n->stat.mzxid = n->stat.pzxid = fz->zxid;
+    n->stat.ctime = n->stat.mtime = now_ms(fz);
+    n->stat.ephemeralOwner = (flags & ZOO_EPHEMERAL) ? owner : 0;
+    n->stat.dataLength = data->len > 0 ? data->len : 0;
+    if (node_link(fz, parent, n) < 0) {
+        node_free(n);
+        return ZSYSTEMERROR;
+    }
+    if (txn_log(fz, ZOO_CREATE_OP, n) < 0) {
+        node_unlink(fz, n);
+        node_free(n);
+        return ZSYSTEMERROR;
+    }
+    parent->stat.cversion++;
+    parent->stat.numChildren++;
+    parent->stat.pzxid = fz->zxid;
+    queue_event(fz, n->path, CREATED_EVENT_DEF, MASK_DATA);
+    queue_event(fz, parent->path, CHILD_EVENT_DEF, MASK_CHILD);
+    *out = n;
+    return ZOK;
+}
+
+static int op_delete(zkfake_t *fz, const char *path, int version)
+{
+    struct znode *n = node_find(fz, path);
+    struct znode *parent;
+    if (n == 0)
+        return ZNONODE;
+    if (n == fz->root)
+        return ZBADARGUMENTS;
+    if (check_version(n, version) != ZOK)
+        return ZBADVERSION;
+    if (n->nkids)
+        return ZNOTEMPTY;
+    if (txn_log(fz, ZOO_DELETE_OP, n) < 0)
+        return ZSYSTEMERROR;
+    parent = n->parent;
+    fz->zxid++;
+    node_unlink(fz, n);
+    parent->stat.cversion++;
+    parent->stat.numChildren--;
+    parent->stat.pzxid = fz->zxid;
+    queue_event(fz, path, DELETED_EVENT_DEF, MASK_DATA | MASK_CHILD);
+    queue_event(fz, parent->path, CHILD_EVENT_DEF, MASK_CHILD);
+    return ZOK;
+}
+
+static int op_set(zkfake_t *fz, const char *path, struct buffer *data,
+        int version, struct znode **out)
+{
+    struct znode *n = node_find(fz, path);
+    char *copy = 0;
+    if (n == 0)
+        return ZNONODE;
+    if (check_version(n, version) != ZOK)
+        return ZBADVERSION;
+    if (data->len > 0 && (copy = malloc(data->len)) == 0)
+        return ZSYSTEMERROR;
+    if (txn_log(fz, ZOO_SETDATA_OP, n) < 0) {
+        free(copy);
+        return ZSYSTEMERROR;
+    }
+    if (data->len > 0)
+        memcpy(copy, data->buff, data->len);
+    fz->zxid++;
+    n->data = copy;
+    n->len = data->len;
+    n->stat.version++;
+    n->stat.mzxid = fz->zxid;
+    n->stat.mtime = now_ms(fz);
+    n->stat.dataLength = data->len > 0 ? data->len : 0;
+    queue_event(fz, path, CHANGED_EVENT_DEF, MASK_DATA);
+    *out = n;
+    return ZOK;
+}
+
+static int op_check(zkfake_t *fz, const char *path, int version)
+{
+    struct znode *n = node_find(fz, path);
+    if (n == 0)
+        return ZNONODE;
+    return check_version(n, version);
+}
+
+static void watch_add(zkfake_t *fz, const char *path, int which,
+        struct conn *c)
+{
+    struct watchset *ws = hashtable_search(fz->watches, (void *)path);
+    if (ws == 0) {
+        char *key = strdup(path);
+        ws = calloc(1, sizeof(*ws));
+        if (key == 0 || ws == 0 || !hashtable_insert(fz->watches, key, ws)) {
+            free(key);
+            free(ws);
+            return;
+        }
+    }
+    if (watching(ws, which, c->id))
+        return;
+    if (grow(&ws->ids[which], &ws->cap[which], ws->n[which] + 1,
+            sizeof(int64_t)) == 0)
+        ws->ids[which][ws->n[which]++] = c->id;
+}
+
+/* sessions */
+
+static struct session *session_find(zkfake_t *fz, int64_t id)
+{
+    struct session *s;
+    for (s = fz->sessions; s; s = s->next)
+        if (s->id == id)
+            return s;
+    return 0;
+}
+
+static void conn_close(zkfake_t *fz, struct conn *c);
+
+static void session_end(zkfake_t *fz, struct session *s)
+{
+    struct session **pp;
+    struct hashtable_itr *it;
+    char **paths = 0;
+    int n = 0, cap = 0, i;
+
+    if (hashtable_count(fz->nodes) > 0 &&
+            (it = hashtable_iterator(fz->nodes)) != 0) {
+        do {
+            struct znode *z = hashtable_iterator_value(it);
+            if (z->stat.ephemeralOwner == s->id &&
+                    grow(&paths, &cap, n + 1, sizeof(*paths)) == 0)
+                paths[n++] = strdup(z->path);
+        } while (hashtable_iterator_advance(it));
+        free(it);
+    }
+    for (i = 0; i < n; i++) {
+        if (paths[i] == 0)
+            continue;
+        txn_begin(fz);
+        if (op_delete(fz, paths[i], -1) == ZOK)
+            txn_commit(fz);
+        else
+            txn_abort(fz);
+        free(paths[i]);
+    }
+    free(paths);
+
+    if (s->conn) {
+        s->conn->sess = 0;
+        conn_close(fz, s->conn);
+    }
+    for (pp = &fz->sessions; *pp; pp = &(*pp)->next) {
+        if (*pp == s) {
+            *pp = s->next;
+            break;
+        }
+    }
+    free(s);
+}
+
+/* connections and replies */
+
+static void conn_close(zkfake_t *fz, struct conn *c)
+{
+    if (c->dead)
+        return;
+    c->dead = 1;
+    close(c->fd);
+    if (c->sess && c->sess->conn == c) {
+        c->sess->conn = 0;
+        c->sess->expires = fz->now;
+        timeval_add_us(&c->sess->expires, (int64_t)c->sess->timeout * 1000);
+    }
+}
+
+static void conn_free(struct conn *c)
+{
+    free(c->in);
+    free(c->out);
+    free(c->marks);
+    free(c);
+}
+
+static int serialize_body(struct oarchive *oa, struct result *r);
+
+static int serialize_multi(struct oarchive *oa, zkfake_t *fz)
+{
+    struct MultiHeader mh;
+    int i, rc = 0, failed = 0;
+    for (i = 0; i < fz->nmres; i++)
+        if (fz->mres[i].err != ZOK)
+            failed = 1;
+    for (i = 0; rc >= 0 && i < fz->nmres; i++) {
+        struct result *r = &fz->mres[i];
+        if (failed) {
+            struct ErrorResponse er = { r->err };
+            mh.type = -1;
+            mh.done = 0;
+            mh.err = r->err;
+            rc = serialize_MultiHeader(oa, "multiheader", &mh);
+            rc = rc < 0 ? rc : serialize_ErrorResponse(oa, "error", &er);
+        } else {
+            mh.type = r->op;
+            mh.done = 0;
+            mh.err = 0;
+            rc = serialize_MultiHeader(oa, "multiheader", &mh);
+            rc = rc < 0 ? rc : serialize_body(oa, r);
+        }
+    }
+    mh.type = -1;
+    mh.done = 1;
+    mh.err = -1;
+    return rc < 0 ? rc : serialize_MultiHeader(oa, "multiheader", &mh);
+}
+
+static int serialize_body(struct oarchive *oa, struct result *r)
+{
+    struct GetChildrenResponse children;
+    switch (r->kind) {
+    case R_CONNECT:
+        return serialize_ConnectResponse(oa, "connect", &r->u.connect);
+    case R_CREATE:
+        return oa->serialize_String(oa, "path", &r->u.create.path);
+    case R_CREATE2:
+        return serialize_Create2Response(oa, "reply", &r->u.create);
+    case R_STAT:
+        return serialize_Stat(oa, "stat", &r->u.stat);
+    case R_DATA:
+        return serialize_GetDataResponse(oa, "reply", &r->u.data);
+    case R_CHILDREN:
+        children.children = r->u.children.children;
+        return serialize_GetChildrenResponse(oa, "reply", &children);
+    case R_CHILDREN2:
+        return serialize_GetChildren2Response(oa, "reply", &r->u.children);
+    case R_ACL:
+        return serialize_GetACLResponse(oa, "reply", &r->u.acl);
+    case R_SYNC:
+        return serialize_SyncResponse(oa, "reply", &r->u.sync);
+    case R_EVENT:
+        return serialize_WatcherEvent(oa, "event", &r->u.event);
+    }
+    return 0;
+}
+
+static int serialize_reply(struct oarchive *oa, zkfake_t *fz,
+        struct ReplyHeader *h, struct result *r)
+{
+    int rc = h ? serialize_ReplyHeader(oa, "header", h) : 0;
+    if (rc < 0 || r == 0)
+        return rc;
+    return r->kind == R_MULTI ? serialize_multi(oa, fz) : serialize_body(oa, r);
+}
+
+/* holds the reply just written back until its injected delay has passed */
+static void conn_mark(zkfake_t *fz, struct conn *c)
+{
+    struct mark *m;
+    int64_t delay = fz->cur.latency_us;
+    if (delay <= 0 && fz->cur.jitter_us <= 0 && c->nmarks == c->mark_head) {
+        c->out_ready = c->out_len;
+        return;
+    }
+    if (grow(&c->marks, &c->marks_cap, c->nmarks + 1, sizeof(*c->marks)) < 0) {
+        c->out_ready = c->out_len;
+        return;
+    }
+    if (fz->cur.jitter_us > 0)
+        delay += (int64_t)(random01(fz) * fz->cur.jitter_us);
+    m = &c->marks[c->nmarks++];
+    m->end = c->out_len;
+    m->due = fz->now;
+    timeval_add_us(&m->due, delay);
+    /* replies leave in order, whatever their jitter */
+    if (c->nmarks - 1 > c->mark_head &&
+            timeval_before(&m->due, &c->marks[c->nmarks - 2].due))
+        m->due = c->marks[c->nmarks - 2].due;
+}
+
+/* serializes a framed reply straight into the connection's output */
+static void conn_send(zkfake_t *fz, struct conn *c, struct ReplyHeader *h,
+        struct result *r)
+{
+    struct fixed_oarchive oa;
+    int32_t len, nlen;
+
+    if (c->dead)
+        return;
+    init_fixed_oarchive(&oa, 0, 0);
+    if (serialize_reply(&oa.oa, fz, h, r) < 0)
+        return;
+    len = oa.off;
+    if (grow(&c->out, &c->out_cap, c->out_len + 4 + len, 1) < 0) {
+        conn_close(fz, c);
+        return;
+    }
+    nlen = htonl(len);
+    memcpy(c->out + c->out_len, &nlen, 4);
+    init_fixed_oarchive(&oa, c->out + c->out_len + 4, len);
+    serialize_reply(&oa.oa, fz, h, r);
+    c->out_len += 4 + len;
+    conn_mark(fz, c);
+}
+
+static void send_event(zkfake_t *fz, struct conn *c, int type,
+        const char *path)
+{
+    struct ReplyHeader h = { WATCHER_EVENT_XID, -1, 0 };
+    struct result r;
+    r.kind = R_EVENT;
+    r.u.event.type = type;
+    r.u.event.state = CONNECTED_STATE_DEF;
+    r.u.event.path = (char *)path;
+    conn_send(fz, c, &h, &r);
+    fz->counters.events++;
+}
+
+static void release_marks(zkfake_t *fz, struct conn *c)
+{
+    while (c->mark_head < c->nmarks &&
+            !timeval_before(&fz->now, &c->marks[c->mark_head].due)) {
+        c->out_ready = c->marks[c->mark_head].end;
+        c->mark_head++;
+    }
+    if (c->mark_head == c->nmarks)
+        c->mark_head = c->nmarks = 0;
+}
+
+static void conn_flush(zkfake_t *fz, struct conn *c)
+{
+    int i;
+    while (!c->dead && c->out_sent < c->out_ready) {
+        ssize_t rc = send(c->fd, c->out + c->out_sent,
+                c->out_ready - c->out_sent, MSG_NOSIGNAL);
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                conn_close(fz, c);
+            break;
+        }
+        c->out_sent += rc;
+    }
+    if (c->out_sent == c->out_len) {
+        c->out_sent = c->out_len = c->out_ready = 0;
+    } else if (c->out_sent > c->out_cap / 2) {
+        memmove(c->out, c->out + c->out_sent, c->out_len - c->out_sent);
+        c->out_len -= c->out_sent;
+        c->out_ready -= c->out_sent;
+        for (i = c->mark_head; i < c->nmarks; i++)
+            c->marks[i].end -= c->out_sent;
+        c->out_sent = 0;
+    }
+    if (c->closing && c->out_len == 0)
+        conn_close(fz, c);
+}
+
+/* request handlers */
+
+static void handle_connect(zkfake_t *fz, struct conn *c, char *buf, int len)
+{
+    static char no_passwd[16];
+    struct iarchive *ia = create_buffer_iarchive(buf, len);
+    struct ConnectRequest req;
+    struct session *s = 0;
+    struct result r;
+    int rc;
+
+    if (ia == 0) {
+        conn_close(fz, c);
+        return;
+    }
+    memset(&req, 0, sizeof(req));
+    rc = deserialize_ConnectRequest(ia, "connect", &req);
+    close_buffer_iarchive(&ia);
+    if (rc < 0) {
+        deallocate_ConnectRequest(&req);
+        conn_close(fz, c);
+        return;
+    }
+    if (req.sessionId) {
+        s = session_find(fz, req.sessionId);
+        if (s && (req.passwd.len != sizeof(s->passwd) ||
+                memcmp(req.passwd.buff, s->passwd, sizeof(s->passwd))))
+            s = 0;
+    } else if ((s = calloc(1, sizeof(*s))) != 0) {
+        int i;
+        s->id = fz->next_session_id++;
+        for (i = 0; i < (int)sizeof(s->passwd); i++)
+            s->passwd[i] = rand_r(&fz->cur.seed);
+        s->timeout = req.timeOut;
+        if (fz->cur.session_timeout > 0 &&
+                s->timeout > fz->cur.session_timeout)
+            s->timeout = fz->cur.session_timeout;
+        s->next = fz->sessions;
+        fz->sessions = s;
+    }
+    deallocate_ConnectRequest(&req);
+
+    memset(&r, 0, sizeof(r));
+    r.kind = R_CONNECT;
+    r.u.connect.passwd.len = sizeof(no_passwd);
+    r.u.connect.passwd.buff = no_passwd;
+    if (s) {
+        if (s->conn && s->conn != c) {
+            s->conn->sess = 0;
+            conn_close(fz, s->conn);
+        }
+        s->conn = c;
+        c->sess = s;
+        r.u.connect.timeOut = s->timeout;
+        r.u.connect.sessionId = s->id;
+        r.u.connect.passwd.buff = s->passwd;
+    } else {
+        /* an unknown or expired session: the client sees a zero timeout */
+        c->closing = 1;
+    }
+    conn_send(fz, c, 0, &r);
+}
+
+static struct result *multi_result(zkfake_t *fz, int op)
+{
+    struct result *r;
+    if (grow(&fz->mres, &fz->mres_cap, fz->nmres + 1, sizeof(*fz->mres)) < 0)
+        return 0;
+    r = &fz->mres[fz->nmres++];
+    memset(r, 0, sizeof(*r));
+    r->op = op;
+    return r;
+}
+
+/* applies the operations of a multi in one transaction; returns the first
+ * error, with the result of each operation in fz->mres */
+static int handle_multi(zkfake_t *fz, struct conn *c, struct iarchive *ia)
+{
+    struct MultiHeader mh;
+    struct znode *n;
+    int err = ZOK, i, failed_at = -1;
+
+    fz->nmres = 0;
+    for (;;) {
+        struct result *r;
+        int rc = deserialize_MultiHeader(ia, "multiheader", &mh);
+        if (rc < 0 || mh.done)
+            break;
+        if ((r = multi_result(fz, mh.type)) == 0)
+            return ZSYSTEMERROR;
+        switch (mh.type) {
+        case ZOO_CREATE_OP: {
+            struct CreateRequest req;
+            memset(&req, 0, sizeof(req));
+            if (deserialize_CreateRequest(ia, "req", &req) < 0)
+                r->err = ZMARSHALLINGERROR;
+            else if (err == ZOK)
+                r->err = op_create(fz, c->sess->id, req.path, &req.data,
+                        req.flags, &n);
+            if (err == ZOK && r->err == ZOK) {
+                r->kind = R_CREATE;
+                r->owned = r->u.create.path = strdup(n->path);
+            }
+            deallocate_CreateRequest(&req);
+            break;
+        }
+        case ZOO_DELETE_OP: {
+            struct DeleteRequest req;
+            memset(&req, 0, sizeof(req));
+            if (deserialize_DeleteRequest(ia, "req", &req) < 0)
+                r->err = ZMARSHALLINGERROR;
+            else if (err == ZOK)
+                r->err = op_delete(fz, req.path, req.version);
+            deallocate_DeleteRequest(&req);
+            break;
+        }
+        case ZOO_SETDATA_OP: {
+            struct SetDataRequest req;
+            memset(&req, 0, sizeof(req));
+            if (deserialize_SetDataRequest(ia, "req", &req) < 0)
+                r->err = ZMARSHALLINGERROR;
+            else if (err == ZOK)
+                r->err = op_set(fz, req.path, &req.data, req.version, &n);
+            if (err == ZOK && r->err == ZOK) {
+                r->kind = R_STAT;
+                r->u.stat = n->stat;
+            }
+            deallocate_SetDataRequest(&req);
+            break;
+        }
+        case ZOO_CHECK_OP: {
+            struct CheckVersionRequest req;
+            memset(&req, 0, sizeof(req));
+            if (deserialize_CheckVersionRequest(ia, "req", &req) < 0)
+                r->err = ZMARSHALLINGERROR;
+            else if (err == ZOK)
+                r->err = op_check(fz, req.path, req.version);
+            deallocate_CheckVersionRequest(&req);
+            break;
+        }
+        default:
+            r->err = ZUNIMPLEMENTED;
+            break;
+        }
+        if (err == ZOK && r->err != ZOK) {
+            err = r->err;
+            failed_at = fz->nmres - 1;
+        }
+    }
+    /* a failed multi answers every operation with an error result, which
+     * serialize_multi recognizes by the failed one */
+    for (i = 0; failed_at >= 0 && i < fz->nmres; i++) {
+        struct result *r = &fz->mres[i];
+        r->err = i < failed_at ? ZOK :
+                i > failed_at ? ZRUNTIMEINCONSISTENCY : err;
+    }
+    return err;
+}
+
+static void handle_set_watches(zkfake_t *fz, struct conn *c,
+        struct iarchive *ia)
+{
+    struct SetWatches req;
+    int i;
+    memset(&req, 0, sizeof(req));
+    if (deserialize_SetWatches(ia, "req", &req) < 0) {
+        deallocate_SetWatches(&req);
+        return;
+    }
+    /* fire at once what changed while the client was away */
+    for (i = 0; i < req.dataWatches.count; i++) {
+        char *p = req.dataWatches.data[i];
+        struct znode *n = node_find(fz, p);
+        if (n == 0)
+            send_event(fz, c, DELETED_EVENT_DEF, p);
+        else if (n->stat.mzxid > req.relativeZxid)
+            send_event(fz, c, CHANGED_EVENT_DEF, p);
+        else
+            watch_add(fz, p, WATCH_DATA, c);
+    }
+    for (i = 0; i < req.existWatches.count; i++) {
+        char *p = req.existWatches.data[i];
+        if (node_find(fz, p))
+            send_event(fz, c, CREATED_EVENT_DEF, p);
+        else
+            watch_add(fz, p, WATCH_DATA, c);
+    }
+    for (i = 0; i < req.childWatches.count; i++) {
+        char *p = req.childWatches.data[i];
+        struct znode *n = node_find(fz, p);
+        if (n == 0)
+            send_event(fz, c, DELETED_EVENT_DEF, p);
+        else if (n->stat.pzxid > req.relativeZxid)
+            send_event(fz, c, CHILD_EVENT_DEF, p);
+        else
+            watch_add(fz, p, WATCH_CHILD, c);
+    }
+    deallocate_SetWatches(&req);
+}
+
+static int children_result(zkfake_t *fz, struct znode *n, struct result *r)
+{
+    int i;
+    if (grow(&fz->names, &fz->names_cap, n->nkids, sizeof(*fz->names)) < 0)
+        return ZSYSTEMERROR;
+    for (i = 0; i < n->nkids; i++)
+        fz->names[i] = (char *)n->kids[i]->name;
+    r->u.children.children.count = n->nkids;
+    r->u.children.children.data = fz->names;
+    r->u.children.stat = n->stat;
+    return ZOK;
+}
+
+static int inject_fault(zkfake_t *fz, struct conn *c)
+{
+    if (fz->cur.loss > 0 && random01(fz) < fz->cur.loss) {
+        fz->counters.lost++;
+        return 1;
+    }
+    if (fz->cur.disconnect > 0 && random01(fz) < fz->cur.disconnect) {
+        fz->counters.disconnects++;
+        conn_close(fz, c);
+        return 1;
+    }
+    return 0;
+}
+
+static void handle_request(zkfake_t *fz, struct conn *c, char *buf, int len)
+{
+    struct iarchive *ia = create_buffer_iarchive(buf, len);
+    struct RequestHeader h;
+    struct ReplyHeader rh;
+    struct result r;
+    struct znode *n = 0;
+    int err = ZOK;
+
+    if (ia == 0 || deserialize_RequestHeader(ia, "header", &h) < 0) {
+        if (ia)
+            close_buffer_iarchive(&ia);
+        conn_close(fz, c);
+        return;
+    }
+    fz->counters.requests++;
+    if (h.type != ZOO_CLOSE_OP && inject_fault(fz, c)) {
+        close_buffer_iarchive(&ia);
+        return;
+    }
+    memset(&r, 0, sizeof(r));
+    txn_begin(fz);
+    switch (h.type) {
+    case ZOO_PING_OP:
+    case ZOO_SETAUTH_OP:
+        break;
+    case ZOO_CREATE_OP:
+    case ZOO_CREATE2_OP: {
+        /* a Create2Request has the same layout */
+        struct CreateRequest req;
+        memset(&req, 0, sizeof(req));
+        if (deserialize_CreateRequest(ia, "req", &req) < 0) {
+            err = ZMARSHALLINGERROR;
+        } else if ((err = op_create(fz, c->sess->id, req.path, &req.data,
+                req.flags, &n)) == ZOK) {
+            r.kind = h.type == ZOO_CREATE_OP ? R_CREATE : R_CREATE2;
+            r.owned = r.u.create.path = strdup(n->path);
+            r.u.create.stat = n->stat;
+        }
+        deallocate_CreateRequest(&req);
+        break;
+    }
+    case ZOO_DELETE_OP: {
+        struct DeleteRequest req;
+        memset(&req, 0, sizeof(req));
+        err = deserialize_DeleteRequest(ia, "req", &req) < 0 ?
+                ZMARSHALLINGERROR : op_delete(fz, req.path, req.version);
+        deallocate_DeleteRequest(&req);
+        break;
+    }
+    case ZOO_SETDATA_OP: {
+        struct SetDataRequest req;
+        memset(&req, 0, sizeof(req));
+        if (deserialize_SetDataRequest(ia, "req", &req) < 0) {
+            err = ZMARSHALLINGERROR;
+        } else if ((err = op_set(fz, req.path, &req.data, req.version,
+                &n)) == ZOK) {
+            r.kind = R_STAT;
+            r.u.stat = n->stat;
+        }
+        deallocate_SetDataRequest(&req);
+        break;
+    }
+    case ZOO_EXISTS_OP: {
+        struct ExistsRequest req;
+        memset(&req, 0, sizeof(req));
+        if (deserialize_ExistsRequest(ia, "req", &req) < 0) {
+            err = ZMARSHALLINGERROR;
+        } else {
+            n = node_find(fz, req.path);
+            if (req.watch)
+                watch_add(fz, req.path, WATCH_DATA, c);
+            if (n == 0) {
+                err = ZNONODE;
+            } else {
+                r.kind = R_STAT;
+                r.u.stat = n->stat;
+            }
+        }
+        deallocate_ExistsRequest(&req);
+        break;
+    }
+    case ZOO_GETDATA_OP: {
+        struct GetDataRequest req;
+        memset(&req, 0, sizeof(req));
+        if (deserialize_GetDataRequest(ia, "req", &req) < 0) {
+            err = ZMARSHALLINGERROR;
+        } else if ((n = node_find(fz, req.path)) == 0) {
+            err = ZNONODE;
+        } else {
+            if (req.watch)
+                watch_add(fz, req.path, WATCH_DATA, c);
+            r.kind = R_DATA;
+            r.u.data.data.buff = n->data;
+            r.u.data.data.len = n->len;
+            r.u.data.stat = n->stat;
+        }
+        deallocate_GetDataRequest(&req);
+        break;
+    }
+    case ZOO_GETCHILDREN_OP:
+    case ZOO_GETCHILDREN2_OP: {
+        /* a GetChildren2Request has the same layout */
+        struct GetChildrenRequest req;
+        memset(&req, 0, sizeof(req));
+        if (deserialize_GetChildrenRequest(ia, "req", &req) < 0) {
+            err = ZMARSHALLINGERROR;
+        } else if ((n = node_find(fz, req.path)) == 0) {
+            err = ZNONODE;
+        } else {
+            if (req.watch)
+                watch_add(fz, req.path, WATCH_CHILD, c);
+            r.kind = h.type == ZOO_GETCHILDREN_OP ? R_CHILDREN : R_CHILDREN2;
+            err = children_result(fz, n, &r);
+        }
+        deallocate_GetChildrenRequest(&req);
+        break;
+    }
+    case ZOO_GETACL_OP:
+    case ZOO_SETACL_OP: {
+        /* ACLs are accepted and ignored: every node is open to everyone */
+        struct GetACLRequest req;
+        memset(&req, 0, sizeof(req));
+        if (deserialize_GetACLRequest(ia, "req", &req) < 0) {
+            err = ZMARSHALLINGERROR;
+        } else if ((n = node_find(fz, req.path)) == 0) {
+            err = ZNONODE;
+        } else if (h.type == ZOO_SETACL_OP) {
+            r.kind = R_STAT;
+            r.u.stat = n->stat;
+        } else {
+            r.kind = R_ACL;
+            r.u.acl.acl.count = 1;
+            r.u.acl.acl.data = &open_acl;
+            r.u.acl.stat = n->stat;
+        }
+        deallocate_GetACLRequest(&req);
+        break;
+    }
+    case ZOO_SYNC_OP: {
+        struct SyncRequest req;
+        memset(&req, 0, sizeof(req));
+        if (deserialize_SyncRequest(ia, "req", &req) < 0) {
+            err = ZMARSHALLINGERROR;
+        } else {
+            r.kind = R_SYNC;
+            r.owned = r.u.sync.path = req.path;
+            req.path = 0;
+        }
+        deallocate_SyncRequest(&req);
+        break;
+    }
+    case ZOO_MULTI_OP:
+        err = handle_multi(fz, c, ia);
+        r.kind = R_MULTI;
+        break;
+    case ZOO_SETWATCHES_OP:
+        handle_set_watches(fz, c, ia);
+        break;
+    case ZOO_CLOSE_OP: {
+        /* keep the connection open for the reply */
+        struct session *s = c->sess;
+        s->conn = 0;
+        c->sess = 0;
+        session_end(fz, s);
+        c->closing = 1;
+        break;
+    }
+    default:
+        err = ZUNIMPLEMENTED;
+        break;
+    }
+    close_buffer_iarchive(&ia);
+
+    if (err == ZOK)
+        txn_commit(fz);
+    else
+        txn_abort(fz);
+    rh.xid = h.xid;
+    rh.zxid = fz->zxid;
+    /* a multi reports its errors per operation */
+    rh.err = h.type == ZOO_MULTI_OP ? ZOK : err;
+    conn_send(fz, c, &rh, rh.err == ZOK ? &r : 0);
+    fz->counters.replies++;
+    free(r.owned);
+    if (h.type == ZOO_MULTI_OP) {
+        int i;
+        for (i = 0; i < fz->nmres; i++)
+            free(fz->mres[i].owned);
+        fz->nmres = 0;
+    }
+}
+
+static void conn_read(zkfake_t *fz, struct conn *c)
+{
+    int off = 0;
+    for (;;) {
+        ssize_t rc;
+        int room;
+        if (grow(&c->in, &c->in_cap, c->in_len + IO_CHUNK, 1) < 0) {
+            conn_close(fz, c);
+            return;
+        }
+        room = c->in_cap - c->in_len;
+        rc = recv(c->fd, c->in + c->in_len, room, 0);
+        if (rc > 0) {
+            c->in_len += rc;
+            /* a short read has drained the socket */
+            if (rc < room)
+                break;
+            continue;
+        }
+        if (rc == 0) {
+            conn_close(fz, c);
+            return;
+        }
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            conn_close(fz, c);
+            return;
+        }
+        break;
+    }
+    while (!c->dead && !c->closing && c->in_len - off >= 4) {
+        int32_t len;
+        memcpy(&len, c->in + off, 4);
+        len = ntohl(len);
+        if (len < 0 || len > MAX_FRAME) {
+            conn_close(fz, c);
+            return;
+        }
+        if (c->in_len - off - 4 < len)
+            break;
+        if (c->sess)
+            handle_request(fz, c, c->in + off + 4, len);
+        else
+            handle_connect(fz, c, c->in + off + 4, len);
+        off += 4 + len;
+    }
+    if (c->dead)
+        return;
+    memmove(c->in, c->in + off, c->in_len - off);
+    c->in_len -= off;
+}
+
+static void accept_conns(zkfake_t *fz)
+{
+    for (;;) {
+        int one = 1;
+        struct conn *c;
+        int fd = accept(fz->listen_fd, 0, 0);
+        if (fd < 0)
+            return;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if ((c = calloc(1, sizeof(*c))) == 0) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->id = fz->next_conn_id++;
+        c->next = fz->conns;
+        fz->conns = c;
+        fz->counters.connections++;
+    }
+}
+
+static void reap_conns(zkfake_t *fz)
+{
+    struct conn **pp = &fz->conns;
+    while (*pp) {
+        struct conn *c = *pp;
+        if (c->dead) {
+            *pp = c->next;
+            conn_free(c);
+        } else {
+            pp = &c->next;
+        }
+    }
+}
+
+/* the time until the next held reply or session expiry, -1 for none */
+static int next_timeout(zkfake_t *fz)
+{
+    struct timeval next = { 0, 0 };
+    struct session *s;
+    struct conn *c;
+    int have = 0;
+    int64_t ms;
+
+    for (c = fz->conns; c; c = c->next) {
+        if (c->mark_head < c->nmarks && (!have ||
+                timeval_before(&c->marks[c->mark_head].due, &next))) {
+            next = c->marks[c->mark_head].due;
+            have = 1;
+        }
+    }
+    for (s = fz->sessions; s; s = s->next) {
+        if (s->conn == 0 && (!have || timeval_before(&s->expires, &next))) {
+            next = s->expires;
+            have = 1;
+        }
+    }
+    if (!have)
+        return -1;
+    ms = ((int64_t)next.tv_sec - fz->now.tv_sec) * 1000 +
+            (next.tv_usec - fz->now.tv_usec + 999) / 1000;
+    return ms < 0 ? 0 : ms > 1000 ? 1000 : (int)ms;
+}
+
+static void *server_main(void *arg)
+{
+    zkfake_t *fz = arg;
+    for (;;) {
+        struct session *s, *snext;
+        struct conn *c;
+        int n, i, drop_all, expire_all;
+        char drain[64];
+
+        pthread_mutex_lock(&fz->lock);
+        fz->stats = fz->counters;
+        if (fz->stop) {
+            pthread_mutex_unlock(&fz->lock);
+            break;
+        }
+        fz->cur.latency_us = fz->opts.latency_us;
+        fz->cur.jitter_us = fz->opts.jitter_us;
+        fz->cur.loss = fz->opts.loss;
+        fz->cur.disconnect = fz->opts.disconnect;
+        drop_all = fz->drop_all;
+        expire_all = fz->expire_all;
+        fz->drop_all = fz->expire_all = 0;
+        pthread_mutex_unlock(&fz->lock);
+
+        gettimeofday(&fz->now, 0);
+        if (drop_all)
+            for (c = fz->conns; c; c = c->next)
+                conn_close(fz, c);
+        for (s = fz->sessions; s; s = snext) {
+            snext = s->next;
+            if (expire_all ||
+                    (s->conn == 0 && !timeval_before(&fz->now, &s->expires))) {
+                fz->counters.expired++;
+                session_end(fz, s);
+            }
+        }
+        n = 2;
+        for (c = fz->conns; c; c = c->next) {
+            release_marks(fz, c);
+            conn_flush(fz, c);
+            n++;
+        }
+        reap_conns(fz);
+        if (grow(&fz->pfds, &fz->pfds_cap, n, sizeof(*fz->pfds)) < 0 ||
+                grow(&fz->pconns, &fz->pconns_cap, n, sizeof(*fz->pconns)) < 0)
+            break;
+        fz->pfds[0].fd = fz->wake[0];
+        fz->pfds[0].events = POLLIN;
+        fz->pfds[1].fd = fz->listen_fd;
+        fz->pfds[1].events = POLLIN;
+        n = 2;
+        for (c = fz->conns; c; c = c->next) {
+            fz->pfds[n].fd = c->fd;
+            fz->pfds[n].events = POLLIN;
+            if (c->out_sent < c->out_ready)
+                fz->pfds[n].events |= POLLOUT;
+            fz->pconns[n++] = c;
+        }
+        if (poll(fz->pfds, n, next_timeout(fz)) < 0 && errno != EINTR)
+            break;
+        gettimeofday(&fz->now, 0);
+        if (fz->pfds[0].revents)
+            while (read(fz->wake[0], drain, sizeof(drain)) > 0)
+                ;
+        if (fz->pfds[1].revents)
+            accept_conns(fz);
+        for (i = 2; i < n; i++) {
+            c = fz->pconns[i];
+            if (c->dead)
+                continue;
+            if (fz->pfds[i].revents & (POLLIN | POLLHUP | POLLERR))
+                conn_read(fz, c);
+            conn_flush(fz, c);
+        }
+        reap_conns(fz);
+    }
+    return 0;
+}
+
+static void wake_server(zkfake_t *fz)
+{
+    char c = 0;
+    if (write(fz->wake[1], &c, 1) < 0) {
+        /* the pipe is full, so the server is awake anyway */
+    }
+}
+
+static int add_node(zkfake_t *fz, const char *path)
+{
+    struct znode *n = node_new(path, 0, 0);
+    char *p = strdup(path);
+    struct znode *parent = p ? parent_of(fz, p) : 0;
+    free(p);
+    if (n == 0 || parent == 0 || node_link(fz, parent, n) < 0) {
+        if (n)
+            node_free(n);
+        return -1;
+    }
+    parent->stat.numChildren++;
+    parent->stat.cversion++;
+    return 0;
+}
+
+zkfake_t *zkfake_start(const struct zkfake_options *opts)
+{
+    struct sockaddr_in addr;
+    socklen_t alen = sizeof(addr);
+    int one = 1;
+    zkfake_t *fz = calloc(1, sizeof(*fz));
+
+    if (fz == 0)
+        return 0;
+    if (opts)
+        fz->opts = *opts;
+    fz->cur = fz->opts;
+    fz->listen_fd = -1;
+    fz->wake[0] = fz->wake[1] = -1;
+    pthread_mutex_init(&fz->lock, 0);
+    fz->next_conn_id = 1;
+    fz->next_session_id = ((int64_t)time(0) << 24) + 1;
+    fz->nodes = create_hashtable(1024, path_hash, path_equal);
+    fz->watches = create_hashtable(64, path_hash, path_equal);
+    fz->root = node_new("/", 0, 0);
+    if (fz->nodes == 0 || fz->watches == 0 || fz->root == 0 ||
+            !hashtable_insert(fz->nodes, strdup("/"), fz->root) ||
+            add_node(fz, "/zookeeper") < 0 ||
+            add_node(fz, ZOO_CONFIG_NODE) < 0)
+        goto fail;
+
+    if ((fz->listen_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+        goto fail;
+    setsockopt(fz->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(fz->opts.port);
+    if (bind(fz->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+            listen(fz->listen_fd, 128) < 0 ||
+            getsockname(fz->listen_fd, (struct sockaddr *)&addr, &alen) < 0)
+        goto fail;
+    fz->port = ntohs(addr.sin_port);
+    fcntl(fz->listen_fd, F_SETFL, fcntl(fz->listen_fd, F_GETFL, 0) | O_NONBLOCK);
+    if (pipe(fz->wake) < 0)
+        goto fail;
+    fcntl(fz->wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(fz->wake[1], F_SETFL, O_NONBLOCK);
+    if ((errno = pthread_create(&fz->thread, 0, server_main, fz)) != 0)
+        goto fail;
+    return fz;
+
+fail:
+    {
+        int err = errno;
+        if (fz->listen_fd >= 0)
+            close(fz->listen_fd);
+        if (fz->wake[0] >= 0) {
+            close(fz->wake[0]);
+            close(fz->wake[1]);
+        }
+        if (fz->root)
+            node_free_tree(fz->root);
+        if (fz->nodes)
+            hashtable_destroy(fz->nodes, 0);
+        if (fz->watches)
+            hashtable_destroy(fz->watches, 0);
+        pthread_mutex_destroy(&fz->lock);
+        free(fz);
+        errno = err;
+    }
+    return 0;
+}
+
+int zkfake_port(zkfake_t *fz)
+{
+    return fz->port;
+}
+
+void zkfake_set_faults(zkfake_t *fz, int latency_us, int jitter_us,
+        double loss, double disconnect)
+{
+    pthread_mutex_lock(&fz->lock);
+    fz->opts.latency_us = latency_us;
+    fz->opts.jitter_us = jitter_us;
+    fz->opts.loss = loss;
+    fz->opts.disconnect = disconnect;
+    pthread_mutex_unlock(&fz->lock);
+    wake_server(fz);
+}
+
+void zkfake_drop_connections(zkfake_t *fz)
+{
+    pthread_mutex_lock(&fz->lock);
+    fz->drop_all = 1;
+    pthread_mutex_unlock(&fz->lock);
+    wake_server(fz);
+}
+
+void zkfake_expire_sessions(zkfake_t *fz)
+{
+    pthread_mutex_lock(&fz->lock);
+    fz->expire_all = 1;
+    pthread_mutex_unlock(&fz->lock);
+    wake_server(fz);
+}
+
+void zkfake_get_stats(zkfake_t *fz, struct zkfake_stats *stats)
+{
+    pthread_mutex_lock(&fz->lock);
+    *stats = fz->stats;
+    pthread_mutex_unlock(&fz->lock);
+}
+
+void zkfake_stop(zkfake_t *fz)
+{
+    struct hashtable_itr *it;
+    struct conn *c;
+
+    pthread_mutex_lock(&fz->lock);
+    fz->stop = 1;
+    pthread_mutex_unlock(&fz->lock);
+    wake_server(fz);
+    pthread_join(fz->thread, 0);
+
+    for (c = fz->conns; c; c = c->next)
+        conn_close(fz, c);
+    reap_conns(fz);
+    while (fz->sessions) {
+        struct session *s = fz->sessions;
+        fz->sessions = s->next;
+        free(s);
+    }
+    if (hashtable_count(fz->watches) > 0 &&
+            (it = hashtable_iterator(fz->watches)) != 0) {
+        do {
+            struct watchset *ws = hashtable_iterator_value(it);
+            free(ws->ids[WATCH_DATA]);
+            free(ws->ids[WATCH_CHILD]);
+        } while (hashtable_iterator_advance(it));
+        free(it);
+    }
+    hashtable_destroy(fz->watches, 1);
+    hashtable_destroy(fz->nodes, 0);
+    node_free_tree(fz->root);
+    close(fz->listen_fd);
+    close(fz->wake[0]);
+    close(fz->wake[1]);
+    pthread_mutex_destroy(&fz->lock);
+    free(fz->undo);
+    free(fz->events);
+    free(fz->mres);
+    free(fz->names);
+    free(fz->pfds);
+    free(fz->pconns);
+    free(fz);
+}
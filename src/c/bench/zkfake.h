@@ -0,0 +1,106 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ZKFAKE_H_
+#define ZKFAKE_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \file zkfake.h
+ * \brief An in-process fake ZooKeeper server for benchmarking and stressing
+ * the C client.
+ *
+ * The server speaks the client wire protocol on a loopback port from a
+ * thread of its own and keeps the tree in memory. It handles the handshake,
+ * pings, create/delete/exists/get/set/children/sync/multi and watch events,
+ * with sessions and ephemeral nodes. ACLs are accepted and ignored. It can
+ * delay replies, drop requests and drop connections on purpose.
+ */
+typedef struct zkfake zkfake_t;
+
+struct zkfake_options {
+    int port;               /* port to listen on, 0 picks a free one */
+    int session_timeout;    /* upper bound on negotiated timeouts (ms), 0 for none */
+    int latency_us;         /* delay added to every reply */
+    int jitter_us;          /* plus a random delay of up to this much */
+    double loss;            /* fraction of requests dropped without a reply */
+    double disconnect;      /* fraction of requests that drop the connection */
+    unsigned seed;          /* seed for the injected faults */
+};
+
+struct zkfake_stats {
+    int64_t connections;    /* connections accepted */
+    int64_t requests;       /* requests received */
+    int64_t replies;        /* replies sent */
+    int64_t events;         /* watch events sent */
+    int64_t lost;           /* requests dropped by fault injection */
+    int64_t disconnects;    /* connections dropped by fault injection */
+    int64_t expired;        /* sessions expired */
+};
+
+/**
+ * \brief starts a server on 127.0.0.1.
+ *
+ * \param opts the options, or NULL for a fault-free server on a free port
+ * \return the server, or NULL with errno set
+ */
+zkfake_t *zkfake_start(const struct zkfake_options *opts);
+
+/**
+ * \brief the port the server listens on.
+ */
+int zkfake_port(zkfake_t *fz);
+
+/**
+ * \brief changes the injected faults of a running server.
+ */
+void zkfake_set_faults(zkfake_t *fz, int latency_us, int jitter_us,
+        double loss, double disconnect);
+
+/**
+ * \brief closes every client connection; sessions survive.
+ */
+void zkfake_drop_connections(zkfake_t *fz);
+
+/**
+ * \brief expires every session and closes its connection.
+ */
+void zkfake_expire_sessions(zkfake_t *fz);
+
+/**
+ * \brief copies the server's counters.
+ *
+ * They are refreshed once per turn of the server's event loop.
+ */
+void zkfake_get_stats(zkfake_t *fz, struct zkfake_stats *stats);
+
+/**
+ * \brief stops the server and frees it.
+ */
+void zkfake_stop(zkfake_t *fz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ZKFAKE_H_*/
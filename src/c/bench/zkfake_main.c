@@ -0,0 +1,98 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs the fake server on its own, for clients in other processes such as
+ * load_gen, until interrupted.
+ */
+
+#include "zkfake.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static volatile sig_atomic_t stopped;
+
+static void on_signal(int sig)
+{
+    stopped = 1;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "USAGE: %s [-p port] [-t max session timeout ms] [-l latency us]\n"
+            "          [-j jitter us] [-L loss fraction] [-D disconnect fraction]\n"
+            "          [-s seed] [-i stats interval s]\n", prog);
+}
+
+static void print_stats(zkfake_t *fz)
+{
+    struct zkfake_stats st;
+    zkfake_get_stats(fz, &st);
+    fprintf(stderr, "connections=%lld requests=%lld replies=%lld events=%lld "
+            "lost=%lld disconnects=%lld expired=%lld\n",
+            (long long)st.connections, (long long)st.requests,
+            (long long)st.replies, (long long)st.events, (long long)st.lost,
+            (long long)st.disconnects, (long long)st.expired);
+}
+
+int main(int argc, char **argv)
+{
+    struct zkfake_options opts;
+    int interval = 0, c;
+    zkfake_t *fz;
+
+    memset(&opts, 0, sizeof(opts));
+    opts.port = 2181;
+    while ((c = getopt(argc, argv, "p:t:l:j:L:D:s:i:")) != -1) {
+        switch (c) {
+        case 'p': opts.port = atoi(optarg); break;
+        case 't': opts.session_timeout = atoi(optarg); break;
+        case 'l': opts.latency_us = atoi(optarg); break;
+        case 'j': opts.jitter_us = atoi(optarg); break;
+        case 'L': opts.loss = atof(optarg); break;
+        case 'D': opts.disconnect = atof(optarg); break;
+        case 's': opts.seed = strtoul(optarg, 0, 10); break;
+        case 'i': interval = atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    fz = zkfake_start(&opts);
+    if (fz == 0) {
+        perror("zkfake_start");
+        return 1;
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    fprintf(stderr, "listening on 127.0.0.1:%d\n", zkfake_port(fz));
+    while (!stopped) {
+        sleep(interval > 0 ? interval : 1);
+        if (interval > 0 && !stopped)
+            print_stats(fz);
+    }
+    print_stats(fz);
+    zkfake_stop(fz);
+    return 0;
+}
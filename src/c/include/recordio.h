@@ -69,6 +69,32 @@ struct iarchive *create_buffer_iarchive(char *buffer, int len);
 void close_buffer_iarchive(struct iarchive **ia);
 char *get_buffer(struct oarchive *);
 int get_buffer_len(struct oarchive *);
+/**
+ * Reads the next string of a buffer archive in place: s points into the
+ * archive's buffer, is not NUL terminated and stays valid as long as the
+ * buffer does. Returns 0, or a negative error like the deserializers.
+ */
+int get_buffer_string(struct iarchive *ia, const char **s, int32_t *len);
+
+/**
+ * An output archive that lives in caller storage and never allocates. With
+ * a NULL buffer it only counts the bytes written to it; with a buffer it
+ * fills it and fails with -E2BIG instead of growing it. Serializing a record
+ * once of each gives an exactly sized encoding.
+ *
+ * A path prefix, if set, is written in front of every string serialized
+ * under the name "path", as the chroot of a handle is; the path "/" stands
+ * for the prefix itself. init_fixed_oarchive() clears it.
+ */
+struct fixed_oarchive {
+    struct oarchive oa;
+    int32_t len;
+    int32_t off;
+    char *buffer;
+    const char *path_prefix;
+    int32_t path_prefix_len;
+};
+void init_fixed_oarchive(struct fixed_oarchive *foa, char *buffer, int len);
 
 int64_t htonll(int64_t v);
 
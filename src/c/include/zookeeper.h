@@ -575,6 +575,290 @@ ZOOAPI watcher_fn zoo_set_watcher(zhandle_t *zh,watcher_fn newFn);
 ZOOAPI struct sockaddr* zookeeper_get_connected_host(zhandle_t *zh,
         struct sockaddr *addr, socklen_t *addr_len);
 
+/** the number of buckets in a \ref zoo_latency histogram */
+#define ZOO_LATENCY_BUCKETS 32
+/** the size of \ref zoo_stats.requests, indexed by operation code */
+#define ZOO_STATS_OPS 17
+
+/**
+ * \brief a latency histogram.
+ *
+ * buckets[0] counts latencies under 1 microsecond and buckets[i] those from
+ * 2^(i-1) up to 2^i microseconds; the last bucket also counts anything
+ * longer.
+ */
+struct zoo_latency {
+    int64_t count;
+    int64_t total_us;
+    int64_t max_us;
+    int64_t buckets[ZOO_LATENCY_BUCKETS];
+};
+
+/**
+ * \brief counters kept by every handle, see \ref zoo_get_stats.
+ */
+struct zoo_stats {
+    /** time from queueing a request to reading its reply, by operation
+     * code (ZOO_CREATE_OP, ZOO_GETDATA_OP...); pings are kept apart */
+    struct zoo_latency requests[ZOO_STATS_OPS];
+    /** ping round trips */
+    struct zoo_latency ping;
+    /** time from reading a reply or watch event to calling its
+     * asynchronous completion or watcher */
+    struct zoo_latency dispatch;
+    /** time from losing a connection to re-establishing the session; the
+     * count is the number of reconnects */
+    struct zoo_latency reconnect;
+    int64_t bytes_sent;
+    int64_t bytes_received;
+    int64_t packets_sent;
+    int64_t packets_received;
+    /** requests waiting to be sent */
+    int32_t send_queue;
+    /** requests sent and waiting for their reply */
+    int32_t pending_requests;
+    /** replies and events waiting for their completion or watcher */
+    int32_t completion_queue;
+};
+
+/**
+ * \brief copies the handle's counters.
+ *
+ * The counters are always on and are updated without locks by the thread
+ * doing the work, so a copy taken while requests are in flight may be
+ * slightly inconsistent from one field to the next. They accumulate for the
+ * life of the handle.
+ *
+ * \param zh the zookeeper handle obtained by a call to \ref zookeeper_init
+ * \param stats receives the counters
+ * \return ZOK, or ZBADARGUMENTS if either argument is NULL
+ */
+ZOOAPI int zoo_get_stats(zhandle_t *zh, struct zoo_stats *stats);
+
+/**
+ * \brief estimates a percentile of a latency histogram.
+ *
+ * \param latency the histogram
+ * \param q the percentile as a fraction, e.g. 0.99
+ * \return the upper bound in microseconds of the bucket holding the
+ * percentile, but no more than the maximum seen; 0 if the histogram is empty
+ */
+ZOOAPI int64_t zoo_latency_percentile(const struct zoo_latency *latency,
+        double q);
+
+/** a request has been queued to be sent */
+#define ZOO_TRACE_QUEUED 1
+/** the first byte of a request has been written to the socket */
+#define ZOO_TRACE_SENT 2
+/** the reply to a request has been read and matched to it */
+#define ZOO_TRACE_RECEIVED 3
+/** the reply is about to be decoded and delivered */
+#define ZOO_TRACE_DISPATCHED 4
+/** the completion has returned, or the synchronous caller has been woken */
+#define ZOO_TRACE_COMPLETED 5
+
+/**
+ * \brief one stage of a request, see \ref zoo_trace_hooks.
+ */
+struct zoo_trace_event {
+    /** one of the ZOO_TRACE_* stages */
+    int stage;
+    int32_t xid;
+    /** the operation code, e.g. ZOO_GETDATA_OP */
+    int op;
+    /** the path, without any chroot; NULL for requests with no path such
+     * as multi and ping. Only valid during the call. */
+    const char *path;
+    /** the result from the server from ZOO_TRACE_RECEIVED on, 0 before */
+    int rc;
+    /** a monotonic timestamp in nanoseconds */
+    int64_t time_ns;
+};
+
+/**
+ * \brief request tracing callbacks.
+ *
+ * When set, trace is called as each request passes through the stages in
+ * turn. QUEUED is reported on the thread issuing the request, SENT and
+ * RECEIVED on the IO thread, and DISPATCHED and COMPLETED on the completion
+ * thread (the IO thread for synchronous calls). The callback must be quick
+ * and must not call back into the handle. Pings and the requests the
+ * client makes itself are reported too; only requests with a reply go past
+ * SENT. A lost connection skips RECEIVED.
+ */
+struct zoo_trace_hooks {
+    void (*trace)(zhandle_t *zh, const struct zoo_trace_event *event,
+            void *context);
+    void *context;
+};
+
+/**
+ * \brief sets (or, with NULL, clears) the request tracing callbacks.
+ *
+ * Tracing costs a test per stage while it is off. Set the hooks before
+ * issuing the requests to be traced; requests already in flight may be
+ * reported only in part.
+ *
+ * \param zh the zookeeper handle obtained by a call to \ref zookeeper_init
+ * \param hooks the callbacks; copied into the handle
+ * \return ZOK, or ZBADARGUMENTS if zh is NULL
+ */
+ZOOAPI int zoo_set_trace_hooks(zhandle_t *zh,
+        const struct zoo_trace_hooks *hooks);
+
+/** the number of events each handle's flight recorder keeps */
+#define ZOO_FLIGHT_EVENTS 64
+
+/** the connection state changed to values[0] */
+#define ZOO_FLIGHT_STATE 1
+/** a connection to the server in text is being made */
+#define ZOO_FLIGHT_SERVER 2
+/** a ping took values[0] microseconds */
+#define ZOO_FLIGHT_PING 3
+/** zookeeper_interest() was called values[0] ms after its deadline */
+#define ZOO_FLIGHT_OVERRUN 4
+/** values[0] requests were waiting to be sent and values[1] for a reply */
+#define ZOO_FLIGHT_QUEUES 5
+/** the connection failed with the result code values[0] and errno
+ * values[1]; text starts the message */
+#define ZOO_FLIGHT_ERROR 6
+
+/**
+ * \brief an entry in the flight recorder, see \ref zoo_get_flight_events.
+ */
+struct zoo_flight_event {
+    /** wall clock time in microseconds */
+    int64_t time_us;
+    /** one of ZOO_FLIGHT_* */
+    int type;
+    int64_t values[2];
+    char text[64];
+};
+
+/**
+ * \brief copies the most recent events of the handle's flight recorder.
+ *
+ * Every handle keeps the last \ref ZOO_FLIGHT_EVENTS connection state
+ * changes, servers tried, ping times, missed deadlines, queue depths at
+ * the time of a failure and connection errors, at little cost. When the
+ * session expires they are written to the log at the WARN level.
+ *
+ * \param zh the zookeeper handle obtained by a call to \ref zookeeper_init
+ * \param events receives the events, oldest first
+ * \param count the room in events
+ * \return the number of events copied, or ZBADARGUMENTS
+ */
+ZOOAPI int zoo_get_flight_events(zhandle_t *zh,
+        struct zoo_flight_event *events, int count);
+
+/**
+ * \brief writes the handle's flight recorder out, oldest event first.
+ *
+ * \param zh the zookeeper handle obtained by a call to \ref zookeeper_init
+ * \param out the stream to write to, or NULL for the log
+ * \return ZOK, or ZBADARGUMENTS if zh is NULL
+ */
+ZOOAPI int zoo_dump_flight_recorder(zhandle_t *zh, FILE *out);
+
+/* the calls counted by \ref zoo_get_call_counts */
+#define ZOO_CALL_SEND 0
+#define ZOO_CALL_RECV 1
+#define ZOO_CALL_POLL 2
+/** read(), which drains the multithreaded library's wakeup pipe */
+#define ZOO_CALL_READ 3
+/** write(), which wakes the multithreaded library's IO thread */
+#define ZOO_CALL_WRITE 4
+#define ZOO_CALL_GETTIMEOFDAY 5
+#define ZOO_CALL_CLOCK_GETTIME 6
+#define ZOO_CALL_GETADDRINFO 7
+/** malloc() and strdup() */
+#define ZOO_CALL_MALLOC 8
+#define ZOO_CALL_CALLOC 9
+#define ZOO_CALL_REALLOC 10
+#define ZOO_CALL_FREE 11
+#define ZOO_CALLS 12
+
+/* the entry points calls are charged to, see \ref zoo_get_call_counts */
+/** none of the below */
+#define ZOO_ENTRY_OTHER 0
+#define ZOO_ENTRY_INIT 1
+#define ZOO_ENTRY_CLOSE 2
+#define ZOO_ENTRY_INTEREST 3
+/** zookeeper_process() and zookeeper_dispatch(), completions included */
+#define ZOO_ENTRY_PROCESS 4
+/** the multithreaded library's IO thread, outside of the above */
+#define ZOO_ENTRY_IO_THREAD 5
+/** the multithreaded library's completion thread, completions included */
+#define ZOO_ENTRY_COMPLETION_THREAD 6
+/* the operations, synchronous and asynchronous calls alike */
+#define ZOO_ENTRY_CREATE 7
+#define ZOO_ENTRY_DELETE 8
+#define ZOO_ENTRY_EXISTS 9
+#define ZOO_ENTRY_GET 10
+#define ZOO_ENTRY_SET 11
+#define ZOO_ENTRY_GET_CHILDREN 12
+#define ZOO_ENTRY_GET_ACL 13
+#define ZOO_ENTRY_SET_ACL 14
+#define ZOO_ENTRY_SYNC 15
+#define ZOO_ENTRY_MULTI 16
+#define ZOO_ENTRY_GETCONFIG 17
+#define ZOO_ENTRY_RECONFIG 18
+#define ZOO_ENTRY_ADD_AUTH 19
+#define ZOO_ENTRIES 20
+
+/**
+ * \brief counts of library calls, see \ref zoo_get_call_counts.
+ */
+struct zoo_call_counts {
+    /** calls[entry][call], e.g. calls[ZOO_ENTRY_GET][ZOO_CALL_MALLOC] */
+    int64_t calls[ZOO_ENTRIES][ZOO_CALLS];
+};
+
+/**
+ * \brief copies the library's call counters.
+ *
+ * A library configured with --enable-call-counting counts the system and
+ * allocation calls it makes, by the API entry point the calling thread was
+ * in at the time; an API called from a completion or watcher counts as
+ * itself. The multithreaded library sends and receives on its IO thread,
+ * so those calls are charged to the IO thread rather than to the request.
+ *
+ * The counters are process wide and are kept by interposing on the calls
+ * when the shared library is linked. Programs linking the static library
+ * have to pass the same --wrap options to the linker to be counted.
+ *
+ * \param counts receives the counters
+ * \return ZOK, ZBADARGUMENTS if counts is NULL, or ZUNIMPLEMENTED (with
+ * the counts zeroed) if the library doesn't count calls
+ */
+ZOOAPI int zoo_get_call_counts(struct zoo_call_counts *counts);
+
+/**
+ * \brief zeroes the library's call counters.
+ */
+ZOOAPI void zoo_reset_call_counts(void);
+
+/**
+ * \brief the name of a ZOO_CALL_* constant, e.g. "malloc"; NULL if unknown.
+ */
+ZOOAPI const char *zoo_call_name(int call);
+
+/**
+ * \brief the name of a ZOO_ENTRY_* constant, e.g. "get"; NULL if unknown.
+ */
+ZOOAPI const char *zoo_entry_name(int entry);
+
+/**
+ * \brief writes call counts out as a table, one line per entry point with
+ * calls.
+ *
+ * \param counts the counts, for instance the difference of two copies
+ * \param out the stream to write to
+ * \return ZOK, or ZBADARGUMENTS if either argument is NULL
+ */
+ZOOAPI int zoo_dump_call_counts(const struct zoo_call_counts *counts,
+        FILE *out);
+
 #ifndef THREADED
 /**
  * \brief Returns the events that zookeeper is interested in.
@@ -621,6 +905,66 @@ ZOOAPI int zookeeper_interest(zhandle_t *zh, int *fd, int *interest,
  *              to be processed (when called with ZOOKEEPER_READ flag).
  */
 ZOOAPI int zookeeper_process(zhandle_t *zh, int events);
+
+/**
+ * \brief callbacks used to drive a handle from an external event loop.
+ *
+ * Instead of polling \ref zookeeper_interest before every wait, an
+ * application that owns an event loop registers these callbacks once with
+ * \ref zoo_set_loop_callbacks and calls \ref zookeeper_dispatch whenever
+ * the socket becomes ready or the timer expires. The callbacks are invoked
+ * only when something actually changes.
+ */
+struct zoo_loop_callbacks {
+    /**
+     * Called when the socket or the events of interest change. oldfd is
+     * the descriptor last reported (-1 if none) and should be removed from
+     * the loop; it may already be closed, and newfd may have the same
+     * number. newfd is -1 while there is no connection. interest is an or
+     * of ZOOKEEPER_READ and ZOOKEEPER_WRITE; edge-triggered loops can
+     * ignore it and always watch both.
+     */
+    void (*fd_changed)(zhandle_t *zh, int oldfd, int newfd, int interest,
+            void *context);
+    /**
+     * Called to (re)arm the loop's one-shot timer, timeout_ms from now;
+     * -1 cancels it. The timer may fire before the handle strictly needs
+     * it, so a later deadline is not reported until the armed one expires.
+     */
+    void (*deadline_changed)(zhandle_t *zh, int timeout_ms, void *context);
+    void *context;
+};
+
+/**
+ * \brief attaches (or, with NULL, detaches) event loop callbacks.
+ *
+ * Attaching immediately performs a \ref zookeeper_dispatch so the current
+ * socket and deadline are reported. Detaching reports the socket as gone
+ * and cancels the timer. Detach before calling \ref zookeeper_close if the
+ * loop state must outlive the handle.
+ *
+ * \param zh the zookeeper handle obtained by a call to \ref zookeeper_init
+ * \param callbacks the callbacks; copied into the handle
+ * \return ZOK or the result of the initial \ref zookeeper_dispatch
+ */
+ZOOAPI int zoo_set_loop_callbacks(zhandle_t *zh,
+        const struct zoo_loop_callbacks *callbacks);
+
+/**
+ * \brief processes socket events and timers for a loop-driven handle.
+ *
+ * Handles every response readable on the socket (so it is safe for
+ * edge-triggered notification), then does the connection, ping and timeout
+ * bookkeeping that \ref zookeeper_interest would do and reports changes
+ * through the registered \ref zoo_loop_callbacks. Call it with the ready
+ * events when the socket fires, and with 0 when the timer expires.
+ *
+ * \param zh the zookeeper handle obtained by a call to \ref zookeeper_init
+ * \param events an or of ZOOKEEPER_READ and ZOOKEEPER_WRITE, or 0
+ * \return a result code, as for \ref zookeeper_process and
+ * \ref zookeeper_interest; ZNOTHING is never returned.
+ */
+ZOOAPI int zookeeper_dispatch(zhandle_t *zh, int events);
 #endif
 
 /**
@@ -1407,6 +1751,62 @@ ZOOAPI void zoo_set_debug_level(ZooLogLevel logLevel);
  */
 ZOOAPI void zoo_set_log_stream(FILE* logStream);
 
+/**
+ * \brief a log sink, see \ref zoo_set_log_callback.
+ *
+ * \param level the level of the message
+ * \param message the complete log line, without a trailing newline
+ * \param context the context given to \ref zoo_set_log_callback
+ */
+typedef void (*log_callback_fn)(ZooLogLevel level, const char *message,
+        void *context);
+
+/**
+ * \brief sends the library's log lines to a callback instead of the stream
+ *
+ * The callback is called on the logging thread, or on the writer thread
+ * when \ref zoo_set_log_async is on, and must be safe to call from any of
+ * them. Passing in NULL goes back to the stream set by
+ * \ref zoo_set_log_stream.
+ */
+ZOOAPI void zoo_set_log_callback(log_callback_fn callback, void *context);
+
+/**
+ * \brief moves log formatting and writing onto a background thread
+ *
+ * Logging threads then only copy their message into a ring of capacity
+ * slots, rounded up to a power of two; the writer thread timestamps,
+ * formats and writes them in order. Messages are truncated to 511
+ * characters. When the ring is full new messages are dropped rather than
+ * making the caller wait; the writer logs how many were lost and
+ * \ref zoo_get_log_dropped counts them. A capacity of 0 flushes the ring
+ * and returns to logging on the calling thread. Don't call this from more
+ * than one thread at a time. Only the multithreaded library supports it.
+ *
+ * \param capacity the number of messages the ring holds, or 0 to stop
+ * \return ZOK, ZBADARGUMENTS if capacity is negative, ZSYSTEMERROR if the
+ * writer could not be started, ZUNIMPLEMENTED in the single-threaded library
+ */
+ZOOAPI int zoo_set_log_async(int capacity);
+
+/**
+ * \brief the number of log messages dropped because the ring was full
+ */
+ZOOAPI int64_t zoo_get_log_dropped(void);
+
+/**
+ * \brief writes compact binary log records to a stream instead of text
+ *
+ * Each record holds the address of the format string and the raw
+ * arguments, with the text of each format string written out once; the
+ * zk_logdecode tool turns a file of them back into the usual log lines.
+ * Nothing is formatted when logging, and the stream is only flushed for
+ * errors. It takes precedence over the stream, callback and asynchronous
+ * writer. Passing in NULL flushes the stream and goes back to text. Switch
+ * while the library isn't logging from other threads.
+ */
+ZOOAPI void zoo_set_log_binary(FILE* stream);
+
 /**
  * \brief enable/disable quorum endpoint order randomization
  *
@@ -0,0 +1,70 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ZOOKEEPER_EPOLL_H_
+#define ZOOKEEPER_EPOLL_H_
+
+#include <sys/epoll.h>
+#include <zookeeper.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \file zookeeper_epoll.h
+ * \brief Runs a single-threaded handle inside an application's epoll loop.
+ *
+ * The adaptor registers the handle's socket (edge-triggered, for both read
+ * and write) and a timerfd with the application's epoll descriptor, and
+ * keeps both up to date through \ref zoo_set_loop_callbacks. No threads are
+ * created. Every event returned by epoll_wait() is offered to
+ * \ref zoo_epoll_process first.
+ */
+typedef struct zoo_epoll zoo_epoll_t;
+
+/**
+ * \brief attaches a handle to an epoll descriptor.
+ *
+ * \param zh the zookeeper handle obtained by a call to \ref zookeeper_init
+ *    using the single-threaded library
+ * \param epfd an epoll descriptor owned by the caller
+ * \return the adaptor, or NULL with errno set
+ */
+ZOOAPI zoo_epoll_t *zoo_epoll_attach(zhandle_t *zh, int epfd);
+
+/**
+ * \brief handles an event returned by epoll_wait().
+ *
+ * \return 1 if the event belonged to the adaptor and has been processed,
+ * 0 if it is one of the application's own events.
+ */
+ZOOAPI int zoo_epoll_process(zoo_epoll_t *ep, const struct epoll_event *ev);
+
+/**
+ * \brief removes the handle from the epoll descriptor and frees the adaptor.
+ *
+ * Must be called before \ref zookeeper_close.
+ */
+ZOOAPI void zoo_epoll_detach(zoo_epoll_t *ep);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ZOOKEEPER_EPOLL_H_*/
@@ -26,22 +26,40 @@ extern "C" {
 #endif
 
 extern ZOOAPI ZooLogLevel logLevel;
+extern ZOOAPI FILE* logBinaryStream;
 #define LOGSTREAM getLogStream()
 
-#define LOG_ERROR(x) if(logLevel>=ZOO_LOG_LEVEL_ERROR) \
-    log_message(ZOO_LOG_LEVEL_ERROR,__LINE__,__func__,format_log_message x)
-#define LOG_WARN(x) if(logLevel>=ZOO_LOG_LEVEL_WARN) \
-    log_message(ZOO_LOG_LEVEL_WARN,__LINE__,__func__,format_log_message x)
-#define LOG_INFO(x) if(logLevel>=ZOO_LOG_LEVEL_INFO) \
-    log_message(ZOO_LOG_LEVEL_INFO,__LINE__,__func__,format_log_message x)
-#define LOG_DEBUG(x) if(logLevel==ZOO_LOG_LEVEL_DEBUG) \
-    log_message(ZOO_LOG_LEVEL_DEBUG,__LINE__,__func__,format_log_message x)
+/* Log calls below this level are compiled out; configure sets it with
+ * --with-log-level. */
+#ifndef ZOO_LOG_COMPILED_LEVEL
+#define ZOO_LOG_COMPILED_LEVEL ZOO_LOG_LEVEL_DEBUG
+#endif
+
+/* writes a binary record when zoo_set_log_binary() has set a stream, and a
+ * formatted line otherwise */
+#define LOG_EMIT(level,x) (logBinaryStream ? \
+    log_record(level,__LINE__,__func__,pack_log_message x) : \
+    log_message(level,__LINE__,__func__,format_log_message x))
+
+#define LOG_ERROR(x) if(ZOO_LOG_COMPILED_LEVEL>=ZOO_LOG_LEVEL_ERROR && \
+    logLevel>=ZOO_LOG_LEVEL_ERROR) LOG_EMIT(ZOO_LOG_LEVEL_ERROR,x)
+#define LOG_WARN(x) if(ZOO_LOG_COMPILED_LEVEL>=ZOO_LOG_LEVEL_WARN && \
+    logLevel>=ZOO_LOG_LEVEL_WARN) LOG_EMIT(ZOO_LOG_LEVEL_WARN,x)
+#define LOG_INFO(x) if(ZOO_LOG_COMPILED_LEVEL>=ZOO_LOG_LEVEL_INFO && \
+    logLevel>=ZOO_LOG_LEVEL_INFO) LOG_EMIT(ZOO_LOG_LEVEL_INFO,x)
+#define LOG_DEBUG(x) if(ZOO_LOG_COMPILED_LEVEL>=ZOO_LOG_LEVEL_DEBUG && \
+    logLevel==ZOO_LOG_LEVEL_DEBUG) LOG_EMIT(ZOO_LOG_LEVEL_DEBUG,x)
 
 ZOOAPI void log_message(ZooLogLevel curLevel, int line,const char* funcName,
     const char* message);
 
 ZOOAPI const char* format_log_message(const char* format,...);
 
+ZOOAPI void log_record(ZooLogLevel curLevel, int line, const char* funcName,
+    const char* packed);
+
+ZOOAPI const char* pack_log_message(const char* format,...);
+
 FILE* getLogStream();
 
 #ifdef __cplusplus
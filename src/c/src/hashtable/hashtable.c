@@ -55,10 +55,16 @@ create_hashtable(unsigned int minsize,
 /*****************************************************************************/
 unsigned int
 hash(struct hashtable *h, void *k)
+{
+    return mix_hash(h->hashfn(k));
+}
+
+/*****************************************************************************/
+unsigned int
+mix_hash(unsigned int i)
 {
     /* Aim to protect against poor hash functions by adding logic here
      * - logic taken from java 1.4 hashtable source */
-    unsigned int i = h->hashfn(k);
     i += ~(i << 9);
     i ^=  ((i >> 14) | (i << 18)); /* >>> */
     i +=  (i << 4);
@@ -135,6 +141,14 @@ hashtable_count(struct hashtable *h)
 /*****************************************************************************/
 int
 hashtable_insert(struct hashtable *h, void *k, void *v)
+{
+    return hashtable_insert_hash(h,k,v,h->hashfn(k));
+}
+
+/*****************************************************************************/
+int
+hashtable_insert_hash(struct hashtable *h, void *k, void *v,
+                      unsigned int keyhash)
 {
     /* This method allows duplicate keys - but they shouldn't be used */
     unsigned int index;
@@ -149,7 +163,7 @@ hashtable_insert(struct hashtable *h, void *k, void *v)
     }
     e = (struct entry *)malloc(sizeof(struct entry));
     if (NULL == e) { --(h->entrycount); return 0; } /*oom*/
-    e->h = hash(h,k);
+    e->h = mix_hash(keyhash);
     index = indexFor(h->tablelength,e->h);
     e->k = k;
     e->v = v;
@@ -161,10 +175,17 @@ hashtable_insert(struct hashtable *h, void *k, void *v)
 /*****************************************************************************/
 void * /* returns value associated with key */
 hashtable_search(struct hashtable *h, void *k)
+{
+    return hashtable_search_hash(h,k,h->hashfn(k));
+}
+
+/*****************************************************************************/
+void * /* returns value associated with key */
+hashtable_search_hash(struct hashtable *h, void *k, unsigned int keyhash)
 {
     struct entry *e;
     unsigned int hashvalue, index;
-    hashvalue = hash(h,k);
+    hashvalue = mix_hash(keyhash);
     index = indexFor(h->tablelength,hashvalue);
     e = h->table[index];
     while (NULL != e)
@@ -179,6 +200,13 @@ hashtable_search(struct hashtable *h, void *k)
 /*****************************************************************************/
 void * /* returns value associated with key */
 hashtable_remove(struct hashtable *h, void *k)
+{
+    return hashtable_remove_hash(h,k,h->hashfn(k));
+}
+
+/*****************************************************************************/
+void * /* returns value associated with key */
+hashtable_remove_hash(struct hashtable *h, void *k, unsigned int keyhash)
 {
     /* TODO: consider compacting the table when the load factor drops enough,
      *       or provide a 'compact' method. */
@@ -188,7 +216,7 @@ hashtable_remove(struct hashtable *h, void *k)
     void *v;
     unsigned int hashvalue, index;
 
-    hashvalue = hash(h,k);
+    hashvalue = mix_hash(keyhash);
     index = indexFor(h->tablelength, hashvalue);
     pE = &(h->table[index]);
     e = *pE;
@@ -104,6 +104,19 @@ create_hashtable(unsigned int minsize,
 int 
 hashtable_insert(struct hashtable *h, void *k, void *v);
 
+/*****************************************************************************
+ * hashtable_insert_hash
+   
+ * @name        hashtable_insert_hash
+ * @param   keyhash what the table's hash function returns for k
+ *
+ * As hashtable_insert, for a caller that has hashed the key already.
+ */
+
+int
+hashtable_insert_hash(struct hashtable *h, void *k, void *v,
+                      unsigned int keyhash);
+
 #define DEFINE_HASHTABLE_INSERT(fnname, keytype, valuetype) \
 int fnname (struct hashtable *h, keytype *k, valuetype *v) \
 { \
@@ -122,6 +135,18 @@ int fnname (struct hashtable *h, keytype *k, valuetype *v) \
 void *
 hashtable_search(struct hashtable *h, void *k);
 
+/*****************************************************************************
+ * hashtable_search_hash
+   
+ * @name        hashtable_search_hash
+ * @param   keyhash what the table's hash function returns for k
+ *
+ * As hashtable_search, for a caller that has hashed the key already.
+ */
+
+void *
+hashtable_search_hash(struct hashtable *h, void *k, unsigned int keyhash);
+
 #define DEFINE_HASHTABLE_SEARCH(fnname, keytype, valuetype) \
 valuetype * fnname (struct hashtable *h, keytype *k) \
 { \
@@ -140,6 +165,18 @@ valuetype * fnname (struct hashtable *h, keytype *k) \
 void * /* returns value */
 hashtable_remove(struct hashtable *h, void *k);
 
+/*****************************************************************************
+ * hashtable_remove_hash
+   
+ * @name        hashtable_remove_hash
+ * @param   keyhash what the table's hash function returns for k
+ *
+ * As hashtable_remove, for a caller that has hashed the key already.
+ */
+
+void * /* returns value */
+hashtable_remove_hash(struct hashtable *h, void *k, unsigned int keyhash);
+
 #define DEFINE_HASHTABLE_REMOVE(fnname, keytype, valuetype) \
 valuetype * fnname (struct hashtable *h, keytype *k) \
 { \
@@ -27,6 +27,10 @@ struct hashtable {
 unsigned int
 hash(struct hashtable *h, void *k);
 
+/* the mixing hash() applies to what the hash function returns */
+unsigned int
+mix_hash(unsigned int i);
+
 /*****************************************************************************/
 /* indexFor */
 static inline unsigned int
@@ -16,22 +16,105 @@
  * limitations under the License.
  */
 
+/*
+ * A benchmark driver for the client: threads spread over one or more
+ * handles issue a mix of reads and writes against a set of znodes for a
+ * fixed time, and the latency of every operation goes into a log-linear
+ * histogram. The result is printed as text or as JSON.
+ *
+ * zkfake (built alongside) stands in for a server when only the client's
+ * own overhead is of interest.
+ */
+
 #include <zookeeper.h>
 #include "zookeeper_log.h"
 #include <errno.h>
 #ifndef WIN32
-#ifdef THREADED 
+#ifdef THREADED
 #include <pthread.h>
 #endif
 #else
 #include "win32port.h"
 #endif
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_HANDLES 256
+#define MAX_THREADS 1024
+
+/* latencies are kept in nanoseconds, with 2^(HIST_SUB_BITS-1) linear
+ * sub-buckets per power of two: under 1% error at any magnitude */
+#define HIST_SUB_BITS 7
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_HALF (HIST_SUB / 2)
+#define HIST_BUCKETS (64 * HIST_HALF)
+
+struct histogram {
+    int64_t count;
+    int64_t sum;
+    int64_t max;
+    int64_t buckets[HIST_BUCKETS];
+};
+
+struct config {
+    const char *hosts;
+    const char *root;
+    int keys;
+    int read_pct;
+    int value_size;
+    int zipf;
+    double theta;
+    int pipeline;
+    int threads;
+    int handles;
+    int async;
+    int duration;
+    int warmup;
+    int json;
+    int keep;
+    unsigned seed;
+};
+
+struct worker;
 
-static zhandle_t *zh;
+struct op {
+    struct worker *w;
+    int64_t start;
+    int is_write;
+    int measured;
+};
 
-static int shutdownThisThing=0;
+struct worker {
+    pthread_t thread;
+    zhandle_t *zh;
+    uint64_t rnd;
+    struct histogram reads;
+    struct histogram writes;
+    int64_t errors;
+    /* async mode: the requests in flight, bounded by the pipeline depth */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct op *ops;
+    struct op **free_ops;
+    int nfree;
+};
+
+static struct config cfg;
+static zhandle_t *handles[MAX_HANDLES];
+static char *value;
+static volatile int measuring;
+static volatile int stopped;
+
+/* the zipfian generator of Gray et al., "Quickly Generating Billion-Record
+ * Synthetic Databases" */
+static double zipf_zetan;
+static double zipf_alpha;
+static double zipf_eta;
 
 // *****************************************************************************
 //
@@ -40,11 +123,9 @@ static pthread_mutex_t lock=PTHREAD_MUTEX_INITIALIZER;
 
 static pthread_cond_t counterCond=PTHREAD_COND_INITIALIZER;
 static pthread_mutex_t counterLock=PTHREAD_MUTEX_INITIALIZER;
-static int counter; 
-
-
+static int counter;
 
-void ensureConnected(){
+void ensureConnected(zhandle_t *zh){
     pthread_mutex_lock(&lock);
     while (zoo_state(zh)!=ZOO_CONNECTED_STATE) {
         pthread_cond_wait(&cond,&lock);
@@ -56,22 +137,16 @@ void incCounter(int delta){
     pthread_mutex_lock(&counterLock);
     counter+=delta;
     pthread_cond_broadcast(&counterCond);
-    pthread_mutex_unlock(&counterLock);        
-    
+    pthread_mutex_unlock(&counterLock);
 }
-void setCounter(int cnt){
-    pthread_mutex_lock(&counterLock);
-    counter=cnt;
-    pthread_cond_broadcast(&counterCond);
-    pthread_mutex_unlock(&counterLock);        
-    
-}
-void waitCounter(){
+
+/* waits until no more than max requests are outstanding */
+void waitCounter(int max){
     pthread_mutex_lock(&counterLock);
-    while (counter>0) {
+    while (counter>max) {
         pthread_cond_wait(&counterCond,&counterLock);
     }
-    pthread_mutex_unlock(&counterLock);    
+    pthread_mutex_unlock(&counterLock);
 }
 
 void listener(zhandle_t *zzh, int type, int state, const char *path,void* ctx) {
@@ -81,101 +156,246 @@ void listener(zhandle_t *zzh, int type, int state, const char *path,void* ctx) {
             pthread_cond_broadcast(&cond);
             pthread_mutex_unlock(&lock);
         }
-        setCounter(0);
     }
 }
 
-void create_completion(int rc, const char *name, const void *data) {
-    incCounter(-1);
-    if(rc!=ZOK){
-        LOG_ERROR(("Failed to create a node rc=%d",rc));
-    }
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
 }
 
-int doCreateNodes(const char* root, int count){
-    char nodeName[1024];
-    int i;
-    for(i=0; i<count;i++){
-        int rc = 0;
-        snprintf(nodeName, sizeof(nodeName),"%s/%d",root,i);
-        incCounter(1);
-        rc=zoo_acreate(zh, nodeName, "first", 5, &ZOO_OPEN_ACL_UNSAFE, 0,
-                            create_completion, 0);
-        if(i%1000==0){
-            LOG_INFO(("Created %s",nodeName));
-        }
-        if(rc!=ZOK) return rc;        
-    }
+// *****************************************************************************
+// histograms
+
+static int hist_index(int64_t v)
+{
+    int shift = 0;
+    if (v < 0)
+        v = 0;
+    while ((v >> shift) >= HIST_SUB)
+        shift++;
+    return shift == 0 ? (int)v : shift * HIST_HALF + (int)(v >> shift);
 }
 
-int createRoot(const char* root){
-    char realpath[1024];
-    return zoo_create(zh,root,"root",4,&ZOO_OPEN_ACL_UNSAFE,0,realpath,sizeof(realpath)-1);
+/* the highest value that falls in a bucket */
+static int64_t hist_value(int index)
+{
+    int shift;
+    if (index < HIST_SUB)
+        return index;
+    shift = index / HIST_HALF - 1;
+    return ((int64_t)(index % HIST_HALF + HIST_HALF + 1) << shift) - 1;
 }
 
-void write_completion(int rc, const struct Stat *stat, const void *data) {
-    incCounter(-1);
-    if(rc!=ZOK){
-        LOG_ERROR(("Failed to write a node rc=%d",rc));
-    }
+static void hist_record(struct histogram *h, int64_t v)
+{
+    h->buckets[hist_index(v)]++;
+    h->count++;
+    h->sum += v;
+    if (v > h->max)
+        h->max = v;
 }
 
-int doWrites(const char* root, int count){
-    char nodeName[1024];
+static void hist_merge(struct histogram *to, const struct histogram *from)
+{
     int i;
-    counter=0;
-    for(i=0; i<count;i++){
-        int rc = 0;
-        snprintf(nodeName, sizeof(nodeName),"%s/%d",root,i);
-        incCounter(1);
-        rc=zoo_aset(zh, nodeName, "second", 6,-1,write_completion, 0);
-        if(rc!=ZOK) return rc;        
-    }
+    for (i = 0; i < HIST_BUCKETS; i++)
+        to->buckets[i] += from->buckets[i];
+    to->count += from->count;
+    to->sum += from->sum;
+    if (from->max > to->max)
+        to->max = from->max;
 }
 
-void read_completion(int rc, const char *value, int value_len,
-        const struct Stat *stat, const void *data) {
-    incCounter(-1);    
-    if(rc!=ZOK){
-        LOG_ERROR(("Failed to read a node rc=%d",rc));
-        return;
-    }
-    if(memcmp(value,"second",6)!=0){
-        char buf[value_len+1];
-        memcpy(buf,value,value_len);buf[value_len]=0;
-        LOG_ERROR(("Invalid read, expected [second], received [%s]\n",buf));
-        exit(1);
+static int64_t hist_percentile(const struct histogram *h, double q)
+{
+    int64_t target = (int64_t)ceil(q * h->count);
+    int64_t seen = 0;
+    int i;
+    if (target < 1)
+        target = 1;
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= target)
+            return hist_value(i) < h->max ? hist_value(i) : h->max;
     }
+    return h->max;
 }
 
-int doReads(const char* root, int count){
-    char nodeName[1024];
+// *****************************************************************************
+// key selection
+
+static uint64_t next_random(struct worker *w)
+{
+    /* xorshift64* */
+    w->rnd ^= w->rnd >> 12;
+    w->rnd ^= w->rnd << 25;
+    w->rnd ^= w->rnd >> 27;
+    return w->rnd * 2685821657736338717ULL;
+}
+
+static double next_uniform(struct worker *w)
+{
+    return (next_random(w) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void zipf_init(int n, double theta)
+{
+    double zeta2 = 1.0 + pow(0.5, theta);
     int i;
-    counter=0;
-    for(i=0; i<count;i++){
-        int rc = 0;
-        snprintf(nodeName, sizeof(nodeName),"%s/%d",root,i);
-        incCounter(1);
-        rc=zoo_aget(zh, nodeName,0,read_completion, 0);
-        if(rc!=ZOK) return rc;        
+    zipf_zetan = 0;
+    for (i = 1; i <= n; i++)
+        zipf_zetan += 1.0 / pow(i, theta);
+    zipf_alpha = 1.0 / (1.0 - theta);
+    zipf_eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zipf_zetan);
+}
+
+static int next_key(struct worker *w)
+{
+    double u, uz;
+    int k;
+    if (!cfg.zipf)
+        return next_random(w) % cfg.keys;
+    u = next_uniform(w);
+    uz = u * zipf_zetan;
+    if (uz < 1.0)
+        return 0;
+    if (uz < 1.0 + pow(0.5, cfg.theta))
+        return 1;
+    k = (int)(cfg.keys * pow(zipf_eta * u - zipf_eta + 1.0, zipf_alpha));
+    return k < cfg.keys ? k : cfg.keys - 1;
+}
+
+// *****************************************************************************
+// the workload
+
+static void record(struct worker *w, int is_write, int64_t start, int rc)
+{
+    if (rc != ZOK)
+        w->errors++;
+    else
+        hist_record(is_write ? &w->writes : &w->reads, now_ns() - start);
+}
+
+static void op_done(struct op *op, int rc)
+{
+    struct worker *w = op->w;
+    pthread_mutex_lock(&w->lock);
+    if (op->measured)
+        record(w, op->is_write, op->start, rc);
+    w->free_ops[w->nfree++] = op;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+static void read_completion(int rc, const char *value, int value_len,
+        const struct Stat *stat, const void *data)
+{
+    op_done((struct op *)data, rc);
+}
+
+static void write_completion(int rc, const struct Stat *stat, const void *data)
+{
+    op_done((struct op *)data, rc);
+}
+
+static struct op *acquire_op(struct worker *w)
+{
+    struct op *op = 0;
+    pthread_mutex_lock(&w->lock);
+    while (w->nfree == 0 && !stopped)
+        pthread_cond_wait(&w->cond, &w->lock);
+    if (w->nfree > 0)
+        op = w->free_ops[--w->nfree];
+    pthread_mutex_unlock(&w->lock);
+    return op;
+}
+
+static void drain(struct worker *w)
+{
+    pthread_mutex_lock(&w->lock);
+    while (w->nfree < cfg.pipeline)
+        pthread_cond_wait(&w->cond, &w->lock);
+    pthread_mutex_unlock(&w->lock);
+}
+
+static void *worker_main(void *arg)
+{
+    struct worker *w = arg;
+    char path[1024];
+    char *buf = malloc(cfg.value_size + 1);
+
+    while (!stopped) {
+        int is_write = (int)(next_random(w) % 100) >= cfg.read_pct;
+        int rc;
+        snprintf(path, sizeof(path), "%s/%08d", cfg.root, next_key(w));
+        if (cfg.async) {
+            struct op *op = acquire_op(w);
+            if (op == 0)
+                break;
+            op->is_write = is_write;
+            op->measured = measuring;
+            op->start = now_ns();
+            if (is_write)
+                rc = zoo_aset(w->zh, path, value, cfg.value_size, -1,
+                        write_completion, op);
+            else
+                rc = zoo_aget(w->zh, path, 0, read_completion, op);
+            if (rc != ZOK)
+                op_done(op, rc);
+        } else {
+            int measured = measuring;
+            int64_t start = now_ns();
+            if (is_write) {
+                rc = zoo_set(w->zh, path, value, cfg.value_size, -1);
+            } else {
+                int len = cfg.value_size + 1;
+                rc = zoo_get(w->zh, path, 0, buf, &len, 0);
+            }
+            if (measured)
+                record(w, is_write, start, rc);
+        }
     }
+    if (cfg.async)
+        drain(w);
+    free(buf);
+    return 0;
 }
 
-void delete_completion(int rc, const void *data) {
-    incCounter(-1);    
+// *****************************************************************************
+// setup and cleanup
+
+void create_completion(int rc, const char *name, const void *data) {
+    incCounter(-1);
+    if(rc!=ZOK && rc!=ZNODEEXISTS){
+        LOG_ERROR(("Failed to create a node rc=%d",rc));
+    }
 }
 
-int doDeletes(const char* root, int count){
+int doCreateNodes(zhandle_t *zh, const char* root, int count){
     char nodeName[1024];
     int i;
-    counter=0;
     for(i=0; i<count;i++){
         int rc = 0;
-        snprintf(nodeName, sizeof(nodeName),"%s/%d",root,i);
+        snprintf(nodeName, sizeof(nodeName),"%s/%08d",root,i);
+        waitCounter(1000);
         incCounter(1);
-        rc=zoo_adelete(zh, nodeName,-1,delete_completion, 0);
-        if(rc!=ZOK) return rc;        
+        rc=zoo_acreate(zh, nodeName, value, cfg.value_size,
+                &ZOO_OPEN_ACL_UNSAFE, 0, create_completion, 0);
+        if(rc!=ZOK){
+            incCounter(-1);
+            return rc;
+        }
     }
+    waitCounter(0);
+    return ZOK;
+}
+
+int createRoot(zhandle_t *zh, const char* root){
+    int rc = zoo_create(zh,root,"root",4,&ZOO_OPEN_ACL_UNSAFE,0,0,0);
+    return rc == ZNODEEXISTS ? ZOK : rc;
 }
 
 static int free_String_vector(struct String_vector *v) {
@@ -192,7 +412,7 @@ static int free_String_vector(struct String_vector *v) {
 
 static int deletedCounter;
 
-int recursiveDelete(const char* root){
+int recursiveDelete(zhandle_t *zh, const char* root){
     struct String_vector children;
     int i;
     int rc=zoo_get_children(zh,root,0,&children);
@@ -205,7 +425,7 @@ int recursiveDelete(const char* root){
             int rc = 0;
             char nodeName[2048];
             snprintf(nodeName, sizeof(nodeName),"%s/%s",root,children.data[i]);
-            rc=recursiveDelete(nodeName);
+            rc=recursiveDelete(zh,nodeName);
             if(rc!=ZOK){
                 free_String_vector(&children);
                 return rc;
@@ -223,60 +443,278 @@ int recursiveDelete(const char* root){
     return rc;
 }
 
+// *****************************************************************************
+// reporting
+
+static void print_text_hist(const char *name, const struct histogram *h)
+{
+    if (h->count == 0) {
+        printf("%-6s count=0\n", name);
+        return;
+    }
+    printf("%-6s count=%lld mean=%.1f p50=%.1f p99=%.1f p999=%.1f "
+            "max=%.1f (us)\n", name, (long long)h->count,
+            (double)h->sum / h->count / 1e3,
+            hist_percentile(h, 0.5) / 1e3, hist_percentile(h, 0.99) / 1e3,
+            hist_percentile(h, 0.999) / 1e3, h->max / 1e3);
+}
+
+static void print_json_hist(const char *name, const struct histogram *h)
+{
+    printf("\"%s\":{\"count\":%lld,\"mean_us\":%.3f,\"p50_us\":%.3f,"
+            "\"p99_us\":%.3f,\"p999_us\":%.3f,\"max_us\":%.3f}", name,
+            (long long)h->count, h->count ? (double)h->sum / h->count / 1e3 : 0,
+            hist_percentile(h, 0.5) / 1e3, hist_percentile(h, 0.99) / 1e3,
+            hist_percentile(h, 0.999) / 1e3, h->max / 1e3);
+}
+
+static void print_calls(const struct zoo_call_counts *calls, int64_t ops)
+{
+    int i, j;
+    for (j = 0; j < ZOO_CALLS; j++) {
+        int64_t total = 0;
+        for (i = 0; i < ZOO_ENTRIES; i++)
+            total += calls->calls[i][j];
+        if (cfg.json)
+            printf("%s\"%s\":%.3f", j ? "," : "", zoo_call_name(j),
+                    ops ? (double)total / ops : 0);
+        else
+            printf(" %s=%.2f", zoo_call_name(j), ops ? (double)total / ops : 0);
+    }
+}
+
+static void report(const struct histogram *reads,
+        const struct histogram *writes, int64_t errors, double seconds,
+        const struct zoo_call_counts *calls)
+{
+    int64_t ops = reads->count + writes->count;
+    double throughput = seconds > 0 ? ops / seconds : 0;
+
+    if (cfg.json) {
+        printf("{\"config\":{\"keys\":%d,\"read_pct\":%d,\"value_size\":%d,"
+                "\"distribution\":\"%s\",\"theta\":%.3f,\"mode\":\"%s\","
+                "\"pipeline\":%d,\"threads\":%d,\"handles\":%d,"
+                "\"duration_s\":%d,\"warmup_s\":%d},", cfg.keys, cfg.read_pct,
+                cfg.value_size, cfg.zipf ? "zipf" : "uniform", cfg.theta,
+                cfg.async ? "async" : "sync", cfg.pipeline, cfg.threads,
+                cfg.handles, cfg.duration, cfg.warmup);
+        printf("\"elapsed_s\":%.3f,\"ops\":%lld,\"errors\":%lld,"
+                "\"throughput\":%.1f,", seconds, (long long)ops,
+                (long long)errors, throughput);
+        print_json_hist("read", reads);
+        printf(",");
+        print_json_hist("write", writes);
+        if (calls) {
+            printf(",\"calls_per_op\":{");
+            print_calls(calls, ops);
+            printf("}");
+        }
+        printf("}\n");
+        return;
+    }
+    printf("keys=%d reads=%d%% value=%dB dist=%s", cfg.keys, cfg.read_pct,
+            cfg.value_size, cfg.zipf ? "zipf" : "uniform");
+    if (cfg.zipf)
+        printf("(%.2f)", cfg.theta);
+    printf(" mode=%s pipeline=%d threads=%d handles=%d\n",
+            cfg.async ? "async" : "sync", cfg.pipeline, cfg.threads,
+            cfg.handles);
+    printf("elapsed=%.3fs ops=%lld errors=%lld throughput=%.1f ops/s\n",
+            seconds, (long long)ops, (long long)errors, throughput);
+    print_text_hist("read", reads);
+    print_text_hist("write", writes);
+    if (calls) {
+        printf("calls per op:");
+        print_calls(calls, ops);
+        printf("\n");
+        zoo_dump_call_counts(calls, stdout);
+    }
+}
+
 void usage(char *argv[]){
-    fprintf(stderr, "USAGE:\t%s zookeeper_host_list path #children\nor", argv[0]);
-    fprintf(stderr, "\t%s zookeeper_host_list path clean\n", argv[0]);
-    exit(0);
+    fprintf(stderr,
+            "USAGE:\t%s [options] zookeeper_host_list path\n"
+            "\t%s zookeeper_host_list path #children\n"
+            "\t%s zookeeper_host_list path clean\n"
+            "options:\n"
+            "\t-k keys        znodes under path (1000)\n"
+            "\t-r percent     share of reads, the rest are writes (90)\n"
+            "\t-v bytes       value size (100)\n"
+            "\t-z theta       zipfian keys with this skew (uniform)\n"
+            "\t-p depth       requests in flight per thread, async only (1)\n"
+            "\t-t threads     worker threads (1)\n"
+            "\t-n handles     sessions the threads are spread over (1)\n"
+            "\t-s             synchronous calls (asynchronous)\n"
+            "\t-d seconds     measured run time (10)\n"
+            "\t-w seconds     warmup before measuring (1)\n"
+            "\t-S seed        random seed (1)\n"
+            "\t-j             print the result as JSON\n"
+            "\t-K             keep the znodes afterwards\n",
+            argv[0], argv[0], argv[0]);
+    exit(2);
 }
 
 int main(int argc, char **argv) {
-    int nodeCount;
-    int cleaning=0;
-    if (argc < 4) {
-        usage(argv);
+    struct histogram *reads, *writes;
+    struct zoo_call_counts *calls, *calls_end;
+    struct worker *workers;
+    int64_t start, end, errors = 0;
+    int cleaning = 0;
+    int c, i, rc;
+
+    cfg.keys = 1000;
+    cfg.read_pct = 90;
+    cfg.value_size = 100;
+    cfg.theta = 0.99;
+    cfg.pipeline = 1;
+    cfg.threads = 1;
+    cfg.handles = 1;
+    cfg.async = 1;
+    cfg.duration = 10;
+    cfg.warmup = 1;
+    cfg.seed = 1;
+    while ((c = getopt(argc, argv, "k:r:v:z:p:t:n:sd:w:S:jK")) != -1) {
+        switch (c) {
+        case 'k': cfg.keys = atoi(optarg); break;
+        case 'r': cfg.read_pct = atoi(optarg); break;
+        case 'v': cfg.value_size = atoi(optarg); break;
+        case 'z': cfg.zipf = 1; cfg.theta = atof(optarg); break;
+        case 'p': cfg.pipeline = atoi(optarg); break;
+        case 't': cfg.threads = atoi(optarg); break;
+        case 'n': cfg.handles = atoi(optarg); break;
+        case 's': cfg.async = 0; break;
+        case 'd': cfg.duration = atoi(optarg); break;
+        case 'w': cfg.warmup = atoi(optarg); break;
+        case 'S': cfg.seed = strtoul(optarg, 0, 10); break;
+        case 'j': cfg.json = 1; break;
+        case 'K': cfg.keep = 1; break;
+        default: usage(argv);
+        }
     }
-    if(strcmp("clean",argv[3])==0){
-        cleaning=1;
+    if (argc - optind < 2 || argc - optind > 3)
+        usage(argv);
+    cfg.hosts = argv[optind];
+    cfg.root = argv[optind + 1];
+    if (argc - optind == 3) {
+        if (strcmp("clean", argv[optind + 2]) == 0)
+            cleaning = 1;
+        else
+            cfg.keys = atoi(argv[optind + 2]);
     }
-    zoo_set_debug_level(ZOO_LOG_LEVEL_INFO);
+    if (cfg.keys <= 0 || cfg.read_pct < 0 || cfg.read_pct > 100 ||
+            cfg.value_size < 0 || cfg.pipeline <= 0 || cfg.threads <= 0 ||
+            cfg.threads > MAX_THREADS || cfg.handles <= 0 ||
+            cfg.handles > MAX_HANDLES || cfg.duration <= 0 ||
+            cfg.warmup < 0 || (cfg.zipf && (cfg.theta <= 0 || cfg.theta >= 1)))
+        usage(argv);
+    if (!cfg.async)
+        cfg.pipeline = 1;
+    if (cfg.handles > cfg.threads)
+        cfg.handles = cfg.threads;
+
+    zoo_set_debug_level(ZOO_LOG_LEVEL_WARN);
     zoo_deterministic_conn_order(1); // enable deterministic order
 
-    zh = zookeeper_init(argv[1], listener, 10000, 0, 0, 0);
-    if (!zh)
-        return errno;
+    for (i = 0; i < cfg.handles; i++) {
+        handles[i] = zookeeper_init(cfg.hosts, listener, 10000, 0, 0, 0);
+        if (!handles[i])
+            return errno;
+    }
+    for (i = 0; i < cfg.handles; i++)
+        ensureConnected(handles[i]);
 
-    LOG_INFO(("Checking server connection..."));
-    ensureConnected();
-    if(cleaning==1){
-        int rc = 0;
+    if (cleaning) {
         deletedCounter=0;
-        rc=recursiveDelete(argv[2]);
-        if(rc==ZOK){
-            LOG_INFO(("Succesfully deleted a subtree starting at %s (%d nodes)",
-                    argv[2],deletedCounter));
-            exit(0);
+        rc=recursiveDelete(handles[0], cfg.root);
+        if (rc==ZOK) {
+            fprintf(stderr, "Deleted a subtree starting at %s (%d nodes)\n",
+                    cfg.root, deletedCounter);
+        }
+        return rc==ZOK ? 0 : 1;
+    }
+
+    value = malloc(cfg.value_size + 1);
+    memset(value, 'x', cfg.value_size);
+    if (cfg.zipf)
+        zipf_init(cfg.keys, cfg.theta);
+    rc = createRoot(handles[0], cfg.root);
+    rc = rc != ZOK ? rc : doCreateNodes(handles[0], cfg.root, cfg.keys);
+    if (rc != ZOK) {
+        fprintf(stderr, "Failed to create %d nodes under %s: %s\n", cfg.keys,
+                cfg.root, zerror(rc));
+        return 1;
+    }
+
+    workers = calloc(cfg.threads, sizeof(*workers));
+    for (i = 0; i < cfg.threads; i++) {
+        struct worker *w = &workers[i];
+        int j;
+        w->zh = handles[i % cfg.handles];
+        w->rnd = ((uint64_t)cfg.seed << 32) ^ (i + 1) * 0x9E3779B97F4A7C15ULL;
+        pthread_mutex_init(&w->lock, 0);
+        pthread_cond_init(&w->cond, 0);
+        w->ops = calloc(cfg.pipeline, sizeof(*w->ops));
+        w->free_ops = calloc(cfg.pipeline, sizeof(*w->free_ops));
+        for (j = 0; j < cfg.pipeline; j++) {
+            w->ops[j].w = w;
+            w->free_ops[w->nfree++] = &w->ops[j];
         }
-        exit(1);
     }
-    nodeCount=atoi(argv[3]);
-    createRoot(argv[2]);
-    while(1) {
-        ensureConnected();
-        LOG_INFO(("Creating children for path %s",argv[2]));
-        doCreateNodes(argv[2],nodeCount);
-        waitCounter();
-        
-        LOG_INFO(("Starting the write cycle for path %s",argv[2]));
-        doWrites(argv[2],nodeCount);
-        waitCounter();
-        LOG_INFO(("Starting the read cycle for path %s",argv[2]));
-        doReads(argv[2],nodeCount);
-        waitCounter();
-
-        LOG_INFO(("Starting the delete cycle for path %s",argv[2]));
-        doDeletes(argv[2],nodeCount);
-        waitCounter();
+    for (i = 0; i < cfg.threads; i++)
+        pthread_create(&workers[i].thread, 0, worker_main, &workers[i]);
+    sleep(cfg.warmup);
+    calls = calloc(1, sizeof(*calls));
+    calls_end = calloc(1, sizeof(*calls_end));
+    zoo_get_call_counts(calls);
+    start = now_ns();
+    measuring = 1;
+    sleep(cfg.duration);
+    measuring = 0;
+    end = now_ns();
+    /* counted only if the library was built with --enable-call-counting */
+    if (zoo_get_call_counts(calls_end) == ZOK) {
+        int j;
+        for (i = 0; i < ZOO_ENTRIES; i++)
+            for (j = 0; j < ZOO_CALLS; j++)
+                calls_end->calls[i][j] -= calls->calls[i][j];
+    } else {
+        free(calls_end);
+        calls_end = 0;
+    }
+    stopped = 1;
+    for (i = 0; i < cfg.threads; i++) {
+        pthread_mutex_lock(&workers[i].lock);
+        pthread_cond_signal(&workers[i].cond);
+        pthread_mutex_unlock(&workers[i].lock);
+        pthread_join(workers[i].thread, 0);
+    }
+
+    reads = calloc(1, sizeof(*reads));
+    writes = calloc(1, sizeof(*writes));
+    for (i = 0; i < cfg.threads; i++) {
+        hist_merge(reads, &workers[i].reads);
+        hist_merge(writes, &workers[i].writes);
+        errors += workers[i].errors;
+    }
+    report(reads, writes, errors, (end - start) / 1e9, calls_end);
+
+    if (!cfg.keep) {
+        deletedCounter=0;
+        recursiveDelete(handles[0], cfg.root);
+    }
+    for (i = 0; i < cfg.handles; i++)
+        zookeeper_close(handles[i]);
+    for (i = 0; i < cfg.threads; i++) {
+        pthread_mutex_destroy(&workers[i].lock);
+        pthread_cond_destroy(&workers[i].cond);
+        free(workers[i].ops);
+        free(workers[i].free_ops);
     }
-    zookeeper_close(zh);
+    free(workers);
+    free(reads);
+    free(writes);
+    free(calls);
+    free(calls_end);
+    free(value);
     return 0;
 }
@@ -363,6 +363,7 @@ void *do_io(void *v)
     struct pollfd fds[2];
     struct adaptor_threads *adaptor_threads = zh->adaptor_priv;
 
+    COUNT_THREAD_CALLS_AS(ZOO_ENTRY_IO_THREAD);
     api_prolog(zh);
     notify_thread_ready(zh);
     LOG_DEBUG(("started IO thread"));
@@ -455,6 +456,7 @@ void *do_completion(void *v)
 #endif
 {
     zhandle_t *zh = v;
+    COUNT_THREAD_CALLS_AS(ZOO_ENTRY_COMPLETION_THREAD);
     api_prolog(zh);
     notify_thread_ready(zh);
     LOG_DEBUG(("started completion thread"));
@@ -490,14 +492,14 @@ int32_t fetch_and_add(volatile int32_t* operand, int incr)
 #endif
 }
 
-// make sure the static xid is initialized before any threads started
-__attribute__((constructor)) int32_t get_xid()
+// each handle has its own counter, so handles used from different threads
+// don't contend on a shared cache line
+int32_t get_xid(zhandle_t *zh)
 {
-    static int32_t xid = -1;
-    if (xid == -1) {
-        xid = time(0);
-    }
-    return fetch_and_add(&xid,1);
+    // callers build the request header before validating the handle
+    if (zh == 0)
+        return 0;
+    return fetch_and_add(&zh->xid,1);
 }
 
 void lock_reconfig(struct _zhandle *zh)
@@ -278,6 +278,23 @@ int ia_deserialize_string(struct iarchive *ia, const char *name, char **s)
     return 0;
 }
 
+int get_buffer_string(struct iarchive *ia, const char **s, int32_t *len)
+{
+    struct buff_struct *priv = ia->priv;
+    int rc = ia_deserialize_int(ia, "len", len);
+    if (rc < 0)
+        return rc;
+    if (*len < 0) {
+        return -EINVAL;
+    }
+    if ((priv->len - priv->off) < *len) {
+        return -E2BIG;
+    }
+    *s = priv->buffer+priv->off;
+    priv->off += *len;
+    return 0;
+}
+
 static struct iarchive ia_default = {
         ia_start_record,
         ia_end_record,
@@ -364,3 +381,95 @@ int get_buffer_len(struct oarchive *oa)
     struct buff_struct *buff = oa->priv;
     return buff->off;
 }
+
+static int fa_write(struct oarchive *oa, const void *p, int32_t n)
+{
+    struct fixed_oarchive *foa = oa->priv;
+    if (foa->buffer) {
+        if ((foa->len - foa->off) < n)
+            return -E2BIG;
+        memcpy(foa->buffer+foa->off, p, n);
+    }
+    foa->off += n;
+    return 0;
+}
+static int fa_serialize_int(struct oarchive *oa, const char *tag,
+        const int32_t *d)
+{
+    int32_t i = htonl(*d);
+    return fa_write(oa, &i, sizeof(i));
+}
+static int fa_serialize_long(struct oarchive *oa, const char *tag,
+        const int64_t *d)
+{
+    const int64_t i = htonll(*d);
+    return fa_write(oa, &i, sizeof(i));
+}
+static int fa_start_vector(struct oarchive *oa, const char *tag,
+        const int32_t *count)
+{
+    return fa_serialize_int(oa, tag, count);
+}
+static int fa_serialize_bool(struct oarchive *oa, const char *name,
+        const int32_t *i)
+{
+    char c = (*i == 0 ? '\0' : '\1');
+    return fa_write(oa, &c, 1);
+}
+static int fa_serialize_buffer(struct oarchive *oa, const char *name,
+        const struct buffer *b)
+{
+    int rc;
+    if (!b) {
+        return fa_serialize_int(oa, "len", &negone);
+    }
+    rc = fa_serialize_int(oa, "len", &b->len);
+    if (rc < 0 || b->len == -1)
+        return rc;
+    return fa_write(oa, b->buff, b->len);
+}
+static int fa_serialize_string(struct oarchive *oa, const char *name, char **s)
+{
+    struct fixed_oarchive *foa = oa->priv;
+    int32_t len;
+    int rc;
+    if (!*s) {
+        return fa_serialize_int(oa, "len", &negone);
+    }
+    len = strlen(*s);
+    if (foa->path_prefix && strcmp(name, "path") == 0) {
+        /* the prefix and the path go in as one string */
+        int32_t total = foa->path_prefix_len;
+        if (len == 1 && **s == '/')
+            len = 0;
+        total += len;
+        rc = fa_serialize_int(oa, "len", &total);
+        rc = rc < 0 ? rc : fa_write(oa, foa->path_prefix,
+                foa->path_prefix_len);
+    } else {
+        rc = fa_serialize_int(oa, "len", &len);
+    }
+    return rc < 0 ? rc : fa_write(oa, *s, len);
+}
+
+static struct oarchive oa_fixed = {
+        oa_start_record,
+        oa_end_record,
+        fa_start_vector,
+        oa_end_vector,
+        fa_serialize_bool,
+        fa_serialize_int,
+        fa_serialize_long,
+        fa_serialize_buffer,
+        fa_serialize_string};
+
+void init_fixed_oarchive(struct fixed_oarchive *foa, char *buffer, int len)
+{
+    foa->oa = oa_fixed;
+    foa->oa.priv = foa;
+    foa->buffer = buffer;
+    foa->len = len;
+    foa->off = 0;
+    foa->path_prefix = 0;
+    foa->path_prefix_len = 0;
+}
@@ -78,7 +78,9 @@ int flush_send_queue(zhandle_t *, int);
 
 int adaptor_send_queue(zhandle_t *zh, int timeout)
 {
-    return flush_send_queue(zh, timeout);
+    int rc = flush_send_queue(zh, timeout);
+    update_loop_interest(zh);
+    return rc;
 }
 
 int32_t inc_ref_counter(zhandle_t* zh,int i)
@@ -87,13 +89,12 @@ int32_t inc_ref_counter(zhandle_t* zh,int i)
     return zh->ref_counter;
 }
 
-int32_t get_xid()
+int32_t get_xid(zhandle_t *zh)
 {
-    static int32_t xid = -1;
-    if (xid == -1) {
-        xid = time(0);
-    }
-    return xid++;
+    // callers build the request header before validating the handle
+    if (zh == 0)
+        return 0;
+    return zh->xid++;
 }
 
 void lock_reconfig(struct _zhandle *zh){}
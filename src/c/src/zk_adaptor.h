@@ -81,6 +81,28 @@ void unlock_buffer_list(buffer_head_t *l);
 void lock_completion_list(completion_head_t *l);
 void unlock_completion_list(completion_head_t *l);
 
+void queue_buffer(buffer_head_t *list, struct _buffer_list *b, int add_to_front);
+struct _buffer_list *dequeue_buffer(buffer_head_t *list);
+
+#define COMPLETION_WATCH -1
+#define COMPLETION_VOID 0
+#define COMPLETION_STAT 1
+#define COMPLETION_DATA 2
+#define COMPLETION_STRINGLIST 3
+#define COMPLETION_STRINGLIST_STAT 4
+#define COMPLETION_ACLLIST 5
+#define COMPLETION_STRING 6
+#define COMPLETION_MULTI 7
+#define COMPLETION_STRING_STAT 8
+
+struct _completion_list *create_completion_entry(int xid, int completion_type,
+        const void *dc, const void *data, watcher_registration_t *wo,
+        completion_head_t *clist);
+void destroy_completion_entry(struct _completion_list *c);
+void queue_completion(completion_head_t *list, struct _completion_list *c,
+        int add_to_front);
+struct _completion_list *dequeue_completion(completion_head_t *list);
+
 struct sync_completion {
     int rc;
     union {
@@ -178,10 +200,15 @@ typedef struct _auth_list_head {
 #endif
 } auth_list_head_t;
 
+/* the zhandle is split into groups of fields written by different threads,
+ * kept apart by a cache line of padding so that they don't false-share */
+#define ZOO_CACHE_LINE 64
+
 /**
  * This structure represents the connection to zookeeper.
  */
 struct _zhandle {
+    // Connection setup and configuration, mostly read after zookeeper_init
 #ifdef WIN32
     SOCKET fd;                          // the descriptor used to talk to zookeeper
 #else
@@ -201,53 +228,86 @@ struct _zhandle {
     int delay;
 
     watcher_fn watcher;                 // the registered watcher
+    void *context;                      // client-side provided context
+    clientid_t client_id;               // client-id
+    int recv_timeout;                   // max receive timeout for messages from server
+    auth_list_head_t auth_h;            // authentication data list
+    void *adaptor_priv;
 
+    // Watchers
+    zk_hashtable* active_node_watchers;   
+    zk_hashtable* active_exist_watchers;
+    zk_hashtable* active_child_watchers;
+
+    /** used for chroot path at the client side **/
+    char *chroot;
+    unsigned int chroot_hash; /* zk_path_hash(chroot), to carry on from */
+    struct zoo_trace_hooks trace;       // request tracing, all zero when off
+
+    char pad_io[ZOO_CACHE_LINE];
+
+    // IO thread working set
     // Message timings
     struct timeval last_recv;           // time last message was received
     struct timeval last_send;           // time last message was sent
     struct timeval last_ping;           // time last PING was sent
     struct timeval next_deadline;       // time of the next deadline
-    int recv_timeout;                   // max receive timeout for messages from server
 
     // Buffers
     buffer_list_t *input_buffer;        // current buffer being read in
     buffer_head_t to_process;           // buffers that have been read and ready to be processed
     buffer_head_t to_send;              // packets queued to send
     completion_head_t sent_requests;    // outstanding requests
-    completion_head_t completions_to_process; // completions that are ready to run
-    int outstanding_sync;               // number of outstanding synchronous requests
 
     // State info
     volatile int state;                 // Current zookeeper state
-    void *context;                      // client-side provided context
-    clientid_t client_id;               // client-id
     long long last_zxid;                // last zookeeper ID
-    auth_list_head_t auth_h;            // authentication data list
+
+    /* Used for debugging only: non-zero value indicates the time when the zookeeper_process
+     * call returned while there was at least one unprocessed server response 
+     * available in the socket recv buffer */
+    struct timeval socket_readable;
+
+    // Counters for zoo_get_stats(), all but the dispatch latency
+    struct zoo_stats stats;
+    int64_t disconnected_us;            // when the connection was lost, 0 when connected
+
+    // Recent connection events for zoo_get_flight_events()
+    struct zoo_flight_event flight[ZOO_FLIGHT_EVENTS];
+    volatile uint32_t flight_next;      // total events recorded
 
     // Primer storage
     struct _buffer_list primer_buffer;  // The buffer used for the handshake at the start of a connection
     struct prime_struct primer_storage; // the connect response
     char primer_storage_buffer[40];     // the true size of primer_storage
 
+#ifndef THREADED
+    // External event loop integration
+    struct zoo_loop_callbacks loop;     // callbacks, all zero when not attached
+    int loop_fd;                        // descriptor last reported to the loop
+    int loop_interest;                  // interest last reported to the loop
+    struct timeval loop_deadline;       // expiry of the loop's armed timer
+#endif
+
+    char pad_completion[ZOO_CACHE_LINE];
+
+    // Completion thread working set
+    completion_head_t completions_to_process; // completions that are ready to run
+    struct zoo_latency dispatch_latency;      // see zoo_stats.dispatch
+
+    char pad_api[ZOO_CACHE_LINE];
+
+    // Written by application threads on every call
+    volatile int32_t xid;               // next request xid, see get_xid()
+    int outstanding_sync;               // number of outstanding synchronous requests
+
     /* zookeeper_close is not reentrant because it de-allocates the zhandler. 
      * This guard variable is used to defer the destruction of zhandle till 
      * right before top-level API call returns to the caller */
     int32_t ref_counter;
     volatile int close_requested;
-    void *adaptor_priv;
-
-    /* Used for debugging only: non-zero value indicates the time when the zookeeper_process
-     * call returned while there was at least one unprocessed server response 
-     * available in the socket recv buffer */
-    struct timeval socket_readable;
 
-    // Watchers
-    zk_hashtable* active_node_watchers;   
-    zk_hashtable* active_exist_watchers;
-    zk_hashtable* active_child_watchers;
-
-    /** used for chroot path at the client side **/
-    char *chroot;
+    char pad_end[ZOO_CACHE_LINE];
 };
 
 
@@ -262,8 +322,7 @@ int adaptor_send_queue(zhandle_t *zh, int timeout);
 int process_async(int outstanding_sync);
 void process_completions(zhandle_t *zh);
 int flush_send_queue(zhandle_t*zh, int timeout);
-char* sub_string(zhandle_t *zh, const char* server_path);
-void free_duplicate_path(const char* free_path, const char* path);
+const char* sub_string(zhandle_t *zh, const char* server_path);
 void zoo_lock_auth(zhandle_t *zh);
 void zoo_unlock_auth(zhandle_t *zh);
 
@@ -278,7 +337,7 @@ void leave_critical(zhandle_t* zh);
 // zhandle object reference counting
 void api_prolog(zhandle_t* zh);
 int api_epilog(zhandle_t *zh, int rc);
-int32_t get_xid();
+int32_t get_xid(zhandle_t *zh);
 
 // returns the new value of the ref counter
 int32_t inc_ref_counter(zhandle_t* zh,int i);
@@ -292,6 +351,27 @@ int32_t fetch_and_add(volatile int32_t* operand, int incr);
 // in single-threaded mode process session event immediately
 //#define PROCESS_SESSION_EVENT(zh,newstate) deliverWatchers(zh,ZOO_SESSION_EVENT,newstate,0)
 #define PROCESS_SESSION_EVENT(zh,newstate) queue_session_event(zh,newstate)
+// tell an attached event loop about changes caused by queueing requests
+void update_loop_interest(zhandle_t *zh);
+#endif
+
+#ifdef ZOO_CALL_COUNTING
+// see zoo_get_call_counts(); the interposed calls are in zk_call_wrappers.c
+extern int64_t call_counters[ZOO_ENTRIES][ZOO_CALLS];
+extern __thread int call_entry;
+int enter_call_entry(int entry);
+void leave_call_entry(int *saved);
+// charges the calls made until the enclosing block is left to entry; must
+// come first among the block's declarations
+#define COUNT_CALLS_AS(entry) \
+    int count_calls_saved_ __attribute__((cleanup(leave_call_entry))) = \
+        enter_call_entry(entry)
+// charges the rest of the thread's calls to entry
+#define COUNT_THREAD_CALLS_AS(entry) (call_entry = (entry))
+#else
+// expands to a declaration so it can lead the declarations
+#define COUNT_CALLS_AS(entry) enum { count_calls_entry_ = (entry) }
+#define COUNT_THREAD_CALLS_AS(entry) ((void)0)
 #endif
 
 #ifdef __cplusplus
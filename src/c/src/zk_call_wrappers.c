@@ -0,0 +1,134 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The calls counted by zoo_get_call_counts(). The shared libraries are
+ * linked with --wrap for each of them (see CALL_WRAPPERS in Makefile.am),
+ * so the library's own references to send() and the like come here and
+ * the real function is reached as __real_send(). Only the library is
+ * affected: the application's calls go straight to libc.
+ */
+
+#include "zk_adaptor.h"
+
+#include <netdb.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#define COUNT_CALL(call) \
+    __sync_fetch_and_add(&call_counters[call_entry][call], 1)
+
+ssize_t __real_send(int s, const void *buf, size_t len, int flags);
+ssize_t __real_recv(int s, void *buf, size_t len, int flags);
+int __real_poll(struct pollfd *fds, nfds_t nfds, int timeout);
+ssize_t __real_read(int fd, void *buf, size_t count);
+ssize_t __real_write(int fd, const void *buf, size_t count);
+int __real_gettimeofday(struct timeval *tv, void *tz);
+int __real_clock_gettime(clockid_t clock, struct timespec *ts);
+int __real_getaddrinfo(const char *node, const char *service,
+        const struct addrinfo *hints, struct addrinfo **res);
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+char *__real_strdup(const char *s);
+
+ssize_t __wrap_send(int s, const void *buf, size_t len, int flags)
+{
+    COUNT_CALL(ZOO_CALL_SEND);
+    return __real_send(s, buf, len, flags);
+}
+
+ssize_t __wrap_recv(int s, void *buf, size_t len, int flags)
+{
+    COUNT_CALL(ZOO_CALL_RECV);
+    return __real_recv(s, buf, len, flags);
+}
+
+int __wrap_poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    COUNT_CALL(ZOO_CALL_POLL);
+    return __real_poll(fds, nfds, timeout);
+}
+
+ssize_t __wrap_read(int fd, void *buf, size_t count)
+{
+    COUNT_CALL(ZOO_CALL_READ);
+    return __real_read(fd, buf, count);
+}
+
+ssize_t __wrap_write(int fd, const void *buf, size_t count)
+{
+    COUNT_CALL(ZOO_CALL_WRITE);
+    return __real_write(fd, buf, count);
+}
+
+int __wrap_gettimeofday(struct timeval *tv, void *tz)
+{
+    COUNT_CALL(ZOO_CALL_GETTIMEOFDAY);
+    return __real_gettimeofday(tv, tz);
+}
+
+int __wrap_clock_gettime(clockid_t clock, struct timespec *ts)
+{
+    COUNT_CALL(ZOO_CALL_CLOCK_GETTIME);
+    return __real_clock_gettime(clock, ts);
+}
+
+int __wrap_getaddrinfo(const char *node, const char *service,
+        const struct addrinfo *hints, struct addrinfo **res)
+{
+    COUNT_CALL(ZOO_CALL_GETADDRINFO);
+    return __real_getaddrinfo(node, service, hints, res);
+}
+
+void *__wrap_malloc(size_t size)
+{
+    COUNT_CALL(ZOO_CALL_MALLOC);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    COUNT_CALL(ZOO_CALL_CALLOC);
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    COUNT_CALL(ZOO_CALL_REALLOC);
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr)
+{
+    COUNT_CALL(ZOO_CALL_FREE);
+    __real_free(ptr);
+}
+
+/* libc's strdup() allocates without going through the wrappers */
+char *__wrap_strdup(const char *s)
+{
+    COUNT_CALL(ZOO_CALL_MALLOC);
+    return __real_strdup(s);
+}
@@ -0,0 +1,154 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DLL_EXPORT
+#  define USE_STATIC_LIB
+#endif
+
+#include "zookeeper_epoll.h"
+#include "zookeeper_log.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+struct zoo_epoll {
+    zhandle_t *zh;
+    int epfd;
+    int timerfd;
+    /* the epoll_data.ptr values of our two registrations */
+    char sock_tag;
+    char timer_tag;
+};
+
+static void fd_changed(zhandle_t *zh, int oldfd, int newfd, int interest,
+        void *context)
+{
+    zoo_epoll_t *ep = context;
+    struct epoll_event ev;
+
+    /* the socket is always watched for both directions, edge-triggered, so
+     * only a new descriptor needs to touch the epoll set */
+    if (oldfd == newfd && oldfd != -1)
+        return;
+    if (oldfd != -1 && epoll_ctl(ep->epfd, EPOLL_CTL_DEL, oldfd, 0) < 0
+            && errno != EBADF && errno != ENOENT) {
+        LOG_WARN(("epoll_ctl(DEL, %d) failed: %s", oldfd, strerror(errno)));
+    }
+    if (newfd != -1) {
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        ev.data.ptr = &ep->sock_tag;
+        if (epoll_ctl(ep->epfd, EPOLL_CTL_ADD, newfd, &ev) < 0) {
+            LOG_ERROR(("epoll_ctl(ADD, %d) failed: %s", newfd,
+                    strerror(errno)));
+        }
+    }
+}
+
+static void deadline_changed(zhandle_t *zh, int timeout_ms, void *context)
+{
+    zoo_epoll_t *ep = context;
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    if (timeout_ms == 0) {
+        /* an all-zero it_value would disarm the timer */
+        its.it_value.tv_nsec = 1;
+    } else if (timeout_ms > 0) {
+        its.it_value.tv_sec = timeout_ms / 1000;
+        its.it_value.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    }
+    if (timerfd_settime(ep->timerfd, 0, &its, 0) < 0) {
+        LOG_ERROR(("timerfd_settime failed: %s", strerror(errno)));
+    }
+}
+
+zoo_epoll_t *zoo_epoll_attach(zhandle_t *zh, int epfd)
+{
+    struct zoo_loop_callbacks cb;
+    struct epoll_event ev;
+    zoo_epoll_t *ep;
+
+    if (zh == 0 || epfd < 0) {
+        errno = EINVAL;
+        return 0;
+    }
+    ep = calloc(1, sizeof(*ep));
+    if (ep == 0) {
+        errno = ENOMEM;
+        return 0;
+    }
+    ep->zh = zh;
+    ep->epfd = epfd;
+    ep->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+    if (ep->timerfd < 0) {
+        free(ep);
+        return 0;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = &ep->timer_tag;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, ep->timerfd, &ev) < 0) {
+        int err = errno;
+        close(ep->timerfd);
+        free(ep);
+        errno = err;
+        return 0;
+    }
+
+    cb.fd_changed = fd_changed;
+    cb.deadline_changed = deadline_changed;
+    cb.context = ep;
+    zoo_set_loop_callbacks(zh, &cb);
+    return ep;
+}
+
+int zoo_epoll_process(zoo_epoll_t *ep, const struct epoll_event *ev)
+{
+    if (ev->data.ptr == &ep->sock_tag) {
+        int events = 0;
+        if (ev->events & (EPOLLIN|EPOLLHUP|EPOLLERR))
+            events |= ZOOKEEPER_READ;
+        if (ev->events & EPOLLOUT)
+            events |= ZOOKEEPER_WRITE;
+        zookeeper_dispatch(ep->zh, events);
+        return 1;
+    }
+    if (ev->data.ptr == &ep->timer_tag) {
+        uint64_t expirations;
+        while (read(ep->timerfd, &expirations, sizeof(expirations)) > 0)
+            ;
+        zookeeper_dispatch(ep->zh, 0);
+        return 1;
+    }
+    return 0;
+}
+
+void zoo_epoll_detach(zoo_epoll_t *ep)
+{
+    if (ep == 0)
+        return;
+    zoo_set_loop_callbacks(ep->zh, 0);
+    epoll_ctl(ep->epfd, EPOLL_CTL_DEL, ep->timerfd, 0);
+    close(ep->timerfd);
+    free(ep);
+}
@@ -64,17 +64,21 @@ watcher_object_t* clone_watcher_object(watcher_object_t* wo)
     return res;
 }
 
-static unsigned int string_hash_djb2(void *str) 
+unsigned int zk_path_hash(const char *path)
 {
-    unsigned int hash = 5381;
+    unsigned int hash = ZK_PATH_HASH_SEED;
     int c;
-    const char* cstr = (const char*)str;
-    while ((c = *cstr++))
-        hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+    while ((c = *path++))
+        hash = ZK_PATH_HASH_STEP(hash, c); /* hash * 33 + c */
 
     return hash;
 }
 
+static unsigned int string_hash_djb2(void *str) 
+{
+    return zk_path_hash((const char*)str);
+}
+
 static int string_equal(void *key1,void *key2)
 {
     return strcmp((const char*)key1,(const char*)key2)==0;
@@ -177,16 +181,18 @@ static int add_to_list(watcher_object_list_t **wl, watcher_object_t *wo,
     return 0;
 }
 
-static int do_insert_watcher_object(zk_hashtable *ht, const char *path, watcher_object_t* wo)
+static int do_insert_watcher_object(zk_hashtable *ht, const char *path,
+        unsigned int hash, watcher_object_t* wo)
 {
     int res=1;
     watcher_object_list_t* wl;
 
-    wl=hashtable_search(ht->ht,(void*)path);
+    wl=hashtable_search_hash(ht->ht,(void*)path,hash);
     if(wl==0){
         int res;
         /* inserting a new path element */
-        res=hashtable_insert(ht->ht,strdup(path),create_watcher_object_list(wo));
+        res=hashtable_insert_hash(ht->ht,strdup(path),
+                create_watcher_object_list(wo),hash);
         assert(res);
     }else{
         /*
@@ -218,10 +224,10 @@ char **collect_keys(zk_hashtable *ht, int *count)
 }
 
 static int insert_watcher_object(zk_hashtable *ht, const char *path,
-                                 watcher_object_t* wo)
+                                 unsigned int hash, watcher_object_t* wo)
 {
     int res;
-    res=do_insert_watcher_object(ht,path,wo);
+    res=do_insert_watcher_object(ht,path,hash,wo);
     return res;
 }
 
@@ -257,10 +263,11 @@ static void collect_session_watchers(zhandle_t *zh,
     copy_table(zh->active_child_watchers, *list);
 }
 
-static void add_for_event(zk_hashtable *ht, char *path, watcher_object_list_t **list)
+static void add_for_event(zk_hashtable *ht, char *path, unsigned int hash,
+        watcher_object_list_t **list)
 {
     watcher_object_list_t* wl;
-    wl = (watcher_object_list_t*)hashtable_remove(ht->ht, path);
+    wl = (watcher_object_list_t*)hashtable_remove_hash(ht->ht, path, hash);
     if (wl) {
         copy_watchers(wl, *list, 0);
         // Since we move, not clone the watch_objects, we just need to free the
@@ -279,12 +286,12 @@ static void do_foreach_watcher(watcher_object_t* wo,zhandle_t* zh,
         wo->watcher(zh,type,state,client_path,wo->context);
         wo=wo->next;
     }    
-    free_duplicate_path(client_path, path);
 }
 
 watcher_object_list_t *collectWatchers(zhandle_t *zh,int type, char *path)
 {
     struct watcher_object_list *list = create_watcher_object_list(0); 
+    unsigned int hash;
 
     if(type==ZOO_SESSION_EVENT){
         watcher_object_t defWatcher;
@@ -294,22 +301,24 @@ watcher_object_list_t *collectWatchers(zhandle_t *zh,int type, char *path)
         collect_session_watchers(zh, &list);
         return list;
     }
+    // hashed once for all the tables the event is looked up in
+    hash = zk_path_hash(path);
     switch(type){
     case CREATED_EVENT_DEF:
     case CHANGED_EVENT_DEF:
         // look up the watchers for the path and move them to a delivery list
-        add_for_event(zh->active_node_watchers,path,&list);
-        add_for_event(zh->active_exist_watchers,path,&list);
+        add_for_event(zh->active_node_watchers,path,hash,&list);
+        add_for_event(zh->active_exist_watchers,path,hash,&list);
         break;
     case CHILD_EVENT_DEF:
         // look up the watchers for the path and move them to a delivery list
-        add_for_event(zh->active_child_watchers,path,&list);
+        add_for_event(zh->active_child_watchers,path,hash,&list);
         break;
     case DELETED_EVENT_DEF:
         // look up the watchers for the path and move them to a delivery list
-        add_for_event(zh->active_node_watchers,path,&list);
-        add_for_event(zh->active_exist_watchers,path,&list);
-        add_for_event(zh->active_child_watchers,path,&list);
+        add_for_event(zh->active_node_watchers,path,hash,&list);
+        add_for_event(zh->active_exist_watchers,path,hash,&list);
+        add_for_event(zh->active_child_watchers,path,hash,&list);
         break;
     }
     return list;
@@ -330,7 +339,7 @@ void activateWatcher(zhandle_t *zh, watcher_registration_t* reg, int rc)
          * by the IO thread */
         zk_hashtable *ht = reg->checker(zh, rc);
         if(ht){
-            insert_watcher_object(ht,reg->path,
+            insert_watcher_object(ht,reg->path,reg->hash,
                     create_watcher_object(reg->watcher, reg->context));
         }
     }    
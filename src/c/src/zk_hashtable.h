@@ -36,6 +36,18 @@ typedef struct _zk_hashtable zk_hashtable;
  */
 typedef zk_hashtable *(*result_checker_fn)(zhandle_t *, int rc);
 
+/**
+ * The hash the tables keep a path under is djb2, which goes over the path
+ * a byte at a time: starting from ZK_PATH_HASH_SEED, each byte c (as a char)
+ * takes the hash h to ZK_PATH_HASH_STEP(h, c). The hash of a path can thus
+ * be carried on from that of its prefix, or worked out while going over the
+ * path for something else.
+ */
+#define ZK_PATH_HASH_SEED 5381
+#define ZK_PATH_HASH_STEP(h, c) (((h) << 5) + (h) + (c))
+
+unsigned int zk_path_hash(const char *path);
+
 /**
  * A watcher object gets temporarily stored with the completion entry until 
  * the server response comes back at which moment the watcher object is moved
@@ -46,6 +58,7 @@ typedef struct _watcher_registration {
     void* context;
     result_checker_fn checker;
     const char* path;
+    unsigned int hash; /* zk_path_hash(path), worked out when it was checked */
 } watcher_registration_t;
 
 zk_hashtable* create_zk_hashtable();
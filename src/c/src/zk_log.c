@@ -21,15 +21,27 @@
 #endif
 
 #include "zookeeper_log.h"
+#include "zk_log_record.h"
 #ifndef WIN32
 #include <unistd.h>
 #endif
 
 #include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
 #include <time.h>
 
-#define TIME_NOW_BUF_SIZE 1024
+#define TIME_NOW_BUF_SIZE 32
 #define FORMAT_LOG_BUF_SIZE 4096
+/* room for the timestamp, pid, thread, level, function and line */
+#define LOG_PREFIX_SIZE 256
+
+/* the text of the current second, so that a line only costs a strftime()
+ * when the second changes */
+struct log_time {
+    time_t sec;
+    char text[TIME_NOW_BUF_SIZE];
+};
 
 #ifdef THREADED
 #ifndef WIN32
@@ -63,17 +75,26 @@ char* getTSData(pthread_key_t key,int size){
     return p;
 }
 
-char* get_time_buffer(){
-    return getTSData(time_now_buffer,TIME_NOW_BUF_SIZE);
+static struct log_time* get_time_buffer(){
+    return (struct log_time*)getTSData(time_now_buffer,
+            sizeof(struct log_time));
 }
 
 char* get_format_log_buffer(){  
     return getTSData(format_log_msg_buffer,FORMAT_LOG_BUF_SIZE);
 }
+
+static unsigned long thread_id(){
+#ifdef WIN32
+    return (unsigned long int)(pthread_self().thread_id);
 #else
-char* get_time_buffer(){
-    static char buf[TIME_NOW_BUF_SIZE];
-    return buf;    
+    return (unsigned long int)pthread_self();
+#endif
+}
+#else
+static struct log_time* get_time_buffer(){
+    static struct log_time buf;
+    return &buf;
 }
 
 char* get_format_log_buffer(){
@@ -86,6 +107,9 @@ char* get_format_log_buffer(){
 ZooLogLevel logLevel=ZOO_LOG_LEVEL_INFO;
 
 static FILE* logStream=0;
+static log_callback_fn logCallback=0;
+static void* logCallbackContext=0;
+
 FILE* getLogStream(){
     if(logStream==0)
         logStream=stderr;
@@ -96,57 +120,306 @@ void zoo_set_log_stream(FILE* stream){
     logStream=stream;
 }
 
-static const char* time_now(char* now_str){
-    struct timeval tv;
+void zoo_set_log_callback(log_callback_fn callback, void *context){
+    logCallbackContext=context;
+    logCallback=callback;
+}
+
+static const char* time_now(struct log_time* now, time_t sec){
     struct tm lt;
-    time_t now = 0;
-    size_t len = 0;
-    
-    gettimeofday(&tv,0);
 
-    now = tv.tv_sec;
-    localtime_r(&now, &lt);
+    if (now->sec == sec && now->text[0] != 0)
+        return now->text;
+    localtime_r(&sec, &lt);
 
     // clone the format used by log4j ISO8601DateFormat
-    // specifically: "yyyy-MM-dd HH:mm:ss,SSS"
-
-    len = strftime(now_str, TIME_NOW_BUF_SIZE,
-                          "%Y-%m-%d %H:%M:%S",
-                          &lt);
-
-    len += snprintf(now_str + len,
-                    TIME_NOW_BUF_SIZE - len,
-                    ",%03d",
-                    (int)(tv.tv_usec/1000));
+    // specifically: "yyyy-MM-dd HH:mm:ss,SSS"; the milliseconds are added
+    // by format_log_line()
+    strftime(now->text, sizeof(now->text), "%Y-%m-%d %H:%M:%S", &lt);
+    now->sec = sec;
+    return now->text;
+}
 
-    return now_str;
+static pid_t log_pid(){
+    static pid_t pid=0;
+    if(pid==0)pid=getpid();
+    return pid;
 }
 
-void log_message(ZooLogLevel curLevel,int line,const char* funcName,
-    const char* message)
+static void format_log_line(char* buf, size_t size, struct log_time* now,
+        const struct timeval* tv, unsigned long thread, ZooLogLevel curLevel,
+        const char* funcName, int line, const char* message)
 {
     static const char* dbgLevelStr[]={"ZOO_INVALID","ZOO_ERROR","ZOO_WARN",
             "ZOO_INFO","ZOO_DEBUG"};
-    static pid_t pid=0;
-#ifdef WIN32
-    char timebuf [TIME_NOW_BUF_SIZE];
-#endif
-    if(pid==0)pid=getpid();
 #ifndef THREADED
-    fprintf(LOGSTREAM, "%s:%d:%s@%s@%d: %s\n", time_now(get_time_buffer()),pid,
+    snprintf(buf, size, "%s,%03d:%d:%s@%s@%d: %s",
+            time_now(now, tv->tv_sec), (int)(tv->tv_usec/1000), log_pid(),
             dbgLevelStr[curLevel],funcName,line,message);
 #else
+    snprintf(buf, size, "%s,%03d:%d(0x%lx):%s@%s@%d: %s",
+            time_now(now, tv->tv_sec), (int)(tv->tv_usec/1000), log_pid(),
+            thread,dbgLevelStr[curLevel],funcName,line,message);
+#endif
+}
+
+/* hands a formatted line to the callback, or writes it to the stream */
+static void write_log_line(ZooLogLevel curLevel, const char* line, int flush)
+{
+    log_callback_fn callback=logCallback;
+    if (callback) {
+        callback(curLevel, line, logCallbackContext);
+        return;
+    }
+    fprintf(LOGSTREAM, "%s\n", line);
+    if (flush)
+        fflush(LOGSTREAM);
+}
+
+#ifdef THREADED
+/*
+ * The asynchronous backend. Logging threads claim a slot of a bounded ring
+ * with a compare-and-swap and copy their message into it; a single writer
+ * thread formats and writes the lines. Each slot's sequence number tells
+ * whose turn it is: equal to the claim position when free, one past it once
+ * filled. A full ring drops the message rather than block the caller.
+ */
+#define ASYNC_MESSAGE_SIZE 512
+
+#ifndef WIN32
+#define ATOMIC_ADD(p, v) __sync_fetch_and_add(p, v)
+#define ATOMIC_CAS(p, o, n) __sync_bool_compare_and_swap(p, o, n)
+#define MEMORY_BARRIER() __sync_synchronize()
+#else
+#define ATOMIC_ADD(p, v) InterlockedExchangeAdd(p, v)
+#define ATOMIC_CAS(p, o, n) (InterlockedCompareExchange(p, n, o) == (o))
+#define MEMORY_BARRIER() MemoryBarrier()
+#endif
+
+struct log_slot {
+    volatile int32_t seq;
+    ZooLogLevel level;
+    int line;
+    const char* funcName;
+    unsigned long thread;
+    struct timeval tv;
+    char message[ASYNC_MESSAGE_SIZE];
+};
+
+static struct log_slot* ring=0;
+static int32_t ring_mask;
+static volatile int32_t ring_head;      // next position to claim
+static int32_t ring_tail;               // next position to write, writer only
+static volatile int32_t async_active=0;
+static volatile int32_t producers=0;    // threads inside async_log()
+static volatile int32_t dropped=0;      // since the writer last reported
+static volatile int64_t dropped_total=0;
+static volatile int writer_idle=0;
+static volatile int writer_stop=0;
+static pthread_t writer;
+static pthread_mutex_t writer_lock;
+static pthread_cond_t writer_cond;
+
+/* returns 0 if the writer isn't running and the caller must log itself */
+static int async_log(ZooLogLevel curLevel, int line, const char* funcName,
+        const char* message)
+{
+    struct log_slot* slot;
+    int32_t pos;
+
+    ATOMIC_ADD(&producers, 1);
+    if (!async_active) {
+        ATOMIC_ADD(&producers, -1);
+        return 0;
+    }
+    pos = ring_head;
+    for (;;) {
+        int32_t diff;
+        slot = &ring[pos & ring_mask];
+        diff = slot->seq - pos;
+        if (diff == 0) {
+            if (ATOMIC_CAS(&ring_head, pos, pos + 1))
+                break;
+        } else if (diff < 0) {
+            ATOMIC_ADD(&dropped, 1);
+            ATOMIC_ADD(&producers, -1);
+            return 1;
+        }
+        pos = ring_head;
+    }
+    slot->level = curLevel;
+    slot->line = line;
+    slot->funcName = funcName;
+    slot->thread = thread_id();
+    gettimeofday(&slot->tv, 0);
+    strncpy(slot->message, message, ASYNC_MESSAGE_SIZE - 1);
+    slot->message[ASYNC_MESSAGE_SIZE - 1] = 0;
+    MEMORY_BARRIER();
+    slot->seq = pos + 1;
+    /* pairs with the barrier in the writer between going idle and looking
+     * at the ring once more */
+    MEMORY_BARRIER();
+    if (writer_idle) {
+        pthread_mutex_lock(&writer_lock);
+        pthread_cond_signal(&writer_cond);
+        pthread_mutex_unlock(&writer_lock);
+    }
+    ATOMIC_ADD(&producers, -1);
+    return 1;
+}
+
+static int ring_empty()
+{
+    return ring[ring_tail & ring_mask].seq != ring_tail + 1;
+}
+
+/* writes out whatever is in the ring; returns the number of lines */
+static int drain_ring(struct log_time* now)
+{
+    char buf[ASYNC_MESSAGE_SIZE + LOG_PREFIX_SIZE];
+    int32_t lost;
+    int n = 0;
+
+    while (!ring_empty()) {
+        struct log_slot* slot = &ring[ring_tail & ring_mask];
+        MEMORY_BARRIER();
+        format_log_line(buf, sizeof(buf), now, &slot->tv, slot->thread,
+                slot->level, slot->funcName, slot->line, slot->message);
+        MEMORY_BARRIER();
+        slot->seq = ring_tail + ring_mask + 1;
+        ring_tail++;
+        write_log_line(slot->level, buf, 0);
+        n++;
+    }
+    lost = dropped;
+    if (lost != 0) {
+        char note[64];
+        struct timeval tv;
+        ATOMIC_ADD(&dropped, -lost);
+        dropped_total += lost;
+        gettimeofday(&tv, 0);
+        snprintf(note, sizeof(note), "dropped %d log messages", lost);
+        format_log_line(buf, sizeof(buf), now, &tv, thread_id(),
+                ZOO_LOG_LEVEL_WARN, __func__, __LINE__, note);
+        write_log_line(ZOO_LOG_LEVEL_WARN, buf, 0);
+        n++;
+    }
+    return n;
+}
+
 #ifdef WIN32
-    fprintf(LOGSTREAM, "%s:%d(0x%lx):%s@%s@%d: %s\n", time_now(timebuf),pid,
-            (unsigned long int)(pthread_self().thread_id),
-            dbgLevelStr[curLevel],funcName,line,message);      
+static unsigned __stdcall log_writer(void* v)
 #else
-    fprintf(LOGSTREAM, "%s:%d(0x%lx):%s@%s@%d: %s\n", time_now(get_time_buffer()),pid,
-            (unsigned long int)pthread_self(),
-            dbgLevelStr[curLevel],funcName,line,message);      
+static void* log_writer(void* v)
 #endif
+{
+    struct log_time now;
+    now.sec = 0;
+    now.text[0] = 0;
+    while (!writer_stop) {
+        if (drain_ring(&now) != 0) {
+            if (!logCallback)
+                fflush(LOGSTREAM);
+            continue;
+        }
+        pthread_mutex_lock(&writer_lock);
+        writer_idle = 1;
+        MEMORY_BARRIER();
+        if (ring_empty() && dropped == 0 && !writer_stop)
+            pthread_cond_wait(&writer_cond, &writer_lock);
+        writer_idle = 0;
+        pthread_mutex_unlock(&writer_lock);
+    }
+    drain_ring(&now);
+    if (!logCallback)
+        fflush(LOGSTREAM);
+    return 0;
+}
+
+static void stop_writer()
+{
+    async_active = 0;
+    MEMORY_BARRIER();
+    while (producers != 0)
+        MEMORY_BARRIER();
+    pthread_mutex_lock(&writer_lock);
+    writer_stop = 1;
+    pthread_cond_signal(&writer_cond);
+    pthread_mutex_unlock(&writer_lock);
+    pthread_join(writer, 0);
+    pthread_cond_destroy(&writer_cond);
+    pthread_mutex_destroy(&writer_lock);
+    free(ring);
+    ring = 0;
+}
+
+int zoo_set_log_async(int capacity)
+{
+    int32_t size = 16;
+    int32_t i;
+
+    if (capacity < 0)
+        return ZBADARGUMENTS;
+    if (ring)
+        stop_writer();
+    if (capacity == 0)
+        return ZOK;
+    while (size < capacity && size < (1 << 20))
+        size <<= 1;
+    ring = calloc(size, sizeof(*ring));
+    if (!ring)
+        return ZSYSTEMERROR;
+    for (i = 0; i < size; i++)
+        ring[i].seq = i;
+    ring_mask = size - 1;
+    ring_head = 0;
+    ring_tail = 0;
+    writer_idle = 0;
+    writer_stop = 0;
+    pthread_mutex_init(&writer_lock, 0);
+    pthread_cond_init(&writer_cond, 0);
+    if (pthread_create(&writer, 0, log_writer, 0) != 0) {
+        pthread_cond_destroy(&writer_cond);
+        pthread_mutex_destroy(&writer_lock);
+        free(ring);
+        ring = 0;
+        return ZSYSTEMERROR;
+    }
+    async_active = 1;
+    return ZOK;
+}
+
+int64_t zoo_get_log_dropped(void)
+{
+    return dropped_total + dropped;
+}
+#else
+int zoo_set_log_async(int capacity)
+{
+    return capacity == 0 ? ZOK : ZUNIMPLEMENTED;
+}
+
+int64_t zoo_get_log_dropped(void)
+{
+    return 0;
+}
 #endif
-    fflush(LOGSTREAM);
+
+void log_message(ZooLogLevel curLevel,int line,const char* funcName,
+    const char* message)
+{
+    char buf[FORMAT_LOG_BUF_SIZE + LOG_PREFIX_SIZE];
+    struct timeval tv;
+    unsigned long thread = 0;
+#ifdef THREADED
+    if (async_log(curLevel, line, funcName, message))
+        return;
+    thread = thread_id();
+#endif
+    gettimeofday(&tv,0);
+    format_log_line(buf, sizeof(buf), get_time_buffer(), &tv, thread,
+            curLevel, funcName, line, message);
+    write_log_line(curLevel, buf, 1);
 }
 
 const char* format_log_message(const char* format,...)
@@ -162,6 +435,195 @@ const char* format_log_message(const char* format,...)
     return buf;
 }
 
+FILE* logBinaryStream=0;
+
+/* format strings and function names already defined in the binary stream,
+ * by address; a collision only costs a repeated definition */
+#define LOG_SEEN_SLOTS 1024
+static const char* volatile logSeen[LOG_SEEN_SLOTS];
+
+/* the packed buffer starts with the bytes used and the format's address */
+#define PACK_HEADER_SIZE (sizeof(uint32_t) + sizeof(uint64_t))
+
+void zoo_set_log_binary(FILE* stream)
+{
+    FILE* old=logBinaryStream;
+    logBinaryStream=0;
+    if (old)
+        fflush(old);
+    memset((void*)logSeen, 0, sizeof(logSeen));
+    if (stream) {
+        struct log_file_header fh;
+        fh.magic=LOG_FILE_MAGIC;
+        fh.version=LOG_FILE_VERSION;
+        fwrite(&fh, sizeof(fh), 1, stream);
+    }
+    logBinaryStream=stream;
+}
+
+static char* pack_arg(char* p, char* end, char tag, const void* v, size_t len)
+{
+    if (p == 0 || (size_t)(end - p) < len + 1)
+        return 0;
+    *p++ = tag;
+    memcpy(p, v, len);
+    return p + len;
+}
+
+static char* pack_string(char* p, char* end, const char* s)
+{
+    size_t len = s ? strlen(s) : 6;
+    uint16_t n;
+    if (p == 0 || end - p < 3)
+        return 0;
+    if (len > (size_t)(end - p) - 3)
+        len = (end - p) - 3;
+    if (len > 0xffff)
+        len = 0xffff;
+    n = (uint16_t)len;
+    *p++ = LOG_ARG_STR;
+    memcpy(p, &n, sizeof(n));
+    memcpy(p + sizeof(n), s ? s : "(null)", len);
+    return p + sizeof(n) + len;
+}
+
+/*
+ * The binary counterpart of format_log_message(): rather than formatting,
+ * it copies the arguments the format string calls for into the thread's
+ * buffer, for log_record() to write out. Arguments that don't fit are left
+ * out.
+ */
+const char* pack_log_message(const char* format,...)
+{
+    va_list va;
+    char* buf=get_format_log_buffer();
+    char* end=buf+FORMAT_LOG_BUF_SIZE;
+    char* p;
+    char* last;
+    const char* f=format;
+    uint64_t id=(uintptr_t)format;
+    uint32_t used;
+
+    if(!buf)
+        return 0;
+    memcpy(buf + sizeof(used), &id, sizeof(id));
+    p=last=buf+PACK_HEADER_SIZE;
+    va_start(va,format);
+    while (p && (f=strchr(f, '%')) != 0) {
+        struct log_spec spec;
+        int i;
+        f=parse_log_spec(f + 1, &spec);
+        for (i = 0; i < spec.stars; i++) {
+            int32_t v=va_arg(va, int);
+            p=pack_arg(p, end, LOG_ARG_INT, &v, sizeof(v));
+        }
+        switch (spec.conv) {
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+            if (spec.length == LOG_LEN_NONE) {
+                int32_t v=va_arg(va, int);
+                p=pack_arg(p, end, LOG_ARG_INT, &v, sizeof(v));
+            } else {
+                int64_t v;
+                switch (spec.length) {
+                case LOG_LEN_LONG: v=va_arg(va, long); break;
+                case LOG_LEN_MAX: v=va_arg(va, intmax_t); break;
+                case LOG_LEN_SIZE: v=va_arg(va, size_t); break;
+                case LOG_LEN_PTRDIFF: v=va_arg(va, ptrdiff_t); break;
+                default: v=va_arg(va, long long); break;
+                }
+                p=pack_arg(p, end, LOG_ARG_LONG, &v, sizeof(v));
+            }
+            break;
+        case 'e': case 'E': case 'f': case 'F':
+        case 'g': case 'G': case 'a': case 'A': {
+            double v=spec.length == LOG_LEN_LONG_DOUBLE ?
+                (double)va_arg(va, long double) : va_arg(va, double);
+            p=pack_arg(p, end, LOG_ARG_DOUBLE, &v, sizeof(v));
+            break;
+        }
+        case 's':
+            p=pack_string(p, end, va_arg(va, const char*));
+            break;
+        case 'p': {
+            uint64_t v=(uintptr_t)va_arg(va, void*);
+            p=pack_arg(p, end, LOG_ARG_PTR, &v, sizeof(v));
+            break;
+        }
+        case 'n':
+            (void)va_arg(va, int*);
+            break;
+        default:
+            break;
+        }
+        if (p)
+            last=p;
+    }
+    va_end(va);
+    used=(uint32_t)(last - buf);
+    memcpy(buf, &used, sizeof(used));
+    return buf;
+}
+
+static void define_log_string(FILE* out, const char* s)
+{
+    char rec[sizeof(struct log_record_header) + FORMAT_LOG_BUF_SIZE];
+    struct log_record_header h;
+    size_t slot=((uintptr_t)s >> 3) & (LOG_SEEN_SLOTS - 1);
+    size_t len;
+
+    if (logSeen[slot] == s)
+        return;
+    len=strlen(s);
+    if (len > FORMAT_LOG_BUF_SIZE)
+        len=FORMAT_LOG_BUF_SIZE;
+    h.size=(uint32_t)(sizeof(h) + len);
+    h.type=LOG_RECORD_STRING;
+    h.id=(uintptr_t)s;
+    memcpy(rec, &h, sizeof(h));
+    memcpy(rec + sizeof(h), s, len);
+    fwrite(rec, 1, h.size, out);
+    logSeen[slot]=s;
+}
+
+void log_record(ZooLogLevel curLevel, int line, const char* funcName,
+    const char* packed)
+{
+    char rec[sizeof(struct log_message_header) + FORMAT_LOG_BUF_SIZE];
+    FILE* out=logBinaryStream;
+    struct log_message_header m;
+    struct timeval tv;
+    uint32_t used;
+
+    if (!out || !packed)
+        return;
+    memcpy(&used, packed, sizeof(used));
+    memcpy(&m.format, packed + sizeof(used), sizeof(m.format));
+    define_log_string(out, (const char*)(uintptr_t)m.format);
+    define_log_string(out, funcName);
+
+    gettimeofday(&tv, 0);
+    m.h.size=(uint32_t)(sizeof(m) + used - PACK_HEADER_SIZE);
+    m.h.type=LOG_RECORD_MESSAGE;
+    m.h.id=0;
+    m.func=(uintptr_t)funcName;
+    m.time_us=(int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+#ifdef THREADED
+    m.thread=thread_id();
+#else
+    m.thread=0;
+#endif
+    m.pid=log_pid();
+    m.line=line;
+    m.level=curLevel;
+    m.pad=0;
+    // a single write, so that records from different threads don't mix
+    memcpy(rec, &m, sizeof(m));
+    memcpy(rec + sizeof(m), packed + PACK_HEADER_SIZE, used - PACK_HEADER_SIZE);
+    fwrite(rec, 1, m.h.size, out);
+    if (curLevel == ZOO_LOG_LEVEL_ERROR)
+        fflush(out);
+}
+
 void zoo_set_debug_level(ZooLogLevel level)
 {
     if(level==0){
@@ -0,0 +1,127 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ZK_LOG_RECORD_H_
+#define ZK_LOG_RECORD_H_
+
+/*
+ * The binary log format written by zoo_set_log_binary() and read by
+ * zk_logdecode. A file starts with a log_file_header and is followed by
+ * records, each starting with a log_record_header. Everything is in the
+ * writer's byte order; the magic number tells a reader if that isn't its
+ * own.
+ *
+ * Format strings and function names are not repeated in every message.
+ * They are identified by their address, and a STRING record defines the
+ * text for an address before its first use (and possibly again later).
+ *
+ * A MESSAGE record is followed by its arguments, each a one byte tag and
+ * a value: LOG_ARG_INT a 32 bit integer, LOG_ARG_LONG a 64 bit integer,
+ * LOG_ARG_DOUBLE a double, LOG_ARG_PTR a 64 bit address and LOG_ARG_STR
+ * a 16 bit length and that many bytes.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#define LOG_FILE_MAGIC 0x5a4b4c47 /* "ZKLG" */
+#define LOG_FILE_VERSION 1
+
+#define LOG_RECORD_STRING 1
+#define LOG_RECORD_MESSAGE 2
+
+#define LOG_ARG_INT 'i'
+#define LOG_ARG_LONG 'l'
+#define LOG_ARG_DOUBLE 'd'
+#define LOG_ARG_PTR 'p'
+#define LOG_ARG_STR 's'
+
+struct log_file_header {
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct log_record_header {
+    uint32_t size;      /* of the whole record, this header included */
+    uint32_t type;      /* LOG_RECORD_* */
+    uint64_t id;        /* STRING: the address the text is for */
+};
+
+struct log_message_header {
+    struct log_record_header h;
+    uint64_t format;    /* the address of the format string */
+    uint64_t func;      /* the address of the function name */
+    int64_t time_us;    /* wall clock time */
+    uint64_t thread;
+    int32_t pid;
+    int32_t line;
+    int32_t level;
+    int32_t pad;
+};
+
+/* length modifiers of a printf conversion, as far as the arguments go */
+#define LOG_LEN_NONE 0
+#define LOG_LEN_LONG 1          /* l */
+#define LOG_LEN_LONG_LONG 2     /* ll, q */
+#define LOG_LEN_MAX 3           /* j */
+#define LOG_LEN_SIZE 4          /* z */
+#define LOG_LEN_PTRDIFF 5       /* t */
+#define LOG_LEN_LONG_DOUBLE 6   /* L */
+
+struct log_spec {
+    int stars;          /* '*' widths and precisions, each taking an int */
+    int length;         /* LOG_LEN_* */
+    char conv;          /* the conversion character, or 0 at the end */
+};
+
+/* Parses the printf conversion that follows a '%' and returns a pointer
+ * just past it. "%%" comes back with conv '%'. */
+static inline const char *parse_log_spec(const char *p, struct log_spec *spec)
+{
+    spec->stars = 0;
+    spec->length = LOG_LEN_NONE;
+    while (*p && strchr("-+ #0'", *p))
+        p++;
+    for (; *p == '*' || (*p >= '0' && *p <= '9') || *p == '.'; p++)
+        if (*p == '*')
+            spec->stars++;
+    for (;; p++) {
+        if (*p == 'h') {
+            continue;
+        } else if (*p == 'l') {
+            spec->length = spec->length == LOG_LEN_LONG ?
+                LOG_LEN_LONG_LONG : LOG_LEN_LONG;
+        } else if (*p == 'q') {
+            spec->length = LOG_LEN_LONG_LONG;
+        } else if (*p == 'j') {
+            spec->length = LOG_LEN_MAX;
+        } else if (*p == 'z') {
+            spec->length = LOG_LEN_SIZE;
+        } else if (*p == 't') {
+            spec->length = LOG_LEN_PTRDIFF;
+        } else if (*p == 'L') {
+            spec->length = LOG_LEN_LONG_DOUBLE;
+        } else {
+            break;
+        }
+    }
+    spec->conv = *p;
+    return *p ? p + 1 : p;
+}
+
+#endif /*ZK_LOG_RECORD_H_*/
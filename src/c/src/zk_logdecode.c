@@ -0,0 +1,320 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Turns the binary records written by zoo_set_log_binary() back into the
+ * log lines the library would have written as text.
+ *
+ *   zk_logdecode [file]
+ *
+ * reads the file, or standard input, and writes the lines to standard
+ * output.
+ */
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "zk_log_record.h"
+#include "hashtable/hashtable.h"
+
+static struct hashtable *strings;
+
+static unsigned int id_hash(void *key)
+{
+    uint64_t id = *(uint64_t *)key;
+    return (unsigned int)(id ^ (id >> 32));
+}
+
+static int id_equal(void *a, void *b)
+{
+    return *(uint64_t *)a == *(uint64_t *)b;
+}
+
+static void define_string(uint64_t id, const char *text, size_t len)
+{
+    uint64_t *key = malloc(sizeof(*key));
+    char *value = malloc(len + 1);
+    *key = id;
+    memcpy(value, text, len);
+    value[len] = 0;
+    free(hashtable_remove(strings, key));
+    hashtable_insert(strings, key, value);
+}
+
+static const char *lookup_string(uint64_t id)
+{
+    const char *s = hashtable_search(strings, &id);
+    return s ? s : "?";
+}
+
+/* the next argument, or 0 if there is none of the expected kind */
+static const char *next_arg(const char *p, const char *end, char tag,
+        void *value, size_t len)
+{
+    if (p == 0 || p + 1 + len > end || *p != tag)
+        return 0;
+    memcpy(value, p + 1, len);
+    return p + 1 + len;
+}
+
+/* formats a single conversion, given the spec without its length
+ * modifiers, the length to use, the conversion character, the values of
+ * any '*' widths and the argument itself */
+static void format_one(char *out, size_t size, const char *spec,
+        size_t spec_len, const char *length, char conv, int stars,
+        const int *star, ...)
+{
+    char fmt[80];
+    size_t n = spec_len + strlen(length);
+    va_list va;
+
+    if (n + 2 > sizeof(fmt)) {
+        snprintf(out, size, "?");
+        return;
+    }
+    memcpy(fmt, spec, spec_len);
+    strcpy(fmt + spec_len, length);
+    fmt[n] = conv;
+    fmt[n + 1] = 0;
+    va_start(va, star);
+    if (stars == 0) {
+        vsnprintf(out, size, fmt, va);
+    } else if (conv == 's') {
+        const char *v = va_arg(va, const char *);
+        if (stars == 1)
+            snprintf(out, size, fmt, star[0], v);
+        else
+            snprintf(out, size, fmt, star[0], star[1], v);
+    } else if (conv == 'p') {
+        void *v = va_arg(va, void *);
+        if (stars == 1)
+            snprintf(out, size, fmt, star[0], v);
+        else
+            snprintf(out, size, fmt, star[0], star[1], v);
+    } else if (strchr("eEfFgGaA", conv)) {
+        double v = va_arg(va, double);
+        if (stars == 1)
+            snprintf(out, size, fmt, star[0], v);
+        else
+            snprintf(out, size, fmt, star[0], star[1], v);
+    } else if (length[0]) {
+        long long v = va_arg(va, long long);
+        if (stars == 1)
+            snprintf(out, size, fmt, star[0], v);
+        else
+            snprintf(out, size, fmt, star[0], star[1], v);
+    } else {
+        int v = va_arg(va, int);
+        if (stars == 1)
+            snprintf(out, size, fmt, star[0], v);
+        else
+            snprintf(out, size, fmt, star[0], star[1], v);
+    }
+    va_end(va);
+}
+
+/* appends the format string filled in with the packed arguments */
+static void format_message(char *out, size_t size, const char *format,
+        const char *p, const char *end)
+{
+    size_t n = 0;
+    char one[4096];
+
+    while (*format && n + 1 < size) {
+        struct log_spec spec;
+        const char *start;
+        char bare[64];
+        size_t bare_len = 0;
+        int star[2] = {0, 0};
+        int i;
+
+        if (*format != '%') {
+            out[n++] = *format++;
+            continue;
+        }
+        start = format;
+        format = parse_log_spec(format + 1, &spec);
+        if (spec.conv == '%') {
+            out[n++] = '%';
+            continue;
+        }
+        /* the spec without its length modifiers, which depend on the
+         * width of the argument as recorded */
+        for (; start < format - 1 && bare_len < sizeof(bare) - 1; start++)
+            if (!strchr("hlqjztL", *start))
+                bare[bare_len++] = *start;
+        for (i = 0; i < spec.stars; i++) {
+            int32_t v = 0;
+            p = next_arg(p, end, LOG_ARG_INT, &v, sizeof(v));
+            if (i < 2)
+                star[i] = v;
+        }
+        one[0] = 0;
+        if (spec.stars > 2)
+            p = 0;
+        switch (spec.conv) {
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+            if (p && *p == LOG_ARG_LONG) {
+                int64_t v;
+                p = next_arg(p, end, LOG_ARG_LONG, &v, sizeof(v));
+                if (p)
+                    format_one(one, sizeof(one), bare, bare_len, "ll",
+                            spec.conv, spec.stars, star, (long long)v);
+            } else {
+                int32_t v;
+                p = next_arg(p, end, LOG_ARG_INT, &v, sizeof(v));
+                if (p)
+                    format_one(one, sizeof(one), bare, bare_len, "",
+                            spec.conv, spec.stars, star, (int)v);
+            }
+            break;
+        case 'e': case 'E': case 'f': case 'F':
+        case 'g': case 'G': case 'a': case 'A': {
+            double v;
+            p = next_arg(p, end, LOG_ARG_DOUBLE, &v, sizeof(v));
+            if (p)
+                format_one(one, sizeof(one), bare, bare_len, "", spec.conv,
+                        spec.stars, star, v);
+            break;
+        }
+        case 's': {
+            uint16_t len;
+            char s[0x10000];
+            if (p && p + 1 + sizeof(len) <= end && *p == LOG_ARG_STR) {
+                memcpy(&len, p + 1, sizeof(len));
+                p += 1 + sizeof(len);
+                if (p + len <= end) {
+                    memcpy(s, p, len);
+                    s[len] = 0;
+                    p += len;
+                    format_one(one, sizeof(one), bare, bare_len, "", 's',
+                            spec.stars, star, s);
+                } else {
+                    p = 0;
+                }
+            } else {
+                p = 0;
+            }
+            break;
+        }
+        case 'p': {
+            uint64_t v;
+            p = next_arg(p, end, LOG_ARG_PTR, &v, sizeof(v));
+            if (p)
+                format_one(one, sizeof(one), bare, bare_len, "", 'p',
+                        spec.stars, star, (void *)(uintptr_t)v);
+            break;
+        }
+        case 'n':
+            continue;
+        default:
+            p = 0;
+            break;
+        }
+        if (!p)
+            snprintf(one, sizeof(one), "?");
+        for (i = 0; one[i] && n + 1 < size; i++)
+            out[n++] = one[i];
+    }
+    out[n] = 0;
+}
+
+static void print_message(const struct log_message_header *m,
+        const char *args, const char *end)
+{
+    static const char *level_str[] = {"ZOO_INVALID", "ZOO_ERROR", "ZOO_WARN",
+            "ZOO_INFO", "ZOO_DEBUG"};
+    char when[32];
+    char thread[32];
+    char message[8192];
+    time_t sec = (time_t)(m->time_us / 1000000);
+    struct tm lt;
+
+    localtime_r(&sec, &lt);
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &lt);
+    format_message(message, sizeof(message), lookup_string(m->format),
+            args, end);
+    if (m->thread == 0)
+        thread[0] = 0;  /* the single-threaded library */
+    else
+        snprintf(thread, sizeof(thread), "(0x%llx)",
+                (unsigned long long)m->thread);
+    printf("%s,%03d:%d%s:%s@%s@%d: %s\n", when,
+            (int)(m->time_us % 1000000 / 1000), m->pid, thread,
+            level_str[m->level >= 1 && m->level <= 4 ? m->level : 0],
+            lookup_string(m->func), m->line, message);
+}
+
+int main(int argc, char **argv)
+{
+    FILE *in = stdin;
+    struct log_file_header fh;
+    struct log_record_header h;
+    char *rec = 0;
+    size_t cap = 0;
+
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [file]\n", argv[0]);
+        return 2;
+    }
+    if (argc == 2 && (in = fopen(argv[1], "rb")) == 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    if (fread(&fh, sizeof(fh), 1, in) != 1 || fh.magic != LOG_FILE_MAGIC) {
+        fprintf(stderr, "not a binary log, or written with a different "
+                "byte order\n");
+        return 1;
+    }
+    if (fh.version != LOG_FILE_VERSION) {
+        fprintf(stderr, "unknown binary log version %u\n", fh.version);
+        return 1;
+    }
+    strings = create_hashtable(256, id_hash, id_equal);
+
+    while (fread(&h, sizeof(h), 1, in) == 1) {
+        if (h.size < sizeof(h)) {
+            fprintf(stderr, "corrupt record\n");
+            return 1;
+        }
+        if (h.size > cap) {
+            cap = h.size;
+            rec = realloc(rec, cap);
+        }
+        memcpy(rec, &h, sizeof(h));
+        if (fread(rec + sizeof(h), h.size - sizeof(h), 1, in) != 1
+                && h.size > sizeof(h)) {
+            fprintf(stderr, "truncated record\n");
+            return 1;
+        }
+        if (h.type == LOG_RECORD_STRING) {
+            define_string(h.id, rec + sizeof(h), h.size - sizeof(h));
+        } else if (h.type == LOG_RECORD_MESSAGE
+                && h.size >= sizeof(struct log_message_header)) {
+            struct log_message_header m;
+            memcpy(&m, rec, sizeof(m));
+            print_message(&m, rec + sizeof(m), rec + h.size);
+        }
+    }
+    hashtable_destroy(strings, 1);
+    free(rec);
+    return 0;
+}
@@ -40,6 +40,7 @@
 #include <assert.h>
 #include <stdarg.h>
 #include <limits.h>
+#include <stddef.h>
 
 #ifndef WIN32
 #include <sys/time.h>
@@ -137,17 +138,6 @@ struct ACL_vector ZOO_OPEN_ACL_UNSAFE = { 1, _OPEN_ACL_UNSAFE_ACL};
 struct ACL_vector ZOO_READ_ACL_UNSAFE = { 1, _READ_ACL_UNSAFE_ACL};
 struct ACL_vector ZOO_CREATOR_ALL_ACL = { 1, _CREATOR_ALL_ACL_ACL};
 
-#define COMPLETION_WATCH -1
-#define COMPLETION_VOID 0
-#define COMPLETION_STAT 1
-#define COMPLETION_DATA 2
-#define COMPLETION_STRINGLIST 3
-#define COMPLETION_STRINGLIST_STAT 4
-#define COMPLETION_ACLLIST 5
-#define COMPLETION_STRING 6
-#define COMPLETION_MULTI 7
-#define COMPLETION_STRING_STAT 8
-
 typedef struct _auth_completion_list {
     void_completion_t completion;
     const char *auth_data;
@@ -172,6 +162,11 @@ typedef struct completion {
 
 typedef struct _completion_list {
     int xid;
+    int op;             /* the request's operation code, for the stats */
+    int64_t stamp;      /* when the request was queued, then when its reply
+                           was read, in microseconds; 0 for a faked reply */
+    int traced;         /* reported to the trace hooks when it was queued */
+    char *trace_path;   /* the path for the trace hooks, or NULL */
     completion_t c;
     const void *data;
     buffer_list_t *buffer;
@@ -188,17 +183,11 @@ static void deserialize_response(int type, int xid, int failed, int rc, completi
 static int deserialize_multi(int xid, completion_list_t *cptr, struct iarchive *ia);
 
 /* completion routine forward declarations */
-static int add_completion(zhandle_t *zh, int xid, int completion_type,
+static int add_completion(zhandle_t *zh, int xid, int op, int completion_type,
         const void *dc, const void *data, int add_to_front,
         watcher_registration_t* wo, completion_head_t *clist);
-static completion_list_t* create_completion_entry(int xid, int completion_type,
-        const void *dc, const void *data, watcher_registration_t* wo,
-        completion_head_t *clist);
-static void destroy_completion_entry(completion_list_t* c);
 static void queue_completion_nolock(completion_head_t *list, completion_list_t *c,
         int add_to_front);
-static void queue_completion(completion_head_t *list, completion_list_t *c,
-        int add_to_front);
 static int handle_socket_error_msg(zhandle_t *zh, int line, int rc,
     const char* format,...);
 static void cleanup_bufs(zhandle_t *zh,int callCompletion,int rc);
@@ -208,7 +197,87 @@ static int disable_conn_permute=0; // permute enabled by default
 static __attribute__((unused)) void print_completion_queue(zhandle_t *zh);
 
 static void *SYNCHRONOUS_MARKER = (void*)&SYNCHRONOUS_MARKER;
-static int isValidPath(const char* path, const int flags);
+
+/* what checking a path finds out about it on the way */
+struct path_scan {
+    int32_t len;            /* of the path as given */
+    unsigned int hash;      /* zk_path_hash() of the server's path */
+};
+
+static int isValidPath(const char* path, const int flags,
+        unsigned int seed, struct path_scan *scan);
+
+static int64_t timeval_usecs(const struct timeval *tv)
+{
+    return (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+/* only ever called by the one thread that owns the histogram */
+static void record_latency(struct zoo_latency *l, int64_t us)
+{
+    int i = 0;
+    if (us < 0)
+        us = 0;
+    while (i < ZOO_LATENCY_BUCKETS - 1 && (us >> i) != 0)
+        i++;
+    l->buckets[i]++;
+    l->count++;
+    l->total_us += us;
+    if (us > l->max_us)
+        l->max_us = us;
+}
+
+/* Events come from the IO thread, apart from the odd one recorded while it
+ * isn't running, so the recorder takes no lock. */
+static void record_flight(zhandle_t *zh, int type, int64_t v0, int64_t v1,
+        const char *text)
+{
+    struct zoo_flight_event *e =
+            &zh->flight[zh->flight_next % ZOO_FLIGHT_EVENTS];
+    struct timeval now;
+    gettimeofday(&now, 0);
+    e->time_us = timeval_usecs(&now);
+    e->type = type;
+    e->values[0] = v0;
+    e->values[1] = v1;
+    e->text[0] = 0;
+    if (text) {
+        strncpy(e->text, text, sizeof(e->text) - 1);
+        e->text[sizeof(e->text) - 1] = 0;
+    }
+    zh->flight_next++;
+}
+
+static int64_t monotonic_nsecs(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return timeval_usecs(&tv) * 1000;
+#endif
+}
+
+/* callers test zh->trace.trace first so that tracing costs nothing when off;
+ * it is read again here in case the hooks were cleared in between */
+static void trace_event(zhandle_t *zh, int stage, int32_t xid, int op,
+        const char *path, int rc)
+{
+    struct zoo_trace_hooks hooks = zh->trace;
+    struct zoo_trace_event ev;
+    if (!hooks.trace)
+        return;
+    ev.stage = stage;
+    ev.xid = xid;
+    ev.op = op;
+    ev.path = path;
+    ev.rc = rc;
+    ev.time_ns = monotonic_nsecs();
+    hooks.trace(zh, &ev, hooks.context);
+}
 
 #ifdef _WINDOWS
 static int zookeeper_send(SOCKET s, const void* buf, int len)
@@ -892,6 +961,241 @@ struct sockaddr* zookeeper_get_connected_host(zhandle_t *zh,
     return addr;
 }
 
+static int32_t count_buffers(buffer_head_t *list)
+{
+    buffer_list_t *b;
+    int32_t n = 0;
+    lock_buffer_list(list);
+    for (b = list->head; b; b = b->next)
+        n++;
+    unlock_buffer_list(list);
+    return n;
+}
+
+static int32_t count_completions(completion_head_t *list)
+{
+    completion_list_t *c;
+    int32_t n = 0;
+    lock_completion_list(list);
+    for (c = list->head; c; c = c->next)
+        n++;
+    unlock_completion_list(list);
+    return n;
+}
+
+int zoo_get_stats(zhandle_t *zh, struct zoo_stats *stats)
+{
+    if (zh == 0 || stats == 0)
+        return ZBADARGUMENTS;
+    *stats = zh->stats;
+    stats->dispatch = zh->dispatch_latency;
+    stats->send_queue = count_buffers(&zh->to_send);
+    stats->pending_requests = count_completions(&zh->sent_requests);
+    stats->completion_queue = count_completions(&zh->completions_to_process);
+    return ZOK;
+}
+
+int64_t zoo_latency_percentile(const struct zoo_latency *latency, double q)
+{
+    int64_t target, seen = 0;
+    int i;
+    if (latency == 0 || latency->count == 0)
+        return 0;
+    target = (int64_t)(q * latency->count + 0.5);
+    if (target < 1)
+        target = 1;
+    for (i = 0; i < ZOO_LATENCY_BUCKETS - 1; i++) {
+        seen += latency->buckets[i];
+        if (seen >= target)
+            break;
+    }
+    if (i == ZOO_LATENCY_BUCKETS - 1 || ((int64_t)1 << i) > latency->max_us)
+        return latency->max_us;
+    return (int64_t)1 << i;
+}
+
+int zoo_get_flight_events(zhandle_t *zh, struct zoo_flight_event *events,
+        int count)
+{
+    uint32_t first, next, last, i;
+    int n = 0, lost;
+    if (zh == 0 || events == 0 || count < 0)
+        return ZBADARGUMENTS;
+    next = zh->flight_next;
+    first = next > ZOO_FLIGHT_EVENTS ? next - ZOO_FLIGHT_EVENTS : 0;
+    if (next - first > (uint32_t)count)
+        first = next - count;
+    for (i = first; i != next; i++)
+        events[n++] = zh->flight[i % ZOO_FLIGHT_EVENTS];
+    /* drop what the IO thread may have overwritten while we copied */
+    last = zh->flight_next;
+    if (last - first > ZOO_FLIGHT_EVENTS) {
+        lost = last - first - ZOO_FLIGHT_EVENTS;
+        if (lost > n)
+            lost = n;
+        memmove(events, events + lost, (n - lost) * sizeof(*events));
+        n -= lost;
+    }
+    return n;
+}
+
+static void format_flight_event(const struct zoo_flight_event *e, char *buf,
+        size_t len)
+{
+    char when[32];
+    time_t sec = (time_t)(e->time_us / 1000000);
+    struct tm lt;
+    int n;
+
+    localtime_r(&sec, &lt);
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &lt);
+    n = snprintf(buf, len, "%s,%03d ", when,
+            (int)(e->time_us % 1000000 / 1000));
+    if (n < 0 || (size_t)n >= len)
+        return;
+    buf += n;
+    len -= n;
+    switch (e->type) {
+    case ZOO_FLIGHT_STATE:
+        snprintf(buf, len, "state %s", state2String((int)e->values[0]));
+        break;
+    case ZOO_FLIGHT_SERVER:
+        snprintf(buf, len, "connecting to %s", e->text);
+        break;
+    case ZOO_FLIGHT_PING:
+        snprintf(buf, len, "ping took %lldus", (long long)e->values[0]);
+        break;
+    case ZOO_FLIGHT_OVERRUN:
+        snprintf(buf, len, "exceeded deadline by %lldms",
+                (long long)e->values[0]);
+        break;
+    case ZOO_FLIGHT_QUEUES:
+        snprintf(buf, len, "%lld requests to send, %lld awaiting a reply",
+                (long long)e->values[0], (long long)e->values[1]);
+        break;
+    case ZOO_FLIGHT_ERROR:
+        snprintf(buf, len, "error %s, errno=%lld: %s",
+                zerror((int)e->values[0]), (long long)e->values[1], e->text);
+        break;
+    default:
+        snprintf(buf, len, "unknown event %d", e->type);
+        break;
+    }
+}
+
+int zoo_dump_flight_recorder(zhandle_t *zh, FILE *out)
+{
+    struct zoo_flight_event events[ZOO_FLIGHT_EVENTS];
+    char line[256];
+    int i, n;
+    if (zh == 0)
+        return ZBADARGUMENTS;
+    n = zoo_get_flight_events(zh, events, ZOO_FLIGHT_EVENTS);
+    for (i = 0; i < n; i++) {
+        format_flight_event(&events[i], line, sizeof(line));
+        if (out) {
+            fprintf(out, "%s\n", line);
+        } else {
+            LOG_WARN(("flight recorder sessionId=%#llx: %s",
+                    zh->client_id.client_id, line));
+        }
+    }
+    if (out)
+        fflush(out);
+    return ZOK;
+}
+
+int zoo_set_trace_hooks(zhandle_t *zh, const struct zoo_trace_hooks *hooks)
+{
+    if (zh == 0)
+        return ZBADARGUMENTS;
+    if (hooks == 0)
+        memset(&zh->trace, 0, sizeof(zh->trace));
+    else
+        zh->trace = *hooks;
+    return ZOK;
+}
+
+static const char *call_names[ZOO_CALLS] = {"send", "recv", "poll", "read",
+    "write", "gettimeofday", "clock_gettime", "getaddrinfo", "malloc",
+    "calloc", "realloc", "free"};
+static const char *entry_names[ZOO_ENTRIES] = {"other", "init", "close",
+    "interest", "process", "io_thread", "completion_thread", "create",
+    "delete", "exists", "get", "set", "get_children", "get_acl", "set_acl",
+    "sync", "multi", "getconfig", "reconfig", "add_auth"};
+
+#ifdef ZOO_CALL_COUNTING
+int64_t call_counters[ZOO_ENTRIES][ZOO_CALLS];
+__thread int call_entry;
+
+/* operations keep their calls when they call each other */
+int enter_call_entry(int entry)
+{
+    int saved = call_entry;
+    if (saved < ZOO_ENTRY_CREATE)
+        call_entry = entry;
+    return saved;
+}
+
+void leave_call_entry(int *saved)
+{
+    call_entry = *saved;
+}
+#endif
+
+int zoo_get_call_counts(struct zoo_call_counts *counts)
+{
+    if (counts == 0)
+        return ZBADARGUMENTS;
+#ifdef ZOO_CALL_COUNTING
+    memcpy(counts->calls, call_counters, sizeof(counts->calls));
+    return ZOK;
+#else
+    memset(counts, 0, sizeof(*counts));
+    return ZUNIMPLEMENTED;
+#endif
+}
+
+void zoo_reset_call_counts(void)
+{
+#ifdef ZOO_CALL_COUNTING
+    memset(call_counters, 0, sizeof(call_counters));
+#endif
+}
+
+const char *zoo_call_name(int call)
+{
+    return call >= 0 && call < ZOO_CALLS ? call_names[call] : 0;
+}
+
+const char *zoo_entry_name(int entry)
+{
+    return entry >= 0 && entry < ZOO_ENTRIES ? entry_names[entry] : 0;
+}
+
+int zoo_dump_call_counts(const struct zoo_call_counts *counts, FILE *out)
+{
+    int i, j;
+    if (counts == 0 || out == 0)
+        return ZBADARGUMENTS;
+    fprintf(out, "%-18s", "calls");
+    for (j = 0; j < ZOO_CALLS; j++)
+        fprintf(out, " %9.9s", call_names[j]);
+    fprintf(out, "\n");
+    for (i = 0; i < ZOO_ENTRIES; i++) {
+        for (j = 0; j < ZOO_CALLS && counts->calls[i][j] == 0; j++)
+            ;
+        if (j == ZOO_CALLS)
+            continue;
+        fprintf(out, "%-18s", entry_names[i]);
+        for (j = 0; j < ZOO_CALLS; j++)
+            fprintf(out, " %9lld", (long long)counts->calls[i][j]);
+        fprintf(out, "\n");
+    }
+    fflush(out);
+    return ZOK;
+}
+
 static void log_env() {
   char buf[2048];
 #ifdef HAVE_SYS_UTSNAME_H
@@ -958,6 +1262,7 @@ static void log_env() {
 zhandle_t *zookeeper_init(const char *host, watcher_fn watcher,
   int recv_timeout, const clientid_t *clientid, void *context, int flags)
 {
+    COUNT_CALLS_AS(ZOO_ENTRY_INIT);
     int errnosave = 0;
     zhandle_t *zh = NULL;
     char *index_chroot = NULL;
@@ -989,6 +1294,7 @@ zhandle_t *zookeeper_init(const char *host, watcher_fn watcher,
     zh->state = ZOO_NOTCONNECTED_STATE;
     zh->context = context;
     zh->recv_timeout = recv_timeout;
+    zh->xid = time(0);
     init_auth_info(&zh->auth_h);
     if (watcher) {
        zh->watcher = watcher;
@@ -1021,9 +1327,13 @@ zhandle_t *zookeeper_init(const char *host, watcher_fn watcher,
         zh->chroot = NULL;
         zh->hostname = strdup(host);
     }
-    if (zh->chroot && !isValidPath(zh->chroot, 0)) {
-        errno = EINVAL;
-        goto abort;
+    if (zh->chroot) {
+        struct path_scan scan;
+        if (!isValidPath(zh->chroot, 0, ZK_PATH_HASH_SEED, &scan)) {
+            errno = EINVAL;
+            goto abort;
+        }
+        zh->chroot_hash = scan.hash;
     }
     if (zh->hostname == 0) {
         goto abort;
@@ -1191,52 +1501,42 @@ const char* zoo_get_current_server(zhandle_t* zh)
 }
 
 /**
- * deallocated the free_path only its beeen allocated
- * and not equal to path
+   strip off the chroot string from a server path of len bytes, which need
+   not be NUL terminated, and return where the client path starts in it.
+   The chroot itself comes back as "/". Nothing is allocated.
  */
-void free_duplicate_path(const char *free_path, const char* path) {
-    if (free_path != path) {
-        free((void*)free_path);
+static const char* strip_chroot(zhandle_t *zh, const char* server_path,
+        int32_t *len)
+{
+    int32_t chroot_len;
+    if (zh->chroot == NULL)
+        return server_path;
+    chroot_len = strlen(zh->chroot);
+    //ZOOKEEPER-1027
+    if (*len < chroot_len ||
+            strncmp(server_path, zh->chroot, chroot_len) != 0) {
+        LOG_ERROR(("server path %.*s does not include chroot path %s",
+                   (int) *len, server_path, zh->chroot));
+        return server_path;
     }
-}
-
-/**
-  prepend the chroot path if available else return the path
-*/
-static char* prepend_string(zhandle_t *zh, const char* client_path) {
-    char *ret_str;
-    if (zh == NULL || zh->chroot == NULL)
-        return (char *) client_path;
-    // handle the chroot itself, client_path = "/"
-    if (strlen(client_path) == 1) {
-        return strdup(zh->chroot);
+    if (*len == chroot_len) {
+        *len = 1;
+        return "/";
     }
-    ret_str = (char *) malloc(strlen(zh->chroot) + strlen(client_path) + 1);
-    strcpy(ret_str, zh->chroot);
-    return strcat(ret_str, client_path);
+    *len -= chroot_len;
+    return server_path + chroot_len;
 }
 
 /**
    strip off the chroot string from the server path
    if there is one else return the exact path
  */
-char* sub_string(zhandle_t *zh, const char* server_path) {
-    char *ret_str;
+const char* sub_string(zhandle_t *zh, const char* server_path) {
+    int32_t len;
     if (zh->chroot == NULL)
-        return (char *) server_path;
-    //ZOOKEEPER-1027
-    if (strncmp(server_path, zh->chroot, strlen(zh->chroot)) != 0) {
-        LOG_ERROR(("server path %s does not include chroot path %s",
-                   server_path, zh->chroot));
-        return (char *) server_path;
-    }
-    if (strlen(server_path) == strlen(zh->chroot)) {
-        //return "/"
-        ret_str = strdup("/");
-        return ret_str;
-    }
-    ret_str = strdup(server_path + strlen(zh->chroot));
-    return ret_str;
+        return server_path;
+    len = strlen(server_path);
+    return strip_chroot(zh, server_path, &len);
 }
 
 static buffer_list_t *allocate_buffer(char *buff, int len)
@@ -1252,18 +1552,46 @@ static buffer_list_t *allocate_buffer(char *buff, int len)
     return buffer;
 }
 
+/* A request encoded in place: the list entry, the length prefix and the
+ * serialized record share a single allocation, so the prefix goes out in
+ * the same send as the body. */
+struct request_buffer {
+    buffer_list_t list;
+    int32_t prefix;
+    char body[1];
+};
+#define REQUEST_BUFFER_HDR offsetof(struct request_buffer, body)
+
+static int is_request_buffer(buffer_list_t *b)
+{
+    return b->buffer == (char*)b + REQUEST_BUFFER_HDR;
+}
+
+static buffer_list_t *allocate_request_buffer(int len)
+{
+    struct request_buffer *r = malloc(REQUEST_BUFFER_HDR + len);
+    if (r == 0)
+        return 0;
+    r->list.buffer = r->body;
+    r->list.len = len;
+    r->list.curr_offset = 0;
+    r->list.next = 0;
+    r->prefix = htonl(len);
+    return &r->list;
+}
+
 static void free_buffer(buffer_list_t *b)
 {
     if (!b) {
         return;
     }
-    if (b->buffer) {
+    if (b->buffer && !is_request_buffer(b)) {
         free(b->buffer);
     }
     free(b);
 }
 
-static buffer_list_t *dequeue_buffer(buffer_head_t *list)
+buffer_list_t *dequeue_buffer(buffer_head_t *list)
 {
     buffer_list_t *b;
     lock_buffer_list(list);
@@ -1289,7 +1617,7 @@ static int remove_buffer(buffer_head_t *list)
     return 1;
 }
 
-static void queue_buffer(buffer_head_t *list, buffer_list_t *b, int add_to_front)
+void queue_buffer(buffer_head_t *list, buffer_list_t *b, int add_to_front)
 {
     b->next = 0;
     lock_buffer_list(list);
@@ -1312,21 +1640,164 @@ static void queue_buffer(buffer_head_t *list, buffer_list_t *b, int add_to_front
     unlock_buffer_list(list);
 }
 
-static int queue_buffer_bytes(buffer_head_t *list, char *buff, int len)
+/* an archive that writes the chroot, if any, in front of request paths */
+static void init_request_oarchive(struct fixed_oarchive *oa,
+        const char *chroot, char *buffer, int len)
 {
-    buffer_list_t *b  = allocate_buffer(buff,len);
-    if (!b)
-        return ZSYSTEMERROR;
-    queue_buffer(list, b, 0);
-    return ZOK;
+    init_fixed_oarchive(oa, buffer, len);
+    if (chroot) {
+        oa->path_prefix = chroot;
+        oa->path_prefix_len = strlen(chroot);
+    }
+}
+
+/*
+ * Serializes a request header and body straight into a send buffer of the
+ * exact encoded size. The first pass through a counting archive measures
+ * the record; the second fills the buffer. Neither pass allocates. The
+ * request's path is the client's; the chroot goes in front of it as the
+ * path is written.
+ */
+#define DEFINE_REQUEST_ENCODER(type)                                       \
+static buffer_list_t *encode_##type(const char *chroot,                    \
+        struct RequestHeader *h, struct type *req)                         \
+{                                                                          \
+    struct fixed_oarchive oa;                                              \
+    buffer_list_t *b;                                                      \
+    int rc;                                                                \
+    init_request_oarchive(&oa, chroot, 0, 0);                              \
+    rc = serialize_RequestHeader(&oa.oa, "header", h);                     \
+    rc = rc < 0 ? rc : serialize_##type(&oa.oa, "req", req);               \
+    if (rc < 0 || (b = allocate_request_buffer(oa.off)) == 0)              \
+        return 0;                                                          \
+    init_request_oarchive(&oa, chroot, b->buffer, b->len);                 \
+    rc = serialize_RequestHeader(&oa.oa, "header", h);                     \
+    rc = rc < 0 ? rc : serialize_##type(&oa.oa, "req", req);               \
+    if (rc < 0 || oa.off != b->len) {                                      \
+        free_buffer(b);                                                    \
+        return 0;                                                          \
+    }                                                                      \
+    return b;                                                              \
+}
+
+DEFINE_REQUEST_ENCODER(GetDataRequest)
+DEFINE_REQUEST_ENCODER(SetDataRequest)
+DEFINE_REQUEST_ENCODER(ReconfigRequest)
+DEFINE_REQUEST_ENCODER(CreateRequest)
+DEFINE_REQUEST_ENCODER(Create2Request)
+DEFINE_REQUEST_ENCODER(DeleteRequest)
+DEFINE_REQUEST_ENCODER(ExistsRequest)
+DEFINE_REQUEST_ENCODER(GetChildrenRequest)
+DEFINE_REQUEST_ENCODER(GetChildren2Request)
+DEFINE_REQUEST_ENCODER(SyncRequest)
+DEFINE_REQUEST_ENCODER(GetACLRequest)
+DEFINE_REQUEST_ENCODER(SetACLRequest)
+DEFINE_REQUEST_ENCODER(AuthPacket)
+DEFINE_REQUEST_ENCODER(SetWatches)
+
+/* header-only requests: ping and close */
+static buffer_list_t *encode_RequestHeader(struct RequestHeader *h)
+{
+    struct fixed_oarchive oa;
+    buffer_list_t *b;
+
+    init_fixed_oarchive(&oa, 0, 0);
+    if (serialize_RequestHeader(&oa.oa, "header", h) < 0 ||
+            (b = allocate_request_buffer(oa.off)) == 0)
+        return 0;
+    init_fixed_oarchive(&oa, b->buffer, b->len);
+    if (serialize_RequestHeader(&oa.oa, "header", h) < 0) {
+        free_buffer(b);
+        return 0;
+    }
+    return b;
 }
 
-static int queue_front_buffer_bytes(buffer_head_t *list, char *buff, int len)
+/* Reads the header of an encoded request, and the path most requests
+ * start with, for the trace hooks. The path is returned without the chroot
+ * in memory the caller frees, or NULL if the request has none. */
+static char *read_request_trace(zhandle_t *zh, const char *buf, int len,
+        int32_t *xid, int *op)
 {
-    buffer_list_t *b  = allocate_buffer(buff,len);
-    if (!b)
-        return ZSYSTEMERROR;
-    queue_buffer(list, b, 1);
+    int32_t v;
+    char *path;
+    const char *client_path;
+    if (len < 8) {
+        *xid = 0;
+        *op = 0;
+        return 0;
+    }
+    memcpy(&v, buf, 4);
+    *xid = ntohl(v);
+    memcpy(&v, buf + 4, 4);
+    *op = ntohl(v);
+    switch (*op) {
+    case ZOO_CREATE_OP: case ZOO_DELETE_OP: case ZOO_EXISTS_OP:
+    case ZOO_GETDATA_OP: case ZOO_SETDATA_OP: case ZOO_GETACL_OP:
+    case ZOO_SETACL_OP: case ZOO_GETCHILDREN_OP: case ZOO_SYNC_OP:
+    case ZOO_GETCHILDREN2_OP: case ZOO_CHECK_OP: case ZOO_CREATE2_OP:
+        break;
+    default:
+        return 0;
+    }
+    if (len < 12)
+        return 0;
+    memcpy(&v, buf + 8, 4);
+    v = ntohl(v);
+    if (v < 0 || v > len - 12)
+        return 0;
+    client_path = strip_chroot(zh, buf + 12, &v);
+    path = malloc(v + 1);
+    if (!path)
+        return 0;
+    memcpy(path, client_path, v);
+    path[v] = 0;
+    return path;
+}
+
+/* Reports a request being queued and hands its path to the completion
+ * just added for it, which reports the later stages. Called in the
+ * critical section, after the completion was added. */
+static void trace_queued(zhandle_t *zh, const char *buf, int len)
+{
+    int32_t xid;
+    int op;
+    completion_list_t *c;
+    char *path = read_request_trace(zh, buf, len, &xid, &op);
+
+    trace_event(zh, ZOO_TRACE_QUEUED, xid, op, path, 0);
+    lock_completion_list(&zh->sent_requests);
+    c = zh->sent_requests.last;
+    if (c && c->xid == xid && !c->traced) {
+        c->traced = 1;
+        c->trace_path = path;
+        path = 0;
+    }
+    unlock_completion_list(&zh->sent_requests);
+    free(path);
+}
+
+static void trace_sent(zhandle_t *zh, buffer_list_t *b)
+{
+    int32_t xid;
+    int op;
+    char *path = read_request_trace(zh, b->buffer, b->len, &xid, &op);
+    trace_event(zh, ZOO_TRACE_SENT, xid, op, path, 0);
+    free(path);
+}
+
+/* queues an encoded request, or frees it if the request failed before it
+ * could be queued */
+static int queue_request_buffer(zhandle_t *zh, buffer_list_t *b,
+        int rc, int add_to_front)
+{
+    if (rc < 0 || !b) {
+        free_buffer(b);
+        return rc < 0 ? rc : ZMARSHALLINGERROR;
+    }
+    if (zh->trace.trace)
+        trace_queued(zh, b->buffer, b->len);
+    queue_buffer(&zh->to_send, b, add_to_front);
     return ZOK;
 }
 
@@ -1356,6 +1827,23 @@ static int send_buffer(int fd, buffer_list_t *buff)
     int off = buff->curr_offset;
     int rc = -1;
 
+    if (is_request_buffer(buff)) {
+        /* the length prefix sits right in front of the body */
+        rc = zookeeper_send(fd, buff->buffer - sizeof(buff->len) + off,
+                len + sizeof(buff->len) - off);
+        if (rc == -1) {
+#ifndef _WINDOWS
+            if (errno != EAGAIN) {
+#else
+            if (WSAGetLastError() != WSAEWOULDBLOCK) {
+#endif
+                return -1;
+            }
+            return 0;
+        }
+        buff->curr_offset += rc;
+        return buff->curr_offset == len + sizeof(buff->len);
+    }
     if (off < 4) {
         /* we need to send the length at the beginning */
         int nlen = htonl(len);
@@ -1433,7 +1921,9 @@ static int recv_buffer(int fd, buffer_list_t *buff)
         off = buff->curr_offset;
         if (buff->curr_offset == sizeof(buff->len)) {
             buff->len = ntohl(buff->len);
-            buff->buffer = calloc(1, buff->len);
+            /* one spare byte lets read_watcher_event() terminate the path
+             * in place */
+            buff->buffer = calloc(1, buff->len + 1);
         }
     }
     if (buff->buffer) {
@@ -1488,6 +1978,9 @@ void free_completions(zhandle_t *zh,int callCompletion,int reason)
                         *sc = (struct sync_completion*)cptr->data;
             sc->rc = reason;
             notify_sync_completion(sc);
+            if (cptr->traced && zh->trace.trace)
+                trace_event(zh, ZOO_TRACE_COMPLETED, cptr->xid, cptr->op,
+                        cptr->trace_path, reason);
             zh->outstanding_sync--;
             destroy_completion_entry(cptr);
         } else if (callCompletion) {
@@ -1495,7 +1988,8 @@ void free_completions(zhandle_t *zh,int callCompletion,int reason)
                 // Nothing to do with a ping response
                 destroy_completion_entry(cptr);
             } else {
-                // Fake the response
+                // Fake the response, which was never read and so has no
+                // dispatch latency to record
                 buffer_list_t *bptr;
                 h.xid = cptr->xid;
                 h.zxid = -1;
@@ -1508,6 +2002,7 @@ void free_completions(zhandle_t *zh,int callCompletion,int reason)
                 bptr->buffer = get_buffer(oa);
                 close_buffer_oarchive(&oa, 0);
                 cptr->buffer = bptr;
+                cptr->stamp = 0;
                 queue_completion(&zh->completions_to_process, cptr, 0);
             }
         }
@@ -1544,6 +2039,16 @@ static void cleanup_bufs(zhandle_t *zh,int callCompletion,int rc)
 
 static void handle_error(zhandle_t *zh,int rc)
 {
+    if (zh->state == ZOO_CONNECTED_STATE && zh->disconnected_us == 0) {
+        struct timeval now;
+        gettimeofday(&now, 0);
+        zh->disconnected_us = timeval_usecs(&now);
+    }
+    record_flight(zh, ZOO_FLIGHT_QUEUES, count_buffers(&zh->to_send),
+            count_completions(&zh->sent_requests), 0);
+    if (zh->state == ZOO_EXPIRED_SESSION_STATE) {
+        zoo_dump_flight_recorder(zh, 0);
+    }
     close(zh->fd);
     if (is_unrecoverable(zh)) {
         LOG_DEBUG(("Calling a watcher for a ZOO_SESSION_EVENT and the state=%s",
@@ -1566,6 +2071,7 @@ static void handle_error(zhandle_t *zh,int rc)
 
     if (!is_unrecoverable(zh)) {
         zh->state = 0;
+        record_flight(zh, ZOO_FLIGHT_STATE, 0, 0, 0);
     }
     if (process_async(zh->outstanding_sync)) {
         process_completions(zh);
@@ -1575,16 +2081,18 @@ static void handle_error(zhandle_t *zh,int rc)
 static int handle_socket_error_msg(zhandle_t *zh, int line, int rc,
         const char* format, ...)
 {
+    va_list va;
+    char buf[1024];
+    int err = errno;
+    va_start(va,format);
+    vsnprintf(buf, sizeof(buf)-1,format,va);
+    va_end(va);
     if(logLevel>=ZOO_LOG_LEVEL_ERROR){
-        va_list va;
-        char buf[1024];
-        va_start(va,format);
-        vsnprintf(buf, sizeof(buf)-1,format,va);
         log_message(ZOO_LOG_LEVEL_ERROR,line,__func__,
             format_log_message("Socket [%s] zk retcode=%d, errno=%d(%s): %s",
-            zoo_get_current_server(zh),rc,errno,strerror(errno),buf));
-        va_end(va);
+            zoo_get_current_server(zh),rc,err,strerror(err),buf));
     }
+    record_flight(zh, ZOO_FLIGHT_ERROR, rc, err, buf);
     handle_error(zh,rc);
     return rc;
 }
@@ -1602,6 +2110,7 @@ static void auth_completion_func(int rc, zhandle_t* zh)
 
     if(rc!=0){
         zh->state=ZOO_AUTH_FAILED_STATE;
+        record_flight(zh, ZOO_FLIGHT_STATE, zh->state, 0, 0);
     }else{
         //change state for all auths
         mark_active_auth(zh);
@@ -1630,23 +2139,14 @@ static void auth_completion_func(int rc, zhandle_t* zh)
 }
 
 static int send_info_packet(zhandle_t *zh, auth_info* auth) {
-    struct oarchive *oa;
     struct RequestHeader h = {AUTH_XID, ZOO_SETAUTH_OP};
     struct AuthPacket req;
-    int rc;
-    oa = create_buffer_oarchive();
-    rc = serialize_RequestHeader(oa, "header", &h);
     req.type=0;   // ignored by the server
     req.scheme = auth->scheme;
     req.auth = auth->auth;
-    rc = rc < 0 ? rc : serialize_AuthPacket(oa, "req", &req);
     /* add this buffer to the head of the send queue */
-    rc = rc < 0 ? rc : queue_front_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
-    /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
-
-    return rc;
+    return queue_request_buffer(zh, encode_AuthPacket(0, &h, &req),
+            ZOK, 1);
 }
 
 /** send all auths, not just the last one **/
@@ -1698,7 +2198,6 @@ static void free_key_list(char **list, int count)
 
 static int send_set_watches(zhandle_t *zh)
 {
-    struct oarchive *oa;
     struct RequestHeader h = {SET_WATCHES_XID, ZOO_SETWATCHES_OP};
     struct SetWatches req;
     int rc;
@@ -1718,14 +2217,9 @@ static int send_set_watches(zhandle_t *zh)
     }
 
 
-    oa = create_buffer_oarchive();
-    rc = serialize_RequestHeader(oa, "header", &h);
-    rc = rc < 0 ? rc : serialize_SetWatches(oa, "req", &req);
     /* add this buffer to the head of the send queue */
-    rc = rc < 0 ? rc : queue_front_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
-    /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
+    rc = queue_request_buffer(zh, encode_SetWatches(0, &h, &req), ZOK,
+            1);
     free_key_list(req.dataWatches.data, req.dataWatches.count);
     free_key_list(req.existWatches.data, req.existWatches.count);
     free_key_list(req.childWatches.data, req.childWatches.count);
@@ -1812,6 +2306,7 @@ static int prime_connection(zhandle_t *zh)
                 "failed to send a handshake packet: %s", strerror(errno));
     }
     zh->state = ZOO_ASSOCIATING_STATE;
+    record_flight(zh, ZOO_FLIGHT_STATE, zh->state, 0, 0);
 
     zh->input_buffer = &zh->primer_buffer;
     /* This seems a bit weird to to set the offset to 4, but we already have a
@@ -1844,28 +2339,26 @@ static struct timeval get_timeval(int interval)
     return tv;
 }
 
- static int add_void_completion(zhandle_t *zh, int xid, void_completion_t dc,
+ static int add_void_completion(zhandle_t *zh, int xid, int op, void_completion_t dc,
      const void *data);
- static int add_string_completion(zhandle_t *zh, int xid,
+ static int add_string_completion(zhandle_t *zh, int xid, int op,
      string_completion_t dc, const void *data);
- static int add_string_stat_completion(zhandle_t *zh, int xid,
+ static int add_string_stat_completion(zhandle_t *zh, int xid, int op,
      string_stat_completion_t dc, const void *data);
 
 
  int send_ping(zhandle_t* zh)
  {
     int rc;
-    struct oarchive *oa = create_buffer_oarchive();
     struct RequestHeader h = {PING_XID, ZOO_PING_OP};
+    buffer_list_t *b = encode_RequestHeader(&h);
 
-    rc = serialize_RequestHeader(oa, "header", &h);
+    rc = b ? ZOK : ZMARSHALLINGERROR;
     enter_critical(zh);
     gettimeofday(&zh->last_ping, 0);
-    rc = rc < 0 ? rc : add_void_completion(zh, h.xid, 0, 0);
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_void_completion(zh, h.xid, h.type, 0, 0);
+    rc = queue_request_buffer(zh, b, rc, 0);
     leave_critical(zh);
-    close_buffer_oarchive(&oa, 0);
     return rc<0 ? rc : adaptor_send_queue(zh, 0);
 }
 
@@ -1879,6 +2372,7 @@ int zookeeper_interest(zhandle_t *zh, int *fd, int *interest,
      struct timeval *tv)
 {
 #endif
+    COUNT_CALLS_AS(ZOO_ENTRY_INTEREST);
     int rc = 0;
     struct timeval now;
     if(zh==0 || fd==0 ||interest==0 || tv==0)
@@ -1890,8 +2384,10 @@ int zookeeper_interest(zhandle_t *zh, int *fd, int *interest,
         int time_left = calculate_interval(&zh->next_deadline, &now);
         int max_exceed = zh->recv_timeout / 10 > 200 ? 200 :
                          (zh->recv_timeout / 10);
-        if (time_left > max_exceed)
+        if (time_left > max_exceed) {
             LOG_WARN(("Exceeded deadline by %dms", time_left));
+            record_flight(zh, ZOO_FLIGHT_OVERRUN, time_left, 0, 0);
+        }
     }
     api_prolog(zh);
 
@@ -1933,6 +2429,8 @@ int zookeeper_interest(zhandle_t *zh, int *fd, int *interest,
             int enable_tcp_nodelay = 1;
 #endif
             zoo_cycle_next_server(zh);
+            record_flight(zh, ZOO_FLIGHT_SERVER, 0, 0,
+                    format_endpoint_info(&zh->addr_cur));
 
             zh->fd = socket(zh->addr_cur.ss_family, SOCK_STREAM, 0);
             if (zh->fd < 0) {
@@ -1966,9 +2464,10 @@ int zookeeper_interest(zhandle_t *zh, int *fd, int *interest,
                 /* we are handling the non-blocking connect according to
                  * the description in section 16.3 "Non-blocking connect"
                  * in UNIX Network Programming vol 1, 3rd edition */
-                if (errno == EWOULDBLOCK || errno == EINPROGRESS)
+                if (errno == EWOULDBLOCK || errno == EINPROGRESS) {
                     zh->state = ZOO_CONNECTING_STATE;
-                else
+                    record_flight(zh, ZOO_FLIGHT_STATE, zh->state, 0, 0);
+                } else
                 {
                     return api_epilog(zh,handle_socket_error_msg(zh,__LINE__,
                             ZCONNECTIONLOSS,"connect() call failed"));
@@ -2087,6 +2586,8 @@ static int check_events(zhandle_t *zh, int events)
         }
         if (rc > 0) {
             gettimeofday(&zh->last_recv, 0);
+            zh->stats.bytes_received += zh->input_buffer->len + 4;
+            zh->stats.packets_received++;
             if (zh->input_buffer != &zh->primer_buffer) {
                 queue_buffer(&zh->to_process, zh->input_buffer, 0);
             } else  {
@@ -2099,6 +2600,7 @@ static int check_events(zhandle_t *zh, int events)
                 newid = zh->primer_storage.sessionId;
                 if (oldid != 0 && oldid != newid) {
                     zh->state = ZOO_EXPIRED_SESSION_STATE;
+                    record_flight(zh, ZOO_FLIGHT_STATE, zh->state, 0, 0);
                     errno = ESTALE;
                     return handle_socket_error_msg(zh,__LINE__,ZSESSIONEXPIRED,
                             "sessionId=%#llx has expired.",oldid);
@@ -2109,7 +2611,14 @@ static int check_events(zhandle_t *zh, int events)
                     memcpy(zh->client_id.passwd, &zh->primer_storage.passwd,
                            sizeof(zh->client_id.passwd));
                     zh->state = ZOO_CONNECTED_STATE;
+                    record_flight(zh, ZOO_FLIGHT_STATE, zh->state, 0, 0);
                     zh->reconfig = 0;
+                    if (zh->disconnected_us != 0) {
+                        record_latency(&zh->stats.reconnect,
+                                timeval_usecs(&zh->last_recv) -
+                                zh->disconnected_us);
+                        zh->disconnected_us = 0;
+                    }
                     LOG_INFO(("session establishment complete on server [%s], sessionId=%#llx, negotiated timeout=%d",
                               format_endpoint_info(&zh->addr_cur),
                               newid, zh->recv_timeout));
@@ -2223,6 +2732,21 @@ completion_list_t *dequeue_completion(completion_head_t *list)
     return cptr;
 }
 
+/* copies the client's part of a created node's server path, as much of it
+ * as fits, into the buffer of a synchronous create */
+static void copy_client_path(zhandle_t *zh, const char *server_path,
+        int32_t len, struct sync_completion *sc)
+{
+    const char *client_path = strip_chroot(zh, server_path, &len);
+    if (len >= sc->u.str.str_len) {
+        len = sc->u.str.str_len - 1;
+    }
+    if (len >= 0) {
+        memcpy(sc->u.str.str, client_path, len);
+        sc->u.str.str[len] = '\0';
+    }
+}
+
 static void process_sync_completion(
         completion_list_t *cptr,
         struct sync_completion *sc,
@@ -2284,41 +2808,24 @@ static void process_sync_completion(
         break;
     case COMPLETION_STRING:
         if (sc->rc==0) {
-            struct CreateResponse res;
-            int len;
-            const char * client_path;
-            deserialize_CreateResponse(ia, "reply", &res);
-            //ZOOKEEPER-1027
-            client_path = sub_string(zh, res.path);
-            len = strlen(client_path) + 1;if (len > sc->u.str.str_len) {
-                len = sc->u.str.str_len;
+            /* the path is read and stripped of the chroot where it lies in
+             * the reply, then copied out */
+            const char *path;
+            int32_t len;
+            if (get_buffer_string(ia, &path, &len) == 0) {
+                //ZOOKEEPER-1027
+                copy_client_path(zh, path, len, sc);
             }
-            if (len > 0) {
-                memcpy(sc->u.str.str, client_path, len - 1);
-                sc->u.str.str[len - 1] = '\0';
-            }
-            free_duplicate_path(client_path, res.path);
-            deallocate_CreateResponse(&res);
         }
         break;
     case COMPLETION_STRING_STAT:
         if (sc->rc==0) {
-            struct Create2Response res;
-            int len;
-            const char * client_path;
-            deserialize_Create2Response(ia, "reply", &res);
-            client_path = sub_string(zh, res.path);
-            len = strlen(client_path) + 1;
-            if (len > sc->u.str.str_len) {
-                len = sc->u.str.str_len;
-            }
-            if (len > 0) {
-                memcpy(sc->u.str.str, client_path, len - 1);
-                sc->u.str.str[len - 1] = '\0';
+            const char *path;
+            int32_t len;
+            if (get_buffer_string(ia, &path, &len) == 0) {
+                copy_client_path(zh, path, len, sc);
+                deserialize_Stat(ia, "stat", &sc->u.stat);
             }
-            free_duplicate_path(client_path, res.path);
-            sc->u.stat = res.stat;
-            deallocate_Create2Response(&res);
         }
         break;
     case COMPLETION_ACLLIST:
@@ -2484,35 +2991,100 @@ static void deserialize_response(int type, int xid, int failed, int rc, completi
 }
 
 
+/* size of the xid, zxid and err fields that start every reply */
+#define REPLY_HEADER_LEN 16
+
+static inline int32_t read_int32(const char *p)
+{
+    int32_t v;
+    memcpy(&v, p, sizeof(v));
+    return ntohl(v);
+}
+
+/* Reads the ReplyHeader in place; it has a fixed size, so there is no need
+ * to build an archive just to get at it. */
+static int read_reply_header(const char *buf, int len, struct ReplyHeader *hdr)
+{
+    int64_t zxid;
+    if (len < REPLY_HEADER_LEN)
+        return -1;
+    memcpy(&zxid, buf + 4, sizeof(zxid));
+    hdr->xid = read_int32(buf);
+    hdr->zxid = htonll(zxid);
+    hdr->err = read_int32(buf + 12);
+    return 0;
+}
+
+/* Reads the WatcherEvent following the header in place. The path is
+ * terminated inside the buffer, which recv_buffer() allocates with a spare
+ * byte for that; it stays valid for as long as the buffer does. */
+static int read_watcher_event(buffer_list_t *bptr, int *type, int *state,
+        char **path)
+{
+    char *buf = bptr->buffer + REPLY_HEADER_LEN;
+    int len = bptr->len - REPLY_HEADER_LEN;
+    int32_t path_len;
+    if (len < 12)
+        return -1;
+    *type = read_int32(buf);
+    *state = read_int32(buf + 4);
+    path_len = read_int32(buf + 8);
+    if (path_len > len - 12)
+        return -1;
+    if (path_len < 0) {
+        *path = NULL;
+    } else if (path_len == 0) {
+        *path = "";
+    } else {
+        buf[12 + path_len] = '\0';
+        *path = buf + 12;
+    }
+    return 0;
+}
+
 /* handles async completion (both single- and multithreaded) */
 void process_completions(zhandle_t *zh)
 {
     completion_list_t *cptr;
     while ((cptr = dequeue_completion(&zh->completions_to_process)) != 0) {
-        struct ReplyHeader hdr;
+        struct ReplyHeader hdr = { 0, 0, 0 };
         buffer_list_t *bptr = cptr->buffer;
-        struct iarchive *ia = create_buffer_iarchive(bptr->buffer,
-                bptr->len);
-        deserialize_ReplyHeader(ia, "hdr", &hdr);
+        read_reply_header(bptr->buffer, bptr->len, &hdr);
+
+        /* session events and faked replies are made up locally and carry
+         * no read time */
+        if (cptr->stamp != 0) {
+            struct timeval now;
+            gettimeofday(&now, 0);
+            record_latency(&zh->dispatch_latency,
+                    timeval_usecs(&now) - cptr->stamp);
+        }
 
         if (hdr.xid == WATCHER_EVENT_XID) {
-            int type, state;
-            struct WatcherEvent evt;
-            deserialize_WatcherEvent(ia, "event", &evt);
-            /* We are doing a notification, so there is no pending request */
-            type = evt.type;
-            state = evt.state;
+            int type = 0, state = 0;
+            char *path = NULL;
+            /* the IO thread has already validated and collected this event */
+            read_watcher_event(bptr, &type, &state, &path);
             /* This is a notification so there aren't any pending requests */
             LOG_DEBUG(("Calling a watcher for node [%s], type = %d event=%s",
-                       (evt.path==NULL?"NULL":evt.path), cptr->c.type,
+                       (path==NULL?"NULL":path), cptr->c.type,
                        watcherEvent2String(type)));
-            deliverWatchers(zh,type,state,evt.path, &cptr->c.watcher_result);
-            deallocate_WatcherEvent(&evt);
+            deliverWatchers(zh,type,state,path, &cptr->c.watcher_result);
         } else {
+            /* the body is decoded here, off the IO thread */
+            struct iarchive *ia = create_buffer_iarchive(
+                    bptr->buffer + REPLY_HEADER_LEN,
+                    bptr->len - REPLY_HEADER_LEN);
+            if (cptr->traced && zh->trace.trace)
+                trace_event(zh, ZOO_TRACE_DISPATCHED, cptr->xid, cptr->op,
+                        cptr->trace_path, hdr.err);
             deserialize_response(cptr->c.type, hdr.xid, hdr.err != 0, hdr.err, cptr, ia);
+            close_buffer_iarchive(&ia);
+            if (cptr->traced && zh->trace.trace)
+                trace_event(zh, ZOO_TRACE_COMPLETED, cptr->xid, cptr->op,
+                        cptr->trace_path, hdr.err);
         }
         destroy_completion_entry(cptr);
-        close_buffer_iarchive(&ia);
     }
 }
 
@@ -2559,6 +3131,7 @@ static void checkResponseLatency(zhandle_t* zh)
 
 int zookeeper_process(zhandle_t *zh, int events)
 {
+    COUNT_CALLS_AS(ZOO_ENTRY_PROCESS);
     buffer_list_t *bptr;
     int rc;
 
@@ -2576,9 +3149,11 @@ int zookeeper_process(zhandle_t *zh, int events)
 
     while (rc >= 0 && (bptr=dequeue_buffer(&zh->to_process))) {
         struct ReplyHeader hdr;
-        struct iarchive *ia = create_buffer_iarchive(
-                                    bptr->buffer, bptr->curr_offset);
-        deserialize_ReplyHeader(ia, "hdr", &hdr);
+        if (read_reply_header(bptr->buffer, bptr->len, &hdr) < 0) {
+            free_buffer(bptr);
+            return api_epilog(zh, handle_socket_error_msg(zh, __LINE__,
+                    ZMARSHALLINGERROR, "short server response"));
+        }
         if (hdr.zxid > 0) {
             zh->last_zxid = hdr.zxid;
         } else {
@@ -2586,23 +3161,24 @@ int zookeeper_process(zhandle_t *zh, int events)
         }
 
         if (hdr.xid == WATCHER_EVENT_XID) {
-            struct WatcherEvent evt;
-            int type = 0;
+            int type = 0, state = 0;
             char *path = NULL;
             completion_list_t *c = NULL;
 
             LOG_DEBUG(("Processing WATCHER_EVENT"));
 
-            deserialize_WatcherEvent(ia, "event", &evt);
-            type = evt.type;
-            path = evt.path;
+            /* Watchers have to be collected here, before any later reply
+             * is handled, so only the event itself is looked at. */
+            if (read_watcher_event(bptr, &type, &state, &path) < 0) {
+                free_buffer(bptr);
+                return api_epilog(zh, handle_socket_error_msg(zh, __LINE__,
+                        ZMARSHALLINGERROR, "malformed watcher event"));
+            }
             /* We are doing a notification, so there is no pending request */
             c = create_completion_entry(WATCHER_EVENT_XID,-1,0,0,0,0);
             c->buffer = bptr;
+            c->stamp = timeval_usecs(&zh->last_recv);
             c->c.watcher_result = collectWatchers(zh, type, path);
-
-            // We cannot free until now, otherwise path will become invalid
-            deallocate_WatcherEvent(&evt);
             queue_completion(&zh->completions_to_process, c, 0);
         } else if (hdr.xid == SET_WATCHES_XID) {
             LOG_DEBUG(("Processing SET_WATCHES"));
@@ -2618,18 +3194,18 @@ int zookeeper_process(zhandle_t *zh, int events)
              * unrecoverable */
             if(is_unrecoverable(zh)){
                 handle_error(zh, ZAUTHFAILED);
-                close_buffer_iarchive(&ia);
                 return api_epilog(zh, ZAUTHFAILED);
             }
         } else {
             int rc = hdr.err;
+            int64_t received;
             /* Find the request corresponding to the response */
             completion_list_t *cptr = dequeue_completion(&zh->sent_requests);
 
             /* [ZOOKEEPER-804] Don't assert if zookeeper_close has been called. */
             if (zh->close_requested == 1 && cptr == NULL) {
                 LOG_DEBUG(("Completion queue has been cleared by zookeeper_close()"));
-                close_buffer_iarchive(&ia);
+                free_buffer(bptr);
                 return api_epilog(zh,ZINVALIDSTATE);
             }
             assert(cptr);
@@ -2638,7 +3214,6 @@ int zookeeper_process(zhandle_t *zh, int events)
                 LOG_DEBUG(("Processing unexpected or out-of-order response!"));
 
                 // received unexpected (or out-of-order) response
-                close_buffer_iarchive(&ia);
                 free_buffer(bptr);
                 // put the completion back on the queue (so it gets properly
                 // signaled and deallocated) and disconnect from the server
@@ -2649,14 +3224,24 @@ int zookeeper_process(zhandle_t *zh, int events)
             }
 
             activateWatcher(zh, cptr->watcher, rc);
+            if (cptr->traced && zh->trace.trace)
+                trace_event(zh, ZOO_TRACE_RECEIVED, cptr->xid, cptr->op,
+                        cptr->trace_path, rc);
+
+            /* the reply was read when last_recv was taken */
+            received = timeval_usecs(&zh->last_recv);
+            if (hdr.xid == PING_XID) {
+                record_latency(&zh->stats.ping, received - cptr->stamp);
+                record_flight(zh, ZOO_FLIGHT_PING, received - cptr->stamp, 0, 0);
+            } else if (cptr->op >= 0 && cptr->op < ZOO_STATS_OPS) {
+                record_latency(&zh->stats.requests[cptr->op],
+                        received - cptr->stamp);
+            }
 
             if (cptr->c.void_result != SYNCHRONOUS_MARKER) {
                 if(hdr.xid == PING_XID){
-                    int elapsed = 0;
-                    struct timeval now;
-                    gettimeofday(&now, 0);
-                    elapsed = calculate_interval(&zh->last_ping, &now);
-                    LOG_DEBUG(("Got ping response in %d ms", elapsed));
+                    LOG_DEBUG(("Got ping response in %lld us",
+                            (long long)(received - cptr->stamp)));
 
                     // Nothing to do with a ping response
                     free_buffer(bptr);
@@ -2665,30 +3250,174 @@ int zookeeper_process(zhandle_t *zh, int events)
                     LOG_DEBUG(("Queueing asynchronous response"));
 
                     cptr->buffer = bptr;
+                    cptr->stamp = received;
                     queue_completion(&zh->completions_to_process, cptr, 0);
                 }
             } else {
                 struct sync_completion
                         *sc = (struct sync_completion*)cptr->data;
+                struct iarchive *ia = create_buffer_iarchive(
+                        bptr->buffer + REPLY_HEADER_LEN,
+                        bptr->len - REPLY_HEADER_LEN);
                 sc->rc = rc;
+                if (cptr->traced && zh->trace.trace)
+                    trace_event(zh, ZOO_TRACE_DISPATCHED, cptr->xid, cptr->op,
+                            cptr->trace_path, rc);
 
                 process_sync_completion(cptr, sc, ia, zh);
 
                 notify_sync_completion(sc);
+                if (cptr->traced && zh->trace.trace)
+                    trace_event(zh, ZOO_TRACE_COMPLETED, cptr->xid, cptr->op,
+                            cptr->trace_path, rc);
+                close_buffer_iarchive(&ia);
                 free_buffer(bptr);
                 zh->outstanding_sync--;
                 destroy_completion_entry(cptr);
             }
         }
-
-        close_buffer_iarchive(&ia);
-
     }
     if (process_async(zh->outstanding_sync)) {
         process_completions(zh);
     }
     return api_epilog(zh,ZOK);}
 
+#ifndef THREADED
+/* the same interest zookeeper_interest() computes for a live socket */
+static int current_interest(zhandle_t *zh)
+{
+    int interest = 0;
+    if (zh->fd != -1) {
+        interest = ZOOKEEPER_READ;
+        if ((zh->to_send.head && (zh->state == ZOO_CONNECTED_STATE))
+            || zh->state == ZOO_CONNECTING_STATE) {
+            interest |= ZOOKEEPER_WRITE;
+        }
+    }
+    return interest;
+}
+
+static void report_loop_fd(zhandle_t *zh, int fd, int interest)
+{
+    int oldfd = zh->loop_fd;
+    if (zh->loop.fd_changed == 0)
+        return;
+    if (fd == oldfd && interest == zh->loop_interest)
+        return;
+    zh->loop_fd = fd;
+    zh->loop_interest = interest;
+    zh->loop.fd_changed(zh, oldfd, fd, interest, zh->loop.context);
+}
+
+static void report_loop_deadline(zhandle_t *zh, const struct timeval *now,
+        int timeout)
+{
+    struct timeval deadline;
+    int armed = zh->loop_deadline.tv_sec != 0 || zh->loop_deadline.tv_usec != 0;
+    if (zh->loop.deadline_changed == 0)
+        return;
+    if (timeout < 0) {
+        if (!armed)
+            return;
+        zh->loop_deadline.tv_sec = 0;
+        zh->loop_deadline.tv_usec = 0;
+        zh->loop.deadline_changed(zh, -1, zh->loop.context);
+        return;
+    }
+    deadline = *now;
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_usec += (timeout % 1000) * 1000;
+    if (deadline.tv_usec >= 1000000) {
+        deadline.tv_sec++;
+        deadline.tv_usec -= 1000000;
+    }
+    /* Pings push the deadline out after nearly every exchange. An early
+     * wakeup only costs a dispatch that re-arms the timer, so keep the armed
+     * timer unless the new deadline is sooner or the old one has passed. */
+    if (armed && calculate_interval(now, &zh->loop_deadline) > 0
+            && calculate_interval(&zh->loop_deadline, &deadline) >= 0)
+        return;
+    zh->loop_deadline = deadline;
+    zh->loop.deadline_changed(zh, timeout, zh->loop.context);
+}
+
+void update_loop_interest(zhandle_t *zh)
+{
+    report_loop_fd(zh, zh->fd, current_interest(zh));
+}
+
+int zoo_set_loop_callbacks(zhandle_t *zh,
+        const struct zoo_loop_callbacks *callbacks)
+{
+    struct timeval now;
+    if (zh == 0)
+        return ZBADARGUMENTS;
+    if (callbacks == 0) {
+        gettimeofday(&now, 0);
+        report_loop_fd(zh, -1, 0);
+        report_loop_deadline(zh, &now, -1);
+        memset(&zh->loop, 0, sizeof(zh->loop));
+        return ZOK;
+    }
+    zh->loop = *callbacks;
+    zh->loop_fd = -1;
+    zh->loop_interest = 0;
+    zh->loop_deadline.tv_sec = 0;
+    zh->loop_deadline.tv_usec = 0;
+    return zookeeper_dispatch(zh, 0);
+}
+
+int zookeeper_dispatch(zhandle_t *zh, int events)
+{
+    COUNT_CALLS_AS(ZOO_ENTRY_PROCESS);
+    struct timeval now;
+    struct timeval tv = {0, 0};
+    int fd;
+    int interest = 0;
+    int rc = ZOK;
+    int irc;
+
+    if (zh == 0)
+        return ZBADARGUMENTS;
+    api_prolog(zh);
+    if (events && zh->fd != -1) {
+        /* an edge-triggered loop will not report the socket again until
+         * more data arrives, so consume everything that is there now */
+        rc = zookeeper_process(zh, events);
+        while (rc == ZOK && (events & ZOOKEEPER_READ)) {
+            rc = zookeeper_process(zh, ZOOKEEPER_READ);
+        }
+        if (rc == ZNOTHING)
+            rc = ZOK;
+    }
+    if (zh->close_requested)
+        return api_epilog(zh, rc);
+
+    /* report a dropped connection before the reconnect below can hand out
+     * a socket with the same descriptor number */
+    if (zh->fd == -1)
+        report_loop_fd(zh, -1, 0);
+
+    gettimeofday(&now, 0);
+    irc = zookeeper_interest(zh, &fd, &interest, &tv);
+    if (irc == ZOK) {
+        report_loop_fd(zh, zh->fd, interest);
+        report_loop_deadline(zh, &now, tv.tv_sec * 1000 + tv.tv_usec / 1000);
+    } else if (is_unrecoverable(zh)) {
+        report_loop_fd(zh, -1, 0);
+        report_loop_deadline(zh, &now, -1);
+    } else {
+        /* the connection was dropped; handle_error() has already decided
+         * whether the next attempt needs to back off */
+        report_loop_fd(zh, zh->fd, current_interest(zh));
+        report_loop_deadline(zh, &now, 0);
+    }
+    if (rc == ZOK)
+        rc = irc;
+    return api_epilog(zh, rc);
+}
+#endif
+
 int zoo_state(zhandle_t *zh)
 {
     if(zh!=0)
@@ -2696,13 +3425,29 @@ int zoo_state(zhandle_t *zh)
     return 0;
 }
 
-static watcher_registration_t* create_watcher_registration(const char* path,
-        result_checker_fn checker,watcher_fn watcher,void* ctx){
+/* the watch is kept under the server's path, the chroot and the client's
+ * path joined in one allocation; the scan of the path has its length and
+ * the hash of the server's path */
+static watcher_registration_t* create_watcher_registration(const char* chroot,
+        const char* path, const struct path_scan *scan,
+        result_checker_fn checker,watcher_fn watcher, void* ctx){
     watcher_registration_t* wo;
+    size_t chroot_len, path_len;
+    char *server_path;
     if(watcher==0)
         return 0;
+    chroot_len = chroot ? strlen(chroot) : 0;
+    path_len = scan->len;
+    if (chroot_len && path_len == 1)
+        path_len = 0;
     wo=calloc(1,sizeof(watcher_registration_t));
-    wo->path=strdup(path);
+    server_path=malloc(chroot_len + path_len + 1);
+    if (chroot_len)
+        memcpy(server_path, chroot, chroot_len);
+    memcpy(server_path + chroot_len, path, path_len);
+    server_path[chroot_len + path_len] = '\0';
+    wo->path=server_path;
+    wo->hash=scan->hash;
     wo->watcher=watcher;
     wo->context=ctx;
     wo->checker=checker;
@@ -2716,7 +3461,7 @@ static void destroy_watcher_registration(watcher_registration_t* wo){
     }
 }
 
-static completion_list_t* create_completion_entry(int xid, int completion_type,
+completion_list_t* create_completion_entry(int xid, int completion_type,
         const void *dc, const void *data,watcher_registration_t* wo, completion_head_t *clist)
 {
     completion_list_t *c = calloc(1,sizeof(completion_list_t));
@@ -2762,11 +3507,12 @@ static completion_list_t* create_completion_entry(int xid, int completion_type,
     return c;
 }
 
-static void destroy_completion_entry(completion_list_t* c){
+void destroy_completion_entry(completion_list_t* c){
     if(c!=0){
         destroy_watcher_registration(c->watcher);
         if(c->buffer!=0)
             free_buffer(c->buffer);
+        free(c->trace_path);
         free(c);
     }
 }
@@ -2795,7 +3541,7 @@ static void queue_completion_nolock(completion_head_t *list,
     }
 }
 
-static void queue_completion(completion_head_t *list, completion_list_t *c,
+void queue_completion(completion_head_t *list, completion_list_t *c,
         int add_to_front)
 {
 
@@ -2804,15 +3550,19 @@ static void queue_completion(completion_head_t *list, completion_list_t *c,
     unlock_completion_list(list);
 }
 
-static int add_completion(zhandle_t *zh, int xid, int completion_type,
+static int add_completion(zhandle_t *zh, int xid, int op, int completion_type,
         const void *dc, const void *data, int add_to_front,
         watcher_registration_t* wo, completion_head_t *clist)
 {
     completion_list_t *c =create_completion_entry(xid, completion_type, dc,
             data, wo, clist);
+    struct timeval now;
     int rc = 0;
     if (!c)
         return ZSYSTEMERROR;
+    gettimeofday(&now, 0);
+    c->op = op;
+    c->stamp = timeval_usecs(&now);
     lock_completion_list(&zh->sent_requests);
     if (zh->close_requested != 1) {
         queue_completion_nolock(&zh->sent_requests, c, add_to_front);
@@ -2828,62 +3578,63 @@ static int add_completion(zhandle_t *zh, int xid, int completion_type,
     return rc;
 }
 
-static int add_data_completion(zhandle_t *zh, int xid, data_completion_t dc,
+static int add_data_completion(zhandle_t *zh, int xid, int op, data_completion_t dc,
         const void *data,watcher_registration_t* wo)
 {
-    return add_completion(zh, xid, COMPLETION_DATA, dc, data, 0, wo, 0);
+    return add_completion(zh, xid, op, COMPLETION_DATA, dc, data, 0, wo, 0);
 }
 
-static int add_stat_completion(zhandle_t *zh, int xid, stat_completion_t dc,
+static int add_stat_completion(zhandle_t *zh, int xid, int op, stat_completion_t dc,
         const void *data,watcher_registration_t* wo)
 {
-    return add_completion(zh, xid, COMPLETION_STAT, dc, data, 0, wo, 0);
+    return add_completion(zh, xid, op, COMPLETION_STAT, dc, data, 0, wo, 0);
 }
 
-static int add_strings_completion(zhandle_t *zh, int xid,
+static int add_strings_completion(zhandle_t *zh, int xid, int op,
         strings_completion_t dc, const void *data,watcher_registration_t* wo)
 {
-    return add_completion(zh, xid, COMPLETION_STRINGLIST, dc, data, 0, wo, 0);
+    return add_completion(zh, xid, op, COMPLETION_STRINGLIST, dc, data, 0, wo, 0);
 }
 
-static int add_strings_stat_completion(zhandle_t *zh, int xid,
+static int add_strings_stat_completion(zhandle_t *zh, int xid, int op,
         strings_stat_completion_t dc, const void *data,watcher_registration_t* wo)
 {
-    return add_completion(zh, xid, COMPLETION_STRINGLIST_STAT, dc, data, 0, wo, 0);
+    return add_completion(zh, xid, op, COMPLETION_STRINGLIST_STAT, dc, data, 0, wo, 0);
 }
 
-static int add_acl_completion(zhandle_t *zh, int xid, acl_completion_t dc,
+static int add_acl_completion(zhandle_t *zh, int xid, int op, acl_completion_t dc,
         const void *data)
 {
-    return add_completion(zh, xid, COMPLETION_ACLLIST, dc, data, 0, 0, 0);
+    return add_completion(zh, xid, op, COMPLETION_ACLLIST, dc, data, 0, 0, 0);
 }
 
-static int add_void_completion(zhandle_t *zh, int xid, void_completion_t dc,
+static int add_void_completion(zhandle_t *zh, int xid, int op, void_completion_t dc,
         const void *data)
 {
-    return add_completion(zh, xid, COMPLETION_VOID, dc, data, 0, 0, 0);
+    return add_completion(zh, xid, op, COMPLETION_VOID, dc, data, 0, 0, 0);
 }
 
-static int add_string_completion(zhandle_t *zh, int xid,
+static int add_string_completion(zhandle_t *zh, int xid, int op,
         string_completion_t dc, const void *data)
 {
-    return add_completion(zh, xid, COMPLETION_STRING, dc, data, 0, 0, 0);
+    return add_completion(zh, xid, op, COMPLETION_STRING, dc, data, 0, 0, 0);
 }
 
-static int add_string_stat_completion(zhandle_t *zh, int xid,
+static int add_string_stat_completion(zhandle_t *zh, int xid, int op,
         string_stat_completion_t dc, const void *data)
 {
-    return add_completion(zh, xid, COMPLETION_STRING_STAT, dc, data, 0, 0, 0);
+    return add_completion(zh, xid, op, COMPLETION_STRING_STAT, dc, data, 0, 0, 0);
 }
 
-static int add_multi_completion(zhandle_t *zh, int xid, void_completion_t dc,
+static int add_multi_completion(zhandle_t *zh, int xid, int op, void_completion_t dc,
         const void *data, completion_head_t *clist)
 {
-    return add_completion(zh, xid, COMPLETION_MULTI, dc, data, 0,0, clist);
+    return add_completion(zh, xid, op, COMPLETION_MULTI, dc, data, 0,0, clist);
 }
 
 int zookeeper_close(zhandle_t *zh)
 {
+    COUNT_CALLS_AS(ZOO_ENTRY_CLOSE);
     int rc=ZOK;
     if (zh==0)
         return ZBADARGUMENTS;
@@ -2908,16 +3659,11 @@ int zookeeper_close(zhandle_t *zh)
     /* No need to decrement the counter since we're just going to
      * destroy the handle later. */
     if(zh->state==ZOO_CONNECTED_STATE){
-        struct oarchive *oa;
-        struct RequestHeader h = {get_xid(), ZOO_CLOSE_OP};
+        struct RequestHeader h = {get_xid(zh), ZOO_CLOSE_OP};
         LOG_INFO(("Closing zookeeper sessionId=%#llx to [%s]\n",
                 zh->client_id.client_id,zoo_get_current_server(zh)));
-        oa = create_buffer_oarchive();
-        rc = serialize_RequestHeader(oa, "header", &h);
-        rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-                get_buffer_len(oa));
-        /* We queued the buffer, so don't free it */
-        close_buffer_oarchive(&oa, 0);
+        rc = queue_request_buffer(zh, encode_RequestHeader(&h), ZOK,
+                0);
         if (rc < 0) {
             rc = ZMARSHALLINGERROR;
             goto finish;
@@ -2933,6 +3679,9 @@ int zookeeper_close(zhandle_t *zh)
     }
 
 finish:
+#ifndef THREADED
+    zoo_set_loop_callbacks(zh, 0);
+#endif
     destroy(zh);
     adaptor_destroy(zh);
     free(zh);
@@ -2942,77 +3691,101 @@ finish:
     return rc;
 }
 
-static int isValidPath(const char* path, const int flags) {
-    int len = 0;
+/*
+ * Checks a path in one pass, which also measures it and hashes it the way
+ * the watcher tables do, carrying on from seed. Most of a path is letters
+ * and digits, which sort above '/' and so cost one compare each: the bytes
+ * the rules are about, '/', '.', control characters and the end, all sort
+ * at or below it.
+ */
+static int isValidPath(const char* path, const int flags,
+        unsigned int seed, struct path_scan *scan) {
+    unsigned int hash = seed;
+    const char *p;
     char lastc = '/';
     char c;
-    int i = 0;
 
   if (path == 0)
     return 0;
-  len = strlen(path);
-  if (len == 0)
-    return 0;
   if (path[0] != '/')
     return 0;
-  if (len == 1) // done checking - it's the root
-    return 1;
-  if (path[len - 1] == '/' && !(flags & ZOO_SEQUENCE))
-    return 0;
+  hash = ZK_PATH_HASH_STEP(hash, '/');
 
-  i = 1;
-  for (; i < len; lastc = path[i], i++) {
-    c = path[i];
+  for (p = path + 1; ; lastc = c, p++) {
+    c = *p;
 
+    if ((unsigned char) c > '/') {
+      hash = ZK_PATH_HASH_STEP(hash, c);
+      continue;
+    }
     if (c == 0) {
-      return 0;
+      // only the root, or a prefix for a sequential node, may end in '/'
+      if (lastc == '/' && p - path > 1 && !(flags & ZOO_SEQUENCE))
+        return 0;
+      break;
     } else if (c == '/' && lastc == '/') {
       return 0;
-    } else if (c == '.' && lastc == '.') {
-      if (path[i-2] == '/' && (((i + 1 == len) && !(flags & ZOO_SEQUENCE))
-                               || path[i+1] == '/')) {
-        return 0;
-      }
-    } else if (c == '.') {
-      if ((path[i-1] == '/') && (((i + 1 == len) && !(flags & ZOO_SEQUENCE))
-                                 || path[i+1] == '/')) {
+    } else if (c == '.' && (lastc == '/' || (lastc == '.' && p[-2] == '/'))) {
+      // a "." or ".." component
+      if (p[1] == '/' || (p[1] == 0 && !(flags & ZOO_SEQUENCE)))
         return 0;
-      }
     } else if (c > 0x00 && c < 0x1f) {
       return 0;
     }
+    hash = ZK_PATH_HASH_STEP(hash, c);
   }
 
+  scan->len = p - path;
+  scan->hash = hash;
   return 1;
 }
 
+/* checks a client's path, hashing the server's path it stands for */
+static int isValidRequestPath(zhandle_t *zh, const char* path,
+        const int flags, struct path_scan *scan) {
+    if (zh->chroot == NULL)
+        return isValidPath(path, flags, ZK_PATH_HASH_SEED, scan);
+    if (!isValidPath(path, flags, zh->chroot_hash, scan))
+        return 0;
+    // the root stands for the chroot itself
+    if (scan->len == 1)
+        scan->hash = zh->chroot_hash;
+    return 1;
+}
+
 /*---------------------------------------------------------------------------*
  * REQUEST INIT HELPERS
  *---------------------------------------------------------------------------*/
 /* Common Request init helper functions to reduce code duplication */
-static int Request_path_init(zhandle_t *zh, int flags,
-        char **path_out, const char *path)
+static int Request_path_scan_init(zhandle_t *zh, int flags,
+        char **path_out, const char *path, struct path_scan *scan)
 {
     assert(path_out);
 
-    *path_out = prepend_string(zh, path);
-    if (zh == NULL || !isValidPath(*path_out, flags)) {
-        free_duplicate_path(*path_out, path);
+    /* the chroot is valid, so the path is if the client's part is */
+    *path_out = (char *) path;
+    if (zh == NULL || !isValidRequestPath(zh, path, flags, scan)) {
         return ZBADARGUMENTS;
     }
     if (is_unrecoverable(zh)) {
-        free_duplicate_path(*path_out, path);
         return ZINVALIDSTATE;
     }
 
     return ZOK;
 }
 
+static int Request_path_init(zhandle_t *zh, int flags,
+        char **path_out, const char *path)
+{
+    struct path_scan scan;
+    return Request_path_scan_init(zh, flags, path_out, path, &scan);
+}
+
 static int Request_path_watch_init(zhandle_t *zh, int flags,
         char **path_out, const char *path,
-        int32_t *watch_out, uint32_t watch)
+        int32_t *watch_out, uint32_t watch, struct path_scan *scan)
 {
-    int rc = Request_path_init(zh, flags, path_out, path);
+    int rc = Request_path_scan_init(zh, flags, path_out, path, scan);
     if (rc != ZOK) {
         return rc;
     }
@@ -3033,32 +3806,26 @@ int zoo_awget(zhandle_t *zh, const char *path,
         watcher_fn watcher, void* watcherCtx,
         data_completion_t dc, const void *data)
 {
-    struct oarchive *oa;
-    char *server_path = prepend_string(zh, path);
-    struct RequestHeader h = {get_xid(), ZOO_GETDATA_OP};
-    struct GetDataRequest req =  { (char*)server_path, watcher!=0 };
+    COUNT_CALLS_AS(ZOO_ENTRY_GET);
+    buffer_list_t *b;
+    struct RequestHeader h = {get_xid(zh), ZOO_GETDATA_OP};
+    struct GetDataRequest req =  { (char*)path, watcher!=0 };
+    struct path_scan scan;
     int rc;
 
-    if (zh==0 || !isValidPath(server_path, 0)) {
-        free_duplicate_path(server_path, path);
+    if (zh==0 || !isValidRequestPath(zh, path, 0, &scan)) {
         return ZBADARGUMENTS;
     }
     if (is_unrecoverable(zh)) {
-        free_duplicate_path(server_path, path);
         return ZINVALIDSTATE;
     }
-    oa=create_buffer_oarchive();
-    rc = serialize_RequestHeader(oa, "header", &h);
-    rc = rc < 0 ? rc : serialize_GetDataRequest(oa, "req", &req);
+    b = encode_GetDataRequest(zh->chroot, &h, &req);
+    rc = b ? ZOK : ZMARSHALLINGERROR;
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_data_completion(zh, h.xid, dc, data,
-    create_watcher_registration(server_path,data_result_checker,watcher,watcherCtx));
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_data_completion(zh, h.xid, h.type, dc, data,
+    create_watcher_registration(zh->chroot,path,&scan,data_result_checker,watcher,watcherCtx));
+    rc = queue_request_buffer(zh, b, rc, 0);
     leave_critical(zh);
-    free_duplicate_path(server_path, path);
-    /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending request xid=%#x for path [%s] to %s",h.xid,path,
             zoo_get_current_server(zh)));
@@ -3076,33 +3843,30 @@ int zoo_agetconfig(zhandle_t *zh, int watch, data_completion_t dc,
 int zoo_awgetconfig(zhandle_t *zh, watcher_fn watcher, void* watcherCtx,
         data_completion_t dc, const void *data)
 {
-    struct oarchive *oa;
+    COUNT_CALLS_AS(ZOO_ENTRY_GETCONFIG);
+    buffer_list_t *b;
     char *path = ZOO_CONFIG_NODE;
-    char *server_path = ZOO_CONFIG_NODE;
-    struct RequestHeader h = { get_xid(), ZOO_GETDATA_OP };
-    struct GetDataRequest req =  { (char*)server_path, watcher!=0 };
+    struct RequestHeader h = { get_xid(zh), ZOO_GETDATA_OP };
+    struct GetDataRequest req =  { path, watcher!=0 };
+    struct path_scan scan;
     int rc;
 
-    if (zh==0 || !isValidPath(server_path, 0)) {
-        free_duplicate_path(server_path, path);
+    if (zh==0) {
         return ZBADARGUMENTS;
     }
     if (is_unrecoverable(zh)) {
-        free_duplicate_path(server_path, path);
         return ZINVALIDSTATE;
     }
-    oa=create_buffer_oarchive();
-    rc = serialize_RequestHeader(oa, "header", &h);
-    rc = rc < 0 ? rc : serialize_GetDataRequest(oa, "req", &req);
+    /* the config node lies outside of any chroot; it is checked only to
+     * measure and hash it */
+    isValidPath(path, 0, ZK_PATH_HASH_SEED, &scan);
+    b = encode_GetDataRequest(0, &h, &req);
+    rc = b ? ZOK : ZMARSHALLINGERROR;
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_data_completion(zh, h.xid, dc, data,
-                                           create_watcher_registration(server_path,data_result_checker,watcher,watcherCtx));
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-                                          get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_data_completion(zh, h.xid, h.type, dc, data,
+                                           create_watcher_registration(0,path,&scan,data_result_checker,watcher,watcherCtx));
+    rc = queue_request_buffer(zh, b, rc, 0);
     leave_critical(zh);
-    free_duplicate_path(server_path, path);
-    /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending request xid=%#x for path [%s] to %s",h.xid,path,
                zoo_get_current_server(zh)));
@@ -3114,8 +3878,9 @@ int zoo_awgetconfig(zhandle_t *zh, watcher_fn watcher, void* watcherCtx,
 int zoo_areconfig(zhandle_t *zh, const char *joining, const char *leaving,
        const char *members, int64_t version, data_completion_t dc, const void *data)
 {
-    struct oarchive *oa;
-    struct RequestHeader h = { get_xid(), ZOO_RECONFIG_OP };
+    COUNT_CALLS_AS(ZOO_ENTRY_RECONFIG);
+    buffer_list_t *b;
+    struct RequestHeader h = { get_xid(zh), ZOO_RECONFIG_OP };
     struct ReconfigRequest req;
    int rc = 0;
 
@@ -3126,20 +3891,16 @@ int zoo_areconfig(zhandle_t *zh, const char *joining, const char *leaving,
         return ZINVALIDSTATE;
     }
 
-   oa=create_buffer_oarchive();
    req.joiningServers = (char *)joining;
    req.leavingServers = (char *)leaving;
    req.newMembers = (char *)members;
    req.curConfigId = version;
-    rc = serialize_RequestHeader(oa, "header", &h);
-   rc = rc < 0 ? rc : serialize_ReconfigRequest(oa, "req", &req);
+    b = encode_ReconfigRequest(0, &h, &req);
+    rc = b ? ZOK : ZMARSHALLINGERROR;
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_data_completion(zh, h.xid, dc, data, NULL);
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_data_completion(zh, h.xid, h.type, dc, data, NULL);
+    rc = queue_request_buffer(zh, b, rc, 0);
     leave_critical(zh);
-    /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending Reconfig request xid=%#x to %s",h.xid, zoo_get_current_server(zh)));
     /* make a best (non-blocking) effort to send the requests asap */
@@ -3167,24 +3928,20 @@ static int SetDataRequest_init(zhandle_t *zh, struct SetDataRequest *req,
 int zoo_aset(zhandle_t *zh, const char *path, const char *buffer, int buflen,
         int version, stat_completion_t dc, const void *data)
 {
-    struct oarchive *oa;
-    struct RequestHeader h = {get_xid(), ZOO_SETDATA_OP};
+    COUNT_CALLS_AS(ZOO_ENTRY_SET);
+    buffer_list_t *b;
+    struct RequestHeader h = {get_xid(zh), ZOO_SETDATA_OP};
     struct SetDataRequest req;
     int rc = SetDataRequest_init(zh, &req, path, buffer, buflen, version);
     if (rc != ZOK) {
         return rc;
     }
-    oa = create_buffer_oarchive();
-    rc = serialize_RequestHeader(oa, "header", &h);
-    rc = rc < 0 ? rc : serialize_SetDataRequest(oa, "req", &req);
+    b = encode_SetDataRequest(zh->chroot, &h, &req);
+    rc = b ? ZOK : ZMARSHALLINGERROR;
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_stat_completion(zh, h.xid, dc, data,0);
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_stat_completion(zh, h.xid, h.type, dc, data,0);
+    rc = queue_request_buffer(zh, b, rc, 0);
     leave_critical(zh);
-    free_duplicate_path(req.path, path);
-    /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending request xid=%#x for path [%s] to %s",h.xid,path,
             zoo_get_current_server(zh)));
@@ -3245,8 +4002,9 @@ int zoo_acreate(zhandle_t *zh, const char *path, const char *value,
         int valuelen, const struct ACL_vector *acl_entries, int flags,
         string_completion_t completion, const void *data)
 {
-    struct oarchive *oa;
-    struct RequestHeader h = {get_xid(), ZOO_CREATE_OP};
+    COUNT_CALLS_AS(ZOO_ENTRY_CREATE);
+    buffer_list_t *b;
+    struct RequestHeader h = {get_xid(zh), ZOO_CREATE_OP};
     struct CreateRequest req;
 
     int rc = CreateRequest_init(zh, &req, 
@@ -3254,17 +4012,12 @@ int zoo_acreate(zhandle_t *zh, const char *path, const char *value,
     if (rc != ZOK) {
         return rc;
     }
-    oa = create_buffer_oarchive();
-    rc = serialize_RequestHeader(oa, "header", &h);
-    rc = rc < 0 ? rc : serialize_CreateRequest(oa, "req", &req);
+    b = encode_CreateRequest(zh->chroot, &h, &req);
+    rc = b ? ZOK : ZMARSHALLINGERROR;
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_string_completion(zh, h.xid, completion, data);
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_string_completion(zh, h.xid, h.type, completion, data);
+    rc = queue_request_buffer(zh, b, rc, 0);
     leave_critical(zh);
-    free_duplicate_path(req.path, path);
-    /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending request xid=%#x for path [%s] to %s",h.xid,path,
             zoo_get_current_server(zh)));
@@ -3277,25 +4030,21 @@ int zoo_acreate2(zhandle_t *zh, const char *path, const char *value,
         int valuelen, const struct ACL_vector *acl_entries, int flags,
         string_stat_completion_t completion, const void *data)
 {
-    struct oarchive *oa;
-    struct RequestHeader h = { get_xid(), ZOO_CREATE2_OP };
+    COUNT_CALLS_AS(ZOO_ENTRY_CREATE);
+    buffer_list_t *b;
+    struct RequestHeader h = { get_xid(zh), ZOO_CREATE2_OP };
     struct Create2Request req;
 
     int rc = Create2Request_init(zh, &req, path, value, valuelen, acl_entries, flags);
     if (rc != ZOK) {
         return rc;
     }
-    oa = create_buffer_oarchive();
-    rc = serialize_RequestHeader(oa, "header", &h);
-    rc = rc < 0 ? rc : serialize_Create2Request(oa, "req", &req);
+    b = encode_Create2Request(zh->chroot, &h, &req);
+    rc = b ? ZOK : ZMARSHALLINGERROR;
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_string_stat_completion(zh, h.xid, completion, data);
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_string_stat_completion(zh, h.xid, h.type, completion, data);
+    rc = queue_request_buffer(zh, b, rc, 0);
     leave_critical(zh);
-    free_duplicate_path(req.path, path);
-    /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending request xid=%#x for path [%s] to %s",h.xid,path,
             zoo_get_current_server(zh)));
@@ -3318,24 +4067,20 @@ int DeleteRequest_init(zhandle_t *zh, struct DeleteRequest *req,
 int zoo_adelete(zhandle_t *zh, const char *path, int version,
         void_completion_t completion, const void *data)
 {
-    struct oarchive *oa;
-    struct RequestHeader h = {get_xid(), ZOO_DELETE_OP};
+    COUNT_CALLS_AS(ZOO_ENTRY_DELETE);
+    buffer_list_t *b;
+    struct RequestHeader h = {get_xid(zh), ZOO_DELETE_OP};
     struct DeleteRequest req;
     int rc = DeleteRequest_init(zh, &req, path, version);
     if (rc != ZOK) {
         return rc;
     }
-    oa = create_buffer_oarchive();
-    rc = serialize_RequestHeader(oa, "header", &h);
-    rc = rc < 0 ? rc : serialize_DeleteRequest(oa, "req", &req);
+    b = encode_DeleteRequest(zh->chroot, &h, &req);
+    rc = b ? ZOK : ZMARSHALLINGERROR;
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_void_completion(zh, h.xid, completion, data);
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_void_completion(zh, h.xid, h.type, completion, data);
+    rc = queue_request_buffer(zh, b, rc, 0);
     leave_critical(zh);
-    free_duplicate_path(req.path, path);
-    /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending request xid=%#x for path [%s] to %s",h.xid,path,
             zoo_get_current_server(zh)));
@@ -3354,27 +4099,24 @@ int zoo_awexists(zhandle_t *zh, const char *path,
         watcher_fn watcher, void* watcherCtx,
         stat_completion_t completion, const void *data)
 {
-    struct oarchive *oa;
-    struct RequestHeader h = {get_xid(), ZOO_EXISTS_OP};
+    COUNT_CALLS_AS(ZOO_ENTRY_EXISTS);
+    buffer_list_t *b;
+    struct RequestHeader h = {get_xid(zh), ZOO_EXISTS_OP};
     struct ExistsRequest req;
+    struct path_scan scan;
     int rc = Request_path_watch_init(zh, 0, &req.path, path, 
-            &req.watch, watcher != NULL);
+            &req.watch, watcher != NULL, &scan);
     if (rc != ZOK) {
         return rc;
     }
-    oa = create_buffer_oarchive();
-    rc = serialize_RequestHeader(oa, "header", &h);
-    rc = rc < 0 ? rc : serialize_ExistsRequest(oa, "req", &req);
+    b = encode_ExistsRequest(zh->chroot, &h, &req);
+    rc = b ? ZOK : ZMARSHALLINGERROR;
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_stat_completion(zh, h.xid, completion, data,
-        create_watcher_registration(req.path,exists_result_checker,
+    rc = rc < 0 ? rc : add_stat_completion(zh, h.xid, h.type, completion, data,
+        create_watcher_registration(zh->chroot,req.path,&scan,exists_result_checker,
                 watcher,watcherCtx));
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = queue_request_buffer(zh, b, rc, 0);
     leave_critical(zh);
-    free_duplicate_path(req.path, path);
-    /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending request xid=%#x for path [%s] to %s",h.xid,path,
             zoo_get_current_server(zh)));
@@ -3388,26 +4130,23 @@ static int zoo_awget_children_(zhandle_t *zh, const char *path,
          strings_completion_t sc,
          const void *data)
 {
-    struct oarchive *oa;
-    struct RequestHeader h = {get_xid(), ZOO_GETCHILDREN_OP};
+    COUNT_CALLS_AS(ZOO_ENTRY_GET_CHILDREN);
+    buffer_list_t *b;
+    struct RequestHeader h = {get_xid(zh), ZOO_GETCHILDREN_OP};
     struct GetChildrenRequest req ;
+    struct path_scan scan;
     int rc = Request_path_watch_init(zh, 0, &req.path, path, 
-            &req.watch, watcher != NULL);
+            &req.watch, watcher != NULL, &scan);
     if (rc != ZOK) {
         return rc;
     }
-    oa = create_buffer_oarchive();
-    rc = serialize_RequestHeader(oa, "header", &h);
-    rc = rc < 0 ? rc : serialize_GetChildrenRequest(oa, "req", &req);
+    b = encode_GetChildrenRequest(zh->chroot, &h, &req);
+    rc = b ? ZOK : ZMARSHALLINGERROR;
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_strings_completion(zh, h.xid, sc, data,
-            create_watcher_registration(req.path,child_result_checker,watcher,watcherCtx));
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_strings_completion(zh, h.xid, h.type, sc, data,
+            create_watcher_registration(zh->chroot,req.path,&scan,child_result_checker,watcher,watcherCtx));
+    rc = queue_request_buffer(zh, b, rc, 0);
     leave_critical(zh);
-    free_duplicate_path(req.path, path);
-    /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending request xid=%#x for path [%s] to %s",h.xid,path,
             zoo_get_current_server(zh)));
@@ -3435,27 +4174,24 @@ static int zoo_awget_children2_(zhandle_t *zh, const char *path,
          strings_stat_completion_t ssc,
          const void *data)
 {
+    COUNT_CALLS_AS(ZOO_ENTRY_GET_CHILDREN);
     /* invariant: (sc == NULL) != (sc == NULL) */
-    struct oarchive *oa;
-    struct RequestHeader h = {get_xid(), ZOO_GETCHILDREN2_OP};
+    buffer_list_t *b;
+    struct RequestHeader h = {get_xid(zh), ZOO_GETCHILDREN2_OP};
     struct GetChildren2Request req ;
+    struct path_scan scan;
     int rc = Request_path_watch_init(zh, 0, &req.path, path, 
-            &req.watch, watcher != NULL);
+            &req.watch, watcher != NULL, &scan);
     if (rc != ZOK) {
         return rc;
     }
-    oa = create_buffer_oarchive();
-    rc = serialize_RequestHeader(oa, "header", &h);
-    rc = rc < 0 ? rc : serialize_GetChildren2Request(oa, "req", &req);
+    b = encode_GetChildren2Request(zh->chroot, &h, &req);
+    rc = b ? ZOK : ZMARSHALLINGERROR;
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_strings_stat_completion(zh, h.xid, ssc, data,
-            create_watcher_registration(req.path,child_result_checker,watcher,watcherCtx));
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_strings_stat_completion(zh, h.xid, h.type, ssc, data,
+            create_watcher_registration(zh->chroot,req.path,&scan,child_result_checker,watcher,watcherCtx));
+    rc = queue_request_buffer(zh, b, rc, 0);
     leave_critical(zh);
-    free_duplicate_path(req.path, path);
-    /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending request xid=%#x for path [%s] to %s",h.xid,path,
             zoo_get_current_server(zh)));
@@ -3481,24 +4217,20 @@ int zoo_awget_children2(zhandle_t *zh, const char *path,
 int zoo_async(zhandle_t *zh, const char *path,
         string_completion_t completion, const void *data)
 {
-    struct oarchive *oa;
-    struct RequestHeader h = {get_xid(), ZOO_SYNC_OP};
+    COUNT_CALLS_AS(ZOO_ENTRY_SYNC);
+    buffer_list_t *b;
+    struct RequestHeader h = {get_xid(zh), ZOO_SYNC_OP};
     struct SyncRequest req;
     int rc = Request_path_init(zh, 0, &req.path, path);
     if (rc != ZOK) {
         return rc;
     }
-    oa = create_buffer_oarchive();
-    rc = serialize_RequestHeader(oa, "header", &h);
-    rc = rc < 0 ? rc : serialize_SyncRequest(oa, "req", &req);
+    b = encode_SyncRequest(zh->chroot, &h, &req);
+    rc = b ? ZOK : ZMARSHALLINGERROR;
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_string_completion(zh, h.xid, completion, data);
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_string_completion(zh, h.xid, h.type, completion, data);
+    rc = queue_request_buffer(zh, b, rc, 0);
     leave_critical(zh);
-    free_duplicate_path(req.path, path);
-    /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending request xid=%#x for path [%s] to %s",h.xid,path,
             zoo_get_current_server(zh)));
@@ -3511,24 +4243,20 @@ int zoo_async(zhandle_t *zh, const char *path,
 int zoo_aget_acl(zhandle_t *zh, const char *path, acl_completion_t completion,
         const void *data)
 {
-    struct oarchive *oa;
-    struct RequestHeader h = {get_xid(), ZOO_GETACL_OP};
+    COUNT_CALLS_AS(ZOO_ENTRY_GET_ACL);
+    buffer_list_t *b;
+    struct RequestHeader h = {get_xid(zh), ZOO_GETACL_OP};
     struct GetACLRequest req;
     int rc = Request_path_init(zh, 0, &req.path, path) ;
     if (rc != ZOK) {
         return rc;
     }
-    oa = create_buffer_oarchive();
-    rc = serialize_RequestHeader(oa, "header", &h);
-    rc = rc < 0 ? rc : serialize_GetACLRequest(oa, "req", &req);
+    b = encode_GetACLRequest(zh->chroot, &h, &req);
+    rc = b ? ZOK : ZMARSHALLINGERROR;
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_acl_completion(zh, h.xid, completion, data);
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_acl_completion(zh, h.xid, h.type, completion, data);
+    rc = queue_request_buffer(zh, b, rc, 0);
     leave_critical(zh);
-    free_duplicate_path(req.path, path);
-    /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending request xid=%#x for path [%s] to %s",h.xid,path,
             zoo_get_current_server(zh)));
@@ -3540,26 +4268,22 @@ int zoo_aget_acl(zhandle_t *zh, const char *path, acl_completion_t completion,
 int zoo_aset_acl(zhandle_t *zh, const char *path, int version,
         struct ACL_vector *acl, void_completion_t completion, const void *data)
 {
-    struct oarchive *oa;
-    struct RequestHeader h = {get_xid(), ZOO_SETACL_OP};
+    COUNT_CALLS_AS(ZOO_ENTRY_SET_ACL);
+    buffer_list_t *b;
+    struct RequestHeader h = {get_xid(zh), ZOO_SETACL_OP};
     struct SetACLRequest req;
     int rc = Request_path_init(zh, 0, &req.path, path);
     if (rc != ZOK) {
         return rc;
     }
-    oa = create_buffer_oarchive();
     req.acl = *acl;
     req.version = version;
-    rc = serialize_RequestHeader(oa, "header", &h);
-    rc = rc < 0 ? rc : serialize_SetACLRequest(oa, "req", &req);
+    b = encode_SetACLRequest(zh->chroot, &h, &req);
+    rc = b ? ZOK : ZMARSHALLINGERROR;
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_void_completion(zh, h.xid, completion, data);
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_void_completion(zh, h.xid, h.type, completion, data);
+    rc = queue_request_buffer(zh, b, rc, 0);
     leave_critical(zh);
-    free_duplicate_path(req.path, path);
-    /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
 
     LOG_DEBUG(("Sending request xid=%#x for path [%s] to %s",h.xid,path,
             zoo_get_current_server(zh)));
@@ -3623,15 +4347,17 @@ static int CheckVersionRequest_init(zhandle_t *zh, struct CheckVersionRequest *r
     return ZOK;
 }
 
-int zoo_amulti(zhandle_t *zh, int count, const zoo_op_t *ops,
-        zoo_op_result_t *results, void_completion_t completion, const void *data)
+/*
+ * Serializes the header and sub-requests of a multi. Given a list, it also
+ * makes the completions that take the results of the sub-requests; a
+ * second pass that fills the buffer is given none.
+ */
+static int serialize_multi(zhandle_t *zh, struct oarchive *oa,
+        struct RequestHeader *h, int count, const zoo_op_t *ops,
+        zoo_op_result_t *results, completion_head_t *clist)
 {
-    struct RequestHeader h = {get_xid(), ZOO_MULTI_OP};
     struct MultiHeader mh = {-1, 1, -1};
-    struct oarchive *oa = create_buffer_oarchive();
-    completion_head_t clist = { 0 };
-
-    int rc = serialize_RequestHeader(oa, "header", &h);
+    int rc = serialize_RequestHeader(oa, "header", h);
 
     int index = 0;
     for (index=0; index < count; index++) {
@@ -3651,13 +4377,14 @@ int zoo_amulti(zhandle_t *zh, int count, const zoo_op_t *ops,
                                         op->create_op.datalen, op->create_op.acl,
                                         op->create_op.flags);
                 rc = rc < 0 ? rc : serialize_CreateRequest(oa, "req", &req);
+                if (!clist)
+                    break;
                 result->value = op->create_op.buf;
                 result->valuelen = op->create_op.buflen;
 
                 enter_critical(zh);
-                entry = create_completion_entry(h.xid, COMPLETION_STRING, op_result_string_completion, result, 0, 0);
+                entry = create_completion_entry(h->xid, COMPLETION_STRING, op_result_string_completion, result, 0, 0);
                 leave_critical(zh);
-                free_duplicate_path(req.path, op->create_op.path);
                 break;
             }
 
@@ -3665,11 +4392,12 @@ int zoo_amulti(zhandle_t *zh, int count, const zoo_op_t *ops,
                 struct DeleteRequest req;
                 rc = rc < 0 ? rc : DeleteRequest_init(zh, &req, op->delete_op.path, op->delete_op.version);
                 rc = rc < 0 ? rc : serialize_DeleteRequest(oa, "req", &req);
+                if (!clist)
+                    break;
 
                 enter_critical(zh);
-                entry = create_completion_entry(h.xid, COMPLETION_VOID, op_result_void_completion, result, 0, 0);
+                entry = create_completion_entry(h->xid, COMPLETION_VOID, op_result_void_completion, result, 0, 0);
                 leave_critical(zh);
-                free_duplicate_path(req.path, op->delete_op.path);
                 break;
             }
 
@@ -3679,12 +4407,13 @@ int zoo_amulti(zhandle_t *zh, int count, const zoo_op_t *ops,
                                         op->set_op.path, op->set_op.data,
                                         op->set_op.datalen, op->set_op.version);
                 rc = rc < 0 ? rc : serialize_SetDataRequest(oa, "req", &req);
+                if (!clist)
+                    break;
                 result->stat = op->set_op.stat;
 
                 enter_critical(zh);
-                entry = create_completion_entry(h.xid, COMPLETION_STAT, op_result_stat_completion, result, 0, 0);
+                entry = create_completion_entry(h->xid, COMPLETION_STAT, op_result_stat_completion, result, 0, 0);
                 leave_critical(zh);
-                free_duplicate_path(req.path, op->set_op.path);
                 break;
             }
 
@@ -3693,11 +4422,12 @@ int zoo_amulti(zhandle_t *zh, int count, const zoo_op_t *ops,
                 rc = rc < 0 ? rc : CheckVersionRequest_init(zh, &req,
                                         op->check_op.path, op->check_op.version);
                 rc = rc < 0 ? rc : serialize_CheckVersionRequest(oa, "req", &req);
+                if (!clist)
+                    break;
 
                 enter_critical(zh);
-                entry = create_completion_entry(h.xid, COMPLETION_VOID, op_result_void_completion, result, 0, 0);
+                entry = create_completion_entry(h->xid, COMPLETION_VOID, op_result_void_completion, result, 0, 0);
                 leave_critical(zh);
-                free_duplicate_path(req.path, op->check_op.path);
                 break;
             }
 
@@ -3706,23 +4436,48 @@ int zoo_amulti(zhandle_t *zh, int count, const zoo_op_t *ops,
                 return ZUNIMPLEMENTED;
         }
 
-        queue_completion(&clist, entry, 0);
+        if (clist)
+            queue_completion(clist, entry, 0);
     }
 
-    rc = rc < 0 ? rc : serialize_MultiHeader(oa, "multiheader", &mh);
+    return rc < 0 ? rc : serialize_MultiHeader(oa, "multiheader", &mh);
+}
+
+int zoo_amulti(zhandle_t *zh, int count, const zoo_op_t *ops,
+        zoo_op_result_t *results, void_completion_t completion, const void *data)
+{
+    COUNT_CALLS_AS(ZOO_ENTRY_MULTI);
+    struct RequestHeader h = {get_xid(zh), ZOO_MULTI_OP};
+    struct fixed_oarchive oa;
+    completion_head_t clist = { 0 };
+    buffer_list_t *b = 0;
+    int rc;
+
+    /* measure the request, as the encoders do, then fill a buffer of the
+     * exact size */
+    init_request_oarchive(&oa, zh->chroot, 0, 0);
+    rc = serialize_multi(zh, &oa.oa, &h, count, ops, results, &clist);
+    if (rc == ZUNIMPLEMENTED) {
+        return rc;
+    }
+    if (rc >= 0 && (b = allocate_request_buffer(oa.off)) == 0) {
+        rc = ZSYSTEMERROR;
+    } else if (rc >= 0) {
+        init_request_oarchive(&oa, zh->chroot, b->buffer, b->len);
+        rc = serialize_multi(zh, &oa.oa, &h, count, ops, results, 0);
+        if (rc >= 0 && oa.off != b->len) {
+            rc = ZMARSHALLINGERROR;
+        }
+    }
 
     /* BEGIN: CRTICIAL SECTION */
     enter_critical(zh);
-    rc = rc < 0 ? rc : add_multi_completion(zh, h.xid, completion, data, &clist);
-    rc = rc < 0 ? rc : queue_buffer_bytes(&zh->to_send, get_buffer(oa),
-            get_buffer_len(oa));
+    rc = rc < 0 ? rc : add_multi_completion(zh, h.xid, h.type, completion, data, &clist);
+    rc = queue_request_buffer(zh, b, rc, 0);
     leave_critical(zh);
 
-    /* We queued the buffer, so don't free it */
-    close_buffer_oarchive(&oa, 0);
-
     LOG_DEBUG(("Sending multi request xid=%#x with %d subrequests to %s",
-            h.xid, index, zoo_get_current_server(zh)));
+            h.xid, count, zoo_get_current_server(zh)));
     /* make a best (non-blocking) effort to send the requests asap */
     adaptor_send_queue(zh, 0);
 
@@ -3789,6 +4544,7 @@ void zoo_check_op_init(zoo_op_t *op, const char *path, int version)
 
 int zoo_multi(zhandle_t *zh, int count, const zoo_op_t *ops, zoo_op_result_t *results)
 {
+    COUNT_CALLS_AS(ZOO_ENTRY_MULTI);
     int rc;
 
     struct sync_completion *sc = alloc_sync_completion();
@@ -3811,6 +4567,7 @@ int zoo_multi(zhandle_t *zh, int count, const zoo_op_t *ops, zoo_op_result_t *re
 int flush_send_queue(zhandle_t*zh, int timeout)
 {
     int rc= ZOK;
+    int tracing;
     struct timeval started;
 #ifdef WIN32
     fd_set pollSet;
@@ -3853,7 +4610,10 @@ int flush_send_queue(zhandle_t*zh, int timeout)
             }
         }
 
+        tracing = zh->trace.trace && zh->to_send.head->curr_offset == 0;
         rc = send_buffer(zh->fd, zh->to_send.head);
+        if (tracing && (rc > 0 || (rc == 0 && zh->to_send.head->curr_offset > 0)))
+            trace_sent(zh, zh->to_send.head);
         if(rc==0 && timeout==0){
             /* send_buffer would block while sending this buffer */
             rc = ZOK;
@@ -3864,8 +4624,11 @@ int flush_send_queue(zhandle_t*zh, int timeout)
             break;
         }
         // if the buffer has been sent successfully, remove it from the queue
-        if (rc > 0)
+        if (rc > 0) {
+            zh->stats.bytes_sent += zh->to_send.head->len + 4;
+            zh->stats.packets_sent++;
             remove_buffer(&zh->to_send);
+        }
         gettimeofday(&zh->last_send, 0);
         rc = ZOK;
     }
@@ -3938,6 +4701,7 @@ const char* zerror(int c)
 int zoo_add_auth(zhandle_t *zh,const char* scheme,const char* cert,
         int certLen,void_completion_t completion, const void *data)
 {
+    COUNT_CALLS_AS(ZOO_ENTRY_ADD_AUTH);
     struct buffer auth;
     auth_info *authinfo;
     if(scheme==NULL || zh==NULL)
@@ -4025,6 +4789,7 @@ int zoo_create(zhandle_t *zh, const char *path, const char *value,
         int valuelen, const struct ACL_vector *acl, int flags,
         char *path_buffer, int path_buffer_len)
 {
+    COUNT_CALLS_AS(ZOO_ENTRY_CREATE);
     struct sync_completion *sc = alloc_sync_completion();
     int rc;
     if (!sc) {
@@ -4045,6 +4810,7 @@ int zoo_create2(zhandle_t *zh, const char *path, const char *value,
         int valuelen, const struct ACL_vector *acl, int flags,
         char *path_buffer, int path_buffer_len, struct Stat *stat)
 {
+    COUNT_CALLS_AS(ZOO_ENTRY_CREATE);
     struct sync_completion *sc = alloc_sync_completion();
     int rc;
     if (!sc) {
@@ -4067,6 +4833,7 @@ int zoo_create2(zhandle_t *zh, const char *path, const char *value,
 
 int zoo_delete(zhandle_t *zh, const char *path, int version)
 {
+    COUNT_CALLS_AS(ZOO_ENTRY_DELETE);
     struct sync_completion *sc = alloc_sync_completion();
     int rc;
     if (!sc) {
@@ -4089,6 +4856,7 @@ int zoo_exists(zhandle_t *zh, const char *path, int watch, struct Stat *stat)
 int zoo_wexists(zhandle_t *zh, const char *path,
         watcher_fn watcher, void* watcherCtx, struct Stat *stat)
 {
+    COUNT_CALLS_AS(ZOO_ENTRY_EXISTS);
     struct sync_completion *sc = alloc_sync_completion();
     int rc;
     if (!sc) {
@@ -4117,6 +4885,7 @@ int zoo_wget(zhandle_t *zh, const char *path,
         watcher_fn watcher, void* watcherCtx,
         char *buffer, int* buffer_len, struct Stat *stat)
 {
+    COUNT_CALLS_AS(ZOO_ENTRY_GET);
     struct sync_completion *sc;
     int rc=0;
 
@@ -4150,6 +4919,7 @@ int zoo_getconfig(zhandle_t *zh, int watch, char *buffer,
 int zoo_wgetconfig(zhandle_t *zh, watcher_fn watcher, void* watcherCtx,
        char *buffer, int* buffer_len, struct Stat *stat)
 {
+    COUNT_CALLS_AS(ZOO_ENTRY_GETCONFIG);
    return zoo_wget(zh, ZOO_CONFIG_NODE, watcher, watcherCtx, buffer, buffer_len, stat);
 }
 
@@ -4158,6 +4928,7 @@ int zoo_reconfig(zhandle_t *zh, const char *joining, const char *leaving,
        const char *members, int64_t version, char *buffer, int* buffer_len,
        struct Stat *stat)
 {
+    COUNT_CALLS_AS(ZOO_ENTRY_RECONFIG);
     struct sync_completion *sc;
     int rc=0;
 
@@ -4192,6 +4963,7 @@ int zoo_set(zhandle_t *zh, const char *path, const char *buffer, int buflen,
 int zoo_set2(zhandle_t *zh, const char *path, const char *buffer, int buflen,
         int version, struct Stat *stat)
 {
+    COUNT_CALLS_AS(ZOO_ENTRY_SET);
     struct sync_completion *sc = alloc_sync_completion();
     int rc;
     if (!sc) {
@@ -4213,6 +4985,7 @@ static int zoo_wget_children_(zhandle_t *zh, const char *path,
         watcher_fn watcher, void* watcherCtx,
         struct String_vector *strings)
 {
+    COUNT_CALLS_AS(ZOO_ENTRY_GET_CHILDREN);
     struct sync_completion *sc = alloc_sync_completion();
     int rc;
     if (!sc) {
@@ -4238,6 +5011,7 @@ static int zoo_wget_children2_(zhandle_t *zh, const char *path,
         watcher_fn watcher, void* watcherCtx,
         struct String_vector *strings, struct Stat *stat)
 {
+    COUNT_CALLS_AS(ZOO_ENTRY_GET_CHILDREN);
     struct sync_completion *sc = alloc_sync_completion();
     int rc;
     if (!sc) {
@@ -4290,6 +5064,7 @@ int zoo_wget_children2(zhandle_t *zh, const char *path,
 int zoo_get_acl(zhandle_t *zh, const char *path, struct ACL_vector *acl,
         struct Stat *stat)
 {
+    COUNT_CALLS_AS(ZOO_ENTRY_GET_ACL);
     struct sync_completion *sc = alloc_sync_completion();
     int rc;
     if (!sc) {
@@ -4317,6 +5092,7 @@ int zoo_get_acl(zhandle_t *zh, const char *path, struct ACL_vector *acl,
 int zoo_set_acl(zhandle_t *zh, const char *path, int version,
         const struct ACL_vector *acl)
 {
+    COUNT_CALLS_AS(ZOO_ENTRY_SET_ACL);
     struct sync_completion *sc = alloc_sync_completion();
     int rc;
     if (!sc) {
@@ -143,6 +143,31 @@ void* Mock_calloc::call(size_t p1, size_t p2){
 
 Mock_calloc* Mock_calloc::mock_=0;
 
+// *****************************************************************************
+// malloc
+#ifndef USING_DUMA
+DECLARE_WRAPPER(void*,malloc,(size_t s)){
+    if(!Mock_malloc::mock_)
+        return CALL_REAL(malloc,(s));
+    return Mock_malloc::mock_->call(s);
+}
+#endif
+
+void* Mock_malloc::call(size_t s){
+#ifndef USING_DUMA
+    if(counter++ ==callsBeforeFailure){
+        counter=0;
+        errno=errnoOnFailure;
+        return 0;
+    }
+    return CALL_REAL(malloc,(s));
+#else
+    return 0;
+#endif
+}
+
+Mock_malloc* Mock_malloc::mock_=0;
+
 // *****************************************************************************
 // realloc
 
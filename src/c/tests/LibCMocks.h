@@ -85,6 +85,25 @@ public:
     static Mock_calloc* mock_;
 };
 
+// *****************************************************************************
+// malloc
+
+class Mock_malloc: public Mock
+{
+public:
+    Mock_malloc():errnoOnFailure(ENOMEM),callsBeforeFailure(-1),counter(0) {
+        mock_=this;
+    }
+    virtual ~Mock_malloc() {mock_=0;}
+
+    int errnoOnFailure;
+    int callsBeforeFailure;
+    int counter;
+    virtual void* call(size_t s);
+
+    static Mock_malloc* mock_;
+};
+
 // *****************************************************************************
 // realloc
 
@@ -202,13 +221,17 @@ public:
             errno=sendErrno;
             return -1;
         }
-        // first call to send() is always the length of the buffer to follow
-        bool sendingLength=sendBuffer.size()==0;
-        // overwrite the length bytes
-        sendBuffer.assign((const char*)buf,len);
-        if(!sendingLength){
-            notifyBufferSent(sendBuffer);
-            sendBuffer.erase();
+        // the length prefix may arrive in its own send() or in the same
+        // send() as the body; split the stream on the prefix either way
+        sendBuffer.append((const char*)buf,len);
+        while(sendBuffer.size()>=4){
+            const unsigned char* p=(const unsigned char*)sendBuffer.data();
+            size_t blen=(size_t(p[0])<<24)|(p[1]<<16)|(p[2]<<8)|p[3];
+            if(sendBuffer.size()<4+blen)
+                break;
+            std::string body=sendBuffer.substr(4,blen);
+            sendBuffer.erase(0,4+blen);
+            notifyBufferSent(body);
         }
         return len;
     }
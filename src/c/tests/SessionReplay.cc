@@ -0,0 +1,422 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <zookeeper.h>
+#include <proto.h>
+
+#include "src/zk_adaptor.h"
+#include "SessionReplay.h"
+
+using namespace std;
+
+static const uint32_t SESSION_LOG_MAGIC=0x5a4b5253; // "ZKRS"
+static const uint32_t SESSION_LOG_VERSION=1;
+
+// *****************************************************************************
+// SessionLog
+
+static bool writeInt(FILE* f,uint32_t v){
+    v=htonl(v);
+    return fwrite(&v,sizeof(v),1,f)==1;
+}
+
+static bool readInt(FILE* f,uint32_t& v){
+    if(fread(&v,sizeof(v),1,f)!=1)
+        return false;
+    v=ntohl(v);
+    return true;
+}
+
+bool SessionLog::save(const char* path) const{
+    FILE* f=fopen(path,"wb");
+    if(f==0)
+        return false;
+    bool ok=writeInt(f,SESSION_LOG_MAGIC) && writeInt(f,SESSION_LOG_VERSION);
+    for(unsigned i=0;ok && i<packets.size();i++){
+        const Packet& p=packets[i];
+        ok=fputc(p.dir,f)!=EOF && writeInt(f,p.bytes.size()) &&
+            (p.bytes.empty() || fwrite(p.bytes.data(),p.bytes.size(),1,f)==1);
+    }
+    return fclose(f)==0 && ok;
+}
+
+bool SessionLog::load(const char* path){
+    FILE* f=fopen(path,"rb");
+    if(f==0)
+        return false;
+    uint32_t magic,version,len;
+    bool ok=readInt(f,magic) && magic==SESSION_LOG_MAGIC &&
+        readInt(f,version) && version==SESSION_LOG_VERSION;
+    packets.clear();
+    int dir;
+    while(ok && (dir=fgetc(f))!=EOF){
+        string bytes;
+        ok=readInt(f,len) && len<0x10000000;
+        if(ok && len>0){
+            bytes.resize(len);
+            ok=fread(&bytes[0],len,1,f)==1;
+        }
+        if(ok)
+            packets.push_back(Packet((Direction)dir,bytes));
+    }
+    fclose(f);
+    return ok;
+}
+
+// *****************************************************************************
+// SessionRecorder
+
+SessionRecorder::SessionRecorder(Mock_socket* inner,int port):
+    inner_(inner),port_(port),fd_(inner?(int)FD:-1),connecting_(false)
+{
+}
+
+SessionRecorder::~SessionRecorder(){
+}
+
+SessionLog SessionRecorder::log() const{
+    synchronized(mx_);
+    return log_;
+}
+
+int SessionRecorder::callSocket(int domain, int type, int protocol){
+    if(inner_)
+        return inner_->callSocket(domain,type,protocol);
+    return LIBC_SYMBOLS.socket(domain,type,protocol);
+}
+
+int SessionRecorder::callClose(int fd){
+    if(!inner_ && fd==fd_){
+        synchronized(mx_);
+        fd_=-2; // only the first connection is recorded
+    }
+    if(inner_)
+        return inner_->callClose(fd);
+    return LIBC_SYMBOLS.close(fd);
+}
+
+int SessionRecorder::callGet(int s,int level,int optname,void *optval,socklen_t *len){
+    if(inner_)
+        return inner_->callGet(s,level,optname,optval,len);
+    return LIBC_SYMBOLS.getsockopt(s,level,optname,optval,len);
+}
+
+int SessionRecorder::callSet(int s,int level,int optname,const void *optval,socklen_t len){
+    if(inner_)
+        return inner_->callSet(s,level,optname,optval,len);
+    return LIBC_SYMBOLS.setsockopt(s,level,optname,optval,len);
+}
+
+int SessionRecorder::callConnect(int s,const struct sockaddr *addr,socklen_t len){
+    {
+        synchronized(mx_);
+        if(inner_ || fd_==-1){
+            const sockaddr_in* in=(const sockaddr_in*)addr;
+            if(inner_ || (in->sin_family==AF_INET && ntohs(in->sin_port)==port_)){
+                fd_=s;
+                connecting_=true;
+            }
+        }
+    }
+    if(inner_)
+        return inner_->callConnect(s,addr,len);
+    return LIBC_SYMBOLS.connect(s,addr,len);
+}
+
+// splits what went through the socket into packets and logs them
+void SessionRecorder::append(string& stream,const char* buf,ssize_t len,
+        bool sent)
+{
+    stream.append(buf,len);
+    while(stream.size()>=4){
+        uint32_t plen;
+        memcpy(&plen,stream.data(),4);
+        plen=ntohl(plen);
+        if(stream.size()<4+plen)
+            break;
+        SessionLog::Direction dir;
+        if(connecting_)
+            dir=sent?SessionLog::CONNECT_REQUEST:SessionLog::CONNECT_RESPONSE;
+        else
+            dir=sent?SessionLog::REQUEST:SessionLog::REPLY;
+        if(dir==SessionLog::CONNECT_RESPONSE)
+            connecting_=false;
+        log_.packets.push_back(SessionLog::Packet(dir,stream.substr(4,plen)));
+        stream.erase(0,4+plen);
+    }
+}
+
+ssize_t SessionRecorder::callSend(int s,const void *buf,size_t len,int flags){
+    ssize_t rc=inner_?inner_->callSend(s,buf,len,flags):
+        LIBC_SYMBOLS.send(s,buf,len,flags);
+    int err=errno;
+    if(rc>0){
+        synchronized(mx_);
+        if(s==fd_)
+            append(sent_,(const char*)buf,rc,true);
+    }
+    errno=err;
+    return rc;
+}
+
+ssize_t SessionRecorder::callRecv(int s,void *buf,size_t len,int flags){
+    ssize_t rc=inner_?inner_->callRecv(s,buf,len,flags):
+        LIBC_SYMBOLS.recv(s,buf,len,flags);
+    int err=errno;
+    if(rc>0){
+        synchronized(mx_);
+        if(s==fd_)
+            append(received_,(const char*)buf,rc,false);
+    }
+    errno=err;
+    return rc;
+}
+
+bool SessionRecorder::hasMoreRecv() const{
+    return inner_?inner_->hasMoreRecv():false;
+}
+
+#ifndef THREADED
+// *****************************************************************************
+// SessionReplayer
+
+void SessionReplayer::Stats::clear(){
+    requests=replies=completions=events=mismatches=0;
+    sends=recvs=allocations=0;
+    cpuNanos=0;
+}
+
+SessionReplayer::SessionReplayer(const SessionLog& log):
+    log_(log),stats_(0),expected_(0)
+{
+}
+
+ssize_t SessionReplayer::callSend(int s,const void *buf,size_t len,int flags){
+    if(stats_)
+        stats_->sends++;
+    return Mock_socket::callSend(s,buf,len,flags);
+}
+
+ssize_t SessionReplayer::callRecv(int s,void *buf,size_t len,int flags){
+    if(stats_)
+        stats_->recvs++;
+    if(recvReturnBuffer.empty()){
+        errno=EAGAIN;
+        return -1;
+    }
+    return Mock_socket::callRecv(s,buf,len,flags);
+}
+
+void SessionReplayer::notifyBufferSent(const string& buffer){
+    // the close request, when the replay is over, isn't checked
+    if(expected_==0)
+        return;
+    if(buffer!=*expected_)
+        stats_->mismatches++;
+    expected_=0;
+}
+
+static void countingWatcher(zhandle_t*,int type,int,const char*,void* ctx){
+    if(type!=ZOO_SESSION_EVENT)
+        ((SessionReplayer::Stats*)ctx)->events++;
+}
+
+static void countCompletion(const void* data){
+    ((SessionReplayer::Stats*)data)->completions++;
+}
+static void voidCompletion(int,const void* data){
+    countCompletion(data);
+}
+static void statCompletion(int,const Stat*,const void* data){
+    countCompletion(data);
+}
+static void dataCompletion(int,const char*,int,const Stat*,const void* data){
+    countCompletion(data);
+}
+static void stringsCompletion(int,const String_vector*,const void* data){
+    countCompletion(data);
+}
+static void stringsStatCompletion(int,const String_vector*,const Stat*,
+        const void* data){
+    countCompletion(data);
+}
+static void aclCompletion(int,ACL_vector*,Stat*,const void* data){
+    countCompletion(data);
+}
+static void stringCompletion(int,const char*,const void* data){
+    countCompletion(data);
+}
+static void stringStatCompletion(int,const char*,const Stat*,const void* data){
+    countCompletion(data);
+}
+
+static int32_t packetXid(const string& packet){
+    int32_t xid=0;
+    if(packet.size()>=4){
+        memcpy(&xid,packet.data(),4);
+        xid=ntohl(xid);
+    }
+    return xid;
+}
+
+// requests the library makes by itself
+static bool isInternal(int32_t xid){
+    return xid==PING_XID || xid==AUTH_XID || xid==SET_WATCHES_XID;
+}
+
+// Each case decodes the request and makes the call that sent it. A request
+// with a watch gets the counting watcher, and so gets the same watch flag.
+#define REPLAY_CASE(op,type,call)                                          \
+    case op: {                                                            \
+        struct type req;                                                  \
+        memset(&req,0,sizeof(req));                                       \
+        rc=deserialize_##type(ia,"req",&req);                             \
+        if(rc==0)                                                         \
+            rc=call;                                                      \
+        deallocate_##type(&req);                                          \
+        break;                                                            \
+    }
+
+int SessionReplayer::issue(zhandle_t* zh,const string& request){
+    iarchive* ia=create_buffer_iarchive((char*)request.data(),request.size());
+    RequestHeader h;
+    int rc=deserialize_RequestHeader(ia,"header",&h);
+    watcher_fn w=countingWatcher;
+    Stats* s=stats_;
+
+    // the client will give the request the xid it had when it was recorded
+    zh->xid=h.xid;
+    expected_=&request;
+    switch(rc==0?h.type:-1){
+    REPLAY_CASE(ZOO_CREATE_OP,CreateRequest,
+            zoo_acreate(zh,req.path,req.data.buff,req.data.len,&req.acl,
+                    req.flags,stringCompletion,s))
+    REPLAY_CASE(ZOO_CREATE2_OP,Create2Request,
+            zoo_acreate2(zh,req.path,req.data.buff,req.data.len,&req.acl,
+                    req.flags,stringStatCompletion,s))
+    REPLAY_CASE(ZOO_DELETE_OP,DeleteRequest,
+            zoo_adelete(zh,req.path,req.version,voidCompletion,s))
+    REPLAY_CASE(ZOO_EXISTS_OP,ExistsRequest,
+            zoo_awexists(zh,req.path,req.watch?w:0,s,statCompletion,s))
+    REPLAY_CASE(ZOO_GETDATA_OP,GetDataRequest,
+            zoo_awget(zh,req.path,req.watch?w:0,s,dataCompletion,s))
+    REPLAY_CASE(ZOO_SETDATA_OP,SetDataRequest,
+            zoo_aset(zh,req.path,req.data.buff,req.data.len,req.version,
+                    statCompletion,s))
+    REPLAY_CASE(ZOO_GETCHILDREN_OP,GetChildrenRequest,
+            zoo_awget_children(zh,req.path,req.watch?w:0,s,
+                    stringsCompletion,s))
+    REPLAY_CASE(ZOO_GETCHILDREN2_OP,GetChildren2Request,
+            zoo_awget_children2(zh,req.path,req.watch?w:0,s,
+                    stringsStatCompletion,s))
+    REPLAY_CASE(ZOO_GETACL_OP,GetACLRequest,
+            zoo_aget_acl(zh,req.path,aclCompletion,s))
+    REPLAY_CASE(ZOO_SETACL_OP,SetACLRequest,
+            zoo_aset_acl(zh,req.path,req.version,&req.acl,voidCompletion,s))
+    REPLAY_CASE(ZOO_SYNC_OP,SyncRequest,
+            zoo_async(zh,req.path,stringCompletion,s))
+    default:
+        rc=rc==0?ZUNIMPLEMENTED:ZMARSHALLINGERROR;
+        break;
+    }
+    close_buffer_iarchive(&ia);
+    expected_=0;
+    if(rc==ZOK)
+        stats_->requests++;
+    return rc;
+}
+
+int SessionReplayer::deliver(zhandle_t* zh,const string& reply){
+    uint32_t len=htonl(reply.size());
+    recvReturnBuffer.append((const char*)&len,sizeof(len));
+    recvReturnBuffer.append(reply);
+    stats_->replies++;
+    // one reply per call, and only while there is one to read: an empty
+    // read would look like the server closing the connection
+    while(!recvReturnBuffer.empty()){
+        int rc=zookeeper_process(zh,ZOOKEEPER_READ);
+        if(rc!=ZOK && rc!=ZNOTHING)
+            return rc;
+    }
+    return ZOK;
+}
+
+static int64_t cpuNanos(){
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&ts);
+    return (int64_t)ts.tv_sec*1000000000+ts.tv_nsec;
+}
+
+int SessionReplayer::replay(zhandle_t* zh,Stats& stats){
+    // check that every request can be issued before starting
+    for(unsigned i=0;i<log_.packets.size();i++){
+        const SessionLog::Packet& p=log_.packets[i];
+        if(p.dir!=SessionLog::REQUEST || isInternal(packetXid(p.bytes)))
+            continue;
+        int32_t type=0;
+        if(p.bytes.size()>=8){
+            memcpy(&type,p.bytes.data()+4,4);
+            type=ntohl(type);
+        }
+        switch(type){
+        case ZOO_CREATE_OP: case ZOO_CREATE2_OP: case ZOO_DELETE_OP:
+        case ZOO_EXISTS_OP: case ZOO_GETDATA_OP: case ZOO_SETDATA_OP:
+        case ZOO_GETCHILDREN_OP: case ZOO_GETCHILDREN2_OP:
+        case ZOO_GETACL_OP: case ZOO_SETACL_OP: case ZOO_SYNC_OP:
+        case ZOO_CLOSE_OP:
+            break;
+        default:
+            return ZUNIMPLEMENTED;
+        }
+    }
+
+    stats.clear();
+    stats_=&stats;
+    int rc=ZOK;
+    {
+        Mock_malloc mallocMock;
+        Mock_calloc callocMock;
+        Mock_realloc reallocMock;
+        int64_t start=cpuNanos();
+        for(unsigned i=0;rc==ZOK && i<log_.packets.size();i++){
+            const SessionLog::Packet& p=log_.packets[i];
+            int32_t xid=packetXid(p.bytes);
+            if(isInternal(xid))
+                continue;
+            if(p.dir==SessionLog::REQUEST){
+                int32_t type;
+                memcpy(&type,p.bytes.data()+4,4);
+                if((int32_t)ntohl(type)!=ZOO_CLOSE_OP)
+                    rc=issue(zh,p.bytes);
+            }else if(p.dir==SessionLog::REPLY){
+                rc=deliver(zh,p.bytes);
+            }
+        }
+        stats.cpuNanos=cpuNanos()-start;
+        stats.allocations=mallocMock.counter+callocMock.counter+
+            reallocMock.counter;
+    }
+    stats_=0;
+    return rc;
+}
+#endif
@@ -0,0 +1,143 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SESSIONREPLAY_H_
+#define SESSIONREPLAY_H_
+
+#include <string>
+#include <vector>
+
+#include <zookeeper.h>
+
+#include "LibCMocks.h"
+#include "ThreadingUtil.h"
+
+// *****************************************************************************
+// The packets of one client connection, in the order the client saw them:
+// a packet from the server is logged once the client has read all of it.
+// Packets are kept without their length prefix.
+struct SessionLog
+{
+    enum Direction{
+        CONNECT_REQUEST='C',
+        CONNECT_RESPONSE='S',
+        REQUEST='c',
+        REPLY='s'       // replies and watch events
+    };
+    struct Packet{
+        Packet(Direction d,const std::string& b):dir(d),bytes(b){}
+        Direction dir;
+        std::string bytes;
+    };
+    std::vector<Packet> packets;
+
+    // the file is a magic number and a version, then for each packet its
+    // direction as a byte, its length as a 32 bit integer in network order
+    // and the packet itself
+    bool save(const char* path) const;
+    bool load(const char* path);
+};
+
+// *****************************************************************************
+// Records the connection to a server. Socket calls go to the wrapped mock if
+// there is one, otherwise to libc, so a session can be captured against a
+// real server as well as against a ZookeeperServer simulator.
+class SessionRecorder: public Mock_socket
+{
+public:
+    // with no mock to wrap, the first connection to the port is recorded;
+    // with one, everything on the mock's FD is
+    explicit SessionRecorder(Mock_socket* inner=0,int port=0);
+    virtual ~SessionRecorder();
+
+    // a copy of the packets recorded so far
+    SessionLog log() const;
+
+    virtual int callSocket(int domain, int type, int protocol);
+    virtual int callClose(int fd);
+    virtual int callGet(int s,int level,int optname,void *optval,socklen_t *len);
+    virtual int callSet(int s,int level,int optname,const void *optval,socklen_t len);
+    virtual int callConnect(int s,const struct sockaddr *addr,socklen_t len);
+    virtual ssize_t callSend(int s,const void *buf,size_t len,int flags);
+    virtual ssize_t callRecv(int s,void *buf,size_t len,int flags);
+    virtual bool hasMoreRecv() const;
+
+private:
+    void append(std::string& stream,const char* buf,ssize_t len,bool sent);
+
+    Mock_socket* inner_;
+    int port_;
+    int fd_;
+    bool connecting_;   // the handshake is still to come
+    std::string sent_;
+    std::string received_;
+    mutable Mutex mx_;
+    SessionLog log_;
+};
+
+#ifndef THREADED
+// *****************************************************************************
+// Plays a recorded session back through a handle of the single threaded
+// library at full speed. Each recorded request is decoded and issued again
+// through the async API with the xid it had, which makes the client send the
+// same bytes; the recorded replies and watch events are then fed to
+// zookeeper_process(). Nothing waits on a clock or a server, so the counts
+// below only change when the client code does.
+//
+// Handshakes, pings, authentication and set-watches packets are the
+// library's own business and are skipped, as is the close request.
+class SessionReplayer: public Mock_socket
+{
+public:
+    struct Stats{
+        Stats(){clear();}
+        void clear();
+
+        int requests;       // issued again
+        int replies;        // fed to the client, watch events included
+        int completions;    // called
+        int events;         // watch events delivered to watchers
+        int mismatches;     // requests that went out differently
+        int sends;          // send() and recv() calls
+        int recvs;
+        int allocations;    // malloc(), calloc() and realloc() calls
+        int64_t cpuNanos;   // process CPU time
+    };
+
+    explicit SessionReplayer(const SessionLog& log);
+
+    // Replays the session through zh, which must be forceConnected(). Returns
+    // ZOK, ZUNIMPLEMENTED if the session has a request the replayer can't
+    // issue, or the error that zookeeper_process() or the API returned.
+    int replay(zhandle_t* zh,Stats& stats);
+
+    virtual ssize_t callSend(int s,const void *buf,size_t len,int flags);
+    virtual ssize_t callRecv(int s,void *buf,size_t len,int flags);
+    virtual void notifyBufferSent(const std::string& buffer);
+
+private:
+    int issue(zhandle_t* zh,const std::string& request);
+    int deliver(zhandle_t* zh,const std::string& reply);
+
+    const SessionLog& log_;
+    Stats* stats_;
+    const std::string* expected_;
+};
+#endif
+
+#endif /*SESSIONREPLAY_H_*/
@@ -0,0 +1,582 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cppunit/extensions/HelperMacros.h>
+#include "CppAssertHelper.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <list>
+#include <string>
+#include <vector>
+
+#include <zookeeper.h>
+#include "ThreadingUtil.h"
+#include "Util.h"
+#include "../bench/zkfake.h"
+
+using namespace std;
+
+class Zookeeper_fakeServer : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(Zookeeper_fakeServer);
+#ifdef THREADED
+    CPPUNIT_TEST(testBasicOps);
+    CPPUNIT_TEST(testSequence);
+    CPPUNIT_TEST(testMulti);
+    CPPUNIT_TEST(testWatches);
+    CPPUNIT_TEST(testChroot);
+    CPPUNIT_TEST(testEphemeral);
+    CPPUNIT_TEST(testDropConnections);
+    CPPUNIT_TEST(testExpireSessions);
+    CPPUNIT_TEST(testStats);
+    CPPUNIT_TEST(testTrace);
+    CPPUNIT_TEST(testFlightRecorder);
+#endif
+    CPPUNIT_TEST_SUITE_END();
+
+#ifdef THREADED
+    struct evt {
+        string path;
+        int type;
+    };
+
+    struct watchCtx {
+        Mutex mutex;
+        list<evt> events;
+        int state;
+
+        watchCtx() : state(0) {}
+
+        int getState() {
+            synchronized(mutex);
+            return state;
+        }
+        int countEvents() {
+            synchronized(mutex);
+            return events.size();
+        }
+        evt getEvent() {
+            synchronized(mutex);
+            evt e = events.front();
+            events.pop_front();
+            return e;
+        }
+    };
+
+    static void watcher(zhandle_t *, int type, int state, const char *path,
+            void *v)
+    {
+        watchCtx *ctx = (watchCtx *)v;
+        synchronized(ctx->mutex);
+        ctx->state = state;
+        if (type != ZOO_SESSION_EVENT) {
+            evt e;
+            e.path = path;
+            e.type = type;
+            ctx->events.push_back(e);
+        }
+    }
+
+    FILE *logfile;
+    zkfake_t *fz;
+
+public:
+
+    Zookeeper_fakeServer() {
+      logfile = openlogfile("Zookeeper_fakeServer");
+    }
+
+    ~Zookeeper_fakeServer() {
+      if (logfile) {
+        fflush(logfile);
+        fclose(logfile);
+        logfile = 0;
+      }
+    }
+
+    void setUp()
+    {
+        zoo_set_log_stream(logfile);
+        fz = zkfake_start(0);
+        CPPUNIT_ASSERT(fz != 0);
+    }
+
+    void tearDown()
+    {
+        zkfake_stop(fz);
+    }
+
+    zhandle_t *createClient(watchCtx *ctx, const char *chroot = "")
+    {
+        char host[64];
+        snprintf(host, sizeof(host), "127.0.0.1:%d%s", zkfake_port(fz),
+                chroot);
+        zhandle_t *zh = zookeeper_init(host, watcher, 10000, 0, ctx, 0);
+        CPPUNIT_ASSERT(zh != 0);
+        CPPUNIT_ASSERT(waitFor(ctx, ZOO_CONNECTED_STATE));
+        return zh;
+    }
+
+    bool waitFor(watchCtx *ctx, int state)
+    {
+        for (int i = 0; i < 1000 && ctx->getState() != state; i++)
+            millisleep(10);
+        return ctx->getState() == state;
+    }
+
+    bool waitForEvents(watchCtx *ctx, int count)
+    {
+        for (int i = 0; i < 1000 && ctx->countEvents() < count; i++)
+            millisleep(10);
+        return ctx->countEvents() >= count;
+    }
+
+    bool waitForConnections(int count)
+    {
+        struct zkfake_stats stats;
+        for (int i = 0; i < 1000; i++) {
+            zkfake_get_stats(fz, &stats);
+            if (stats.connections >= count)
+                return true;
+            millisleep(10);
+        }
+        return false;
+    }
+
+    void testBasicOps()
+    {
+        watchCtx ctx;
+        zhandle_t *zh = createClient(&ctx);
+        char buf[64];
+        int len = sizeof(buf);
+        struct Stat stat;
+        struct String_vector children;
+
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_create(zh, "/a", "one", 3,
+                &ZOO_OPEN_ACL_UNSAFE, 0, 0, 0));
+        CPPUNIT_ASSERT_EQUAL((int)ZNODEEXISTS, zoo_create(zh, "/a", "", 0,
+                &ZOO_OPEN_ACL_UNSAFE, 0, 0, 0));
+        CPPUNIT_ASSERT_EQUAL((int)ZNONODE, zoo_create(zh, "/x/y", "", 0,
+                &ZOO_OPEN_ACL_UNSAFE, 0, 0, 0));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_get(zh, "/a", 0, buf, &len, &stat));
+        CPPUNIT_ASSERT_EQUAL(string("one"), string(buf, len));
+        CPPUNIT_ASSERT_EQUAL(0, stat.version);
+
+        CPPUNIT_ASSERT_EQUAL((int)ZBADVERSION, zoo_set(zh, "/a", "two", 3, 5));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_set(zh, "/a", "two", 3, 0));
+        len = sizeof(buf);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_get(zh, "/a", 0, buf, &len, &stat));
+        CPPUNIT_ASSERT_EQUAL(string("two"), string(buf, len));
+        CPPUNIT_ASSERT_EQUAL(1, stat.version);
+
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_create(zh, "/a/b", 0, -1,
+                &ZOO_OPEN_ACL_UNSAFE, 0, 0, 0));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_get_children(zh, "/a", 0,
+                &children));
+        CPPUNIT_ASSERT_EQUAL(1, children.count);
+        CPPUNIT_ASSERT_EQUAL(string("b"), string(children.data[0]));
+        deallocate_String_vector(&children);
+
+        CPPUNIT_ASSERT_EQUAL((int)ZNOTEMPTY, zoo_delete(zh, "/a", -1));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_delete(zh, "/a/b", -1));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_delete(zh, "/a", -1));
+        CPPUNIT_ASSERT_EQUAL((int)ZNONODE, zoo_exists(zh, "/a", 0, &stat));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_exists(zh, "/zookeeper", 0, &stat));
+        zookeeper_close(zh);
+    }
+
+    void testSequence()
+    {
+        watchCtx ctx;
+        zhandle_t *zh = createClient(&ctx);
+        char path[64];
+
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_create(zh, "/q", "", 0,
+                &ZOO_OPEN_ACL_UNSAFE, 0, 0, 0));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_create(zh, "/q/n-", "", 0,
+                &ZOO_OPEN_ACL_UNSAFE, ZOO_SEQUENCE, path, sizeof(path)));
+        CPPUNIT_ASSERT_EQUAL(string("/q/n-0000000000"), string(path));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_create(zh, "/q/n-", "", 0,
+                &ZOO_OPEN_ACL_UNSAFE, ZOO_SEQUENCE, path, sizeof(path)));
+        CPPUNIT_ASSERT_EQUAL(string("/q/n-0000000001"), string(path));
+        zookeeper_close(zh);
+    }
+
+    void testMulti()
+    {
+        watchCtx ctx;
+        zhandle_t *zh = createClient(&ctx);
+        zoo_op_t ops[3];
+        zoo_op_result_t results[3];
+        char p1[64], p2[64];
+        struct Stat stat;
+
+        zoo_create_op_init(&ops[0], "/m1", "", 0, &ZOO_OPEN_ACL_UNSAFE, 0,
+                p1, sizeof(p1));
+        zoo_create_op_init(&ops[1], "/m2", "", 0, &ZOO_OPEN_ACL_UNSAFE, 0,
+                p2, sizeof(p2));
+        zoo_set_op_init(&ops[2], "/m1", "x", 1, 0, &stat);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_multi(zh, 3, ops, results));
+        CPPUNIT_ASSERT_EQUAL(string("/m2"), string(p2));
+        CPPUNIT_ASSERT_EQUAL(1, stat.version);
+
+        // the delete fails, so the create is rolled back
+        zoo_create_op_init(&ops[0], "/m3", "", 0, &ZOO_OPEN_ACL_UNSAFE, 0,
+                p1, sizeof(p1));
+        zoo_delete_op_init(&ops[1], "/m2", 7);
+        zoo_check_op_init(&ops[2], "/m1", 1);
+        CPPUNIT_ASSERT_EQUAL((int)ZBADVERSION, zoo_multi(zh, 3, ops,
+                results));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, results[0].err);
+        CPPUNIT_ASSERT_EQUAL((int)ZBADVERSION, results[1].err);
+        CPPUNIT_ASSERT_EQUAL((int)ZRUNTIMEINCONSISTENCY, results[2].err);
+        CPPUNIT_ASSERT_EQUAL((int)ZNONODE, zoo_exists(zh, "/m3", 0, 0));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_exists(zh, "/m2", 0, 0));
+        zookeeper_close(zh);
+    }
+
+    void testWatches()
+    {
+        watchCtx ctx1, ctx2;
+        zhandle_t *zh1 = createClient(&ctx1);
+        zhandle_t *zh2 = createClient(&ctx2);
+        struct String_vector children;
+        char buf[8];
+        int len = sizeof(buf);
+
+        CPPUNIT_ASSERT_EQUAL((int)ZNONODE, zoo_exists(zh1, "/w", 1, 0));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_get_children(zh1, "/", 1,
+                &children));
+        deallocate_String_vector(&children);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_create(zh2, "/w", "", 0,
+                &ZOO_OPEN_ACL_UNSAFE, 0, 0, 0));
+        CPPUNIT_ASSERT(waitForEvents(&ctx1, 2));
+        evt e1 = ctx1.getEvent();
+        evt e2 = ctx1.getEvent();
+        CPPUNIT_ASSERT_EQUAL(string("/w"), e1.path);
+        CPPUNIT_ASSERT_EQUAL(ZOO_CREATED_EVENT, e1.type);
+        CPPUNIT_ASSERT_EQUAL(string("/"), e2.path);
+        CPPUNIT_ASSERT_EQUAL(ZOO_CHILD_EVENT, e2.type);
+
+        // watches fire once
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_get(zh1, "/w", 1, buf, &len, 0));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_set(zh2, "/w", "1", 1, -1));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_set(zh2, "/w", "2", 1, -1));
+        CPPUNIT_ASSERT(waitForEvents(&ctx1, 1));
+        e1 = ctx1.getEvent();
+        CPPUNIT_ASSERT_EQUAL(ZOO_CHANGED_EVENT, e1.type);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_exists(zh2, "/w", 0, 0));
+        CPPUNIT_ASSERT_EQUAL(0, ctx1.countEvents());
+        zookeeper_close(zh1);
+        zookeeper_close(zh2);
+    }
+
+    void testChroot()
+    {
+        watchCtx ctx1, ctx2;
+        zhandle_t *zh = createClient(&ctx1);
+        zhandle_t *ch;
+        struct String_vector children;
+        zoo_op_t ops[2];
+        zoo_op_result_t results[2];
+        char buf[64];
+        int len = sizeof(buf);
+
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_create(zh, "/ch", "root", 4,
+                &ZOO_OPEN_ACL_UNSAFE, 0, 0, 0));
+        ch = createClient(&ctx2, "/ch");
+
+        // the paths go out with the chroot and come back without it
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_create(ch, "/a", "", 0,
+                &ZOO_OPEN_ACL_UNSAFE, 0, buf, sizeof(buf)));
+        CPPUNIT_ASSERT_EQUAL(string("/a"), string(buf));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_exists(zh, "/ch/a", 0, 0));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_create(ch, "/a/n-", "", 0,
+                &ZOO_OPEN_ACL_UNSAFE, ZOO_SEQUENCE, buf, sizeof(buf)));
+        CPPUNIT_ASSERT_EQUAL(string("/a/n-0000000000"), string(buf));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_create(ch, "/a/n-", "", 0,
+                &ZOO_OPEN_ACL_UNSAFE, ZOO_SEQUENCE, buf, 5));
+        CPPUNIT_ASSERT_EQUAL(string("/a/n"), string(buf));
+        CPPUNIT_ASSERT_EQUAL((int)ZBADARGUMENTS, zoo_exists(ch, "a", 0, 0));
+        CPPUNIT_ASSERT_EQUAL((int)ZBADARGUMENTS, zoo_exists(ch, "/a/", 0, 0));
+
+        // "/" is the chroot itself
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_get(ch, "/", 0, buf, &len, 0));
+        CPPUNIT_ASSERT_EQUAL(string("root"), string(buf, len));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_get_children(ch, "/", 0,
+                &children));
+        CPPUNIT_ASSERT_EQUAL(1, children.count);
+        CPPUNIT_ASSERT_EQUAL(string("a"), string(children.data[0]));
+        deallocate_String_vector(&children);
+
+        zoo_create_op_init(&ops[0], "/m", "", 0, &ZOO_OPEN_ACL_UNSAFE, 0,
+                0, 0);
+        zoo_check_op_init(&ops[1], "/a", 0);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_multi(ch, 2, ops, results));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_exists(zh, "/ch/m", 0, 0));
+
+        // watches are set and delivered under the client's paths
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_exists(ch, "/a", 1, 0));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_get_children(ch, "/", 1,
+                &children));
+        deallocate_String_vector(&children);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_set(zh, "/ch/a", "1", 1, -1));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_create(zh, "/ch/b", "", 0,
+                &ZOO_OPEN_ACL_UNSAFE, 0, 0, 0));
+        CPPUNIT_ASSERT(waitForEvents(&ctx2, 2));
+        evt e1 = ctx2.getEvent();
+        evt e2 = ctx2.getEvent();
+        CPPUNIT_ASSERT_EQUAL(string("/a"), e1.path);
+        CPPUNIT_ASSERT_EQUAL(ZOO_CHANGED_EVENT, e1.type);
+        CPPUNIT_ASSERT_EQUAL(string("/"), e2.path);
+        CPPUNIT_ASSERT_EQUAL(ZOO_CHILD_EVENT, e2.type);
+        zookeeper_close(ch);
+        zookeeper_close(zh);
+    }
+
+    void testEphemeral()
+    {
+        watchCtx ctx1, ctx2;
+        zhandle_t *zh1 = createClient(&ctx1);
+        zhandle_t *zh2 = createClient(&ctx2);
+
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_create(zh1, "/e", "", 0,
+                &ZOO_OPEN_ACL_UNSAFE, ZOO_EPHEMERAL, 0, 0));
+        CPPUNIT_ASSERT_EQUAL((int)ZNOCHILDRENFOREPHEMERALS, zoo_create(zh1,
+                "/e/c", "", 0, &ZOO_OPEN_ACL_UNSAFE, 0, 0, 0));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_exists(zh2, "/e", 1, 0));
+        zookeeper_close(zh1);
+        CPPUNIT_ASSERT(waitForEvents(&ctx2, 1));
+        CPPUNIT_ASSERT_EQUAL(ZOO_DELETED_EVENT, ctx2.getEvent().type);
+        CPPUNIT_ASSERT_EQUAL((int)ZNONODE, zoo_exists(zh2, "/e", 0, 0));
+        zookeeper_close(zh2);
+    }
+
+    void testDropConnections()
+    {
+        watchCtx ctx;
+        zhandle_t *zh = createClient(&ctx);
+        int64_t id = zoo_client_id(zh)->client_id;
+
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_create(zh, "/d", "", 0,
+                &ZOO_OPEN_ACL_UNSAFE, ZOO_EPHEMERAL, 0, 0));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_exists(zh, "/d", 1, 0));
+        zkfake_drop_connections(fz);
+        CPPUNIT_ASSERT(waitForConnections(2));
+        CPPUNIT_ASSERT(waitFor(&ctx, ZOO_CONNECTED_STATE));
+        CPPUNIT_ASSERT_EQUAL(id, zoo_client_id(zh)->client_id);
+
+        // the session and its watch survived the reconnect
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_delete(zh, "/d", -1));
+        CPPUNIT_ASSERT(waitForEvents(&ctx, 1));
+        CPPUNIT_ASSERT_EQUAL(ZOO_DELETED_EVENT, ctx.getEvent().type);
+        zookeeper_close(zh);
+    }
+
+    void testExpireSessions()
+    {
+        watchCtx ctx;
+        zhandle_t *zh = createClient(&ctx);
+        struct zkfake_stats stats;
+
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_create(zh, "/x", "", 0,
+                &ZOO_OPEN_ACL_UNSAFE, ZOO_EPHEMERAL, 0, 0));
+        zkfake_expire_sessions(fz);
+        CPPUNIT_ASSERT(waitFor(&ctx, ZOO_EXPIRED_SESSION_STATE));
+        zookeeper_close(zh);
+
+        watchCtx ctx2;
+        zh = createClient(&ctx2);
+        CPPUNIT_ASSERT_EQUAL((int)ZNONODE, zoo_exists(zh, "/x", 0, 0));
+        zookeeper_close(zh);
+        zkfake_get_stats(fz, &stats);
+        CPPUNIT_ASSERT(stats.expired >= 1);
+    }
+
+    static void voidCompletion(int rc, const void *data)
+    {
+        *(int *)data = rc + 1;
+    }
+
+    void testStats()
+    {
+        watchCtx ctx;
+        zhandle_t *zh = createClient(&ctx);
+        struct zoo_stats stats;
+        char buf[8];
+        int len = sizeof(buf);
+        volatile int done = 0;
+
+        CPPUNIT_ASSERT_EQUAL((int)ZBADARGUMENTS, zoo_get_stats(zh, 0));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_create(zh, "/s", "", 0,
+                &ZOO_OPEN_ACL_UNSAFE, 0, 0, 0));
+        for (int i = 0; i < 10; i++)
+            CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_get(zh, "/s", 0, buf, &len, 0));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_adelete(zh, "/s", -1,
+                voidCompletion, (const void *)&done));
+        for (int i = 0; i < 1000 && !done; i++)
+            millisleep(10);
+        CPPUNIT_ASSERT_EQUAL(ZOK + 1, (int)done);
+
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_get_stats(zh, &stats));
+        CPPUNIT_ASSERT_EQUAL((int64_t)1, stats.requests[ZOO_CREATE_OP].count);
+        CPPUNIT_ASSERT_EQUAL((int64_t)10, stats.requests[ZOO_GETDATA_OP].count);
+        CPPUNIT_ASSERT_EQUAL((int64_t)1, stats.requests[ZOO_DELETE_OP].count);
+        CPPUNIT_ASSERT(stats.dispatch.count >= 1);
+        CPPUNIT_ASSERT(stats.packets_sent >= 12);
+        CPPUNIT_ASSERT(stats.packets_received >= 13);
+        CPPUNIT_ASSERT(stats.bytes_sent > stats.packets_sent * 4);
+        CPPUNIT_ASSERT_EQUAL(0, stats.pending_requests);
+        CPPUNIT_ASSERT(zoo_latency_percentile(&stats.requests[ZOO_GETDATA_OP],
+                0.5) <= stats.requests[ZOO_GETDATA_OP].max_us);
+        CPPUNIT_ASSERT_EQUAL((int64_t)0, stats.reconnect.count);
+
+        zkfake_drop_connections(fz);
+        CPPUNIT_ASSERT(waitForConnections(2));
+        CPPUNIT_ASSERT(waitFor(&ctx, ZOO_CONNECTED_STATE));
+        CPPUNIT_ASSERT_EQUAL((int)ZNONODE, zoo_exists(zh, "/s", 0, 0));
+        zoo_get_stats(zh, &stats);
+        CPPUNIT_ASSERT_EQUAL((int64_t)1, stats.reconnect.count);
+        zookeeper_close(zh);
+    }
+
+    struct traced {
+        int stage;
+        int32_t xid;
+        int op;
+        string path;
+        int rc;
+        int64_t time_ns;
+    };
+
+    struct traceCtx {
+        Mutex mutex;
+        vector<traced> events;
+
+        // the events seen for requests of the given operation, in order
+        vector<traced> forOp(int op) {
+            synchronized(mutex);
+            vector<traced> v;
+            for (size_t i = 0; i < events.size(); i++)
+                if (events[i].op == op)
+                    v.push_back(events[i]);
+            return v;
+        }
+    };
+
+    static void trace(zhandle_t *, const struct zoo_trace_event *event,
+            void *v)
+    {
+        traceCtx *ctx = (traceCtx *)v;
+        traced t;
+        t.stage = event->stage;
+        t.xid = event->xid;
+        t.op = event->op;
+        t.path = event->path ? event->path : "";
+        t.rc = event->rc;
+        t.time_ns = event->time_ns;
+        synchronized(ctx->mutex);
+        ctx->events.push_back(t);
+    }
+
+    bool waitForTrace(traceCtx *ctx, int op, size_t count)
+    {
+        for (int i = 0; i < 1000 && ctx->forOp(op).size() < count; i++)
+            millisleep(10);
+        return ctx->forOp(op).size() >= count;
+    }
+
+    void testTrace()
+    {
+        watchCtx ctx;
+        traceCtx tctx;
+        zhandle_t *zh = createClient(&ctx);
+        struct zoo_trace_hooks hooks = { trace, &tctx };
+        volatile int done = 0;
+
+        CPPUNIT_ASSERT_EQUAL((int)ZBADARGUMENTS, zoo_set_trace_hooks(0, &hooks));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_set_trace_hooks(zh, &hooks));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_create(zh, "/t", "", 0,
+                &ZOO_OPEN_ACL_UNSAFE, 0, 0, 0));
+        CPPUNIT_ASSERT(waitForTrace(&tctx, ZOO_CREATE_OP, 5));
+        vector<traced> v = tctx.forOp(ZOO_CREATE_OP);
+        CPPUNIT_ASSERT_EQUAL((size_t)5, v.size());
+        for (int i = 0; i < 5; i++) {
+            CPPUNIT_ASSERT_EQUAL(i + 1, v[i].stage);
+            CPPUNIT_ASSERT_EQUAL(v[0].xid, v[i].xid);
+            CPPUNIT_ASSERT_EQUAL(string("/t"), v[i].path);
+            CPPUNIT_ASSERT_EQUAL((int)ZOK, v[i].rc);
+            if (i > 0)
+                CPPUNIT_ASSERT(v[i].time_ns >= v[i - 1].time_ns);
+        }
+
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_adelete(zh, "/missing", -1,
+                voidCompletion, (const void *)&done));
+        CPPUNIT_ASSERT(waitForTrace(&tctx, ZOO_DELETE_OP, 5));
+        CPPUNIT_ASSERT_EQUAL((int)ZNONODE + 1, (int)done);
+        v = tctx.forOp(ZOO_DELETE_OP);
+        CPPUNIT_ASSERT_EQUAL(ZOO_TRACE_COMPLETED, v[4].stage);
+        CPPUNIT_ASSERT_EQUAL(string("/missing"), v[4].path);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, v[1].rc);
+        CPPUNIT_ASSERT_EQUAL((int)ZNONODE, v[2].rc);
+
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_set_trace_hooks(zh, 0));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_exists(zh, "/t", 0, 0));
+        CPPUNIT_ASSERT_EQUAL((size_t)0, tctx.forOp(ZOO_EXISTS_OP).size());
+        zookeeper_close(zh);
+    }
+
+    void testFlightRecorder()
+    {
+        watchCtx ctx;
+        zhandle_t *zh = createClient(&ctx);
+        struct zoo_flight_event events[ZOO_FLIGHT_EVENTS];
+        char buf[8192];
+        size_t len;
+
+        CPPUNIT_ASSERT_EQUAL((int)ZBADARGUMENTS, zoo_get_flight_events(zh, 0, 1));
+        int n = zoo_get_flight_events(zh, events, ZOO_FLIGHT_EVENTS);
+        CPPUNIT_ASSERT(n >= 3);
+        CPPUNIT_ASSERT_EQUAL(ZOO_FLIGHT_SERVER, events[0].type);
+        CPPUNIT_ASSERT_EQUAL((size_t)0, string(events[0].text).find("127.0.0.1:"));
+        CPPUNIT_ASSERT_EQUAL(ZOO_FLIGHT_STATE, events[n - 1].type);
+        CPPUNIT_ASSERT_EQUAL((int64_t)ZOO_CONNECTED_STATE, events[n - 1].values[0]);
+        // with less room, the most recent events are kept
+        CPPUNIT_ASSERT_EQUAL(1, zoo_get_flight_events(zh, events, 1));
+        CPPUNIT_ASSERT_EQUAL((int64_t)ZOO_CONNECTED_STATE, events[0].values[0]);
+
+        zkfake_expire_sessions(fz);
+        CPPUNIT_ASSERT(waitFor(&ctx, ZOO_EXPIRED_SESSION_STATE));
+        FILE *out = tmpfile();
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_dump_flight_recorder(zh, out));
+        rewind(out);
+        len = fread(buf, 1, sizeof(buf), out);
+        fclose(out);
+        string dump(buf, len);
+        CPPUNIT_ASSERT(dump.find("state ZOO_EXPIRED_SESSION_STATE") != string::npos);
+        CPPUNIT_ASSERT(dump.find("error session expired") != string::npos);
+        CPPUNIT_ASSERT(dump.find("awaiting a reply") != string::npos);
+        zookeeper_close(zh);
+    }
+#endif
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Zookeeper_fakeServer);
@@ -0,0 +1,206 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cppunit/extensions/HelperMacros.h>
+#include "CppAssertHelper.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <zookeeper.h>
+#include <zookeeper_log.h>
+#include "ThreadingUtil.h"
+#include "Util.h"
+
+using namespace std;
+
+class Zookeeper_logging : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(Zookeeper_logging);
+    CPPUNIT_TEST(testCallback);
+    CPPUNIT_TEST(testAsync);
+    CPPUNIT_TEST(testBinary);
+#ifdef THREADED
+    CPPUNIT_TEST(testAsyncDrops);
+#endif
+    CPPUNIT_TEST_SUITE_END();
+
+    struct sink {
+        Mutex mutex;
+        vector<string> lines;
+        volatile int blocked;
+
+        sink() : blocked(0) {}
+
+        size_t count() {
+            synchronized(mutex);
+            return lines.size();
+        }
+    };
+
+    static void callback(ZooLogLevel, const char *message, void *context)
+    {
+        sink *s = (sink *)context;
+        while (s->blocked)
+            millisleep(1);
+        synchronized(s->mutex);
+        s->lines.push_back(message);
+    }
+
+    static bool endsWith(const string &s, const string &suffix)
+    {
+        return s.size() >= suffix.size() &&
+            s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    FILE *logfile;
+
+public:
+
+    Zookeeper_logging() {
+      logfile = openlogfile("Zookeeper_logging");
+    }
+
+    ~Zookeeper_logging() {
+      if (logfile) {
+        fflush(logfile);
+        fclose(logfile);
+        logfile = 0;
+      }
+    }
+
+    void setUp()
+    {
+        zoo_set_log_stream(logfile);
+    }
+
+    void tearDown()
+    {
+        zoo_set_log_binary(0);
+        zoo_set_log_async(0);
+        zoo_set_log_callback(0, 0);
+    }
+
+    void testCallback()
+    {
+        sink s;
+        zoo_set_log_callback(callback, &s);
+        log_message(ZOO_LOG_LEVEL_WARN, 42, "testCallback", "hello");
+        CPPUNIT_ASSERT_EQUAL((size_t)1, s.lines.size());
+        CPPUNIT_ASSERT(endsWith(s.lines[0], ":ZOO_WARN@testCallback@42: hello"));
+
+        zoo_set_log_callback(0, 0);
+        log_message(ZOO_LOG_LEVEL_WARN, 42, "testCallback", "to the stream");
+        CPPUNIT_ASSERT_EQUAL((size_t)1, s.lines.size());
+    }
+
+    void testAsync()
+    {
+        sink s;
+        char msg[16];
+        zoo_set_log_callback(callback, &s);
+#ifdef THREADED
+        CPPUNIT_ASSERT_EQUAL((int)ZBADARGUMENTS, zoo_set_log_async(-1));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_set_log_async(64));
+        for (int i = 0; i < 10; i++) {
+            snprintf(msg, sizeof(msg), "line %d", i);
+            log_message(ZOO_LOG_LEVEL_INFO, i, "testAsync", msg);
+        }
+        // stopping writes out whatever is still queued
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_set_log_async(0));
+        CPPUNIT_ASSERT_EQUAL((size_t)10, s.count());
+        for (int i = 0; i < 10; i++) {
+            snprintf(msg, sizeof(msg), "@%d: line %d", i, i);
+            CPPUNIT_ASSERT(endsWith(s.lines[i], msg));
+        }
+        CPPUNIT_ASSERT_EQUAL((int64_t)0, zoo_get_log_dropped());
+#else
+        CPPUNIT_ASSERT_EQUAL((int)ZUNIMPLEMENTED, zoo_set_log_async(64));
+        snprintf(msg, sizeof(msg), "line");
+        log_message(ZOO_LOG_LEVEL_INFO, 1, "testAsync", msg);
+        CPPUNIT_ASSERT_EQUAL((size_t)1, s.count());
+#endif
+    }
+
+    void testBinary()
+    {
+        sink s;
+        FILE *out = tmpfile();
+        char buf[4096];
+        size_t len;
+        uint32_t magic;
+
+        zoo_set_log_callback(callback, &s);
+        zoo_set_log_binary(out);
+        LOG_WARN(("binary %s %d %lld", "record", 7, (long long)1 << 40));
+        LOG_WARN(("binary %s %d %lld", "again", 8, (long long)2));
+        zoo_set_log_binary(0);
+        // nothing was formatted
+        CPPUNIT_ASSERT_EQUAL((size_t)0, s.count());
+
+        rewind(out);
+        len = fread(buf, 1, sizeof(buf), out);
+        fclose(out);
+        memcpy(&magic, buf, sizeof(magic));
+        CPPUNIT_ASSERT_EQUAL((uint32_t)0x5a4b4c47, magic);
+        string file(buf, len);
+        // the format string is written once, the arguments with each record
+        size_t at = file.find("binary %s %d %lld");
+        CPPUNIT_ASSERT(at != string::npos);
+        CPPUNIT_ASSERT_EQUAL(string::npos, file.find("binary %s", at + 1));
+        CPPUNIT_ASSERT(file.find("record") != string::npos);
+        CPPUNIT_ASSERT(file.find("again") != string::npos);
+        CPPUNIT_ASSERT(file.find("testBinary") != string::npos);
+    }
+
+#ifdef THREADED
+    void testAsyncDrops()
+    {
+        sink s;
+        int64_t before = zoo_get_log_dropped();
+        size_t messages = 0, notes = 0;
+
+        zoo_set_log_callback(callback, &s);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_set_log_async(16));
+        // hold the writer up in the sink so that the ring fills
+        s.blocked = 1;
+        log_message(ZOO_LOG_LEVEL_INFO, 1, "testAsyncDrops", "first");
+        millisleep(50);
+        for (int i = 0; i < 100; i++)
+            log_message(ZOO_LOG_LEVEL_INFO, 2, "testAsyncDrops", "more");
+        s.blocked = 0;
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, zoo_set_log_async(0));
+
+        for (size_t i = 0; i < s.lines.size(); i++) {
+            if (s.lines[i].find("dropped ") != string::npos)
+                notes++;
+            else
+                messages++;
+        }
+        CPPUNIT_ASSERT(notes >= 1);
+        CPPUNIT_ASSERT(messages <= 17);
+        CPPUNIT_ASSERT_EQUAL((int64_t)(101 - messages),
+                zoo_get_log_dropped() - before);
+    }
+#endif
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Zookeeper_logging);
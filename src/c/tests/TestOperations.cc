@@ -31,6 +31,7 @@ class Zookeeper_operations : public CPPUNIT_NS::TestFixture
     CPPUNIT_TEST(testPing);
     CPPUNIT_TEST(testTimeoutCausedByWatches1);
     CPPUNIT_TEST(testTimeoutCausedByWatches2);
+    CPPUNIT_TEST(testLoopCallbacks);
 #else    
     CPPUNIT_TEST(testAsyncWatcher1);
     CPPUNIT_TEST(testAsyncGetOperation);
@@ -215,6 +216,86 @@ public:
         CPPUNIT_ASSERT_EQUAL((int)ZOPERATIONTIMEOUT,res2.rc_);
     }
 
+    struct LoopRecorder{
+        LoopRecorder():fdCalls(0),oldfd(-2),newfd(-2),interest(-1),
+            deadlineCalls(0),timeout(-2){}
+        int fdCalls;
+        int oldfd;
+        int newfd;
+        int interest;
+        int deadlineCalls;
+        int timeout;
+    };
+    static void fdChanged(zhandle_t*,int oldfd,int newfd,int interest,void* ctx){
+        LoopRecorder* r=(LoopRecorder*)ctx;
+        r->fdCalls++;
+        r->oldfd=oldfd;
+        r->newfd=newfd;
+        r->interest=interest;
+    }
+    static void deadlineChanged(zhandle_t*,int timeout,void* ctx){
+        LoopRecorder* r=(LoopRecorder*)ctx;
+        r->deadlineCalls++;
+        r->timeout=timeout;
+    }
+
+    // drive the handle through the event loop callbacks; verify only
+    // changes are reported
+    void testLoopCallbacks()
+    {
+        Mock_gettimeofday timeMock;
+        ZookeeperServer zkServer;
+        // must call zookeeper_close() while all the mocks are in scope
+        CloseFinally guard(&zh);
+
+        zh=zookeeper_init("localhost:2121",watcher,10000,TEST_CLIENT_ID,0,0);
+        CPPUNIT_ASSERT(zh!=0);
+        // simulate connected state
+        forceConnected(zh);
+
+        LoopRecorder rec;
+        zoo_loop_callbacks cb={fdChanged,deadlineChanged,&rec};
+        int rc=zoo_set_loop_callbacks(zh,&cb);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+        CPPUNIT_ASSERT_EQUAL(1,rec.fdCalls);
+        CPPUNIT_ASSERT_EQUAL(-1,rec.oldfd);
+        CPPUNIT_ASSERT_EQUAL((int)ZookeeperServer::FD,rec.newfd);
+        CPPUNIT_ASSERT_EQUAL((int)ZOOKEEPER_READ,rec.interest);
+        CPPUNIT_ASSERT_EQUAL(1,rec.deadlineCalls);
+        CPPUNIT_ASSERT(rec.timeout>0);
+
+        AsyncGetOperationCompletion res1;
+        zkServer.addOperationResponse(new ZooGetResponse("1",1));
+        rc=zoo_aget(zh,"/x/y/1",0,asyncCompletion,&res1);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+        AsyncGetOperationCompletion res2;
+        zkServer.addOperationResponse(new ZooGetResponse("2",1));
+        rc=zoo_aget(zh,"/x/y/2",0,asyncCompletion,&res2);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+
+        // a single dispatch handles all the responses available
+        rc=zookeeper_dispatch(zh,ZOOKEEPER_READ);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+        CPPUNIT_ASSERT_EQUAL(string("1"),res1.value_);
+        CPPUNIT_ASSERT_EQUAL(string("2"),res2.value_);
+        // nothing changed for the loop
+        CPPUNIT_ASSERT_EQUAL(1,rec.fdCalls);
+        CPPUNIT_ASSERT_EQUAL(1,rec.deadlineCalls);
+
+        // the timer expires; the handle pings and re-arms it
+        timeMock.tick(4);
+        rc=zookeeper_dispatch(zh,0);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+        CPPUNIT_ASSERT_EQUAL(2,rec.deadlineCalls);
+
+        rc=zoo_set_loop_callbacks(zh,0);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+        CPPUNIT_ASSERT_EQUAL(2,rec.fdCalls);
+        CPPUNIT_ASSERT_EQUAL(-1,rec.newfd);
+        CPPUNIT_ASSERT_EQUAL(3,rec.deadlineCalls);
+        CPPUNIT_ASSERT_EQUAL(-1,rec.timeout);
+    }
+
     class PingCountingServer: public ZookeeperServer{
     public:
         PingCountingServer():pingCount_(0){}
@@ -0,0 +1,251 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cppunit/extensions/HelperMacros.h>
+#include "CppAssertHelper.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "ZKMocks.h"
+#include "SessionReplay.h"
+#ifdef THREADED
+#include "../bench/zkfake.h"
+#endif
+
+using namespace std;
+
+// Sessions are recorded through SessionRecorder and played back at full
+// speed through SessionReplayer, which counts what the client did on the way.
+//
+// testReplay records a small session of its own. To replay a session
+// recorded elsewhere instead, point ZKREPLAY_SESSION at it; ZKREPLAY_RECORD
+// saves the session testReplay recorded. If ZKREPLAY_BUDGET is set, the test
+// fails when a replay makes more allocations or socket calls per reply than
+// the budget allows, which is how a change to the IO path that makes it
+// chattier gets noticed.
+class Zookeeper_replay : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(Zookeeper_replay);
+#ifndef THREADED
+    CPPUNIT_TEST(testReplay);
+#else
+    CPPUNIT_TEST(testRecord);
+#endif
+    CPPUNIT_TEST(testSaveLoad);
+    CPPUNIT_TEST_SUITE_END();
+
+    FILE *logfile;
+
+    static void watcher(zhandle_t *, int, int, const char *,void*){}
+
+    static string tempFile(){
+        char path[]="/tmp/zkreplay.XXXXXX";
+        int fd=mkstemp(path);
+        CPPUNIT_ASSERT(fd!=-1);
+        close(fd);
+        return path;
+    }
+
+    static void assertSameLog(const SessionLog& expected,const SessionLog& actual){
+        CPPUNIT_ASSERT_EQUAL(expected.packets.size(),actual.packets.size());
+        for(unsigned i=0;i<expected.packets.size();i++){
+            CPPUNIT_ASSERT_EQUAL(expected.packets[i].dir,actual.packets[i].dir);
+            CPPUNIT_ASSERT(expected.packets[i].bytes==actual.packets[i].bytes);
+        }
+    }
+
+    static int count(const SessionLog& log,SessionLog::Direction dir){
+        int n=0;
+        for(unsigned i=0;i<log.packets.size();i++)
+            if(log.packets[i].dir==dir)
+                n++;
+        return n;
+    }
+public:
+    Zookeeper_replay() {
+      logfile = openlogfile("Zookeeper_replay");
+    }
+
+    ~Zookeeper_replay() {
+      if (logfile) {
+        fflush(logfile);
+        fclose(logfile);
+        logfile = 0;
+      }
+    }
+
+    void setUp()
+    {
+        zoo_set_log_stream(logfile);
+        zoo_deterministic_conn_order(0);
+    }
+
+    void testSaveLoad()
+    {
+        SessionLog log;
+        log.packets.push_back(SessionLog::Packet(SessionLog::CONNECT_REQUEST,"hello"));
+        log.packets.push_back(SessionLog::Packet(SessionLog::REQUEST,string("\0\1\2",3)));
+        log.packets.push_back(SessionLog::Packet(SessionLog::REPLY,""));
+        string path=tempFile();
+        CPPUNIT_ASSERT(log.save(path.c_str()));
+        SessionLog loaded;
+        CPPUNIT_ASSERT(loaded.load(path.c_str()));
+        assertSameLog(log,loaded);
+
+        // a truncated file is refused
+        CPPUNIT_ASSERT(truncate(path.c_str(),12)==0);
+        CPPUNIT_ASSERT(!loaded.load(path.c_str()));
+        unlink(path.c_str());
+        CPPUNIT_ASSERT(!loaded.load(path.c_str()));
+    }
+
+#ifndef THREADED
+    SessionLog record()
+    {
+        Mock_gettimeofday timeMock;
+        ZookeeperServer zkServer;
+        SessionRecorder recorder(&zkServer);
+        zhandle_t* zh=0;
+        CloseFinally guard(&zh);
+        zh=zookeeper_init("localhost:2121",watcher,10000,TEST_CLIENT_ID,0,0);
+        CPPUNIT_ASSERT(zh!=0);
+        forceConnected(zh);
+
+        AsyncCompletion res;
+        ZooGetChildrenResponse::StringVector children;
+        children.push_back("a");
+        children.push_back("b");
+        zkServer.addOperationResponse(new ZooGetResponse("1",1));
+        zkServer.addOperationResponse(new ZooStatResponse);
+        zkServer.addOperationResponse(new ZooGetChildrenResponse(children));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,
+                zoo_awget(zh,"/x",watcher,0,asyncCompletion,&res));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,
+                zoo_aexists(zh,"/x/y",0,asyncCompletion,&res));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,
+                zoo_aget_children(zh,"/x",0,asyncCompletion,&res));
+        while(zkServer.hasMoreRecv())
+            zookeeper_process(zh,ZOOKEEPER_READ);
+        zkServer.addRecvResponse(new ZNodeEvent(ZOO_CHANGED_EVENT,"/x"));
+        while(zkServer.hasMoreRecv())
+            zookeeper_process(zh,ZOOKEEPER_READ);
+        return recorder.log();
+    }
+
+    void replay(const SessionLog& log,SessionReplayer::Stats& stats)
+    {
+        Mock_gettimeofday timeMock;
+        SessionReplayer replayer(log);
+        zhandle_t* zh=0;
+        CloseFinally guard(&zh);
+        zh=zookeeper_init("localhost:2121",watcher,10000,TEST_CLIENT_ID,0,0);
+        CPPUNIT_ASSERT(zh!=0);
+        forceConnected(zh);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,replayer.replay(zh,stats));
+    }
+
+    void testReplay()
+    {
+        SessionLog log;
+        const char* session=getenv("ZKREPLAY_SESSION");
+        if(session){
+            CPPUNIT_ASSERT(log.load(session));
+        }else{
+            log=record();
+            CPPUNIT_ASSERT_EQUAL(3,count(log,SessionLog::REQUEST));
+            CPPUNIT_ASSERT_EQUAL(4,count(log,SessionLog::REPLY));
+            const char* out=getenv("ZKREPLAY_RECORD");
+            if(out)
+                CPPUNIT_ASSERT(log.save(out));
+        }
+
+        SessionReplayer::Stats first,second;
+        replay(log,first);
+        replay(log,second);
+        CPPUNIT_ASSERT_EQUAL(0,first.mismatches);
+        CPPUNIT_ASSERT_EQUAL(first.requests,first.completions);
+        if(!session){
+            CPPUNIT_ASSERT_EQUAL(3,first.requests);
+            CPPUNIT_ASSERT_EQUAL(1,first.events);
+        }
+        // nothing in a replay depends on timing, so neither do the counts
+        CPPUNIT_ASSERT_EQUAL(first.sends,second.sends);
+        CPPUNIT_ASSERT_EQUAL(first.recvs,second.recvs);
+        CPPUNIT_ASSERT_EQUAL(first.allocations,second.allocations);
+
+        // the stats are only of interest when replaying a recorded session
+        // or checking a budget
+        const char* budget=getenv("ZKREPLAY_BUDGET");
+        if(session || budget)
+            fprintf(stderr,"\nreplay: %d requests, %d replies, %d events: "
+                    "%d sends, %d recvs, %d allocations, %lld us cpu\n",
+                    first.requests,first.replies,first.events,first.sends,
+                    first.recvs,first.allocations,
+                    (long long)first.cpuNanos/1000);
+        if(budget && first.replies>0){
+            double limit=atof(budget);
+            CPPUNIT_ASSERT((double)first.allocations/first.replies<=limit);
+            CPPUNIT_ASSERT((double)(first.sends+first.recvs)/first.replies<=limit);
+        }
+    }
+#else
+    // records a session with a live server, handshake included
+    void testRecord()
+    {
+        zkfake_t* fz=zkfake_start(0);
+        CPPUNIT_ASSERT(fz!=0);
+        SessionRecorder recorder(0,zkfake_port(fz));
+        char host[32];
+        snprintf(host,sizeof(host),"127.0.0.1:%d",zkfake_port(fz));
+        zhandle_t* zh=zookeeper_init(host,watcher,10000,0,0,0);
+        CPPUNIT_ASSERT(zh!=0);
+        int rc=ZCONNECTIONLOSS;
+        for(int i=0;i<100 && rc==ZCONNECTIONLOSS;i++){
+            rc=zoo_create(zh,"/r","v",1,&ZOO_OPEN_ACL_UNSAFE,0,0,0);
+            if(rc==ZCONNECTIONLOSS)
+                millisleep(10);
+        }
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,rc);
+        char buf[8];
+        int len=sizeof(buf);
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_get(zh,"/r",0,buf,&len,0));
+        CPPUNIT_ASSERT_EQUAL((int)ZOK,zoo_delete(zh,"/r",-1));
+        zookeeper_close(zh);
+        zkfake_stop(fz);
+
+        SessionLog log=recorder.log();
+        CPPUNIT_ASSERT(log.packets.size()>=2);
+        CPPUNIT_ASSERT_EQUAL(SessionLog::CONNECT_REQUEST,log.packets[0].dir);
+        CPPUNIT_ASSERT_EQUAL(SessionLog::CONNECT_RESPONSE,log.packets[1].dir);
+        // create, get, delete and close; pings may come in between
+        CPPUNIT_ASSERT(count(log,SessionLog::REQUEST)>=4);
+        CPPUNIT_ASSERT(count(log,SessionLog::REPLY)>=3);
+
+        string path=tempFile();
+        CPPUNIT_ASSERT(log.save(path.c_str()));
+        SessionLog loaded;
+        CPPUNIT_ASSERT(loaded.load(path.c_str()));
+        unlink(path.c_str());
+        assertSameLog(log,loaded);
+    }
+#endif
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Zookeeper_replay);
@@ -0,0 +1,212 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compares reading a set of znodes through the synchronous C API (what the
+ * existing C++ adapters do) with the asynchronous futures and coroutines
+ * of zkcpp, all over the same session.
+ */
+
+#include "ZooKeeper.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+using namespace zkcpp;
+
+typedef std::chrono::steady_clock Clock;
+
+static std::atomic<int> errors(0);
+
+class Latch
+{
+    public:
+        explicit Latch(int count) : m_count(count) {}
+        void countDown()
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            if (--m_count == 0)
+                m_cond.notify_all();
+        }
+        void wait()
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_cond.wait(lock, [this] { return m_count == 0; });
+        }
+    private:
+        std::mutex m_lock;
+        std::condition_variable m_cond;
+        int m_count;
+};
+
+static void report(const char *name, size_t ops, Clock::time_point start)
+{
+    double secs = std::chrono::duration<double>(Clock::now() - start).count();
+    printf("%-28s %8zu ops %10.3f s %12.0f ops/s\n", name, ops, secs,
+            ops / secs);
+}
+
+/* one thread, one blocking call at a time */
+static void syncReads(ZooKeeper &zk, const std::vector<std::string> &paths,
+        int threads)
+{
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            char buf[1024];
+            for (size_t i = t; i < paths.size(); i += threads) {
+                int len = sizeof(buf);
+                if (zoo_get(zk.handle(), paths[i].c_str(), 0, buf, &len, 0)
+                        != ZOK)
+                    errors++;
+            }
+        });
+    }
+    for (std::thread &w : workers)
+        w.join();
+    char name[64];
+    snprintf(name, sizeof(name), "sync zoo_get (%d threads)", threads);
+    report(name, paths.size(), start);
+}
+
+/* one thread keeping a window of requests in flight */
+static void futureReads(ZooKeeper &zk, const std::vector<std::string> &paths,
+        size_t window)
+{
+    Clock::time_point start = Clock::now();
+    std::vector<Future<DataResult> > inflight(window);
+    for (size_t i = 0; i < paths.size(); i++) {
+        Future<DataResult> &slot = inflight[i % window];
+        if (slot.valid() && !slot.get().ok())
+            errors++;
+        slot = zk.getNodeData(paths[i]);
+    }
+    for (Future<DataResult> &f : inflight)
+        if (f.valid() && !f.get().ok())
+            errors++;
+    char name[64];
+    snprintf(name, sizeof(name), "futures (window %zu)", window);
+    report(name, paths.size(), start);
+}
+
+#ifdef ZKCPP_HAVE_COROUTINES
+struct Detached
+{
+    struct promise_type
+    {
+        Detached get_return_object() { return Detached(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+static Detached reader(ZooKeeper &zk, const std::vector<std::string> &paths,
+        size_t first, size_t step, Latch &done)
+{
+    for (size_t i = first; i < paths.size(); i += step) {
+        DataResult r = co_await zk.getNodeData(paths[i]);
+        if (!r.ok())
+            errors++;
+    }
+    done.countDown();
+}
+
+/* a fixed number of coroutines, each reading sequentially */
+static void coroutineReads(ZooKeeper &zk,
+        const std::vector<std::string> &paths, size_t count)
+{
+    Clock::time_point start = Clock::now();
+    Latch done(count);
+    for (size_t c = 0; c < count; c++)
+        reader(zk, paths, c, count, done);
+    done.wait();
+    char name[64];
+    snprintf(name, sizeof(name), "coroutines (%zu)", count);
+    report(name, paths.size(), start);
+}
+#endif
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "USAGE: %s host:port [nodes] [window] [threads]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+        usage(argv[0]);
+    size_t nodes = argc > 2 ? atoi(argv[2]) : 10000;
+    size_t window = argc > 3 ? atoi(argv[3]) : 128;
+    int threads = argc > 4 ? atoi(argv[4]) : 8;
+    if (nodes == 0 || window == 0 || threads <= 0)
+        usage(argv[0]);
+
+    zoo_set_debug_level(ZOO_LOG_LEVEL_WARN);
+    ZooKeeper zk(argv[1], 30000);
+    if (!zk.waitConnected(std::chrono::milliseconds(30000))) {
+        fprintf(stderr, "Unable to connect to %s\n", argv[1]);
+        return 1;
+    }
+
+    char root[64];
+    snprintf(root, sizeof(root), "/zkcppbench-%d", (int)getpid());
+    PathResult created = zk.createNode(root, "", 0).get();
+    if (!created.ok()) {
+        fprintf(stderr, "Unable to create %s: %s\n", root, created.error());
+        return 1;
+    }
+
+    std::vector<std::string> paths;
+    std::vector<Future<PathResult> > creates;
+    for (size_t i = 0; i < nodes; i++) {
+        paths.push_back(std::string(root) + "/" + std::to_string(i));
+        creates.push_back(zk.createNode(paths.back(), "0123456789", 10));
+    }
+    for (Future<PathResult> &f : creates)
+        if (!f.get().ok())
+            errors++;
+
+    syncReads(zk, paths, 1);
+    syncReads(zk, paths, threads);
+    futureReads(zk, paths, 1);
+    futureReads(zk, paths, window);
+#ifdef ZKCPP_HAVE_COROUTINES
+    coroutineReads(zk, paths, window);
+#endif
+
+    std::vector<Future<Result> > deletes;
+    for (const std::string &p : paths)
+        deletes.push_back(zk.deleteNode(p));
+    for (Future<Result> &f : deletes)
+        f.get();
+    zk.deleteNode(root).get();
+
+    if (errors)
+        fprintf(stderr, "%d requests failed\n", errors.load());
+    return errors ? 1 : 0;
+}
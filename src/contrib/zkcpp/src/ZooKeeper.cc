@@ -0,0 +1,403 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ZooKeeper.h"
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+namespace zkcpp
+{
+    Buffer::Buffer(const char *data, int len) : m_data(0), m_size(-1)
+    {
+        if (data == 0 || len < 0)
+            return;
+        m_data = static_cast<char *>(std::malloc(len + 1));
+        if (m_data == 0)
+            throw std::bad_alloc();
+        std::memcpy(m_data, data, len);
+        m_data[len] = 0;
+        m_size = len;
+    }
+
+    Children::Children(const struct String_vector *strings)
+        : m_names(0), m_count(0)
+    {
+        if (strings == 0 || strings->count <= 0)
+            return;
+        // the pointer table and all the names share one allocation
+        size_t total = strings->count * sizeof(char *);
+        for (int32_t i = 0; i < strings->count; i++)
+            total += std::strlen(strings->data[i]) + 1;
+        m_names = static_cast<char **>(std::malloc(total));
+        if (m_names == 0)
+            throw std::bad_alloc();
+        char *p = reinterpret_cast<char *>(m_names + strings->count);
+        for (int32_t i = 0; i < strings->count; i++) {
+            size_t len = std::strlen(strings->data[i]) + 1;
+            std::memcpy(p, strings->data[i], len);
+            m_names[i] = p;
+            p += len;
+        }
+        m_count = strings->count;
+    }
+
+    StatResult::StatResult(int rc, const struct Stat *stat) : Result(rc)
+    {
+        if (stat)
+            m_stat = *stat;
+        else
+            std::memset(&m_stat, 0, sizeof(m_stat));
+    }
+
+    PathResult::PathResult(int rc, const char *path)
+        : Result(rc), m_path(path, path ? (int)std::strlen(path) : -1)
+    {
+    }
+
+    namespace detail
+    {
+        /**
+         * Client side of one watch registration. One reference belongs to
+         * the C client (dropped when the watch triggers or the session is
+         * closed), the other to the WatchHandle.
+         */
+        struct WatchContext
+        {
+            WatchContext(ZooKeeper *owner, WatchFn &&fn)
+                : owner(owner), fn(std::move(fn)), refs(2), done(false) {}
+
+            void release()
+            {
+                if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    delete this;
+            }
+
+            /**
+             * Drops the C client's reference once it can no longer call us.
+             */
+            void unregister()
+            {
+                {
+                    std::lock_guard<std::recursive_mutex> guard(lock);
+                    fn = WatchFn();
+                    done = true;
+                }
+                owner->forgetWatch(this);
+                release();
+            }
+
+            static void trampoline(zhandle_t *zh, int type, int state,
+                    const char *path, void *ctx)
+            {
+                WatchContext *w = static_cast<WatchContext *>(ctx);
+                {
+                    std::lock_guard<std::recursive_mutex> guard(w->lock);
+                    // the callback may cancel its own handle, which resets
+                    // fn; run it from a local so it outlives that
+                    WatchFn fn(std::move(w->fn));
+                    w->fn = WatchFn();
+                    if (fn)
+                        fn(type, state, path);
+                    if (!w->done)
+                        w->fn = std::move(fn);
+                }
+                // session events are delivered to every watcher; anything
+                // else is the one-shot trigger
+                if (type != ZOO_SESSION_EVENT)
+                    w->unregister();
+            }
+
+            ZooKeeper *owner;
+            std::recursive_mutex lock;
+            WatchFn fn;
+            std::atomic<int> refs;
+            bool done;
+        };
+    }
+
+    void WatchHandle::cancel()
+    {
+        if (m_ctx == 0)
+            return;
+        {
+            std::lock_guard<std::recursive_mutex> guard(m_ctx->lock);
+            m_ctx->fn = WatchFn();
+            m_ctx->done = true;
+        }
+        m_ctx->release();
+        m_ctx = 0;
+    }
+
+    bool WatchHandle::active() const
+    {
+        if (m_ctx == 0)
+            return false;
+        std::lock_guard<std::recursive_mutex> guard(m_ctx->lock);
+        return !m_ctx->done;
+    }
+
+    namespace
+    {
+        template <typename T> T failure(int rc);
+        template <> Result failure<Result>(int rc)
+        {
+            return Result(rc);
+        }
+        template <> StatResult failure<StatResult>(int rc)
+        {
+            return StatResult(rc, 0);
+        }
+        template <> DataResult failure<DataResult>(int rc)
+        {
+            return DataResult(rc, 0, -1, 0);
+        }
+        template <> PathResult failure<PathResult>(int rc)
+        {
+            return PathResult(rc, 0);
+        }
+        template <> ChildrenResult failure<ChildrenResult>(int rc)
+        {
+            return ChildrenResult(rc, 0, 0);
+        }
+
+        template <typename T>
+        detail::State<T> *stateOf(const void *data)
+        {
+            return static_cast<detail::State<T> *>(const_cast<void *>(data));
+        }
+
+        /**
+         * The C client only keeps a watcher if the request succeeded;
+         * otherwise it is dropped silently and we must let go of it here.
+         */
+        void settleWatch(detail::WatchContext *watch, bool registered)
+        {
+            if (watch && !registered)
+                watch->unregister();
+        }
+
+        template <typename T, typename Submit>
+        Future<T> submit(detail::WatchContext *watch, Submit submitFn)
+        {
+            detail::State<T> *state = new detail::State<T>();
+            state->setWatch(watch);
+            int rc = submitFn(static_cast<const void *>(state));
+            if (rc != ZOK) {
+                settleWatch(watch, false);
+                state->complete(failure<T>(rc));
+            }
+            return Future<T>(state);
+        }
+
+        void voidCompletion(int rc, const void *data)
+        {
+            stateOf<Result>(data)->complete(Result(rc));
+        }
+
+        void statCompletion(int rc, const struct Stat *stat, const void *data)
+        {
+            detail::State<StatResult> *state = stateOf<StatResult>(data);
+            settleWatch(state->watch(), rc == ZOK || rc == ZNONODE);
+            state->complete(StatResult(rc, stat));
+        }
+
+        void dataCompletion(int rc, const char *value, int len,
+                const struct Stat *stat, const void *data)
+        {
+            detail::State<DataResult> *state = stateOf<DataResult>(data);
+            settleWatch(state->watch(), rc == ZOK);
+            state->complete(DataResult(rc, value, len, stat));
+        }
+
+        void stringCompletion(int rc, const char *value, const void *data)
+        {
+            stateOf<PathResult>(data)->complete(PathResult(rc, value));
+        }
+
+        void childrenCompletion(int rc, const struct String_vector *strings,
+                const struct Stat *stat, const void *data)
+        {
+            detail::State<ChildrenResult> *state =
+                stateOf<ChildrenResult>(data);
+            settleWatch(state->watch(), rc == ZOK);
+            state->complete(ChildrenResult(rc, strings, stat));
+        }
+    }
+
+    ZooKeeper::ZooKeeper(const std::string &hosts, int recvTimeout,
+            WatchFn sessionWatcher)
+        : m_zh(0), m_sessionWatcher(std::move(sessionWatcher))
+    {
+        m_zh = zookeeper_init(hosts.c_str(), &ZooKeeper::sessionWatcher,
+                recvTimeout, 0, this, 0);
+        if (m_zh == 0)
+            throw std::system_error(errno, std::generic_category(),
+                    "zookeeper_init");
+    }
+
+    ZooKeeper::~ZooKeeper()
+    {
+        zookeeper_close(m_zh);
+        // the C client never fires watches that were still registered at
+        // close time, so their references are released here
+        std::unordered_set<detail::WatchContext *> watches;
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            watches.swap(m_watches);
+        }
+        for (detail::WatchContext *w : watches) {
+            {
+                std::lock_guard<std::recursive_mutex> guard(w->lock);
+                w->fn = WatchFn();
+                w->done = true;
+            }
+            w->release();
+        }
+    }
+
+    void ZooKeeper::sessionWatcher(zhandle_t *zh, int type, int state,
+            const char *path, void *ctx)
+    {
+        ZooKeeper *self = static_cast<ZooKeeper *>(ctx);
+        if (type == ZOO_SESSION_EVENT) {
+            std::lock_guard<std::mutex> guard(self->m_lock);
+            self->m_cond.notify_all();
+        }
+        if (self->m_sessionWatcher)
+            self->m_sessionWatcher(type, state, path);
+    }
+
+    bool ZooKeeper::waitConnected(std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        return m_cond.wait_for(lock, timeout, [this] {
+            return zoo_state(m_zh) == ZOO_CONNECTED_STATE;
+        });
+    }
+
+    detail::WatchContext *ZooKeeper::newWatch(WatchFn &&watcher,
+            WatchHandle &watch)
+    {
+        detail::WatchContext *ctx =
+            new detail::WatchContext(this, std::move(watcher));
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_watches.insert(ctx);
+        }
+        watch.cancel();
+        watch.m_ctx = ctx;
+        return ctx;
+    }
+
+    void ZooKeeper::forgetWatch(detail::WatchContext *ctx)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_watches.erase(ctx);
+    }
+
+    Future<PathResult> ZooKeeper::createNode(const std::string &path,
+            const char *value, int len, int flags,
+            const struct ACL_vector *acl)
+    {
+        return submit<PathResult>(0, [&](const void *data) {
+            return zoo_acreate(m_zh, path.c_str(), value, len, acl, flags,
+                    stringCompletion, data);
+        });
+    }
+
+    Future<Result> ZooKeeper::deleteNode(const std::string &path, int version)
+    {
+        return submit<Result>(0, [&](const void *data) {
+            return zoo_adelete(m_zh, path.c_str(), version, voidCompletion,
+                    data);
+        });
+    }
+
+    Future<StatResult> ZooKeeper::nodeExists(const std::string &path)
+    {
+        return submit<StatResult>(0, [&](const void *data) {
+            return zoo_aexists(m_zh, path.c_str(), 0, statCompletion, data);
+        });
+    }
+
+    Future<StatResult> ZooKeeper::nodeExists(const std::string &path,
+            WatchFn watcher, WatchHandle &watch)
+    {
+        detail::WatchContext *ctx = newWatch(std::move(watcher), watch);
+        return submit<StatResult>(ctx, [&](const void *data) {
+            return zoo_awexists(m_zh, path.c_str(),
+                    detail::WatchContext::trampoline, ctx, statCompletion,
+                    data);
+        });
+    }
+
+    Future<DataResult> ZooKeeper::getNodeData(const std::string &path)
+    {
+        return submit<DataResult>(0, [&](const void *data) {
+            return zoo_aget(m_zh, path.c_str(), 0, dataCompletion, data);
+        });
+    }
+
+    Future<DataResult> ZooKeeper::getNodeData(const std::string &path,
+            WatchFn watcher, WatchHandle &watch)
+    {
+        detail::WatchContext *ctx = newWatch(std::move(watcher), watch);
+        return submit<DataResult>(ctx, [&](const void *data) {
+            return zoo_awget(m_zh, path.c_str(),
+                    detail::WatchContext::trampoline, ctx, dataCompletion,
+                    data);
+        });
+    }
+
+    Future<StatResult> ZooKeeper::setNodeData(const std::string &path,
+            const char *value, int len, int version)
+    {
+        return submit<StatResult>(0, [&](const void *data) {
+            return zoo_aset(m_zh, path.c_str(), value, len, version,
+                    statCompletion, data);
+        });
+    }
+
+    Future<ChildrenResult> ZooKeeper::getNodeChildren(const std::string &path)
+    {
+        return submit<ChildrenResult>(0, [&](const void *data) {
+            return zoo_aget_children2(m_zh, path.c_str(), 0,
+                    childrenCompletion, data);
+        });
+    }
+
+    Future<ChildrenResult> ZooKeeper::getNodeChildren(const std::string &path,
+            WatchFn watcher, WatchHandle &watch)
+    {
+        detail::WatchContext *ctx = newWatch(std::move(watcher), watch);
+        return submit<ChildrenResult>(ctx, [&](const void *data) {
+            return zoo_awget_children2(m_zh, path.c_str(),
+                    detail::WatchContext::trampoline, ctx,
+                    childrenCompletion, data);
+        });
+    }
+
+    Future<PathResult> ZooKeeper::sync(const std::string &path)
+    {
+        return submit<PathResult>(0, [&](const void *data) {
+            return zoo_async(m_zh, path.c_str(), stringCompletion, data);
+        });
+    }
+}
@@ -0,0 +1,545 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ZKCPP_ZOOKEEPER_H__
+#define __ZKCPP_ZOOKEEPER_H__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <utility>
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define ZKCPP_HAVE_COROUTINES 1
+#endif
+#endif
+
+extern "C" {
+#include "zookeeper.h"
+}
+
+namespace zkcpp
+{
+    /**
+     * \brief Signature of watch callbacks.
+     *
+     * Receives the event type, the session state and the znode path, exactly
+     * as the C watcher_fn does. The path is only valid for the duration of
+     * the call.
+     */
+    typedef std::function<void(int type, int state, const char *path)> WatchFn;
+
+    /**
+     * \brief An owned, move-only reply buffer.
+     *
+     * The buffer is always NUL-terminated so string replies can be used as
+     * C strings directly. A null buffer (znode without data) reports a size
+     * of -1, matching the C API.
+     */
+    class Buffer
+    {
+        public:
+            Buffer() : m_data(0), m_size(-1) {}
+            Buffer(const char *data, int len);
+            Buffer(Buffer &&other) noexcept
+                : m_data(other.m_data), m_size(other.m_size)
+            {
+                other.m_data = 0;
+                other.m_size = -1;
+            }
+            Buffer &operator=(Buffer &&other) noexcept
+            {
+                if (this != &other) {
+                    std::free(m_data);
+                    m_data = other.m_data;
+                    m_size = other.m_size;
+                    other.m_data = 0;
+                    other.m_size = -1;
+                }
+                return *this;
+            }
+            Buffer(const Buffer &) = delete;
+            Buffer &operator=(const Buffer &) = delete;
+            ~Buffer() { std::free(m_data); }
+
+            const char *data() const { return m_data; }
+            int size() const { return m_size; }
+            bool null() const { return m_data == 0; }
+            std::string str() const
+            {
+                return m_data ? std::string(m_data, m_size) : std::string();
+            }
+
+        private:
+            char *m_data;
+            int m_size;
+    };
+
+    /**
+     * \brief Child names of a znode, packed into a single allocation.
+     */
+    class Children
+    {
+        public:
+            Children() : m_names(0), m_count(0) {}
+            explicit Children(const struct String_vector *strings);
+            Children(Children &&other) noexcept
+                : m_names(other.m_names), m_count(other.m_count)
+            {
+                other.m_names = 0;
+                other.m_count = 0;
+            }
+            Children &operator=(Children &&other) noexcept
+            {
+                if (this != &other) {
+                    std::free(m_names);
+                    m_names = other.m_names;
+                    m_count = other.m_count;
+                    other.m_names = 0;
+                    other.m_count = 0;
+                }
+                return *this;
+            }
+            Children(const Children &) = delete;
+            Children &operator=(const Children &) = delete;
+            ~Children() { std::free(m_names); }
+
+            int size() const { return m_count; }
+            const char *operator[](int i) const { return m_names[i]; }
+            const char *const *begin() const { return m_names; }
+            const char *const *end() const { return m_names + m_count; }
+
+        private:
+            char **m_names;
+            int m_count;
+    };
+
+    /**
+     * \brief Outcome of a request that returns nothing but a status.
+     *
+     * All result types are move-only; the reply data they carry is owned
+     * by the result and released with it.
+     */
+    class Result
+    {
+        public:
+            explicit Result(int rc = ZOK) : m_rc(rc) {}
+            Result(Result &&) = default;
+            Result &operator=(Result &&) = default;
+            Result(const Result &) = delete;
+            Result &operator=(const Result &) = delete;
+
+            /**
+             * \brief Returns the ZOO_ERRORS code of the request.
+             */
+            int rc() const { return m_rc; }
+            bool ok() const { return m_rc == ZOK; }
+            const char *error() const { return zerror(m_rc); }
+
+        protected:
+            int m_rc;
+    };
+
+    /**
+     * \brief Outcome of exists and set requests.
+     */
+    class StatResult : public Result
+    {
+        public:
+            StatResult(int rc, const struct Stat *stat);
+            StatResult(StatResult &&) = default;
+            StatResult &operator=(StatResult &&) = default;
+
+            const struct Stat &stat() const { return m_stat; }
+
+        private:
+            struct Stat m_stat;
+    };
+
+    /**
+     * \brief Outcome of a get request.
+     */
+    class DataResult : public StatResult
+    {
+        public:
+            DataResult(int rc, const char *value, int len,
+                    const struct Stat *stat)
+                : StatResult(rc, stat), m_data(value, len) {}
+            DataResult(DataResult &&) = default;
+            DataResult &operator=(DataResult &&) = default;
+
+            const Buffer &data() const { return m_data; }
+            Buffer release() { return std::move(m_data); }
+
+        private:
+            Buffer m_data;
+    };
+
+    /**
+     * \brief Outcome of create and sync requests.
+     */
+    class PathResult : public Result
+    {
+        public:
+            PathResult(int rc, const char *path);
+            PathResult(PathResult &&) = default;
+            PathResult &operator=(PathResult &&) = default;
+
+            /**
+             * \brief The created (or synced) path, or null on failure.
+             */
+            const char *path() const { return m_path.data(); }
+
+        private:
+            Buffer m_path;
+    };
+
+    /**
+     * \brief Outcome of a get children request.
+     */
+    class ChildrenResult : public StatResult
+    {
+        public:
+            ChildrenResult(int rc, const struct String_vector *strings,
+                    const struct Stat *stat)
+                : StatResult(rc, stat), m_children(strings) {}
+            ChildrenResult(ChildrenResult &&) = default;
+            ChildrenResult &operator=(ChildrenResult &&) = default;
+
+            const Children &children() const { return m_children; }
+
+        private:
+            Children m_children;
+    };
+
+    class ZooKeeper;
+
+    namespace detail
+    {
+        struct WatchContext;
+
+        /**
+         * Shared state between a Future and the C completion that fulfils
+         * it. It starts with two references, one held by each side, and is
+         * freed by whichever lets go last.
+         */
+        template <typename T>
+        class State
+        {
+            public:
+                State() : m_refs(2), m_ready(false), m_resume(0),
+                    m_resumeArg(0), m_watch(0) {}
+
+                bool ready() const
+                {
+                    return m_ready.load(std::memory_order_acquire);
+                }
+
+                void wait()
+                {
+                    if (ready())
+                        return;
+                    std::unique_lock<std::mutex> lock(m_lock);
+                    m_cond.wait(lock, [this] { return ready(); });
+                }
+
+                template <class Rep, class Period>
+                bool waitFor(const std::chrono::duration<Rep, Period> &d)
+                {
+                    if (ready())
+                        return true;
+                    std::unique_lock<std::mutex> lock(m_lock);
+                    return m_cond.wait_for(lock, d, [this] { return ready(); });
+                }
+
+                /**
+                 * Registers a continuation to run once the value is set.
+                 * Returns false if the value is already there, in which
+                 * case the caller must not suspend.
+                 */
+                bool suspend(void (*resume)(void *), void *arg)
+                {
+                    std::lock_guard<std::mutex> lock(m_lock);
+                    if (ready())
+                        return false;
+                    m_resume = resume;
+                    m_resumeArg = arg;
+                    return true;
+                }
+
+                /**
+                 * Called once, from the completion thread. The continuation
+                 * (if any) runs on this thread after the value is published.
+                 */
+                void complete(T &&value)
+                {
+                    void (*resume)(void *);
+                    void *arg;
+                    {
+                        std::lock_guard<std::mutex> lock(m_lock);
+                        m_value.emplace(std::move(value));
+                        m_ready.store(true, std::memory_order_release);
+                        resume = m_resume;
+                        arg = m_resumeArg;
+                    }
+                    m_cond.notify_all();
+                    if (resume)
+                        resume(arg);
+                    release();
+                }
+
+                T take() { return std::move(*m_value); }
+
+                void release()
+                {
+                    if (m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                        delete this;
+                }
+
+                WatchContext *watch() const { return m_watch; }
+                void setWatch(WatchContext *watch) { m_watch = watch; }
+
+            private:
+                std::atomic<int> m_refs;
+                std::atomic<bool> m_ready;
+                std::mutex m_lock;
+                std::condition_variable m_cond;
+                std::optional<T> m_value;
+                void (*m_resume)(void *);
+                void *m_resumeArg;
+                WatchContext *m_watch;
+        };
+
+#ifdef ZKCPP_HAVE_COROUTINES
+        inline void resumeCoroutine(void *address)
+        {
+            std::coroutine_handle<>::from_address(address).resume();
+        }
+#endif
+    }
+
+    /**
+     * \brief The pending result of an asynchronous request.
+     *
+     * Behaves like a move-only std::future: get() blocks until the reply
+     * arrives and hands out the result. Under C++20 a Future can also be
+     * awaited with co_await, in which case the awaiting coroutine is
+     * resumed on the client's completion thread.
+     */
+    template <typename T>
+    class Future
+    {
+        public:
+            Future() : m_state(0) {}
+            explicit Future(detail::State<T> *state) : m_state(state) {}
+            Future(Future &&other) noexcept : m_state(other.m_state)
+            {
+                other.m_state = 0;
+            }
+            Future &operator=(Future &&other) noexcept
+            {
+                if (this != &other) {
+                    reset();
+                    m_state = other.m_state;
+                    other.m_state = 0;
+                }
+                return *this;
+            }
+            Future(const Future &) = delete;
+            Future &operator=(const Future &) = delete;
+            ~Future() { reset(); }
+
+            bool valid() const { return m_state != 0; }
+            bool ready() const { return m_state->ready(); }
+            void wait() const { m_state->wait(); }
+
+            template <class Rep, class Period>
+            bool wait_for(const std::chrono::duration<Rep, Period> &d) const
+            {
+                return m_state->waitFor(d);
+            }
+
+            /**
+             * \brief Waits for and returns the result. The future is no
+             * longer valid afterwards.
+             */
+            T get()
+            {
+                m_state->wait();
+                T value(m_state->take());
+                reset();
+                return value;
+            }
+
+#ifdef ZKCPP_HAVE_COROUTINES
+            bool await_ready() const noexcept { return m_state->ready(); }
+            bool await_suspend(std::coroutine_handle<> h)
+            {
+                return m_state->suspend(&detail::resumeCoroutine, h.address());
+            }
+            T await_resume() { return get(); }
+#endif
+
+        private:
+            void reset()
+            {
+                if (m_state) {
+                    m_state->release();
+                    m_state = 0;
+                }
+            }
+
+            detail::State<T> *m_state;
+    };
+
+    /**
+     * \brief Owns the client side of a single watch.
+     *
+     * Destroying (or cancelling) the handle guarantees the callback will
+     * not be invoked afterwards; if the callback is running concurrently
+     * cancel() waits for it to return. The registration itself stays in the
+     * C client until the watch triggers or the session ends, since the
+     * server has no way to remove a watch.
+     *
+     * The callback may re-arm the watch by passing its own handle to a new
+     * request (say getNodeData(path, fn, handle)), or cancel, reassign or
+     * destroy the handle: the callback that is running is kept alive until
+     * it returns.
+     */
+    class WatchHandle
+    {
+        public:
+            WatchHandle() : m_ctx(0) {}
+            WatchHandle(WatchHandle &&other) noexcept : m_ctx(other.m_ctx)
+            {
+                other.m_ctx = 0;
+            }
+            WatchHandle &operator=(WatchHandle &&other) noexcept
+            {
+                if (this != &other) {
+                    cancel();
+                    m_ctx = other.m_ctx;
+                    other.m_ctx = 0;
+                }
+                return *this;
+            }
+            WatchHandle(const WatchHandle &) = delete;
+            WatchHandle &operator=(const WatchHandle &) = delete;
+            ~WatchHandle() { cancel(); }
+
+            /**
+             * \brief Stops delivery to the callback.
+             */
+            void cancel();
+
+            /**
+             * \brief Returns true until the watch has triggered or the
+             * handle has been cancelled.
+             */
+            bool active() const;
+
+        private:
+            friend class ZooKeeper;
+            detail::WatchContext *m_ctx;
+    };
+
+    /**
+     * \brief An asynchronous ZooKeeper client.
+     *
+     * Each request is submitted through the zoo_a* C API and returns a
+     * Future straight away, so any number of requests can be in flight from
+     * a single thread. Replies are delivered on the C client's completion
+     * thread.
+     */
+    class ZooKeeper
+    {
+        public:
+            /**
+             * \brief Creates the handle and starts connecting.
+             *
+             * @param hosts comma separated host:port pairs
+             * @param recvTimeout the session timeout, in milliseconds
+             * @param sessionWatcher optional callback for session events
+             * @throws std::system_error if the C handle cannot be created
+             */
+            ZooKeeper(const std::string &hosts, int recvTimeout,
+                    WatchFn sessionWatcher = WatchFn());
+
+            /**
+             * \brief Closes the session. Outstanding futures complete with
+             * ZCLOSING.
+             */
+            ~ZooKeeper();
+
+            ZooKeeper(const ZooKeeper &) = delete;
+            ZooKeeper &operator=(const ZooKeeper &) = delete;
+
+            zhandle_t *handle() const { return m_zh; }
+            int state() const { return zoo_state(m_zh); }
+
+            /**
+             * \brief Blocks until the session is connected.
+             *
+             * @return false if the timeout elapsed first
+             */
+            bool waitConnected(std::chrono::milliseconds timeout);
+
+            Future<PathResult> createNode(const std::string &path,
+                    const char *value, int len, int flags = 0,
+                    const struct ACL_vector *acl = &ZOO_OPEN_ACL_UNSAFE);
+            Future<Result> deleteNode(const std::string &path,
+                    int version = -1);
+            Future<StatResult> nodeExists(const std::string &path);
+            Future<StatResult> nodeExists(const std::string &path,
+                    WatchFn watcher, WatchHandle &watch);
+            Future<DataResult> getNodeData(const std::string &path);
+            Future<DataResult> getNodeData(const std::string &path,
+                    WatchFn watcher, WatchHandle &watch);
+            Future<StatResult> setNodeData(const std::string &path,
+                    const char *value, int len, int version = -1);
+            Future<ChildrenResult> getNodeChildren(const std::string &path);
+            Future<ChildrenResult> getNodeChildren(const std::string &path,
+                    WatchFn watcher, WatchHandle &watch);
+            Future<PathResult> sync(const std::string &path);
+
+        private:
+            friend struct detail::WatchContext;
+
+            static void sessionWatcher(zhandle_t *zh, int type, int state,
+                    const char *path, void *ctx);
+            detail::WatchContext *newWatch(WatchFn &&watcher,
+                    WatchHandle &watch);
+            void forgetWatch(detail::WatchContext *ctx);
+
+            zhandle_t *m_zh;
+            WatchFn m_sessionWatcher;
+            std::mutex m_lock;
+            std::condition_variable m_cond;
+            std::unordered_set<detail::WatchContext *> m_watches;
+    };
+}
+
+#endif /* __ZKCPP_ZOOKEEPER_H__ */
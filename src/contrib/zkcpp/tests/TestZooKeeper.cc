@@ -0,0 +1,283 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "ZooKeeper.h"
+#include "zkfake.h"
+
+using namespace std;
+using namespace zkcpp;
+
+class Zkcpp_test : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(Zkcpp_test);
+    CPPUNIT_TEST(testFuture);
+    CPPUNIT_TEST(testResultOwnership);
+#ifdef ZKCPP_HAVE_COROUTINES
+    CPPUNIT_TEST(testCoroutine);
+#endif
+    CPPUNIT_TEST(testWatchFiresOnce);
+    CPPUNIT_TEST(testCancelBeforeTrigger);
+    CPPUNIT_TEST(testRearmFromCallback);
+    CPPUNIT_TEST_SUITE_END();
+
+    /* counts the events a watch callback saw */
+    struct Events
+    {
+        mutex lock;
+        condition_variable cond;
+        int count;
+        int type;
+        string path;
+
+        Events() : count(0), type(0) {}
+
+        void add(int t, const char *p)
+        {
+            lock_guard<mutex> guard(lock);
+            count++;
+            type = t;
+            path = p;
+            cond.notify_all();
+        }
+        bool waitFor(int n)
+        {
+            unique_lock<mutex> guard(lock);
+            return cond.wait_for(guard, chrono::seconds(5),
+                    [&] { return count >= n; });
+        }
+        int seen()
+        {
+            lock_guard<mutex> guard(lock);
+            return count;
+        }
+    };
+
+    zkfake_t *fz;
+    ZooKeeper *zk;
+
+    void set(const string &path, const string &value)
+    {
+        CPPUNIT_ASSERT(zk->setNodeData(path, value.data(), value.size())
+                .get().ok());
+    }
+
+    /* one round trip, so that any event sent before it has been delivered */
+    void settle()
+    {
+        CPPUNIT_ASSERT(zk->sync("/").get().ok());
+    }
+
+public:
+
+    void setUp()
+    {
+        zoo_set_debug_level(ZOO_LOG_LEVEL_ERROR);
+        fz = zkfake_start(0);
+        CPPUNIT_ASSERT(fz != 0);
+        zk = new ZooKeeper("127.0.0.1:" + to_string(zkfake_port(fz)), 10000);
+        CPPUNIT_ASSERT(zk->waitConnected(chrono::seconds(10)));
+    }
+
+    void tearDown()
+    {
+        delete zk;
+        zkfake_stop(fz);
+    }
+
+    void testFuture()
+    {
+        Future<PathResult> created = zk->createNode("/future", "hello", 5);
+        CPPUNIT_ASSERT(created.valid());
+        PathResult p = created.get();
+        CPPUNIT_ASSERT_EQUAL((int)ZOK, p.rc());
+        CPPUNIT_ASSERT_EQUAL(string("/future"), string(p.path()));
+
+        Future<DataResult> data = zk->getNodeData("/future");
+        CPPUNIT_ASSERT(data.wait_for(chrono::seconds(5)));
+        DataResult d = data.get();
+        CPPUNIT_ASSERT(d.ok());
+        CPPUNIT_ASSERT_EQUAL(string("hello"), d.data().str());
+
+        Future<DataResult> missing = zk->getNodeData("/missing");
+        missing.wait();
+        CPPUNIT_ASSERT_EQUAL((int)ZNONODE, missing.get().rc());
+
+        // many in flight from one thread, completing in order
+        Future<PathResult> children[10];
+        for (int i = 0; i < 10; i++)
+            children[i] = zk->createNode("/future/" + to_string(i), 0, -1);
+        for (int i = 0; i < 10; i++)
+            CPPUNIT_ASSERT(children[i].get().ok());
+        ChildrenResult c = zk->getNodeChildren("/future").get();
+        CPPUNIT_ASSERT(c.ok());
+        CPPUNIT_ASSERT_EQUAL(10, c.children().size());
+    }
+
+    void testResultOwnership()
+    {
+        CPPUNIT_ASSERT(zk->createNode("/owned", "value", 5).get().ok());
+        DataResult first = zk->getNodeData("/owned").get();
+        const char *bytes = first.data().data();
+
+        // moving hands the reply over without copying it
+        DataResult second(std::move(first));
+        CPPUNIT_ASSERT(first.data().null());
+        CPPUNIT_ASSERT(bytes == second.data().data());
+        CPPUNIT_ASSERT_EQUAL(string("value"), second.data().str());
+        CPPUNIT_ASSERT_EQUAL(0, second.stat().version);
+
+        // and the reply outlives the C client's buffers
+        set("/owned", "changed");
+        CPPUNIT_ASSERT_EQUAL(string("value"), second.data().str());
+        first = std::move(second);
+        CPPUNIT_ASSERT_EQUAL(string("value"), first.data().str());
+    }
+
+#ifdef ZKCPP_HAVE_COROUTINES
+    struct Detached
+    {
+        struct promise_type
+        {
+            Detached get_return_object() { return Detached(); }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
+
+    static Detached readTwice(ZooKeeper &zk, Events &done)
+    {
+        DataResult first = co_await zk.getNodeData("/awaited");
+        DataResult second = co_await zk.getNodeData("/awaited");
+        if (first.ok() && second.ok() && second.data().str() == "awaited")
+            done.add(0, "/awaited");
+    }
+
+    void testCoroutine()
+    {
+        Events done;
+        CPPUNIT_ASSERT(zk->createNode("/awaited", "awaited", 7).get().ok());
+        readTwice(*zk, done);
+        CPPUNIT_ASSERT(done.waitFor(1));
+    }
+#endif
+
+    void testWatchFiresOnce()
+    {
+        Events events;
+        WatchHandle watch;
+        CPPUNIT_ASSERT(zk->createNode("/once", "0", 1).get().ok());
+        CPPUNIT_ASSERT(zk->getNodeData("/once",
+                    [&](int type, int, const char *path) {
+                        events.add(type, path);
+                    }, watch).get().ok());
+        CPPUNIT_ASSERT(watch.active());
+
+        set("/once", "1");
+        CPPUNIT_ASSERT(events.waitFor(1));
+        CPPUNIT_ASSERT_EQUAL(ZOO_CHANGED_EVENT, events.type);
+        CPPUNIT_ASSERT_EQUAL(string("/once"), events.path);
+        CPPUNIT_ASSERT(!watch.active());
+
+        set("/once", "2");
+        settle();
+        CPPUNIT_ASSERT_EQUAL(1, events.seen());
+    }
+
+    void testCancelBeforeTrigger()
+    {
+        Events events;
+        WatchHandle watch;
+        CPPUNIT_ASSERT(zk->createNode("/cancelled", "0", 1).get().ok());
+        CPPUNIT_ASSERT(zk->nodeExists("/cancelled",
+                    [&](int type, int, const char *path) {
+                        events.add(type, path);
+                    }, watch).get().ok());
+        watch.cancel();
+        CPPUNIT_ASSERT(!watch.active());
+
+        set("/cancelled", "1");
+        settle();
+        CPPUNIT_ASSERT_EQUAL(0, events.seen());
+
+        // a handle going out of scope cancels as well
+        {
+            WatchHandle scoped;
+            CPPUNIT_ASSERT(zk->getNodeChildren("/cancelled",
+                        [&](int type, int, const char *path) {
+                            events.add(type, path);
+                        }, scoped).get().ok());
+        }
+        CPPUNIT_ASSERT(zk->createNode("/cancelled/child", 0, -1).get().ok());
+        settle();
+        CPPUNIT_ASSERT_EQUAL(0, events.seen());
+    }
+
+    /* the callback sets the watch again with the handle it runs under */
+    struct Rearm
+    {
+        ZooKeeper *zk;
+        WatchHandle watch;
+        Events events;
+        string tail;    // captured, so freeing the callback early shows
+
+        void arm()
+        {
+            // the reply is not waited for: this runs on the completion thread
+            zk->getNodeData("/rearmed",
+                    [this, tail = tail](int type, int, const char *path) {
+                        arm();
+                        // the captures are used after the handle moved on
+                        events.add(type, (string(path) + tail).c_str());
+                    }, watch);
+        }
+    };
+
+    void testRearmFromCallback()
+    {
+        Rearm r;
+        r.zk = zk;
+        r.tail = string(64, 'x');
+        CPPUNIT_ASSERT(zk->createNode("/rearmed", "0", 1).get().ok());
+        r.arm();
+        settle();
+
+        for (int i = 1; i <= 3; i++) {
+            set("/rearmed", to_string(i));
+            CPPUNIT_ASSERT(r.events.waitFor(i));
+            CPPUNIT_ASSERT_EQUAL("/rearmed" + r.tail, r.events.path);
+            settle();
+        }
+        CPPUNIT_ASSERT(r.watch.active());
+        r.watch.cancel();
+        set("/rearmed", "4");
+        settle();
+        CPPUNIT_ASSERT_EQUAL(3, r.events.seen());
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Zkcpp_test);
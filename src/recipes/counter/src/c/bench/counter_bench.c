@@ -0,0 +1,250 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures counting and id allocation: writer threads, each with its own
+ * handle, add to one counter or take ids from one path as fast as they can,
+ * counting the requests they send and the races they lose. The sharded
+ * counter is compared with the usual get and versioned set on one node, and
+ * the block allocator with taking every id by such a set. At the end the
+ * counter's sum is read back, and the ids are checked to be unique.
+ *
+ *   zkcounterbench host:port [writers [ops [shards [block]]]]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <zookeeper.h>
+#include <zoo_counter.h>
+#include <zoo_sequence.h>
+
+struct writer {
+    zhandle_t *zh;
+    const char *path;
+    int mode;
+    int ops;
+    int shards;
+    int64_t block;
+    int64_t *ids;
+    long requests;
+    long conflicts;
+    int failed;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static int connected;
+
+static void watcher(zhandle_t *zh, int type, int state, const char *path,
+        void *ctx)
+{
+    if (type == ZOO_SESSION_EVENT && state == ZOO_CONNECTED_STATE) {
+        pthread_mutex_lock(&lock);
+        connected++;
+        pthread_cond_broadcast(&cond);
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* the hand-made way: get the node, set it one up if nobody else did */
+static int cas_increment(struct writer *w, int64_t *old)
+{
+    char buf[32];
+    struct Stat stat;
+    int len, rc;
+
+    for (;;) {
+        len = sizeof(buf) - 1;
+        w->requests++;
+        rc = zoo_get(w->zh, w->path, 0, buf, &len, &stat);
+        if (rc != ZOK)
+            return rc;
+        buf[len] = '\0';
+        *old = strtoll(buf, NULL, 10);
+        len = snprintf(buf, sizeof(buf), "%lld", (long long) (*old + 1));
+        w->requests++;
+        rc = zoo_set(w->zh, w->path, buf, len, stat.version);
+        if (rc != ZBADVERSION)
+            return rc;
+        w->conflicts++;
+    }
+}
+
+static void *run_writer(void *arg)
+{
+    struct writer *w = (struct writer *) arg;
+    zkr_counter_t counter;
+    zkr_sequence_t seq;
+    int64_t id;
+    int i, rc = ZOK;
+
+    if (w->mode == 1)
+        zkr_counter_init(&counter, w->zh, (char *) w->path,
+                &ZOO_OPEN_ACL_UNSAFE, w->shards);
+    else if (w->mode == 3)
+        zkr_sequence_init(&seq, w->zh, (char *) w->path,
+                &ZOO_OPEN_ACL_UNSAFE, w->block);
+    for (i = 0; i < w->ops; i++) {
+        switch (w->mode) {
+        case 0:
+        case 2:
+            rc = cas_increment(w, &id);
+            break;
+        case 1:
+            rc = zkr_counter_add(&counter, 1);
+            break;
+        case 3:
+            rc = zkr_sequence_next(&seq, &id);
+            break;
+        }
+        if (rc != ZOK)
+            w->failed++;
+        else if (w->ids)
+            w->ids[i] = id;
+    }
+    if (w->mode == 1) {
+        w->requests = counter.requests;
+        w->conflicts = counter.conflicts;
+        zkr_counter_destroy(&counter);
+    } else if (w->mode == 3) {
+        w->requests = seq.requests;
+        w->conflicts = seq.conflicts;
+        zkr_sequence_destroy(&seq);
+    }
+    return NULL;
+}
+
+static int compare_ids(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+/* modes 0 and 1 count, 2 and 3 take ids; 0 and 2 are the hand-made way */
+static void run(zhandle_t **zhs, int writers, int ops, int shards,
+        int64_t block, int mode)
+{
+    static const char *modes[] = {"cas count", "sharded", "cas ids",
+        "block ids"};
+    struct writer *ws = calloc(writers, sizeof(*ws));
+    pthread_t *threads = calloc(writers, sizeof(*threads));
+    int64_t *ids = NULL;
+    long requests = 0, conflicts = 0;
+    int failed = 0, duplicates = 0, i;
+    char path[64];
+    double start;
+
+    snprintf(path, sizeof(path), "/zkcounterbench-%d-%d", getpid(), mode);
+    if (mode == 0 || mode == 2)
+        zoo_create(zhs[0], path, "0", 1, &ZOO_OPEN_ACL_UNSAFE, 0, NULL, 0);
+    if (mode >= 2)
+        ids = malloc((size_t) writers * ops * sizeof(*ids));
+    for (i = 0; i < writers; i++) {
+        ws[i].zh = zhs[i];
+        ws[i].path = path;
+        ws[i].mode = mode;
+        ws[i].ops = ops;
+        ws[i].shards = shards;
+        ws[i].block = block;
+        ws[i].ids = ids ? ids + (size_t) i * ops : NULL;
+    }
+    start = now();
+    for (i = 0; i < writers; i++)
+        pthread_create(&threads[i], NULL, run_writer, &ws[i]);
+    for (i = 0; i < writers; i++) {
+        pthread_join(threads[i], NULL);
+        requests += ws[i].requests;
+        conflicts += ws[i].conflicts;
+        failed += ws[i].failed;
+    }
+    start = now() - start;
+
+    if (mode == 1) {
+        zkr_counter_t counter;
+        int64_t sum = -1;
+        zkr_counter_init(&counter, zhs[0], path, &ZOO_OPEN_ACL_UNSAFE,
+                shards);
+        zkr_counter_get(&counter, &sum);
+        zkr_counter_destroy(&counter);
+        if (sum != (int64_t) writers * ops - failed)
+            fprintf(stderr, "sharded counter reads %lld\n", (long long) sum);
+    }
+    if (ids) {
+        qsort(ids, (size_t) writers * ops, sizeof(*ids), compare_ids);
+        for (i = 1; i < writers * ops; i++)
+            if (ids[i] == ids[i - 1])
+                duplicates++;
+        if (duplicates)
+            fprintf(stderr, "%d ids were handed out twice\n", duplicates);
+    }
+    if (failed)
+        fprintf(stderr, "%d operations failed\n", failed);
+    printf("%10s %8d %10.3f %12.0f %12.3f %10ld\n", modes[mode], writers,
+            start, writers * ops / start, (double) requests / (writers * ops),
+            conflicts);
+    fflush(stdout);
+    free(ids);
+    free(threads);
+    free(ws);
+}
+
+int main(int argc, char **argv)
+{
+    zhandle_t **zhs;
+    int writers, ops, shards, mode, i;
+    int64_t block;
+
+    if (argc < 2) {
+        fprintf(stderr,
+                "USAGE: %s host:port [writers [ops [shards [block]]]]\n",
+                argv[0]);
+        return 2;
+    }
+    writers = argc > 2 ? atoi(argv[2]) : 8;
+    ops = argc > 3 ? atoi(argv[3]) : 500;
+    shards = argc > 4 ? atoi(argv[4]) : writers;
+    block = argc > 5 ? atoll(argv[5]) : 100;
+    zoo_set_debug_level(ZOO_LOG_LEVEL_WARN);
+    zhs = calloc(writers, sizeof(*zhs));
+    for (i = 0; i < writers; i++)
+        zhs[i] = zookeeper_init(argv[1], watcher, 10000, 0, 0, 0);
+    pthread_mutex_lock(&lock);
+    while (connected < writers)
+        pthread_cond_wait(&cond, &lock);
+    pthread_mutex_unlock(&lock);
+
+    printf("%10s %8s %10s %12s %12s %10s\n", "mode", "writers", "seconds",
+            "ops/s", "requests/op", "conflicts");
+    for (mode = 0; mode < 4; mode++)
+        run(zhs, writers, ops, shards, block, mode);
+    for (i = 0; i < writers; i++)
+        zookeeper_close(zhs[i]);
+    return 0;
+}
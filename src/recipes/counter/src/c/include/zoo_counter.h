@@ -0,0 +1,113 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ZOOKEEPER_COUNTER_H_
+#define ZOOKEEPER_COUNTER_H_
+
+#include <zookeeper.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \file zoo_counter.h
+ * \brief zookeeper recipe for a sharded counter.
+ * the value of the counter is the sum of the numbers held by a few shard
+ * nodes under its path. A counter adds to one shard with a set conditioned
+ * on the version it last saw, so writers spread over the shards seldom
+ * meet, and a counter that loses a race to another moves on to the next
+ * shard. A read gets all the shards at once and then checks, in one multi,
+ * that none of them has changed since, so that the sum is a value the
+ * counter really had.
+ */
+
+struct zkr_counter {
+    zhandle_t *zh;
+    char *path;
+    struct ACL_vector *acl;
+    int shards;
+    int home;                       /* the shard we add to */
+    unsigned int seed;              /* for picking another one */
+    int64_t *values;                /* the shards' values when last seen */
+    int32_t *versions;              /* and their versions, -1 if not known */
+    pthread_mutex_t pmutex;
+    pthread_cond_t cond;
+    int pending;                    /* replies a read is waiting for */
+    long requests;                  /* requests sent, for measuring the load */
+    long conflicts;                 /* adds that lost a race */
+};
+
+typedef struct zkr_counter zkr_counter_t;
+
+/**
+ * \brief initializes a sharded counter
+ *
+ * this method instantiates a counter. The shards are created as they are
+ * first used; all counters on a path must use the same number of shards.
+ * \param counter the counter to initialize
+ * \param zh the zookeeper handle to use
+ * \param path the path of the counter, under which the shards are made
+ * \param acl the acl to create the nodes with
+ * \param shards the number of shards
+ * \return return 0 if successful.
+ */
+ZOOAPI int zkr_counter_init(zkr_counter_t *counter, zhandle_t* zh, char* path,
+        struct ACL_vector *acl, int shards);
+
+/**
+ * \brief adds to a sharded counter
+ *
+ * this method adds delta to one shard of the counter, which costs one set
+ * unless another writer changed the shard since this counter last saw it.
+ * It must not be called from a completion or a watcher.
+ * \param counter the counter
+ * \param delta the number to add, which may be negative
+ * \return returns 0 (ZOK) if delta was added, otherwise a zookeeper error
+ * code. If the connection was lost with the set in flight, the error is
+ * ZCONNECTIONLOSS or ZOPERATIONTIMEOUT and delta may or may not have been
+ * added.
+ */
+ZOOAPI int zkr_counter_add(zkr_counter_t *counter, int64_t delta);
+
+/**
+ * \brief reads a sharded counter
+ *
+ * this method gets all the shards and checks them with one multi, which
+ * takes two round trips. It must not be called from a completion or a
+ * watcher.
+ * \param counter the counter
+ * \param value the value of the counter
+ * \return returns 0 (ZOK) if the value was read, ZBADVERSION if the shards
+ * kept changing between the gets and the check, otherwise a zookeeper
+ * error code.
+ */
+ZOOAPI int zkr_counter_get(zkr_counter_t *counter, int64_t *value);
+
+/**
+ * \brief destroys a sharded counter
+ *
+ * this method frees the counter; the nodes stay.
+ * \param counter the counter to destroy
+ */
+ZOOAPI void zkr_counter_destroy(zkr_counter_t *counter);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  //ZOOKEEPER_COUNTER_H_
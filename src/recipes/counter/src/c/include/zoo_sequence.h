@@ -0,0 +1,95 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ZOOKEEPER_SEQUENCE_H_
+#define ZOOKEEPER_SEQUENCE_H_
+
+#include <zookeeper.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \file zoo_sequence.h
+ * \brief zookeeper recipe for allocating ids in blocks.
+ * a node holds the first id no one has taken yet. An allocator reserves a
+ * block of ids by moving it on with a set conditioned on the version it
+ * last saw, and hands the ids of the block out from memory, so that the
+ * ensemble sees one write per block rather than one per id. The ids of an
+ * allocator go up and are unique across all allocators on the node; ids of
+ * a block that was not used up, or whose reservation was lost with the
+ * connection, are skipped.
+ */
+
+struct zkr_sequence {
+    zhandle_t *zh;
+    char *path;
+    struct ACL_vector *acl;
+    int64_t block;
+    int64_t next;                   /* the next id to hand out */
+    int64_t limit;                  /* the end of the block we hold */
+    int64_t seen;                   /* the node's value when last seen */
+    int32_t version;                /* and its version, -1 if not known */
+    pthread_mutex_t pmutex;
+    long requests;                  /* requests sent, for measuring the load */
+    long conflicts;                 /* reservations that lost a race */
+};
+
+typedef struct zkr_sequence zkr_sequence_t;
+
+/**
+ * \brief initializes an id allocator
+ *
+ * this method instantiates an allocator on a node. The first reservation
+ * creates the node if there is none.
+ * \param seq the allocator to initialize
+ * \param zh the zookeeper handle to use
+ * \param path the path of the node that holds the next free id
+ * \param acl the acl to create the node with
+ * \param block the number of ids to reserve at a time
+ * \return return 0 if successful.
+ */
+ZOOAPI int zkr_sequence_init(zkr_sequence_t *seq, zhandle_t* zh, char* path,
+        struct ACL_vector *acl, int64_t block);
+
+/**
+ * \brief allocates an id
+ *
+ * this method hands out the next id of the block the allocator holds,
+ * reserving a new block first if this one is used up. Only the call that
+ * reserves talks to the server. It may be called from several threads.
+ * \param seq the allocator
+ * \param id the id allocated
+ * \return returns 0 (ZOK) if an id was allocated, ZBADARGUMENTS if the node
+ * does not hold a number, otherwise a zookeeper error code.
+ */
+ZOOAPI int zkr_sequence_next(zkr_sequence_t *seq, int64_t *id);
+
+/**
+ * \brief destroys an id allocator
+ *
+ * this method frees the allocator. The ids left in its block are lost.
+ * \param seq the allocator to destroy
+ */
+ZOOAPI void zkr_sequence_destroy(zkr_sequence_t *seq);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  //ZOOKEEPER_SEQUENCE_H_
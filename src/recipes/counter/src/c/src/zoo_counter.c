@@ -0,0 +1,302 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef DLL_EXPORT
+#define USE_STATIC_LIB
+#endif
+
+#if defined(__CYGWIN__)
+#define USE_IPV6
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <zookeeper_log.h>
+#include <zoo_counter.h>
+
+#define COUNTER_RETRIES 3
+/* reads that find the shards changed before giving up */
+#define COUNTER_READ_ATTEMPTS 10
+#define COUNTER_VALUE_LEN 24
+
+/* the get of a shard, or the check of all of them, a read waits for */
+struct counter_reply {
+    zkr_counter_t *counter;
+    int shard;
+    int rc;
+};
+
+ZOOAPI int zkr_counter_init(zkr_counter_t *counter, zhandle_t* zh, char* path,
+        struct ACL_vector *acl, int shards) {
+    int i;
+    if (shards < 1) {
+        return ZBADARGUMENTS;
+    }
+    counter->zh = zh;
+    counter->path = path;
+    counter->acl = acl;
+    counter->shards = shards;
+    counter->seed = (unsigned int) time(0) ^ (unsigned int) getpid()
+        ^ (unsigned int) (unsigned long) counter;
+    counter->home = rand_r(&counter->seed) % shards;
+    counter->values = calloc(shards, sizeof(*counter->values));
+    counter->versions = malloc(shards * sizeof(*counter->versions));
+    for (i = 0; i < shards; i++) {
+        counter->versions[i] = -1;
+    }
+    counter->pending = 0;
+    counter->requests = 0;
+    counter->conflicts = 0;
+    pthread_mutex_init(&(counter->pmutex), NULL);
+    pthread_cond_init(&(counter->cond), NULL);
+    return ZOK;
+}
+
+static int counter_parse(const char *buf, int len, int64_t *value) {
+    char text[COUNTER_VALUE_LEN];
+    char *end;
+    if (len <= 0) {
+        *value = 0;
+        return ZOK;
+    }
+    if (len >= (int) sizeof(text)) {
+        return ZBADARGUMENTS;
+    }
+    memcpy(text, buf, len);
+    text[len] = '\0';
+    *value = strtoll(text, &end, 10);
+    return *end == '\0' ? ZOK : ZBADARGUMENTS;
+}
+
+static void counter_shard_path(zkr_counter_t *counter, int shard, char *buf,
+                               int len) {
+    snprintf(buf, len, "%s/shard-%d", counter->path, shard);
+}
+
+/* creates a missing shard, and the counter's path if that is missing too */
+static int counter_create(zkr_counter_t *counter, const char *shard) {
+    int rc;
+    counter->requests++;
+    rc = zoo_create(counter->zh, shard, "0", 1, counter->acl, 0, NULL, 0);
+    if (rc == ZNONODE) {
+        counter->requests += 2;
+        rc = zoo_create(counter->zh, counter->path, NULL, 0, counter->acl, 0,
+                        NULL, 0);
+        if (rc == ZOK || rc == ZNODEEXISTS) {
+            rc = zoo_create(counter->zh, shard, "0", 1, counter->acl, 0,
+                            NULL, 0);
+        }
+    }
+    return rc == ZNODEEXISTS ? ZOK : rc;
+}
+
+static int counter_read(zkr_counter_t *counter, int shard, const char *path) {
+    char buf[COUNTER_VALUE_LEN];
+    int len = sizeof(buf);
+    struct Stat stat;
+    int rc;
+    counter->requests++;
+    rc = zoo_get(counter->zh, path, 0, buf, &len, &stat);
+    if (rc == ZOK) {
+        rc = counter_parse(buf, len, &counter->values[shard]);
+        counter->versions[shard] = rc == ZOK ? stat.version : -1;
+    }
+    return rc;
+}
+
+ZOOAPI int zkr_counter_add(zkr_counter_t *counter, int64_t delta) {
+    char buf[COUNTER_VALUE_LEN];
+    int len = strlen(counter->path) + 20;
+    char path[len];
+    struct Stat stat;
+    int rc, retries = 0;
+    pthread_mutex_lock(&(counter->pmutex));
+    for (;;) {
+        int shard = counter->home;
+        counter_shard_path(counter, shard, path, len);
+        rc = counter->versions[shard] < 0
+            ? counter_read(counter, shard, path) : ZOK;
+        if (rc == ZOK) {
+            int n = snprintf(buf, sizeof(buf), "%lld",
+                             (long long) (counter->values[shard] + delta));
+            counter->requests++;
+            rc = zoo_set2(counter->zh, path, buf, n,
+                          counter->versions[shard], &stat);
+            if (rc == ZOK) {
+                counter->values[shard] += delta;
+                counter->versions[shard] = stat.version;
+                break;
+            }
+            counter->versions[shard] = -1;
+            if (rc == ZBADVERSION) {
+                // another writer is on this shard: make way for it
+                counter->conflicts++;
+                counter->home = rand_r(&counter->seed) % counter->shards;
+                continue;
+            }
+            if (rc != ZNONODE) {
+                // we can't tell if a set lost with the connection was made
+                break;
+            }
+        }
+        if (rc == ZNONODE) {
+            rc = counter_create(counter, path);
+            if (rc == ZOK) {
+                continue;
+            }
+        }
+        if ((rc == ZCONNECTIONLOSS || rc == ZOPERATIONTIMEOUT)
+                && retries++ < COUNTER_RETRIES) {
+            LOG_DEBUG(("connection loss while reading a shard, retrying"));
+            continue;
+        }
+        break;
+    }
+    pthread_mutex_unlock(&(counter->pmutex));
+    if (rc != ZOK) {
+        LOG_WARN(("could not add to %s: %s", counter->path, zerror(rc)));
+    }
+    return rc;
+}
+
+static void counter_reply_done(struct counter_reply *reply, int rc) {
+    zkr_counter_t *counter = reply->counter;
+    reply->rc = rc;
+    if (--counter->pending == 0) {
+        pthread_cond_broadcast(&(counter->cond));
+    }
+}
+
+static void counter_get_completion(int rc, const char *value, int value_len,
+                                   const struct Stat *stat, const void *data) {
+    struct counter_reply *reply = (struct counter_reply *) data;
+    zkr_counter_t *counter = reply->counter;
+    pthread_mutex_lock(&(counter->pmutex));
+    if (rc == ZOK) {
+        rc = counter_parse(value, value_len, &counter->values[reply->shard]);
+    }
+    counter->versions[reply->shard] = rc == ZOK ? stat->version : -1;
+    counter_reply_done(reply, rc);
+    pthread_mutex_unlock(&(counter->pmutex));
+}
+
+static void counter_check_completion(int rc, const void *data) {
+    struct counter_reply *reply = (struct counter_reply *) data;
+    zkr_counter_t *counter = reply->counter;
+    pthread_mutex_lock(&(counter->pmutex));
+    counter_reply_done(reply, rc);
+    pthread_mutex_unlock(&(counter->pmutex));
+}
+
+/* waits for the replies, with pmutex held */
+static void counter_wait(zkr_counter_t *counter) {
+    while (counter->pending > 0) {
+        pthread_cond_wait(&(counter->cond), &(counter->pmutex));
+    }
+}
+
+ZOOAPI int zkr_counter_get(zkr_counter_t *counter, int64_t *value) {
+    int n = counter->shards;
+    int len = strlen(counter->path) + 20;
+    char paths[n][len];
+    struct counter_reply replies[n];
+    struct counter_reply check;
+    zoo_op_t ops[n];
+    zoo_op_result_t results[n];
+    int i, rc = ZOK, attempts = 0, retries = 0;
+    pthread_mutex_lock(&(counter->pmutex));
+    while (attempts < COUNTER_READ_ATTEMPTS) {
+        int64_t sum = 0;
+        // get all the shards at once
+        for (i = 0; i < n; i++) {
+            counter_shard_path(counter, i, paths[i], len);
+            replies[i].counter = counter;
+            replies[i].shard = i;
+            replies[i].rc = ZOK;
+            counter->requests++;
+            rc = zoo_aget(counter->zh, paths[i], 0, counter_get_completion,
+                          &replies[i]);
+            if (rc != ZOK) {
+                break;
+            }
+            counter->pending++;
+        }
+        counter_wait(counter);
+        for (i = 0; i < n && rc == ZOK; i++) {
+            rc = replies[i].rc;
+        }
+        if (rc == ZOK) {
+            // and check that none of them has changed since
+            for (i = 0; i < n; i++) {
+                zoo_check_op_init(&ops[i], paths[i], counter->versions[i]);
+                sum += counter->values[i];
+            }
+            check.counter = counter;
+            check.rc = ZOK;
+            counter->requests++;
+            rc = zoo_amulti(counter->zh, n, ops, results,
+                            counter_check_completion, &check);
+            if (rc == ZOK) {
+                counter->pending++;
+                counter_wait(counter);
+                rc = check.rc;
+            }
+            if (rc == ZOK) {
+                *value = sum;
+                break;
+            }
+        }
+        if (rc == ZBADVERSION) {
+            attempts++;
+        } else if (rc == ZNONODE) {
+            for (i = 0; i < n; i++) {
+                if (replies[i].rc == ZNONODE
+                        && (rc = counter_create(counter, paths[i])) != ZOK) {
+                    break;
+                }
+            }
+            if (rc != ZOK) {
+                break;
+            }
+        } else if ((rc == ZCONNECTIONLOSS || rc == ZOPERATIONTIMEOUT)
+                   && retries++ < COUNTER_RETRIES) {
+            LOG_DEBUG(("connection loss while reading the shards, retrying"));
+        } else {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&(counter->pmutex));
+    if (rc != ZOK) {
+        LOG_WARN(("could not read %s: %s", counter->path, zerror(rc)));
+    }
+    return rc;
+}
+
+ZOOAPI void zkr_counter_destroy(zkr_counter_t *counter) {
+    free(counter->values);
+    free(counter->versions);
+    counter->values = NULL;
+    counter->versions = NULL;
+    counter->path = NULL;
+    counter->acl = NULL;
+    pthread_cond_destroy(&(counter->cond));
+    pthread_mutex_destroy(&(counter->pmutex));
+}
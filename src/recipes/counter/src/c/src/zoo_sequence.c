@@ -0,0 +1,154 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef DLL_EXPORT
+#define USE_STATIC_LIB
+#endif
+
+#if defined(__CYGWIN__)
+#define USE_IPV6
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <zookeeper_log.h>
+#include <zoo_sequence.h>
+
+#define SEQUENCE_RETRIES 3
+#define SEQUENCE_VALUE_LEN 24
+
+/* parses a node's value, the empty value being 0 */
+static int sequence_parse(const char *buf, int len, int64_t *value) {
+    char text[SEQUENCE_VALUE_LEN];
+    char *end;
+    if (len <= 0) {
+        *value = 0;
+        return ZOK;
+    }
+    if (len >= (int) sizeof(text)) {
+        return ZBADARGUMENTS;
+    }
+    memcpy(text, buf, len);
+    text[len] = '\0';
+    *value = strtoll(text, &end, 10);
+    return *end == '\0' ? ZOK : ZBADARGUMENTS;
+}
+
+ZOOAPI int zkr_sequence_init(zkr_sequence_t *seq, zhandle_t* zh, char* path,
+        struct ACL_vector *acl, int64_t block) {
+    if (block < 1) {
+        return ZBADARGUMENTS;
+    }
+    seq->zh = zh;
+    seq->path = path;
+    seq->acl = acl;
+    seq->block = block;
+    seq->next = 0;
+    seq->limit = 0;
+    seq->seen = 0;
+    seq->version = -1;
+    seq->requests = 0;
+    seq->conflicts = 0;
+    pthread_mutex_init(&(seq->pmutex), NULL);
+    return ZOK;
+}
+
+/* reads the node's value and version, creating the node if there is none */
+static int sequence_read(zkr_sequence_t *seq) {
+    char buf[SEQUENCE_VALUE_LEN];
+    int len = sizeof(buf);
+    struct Stat stat;
+    int rc;
+    seq->requests++;
+    rc = zoo_get(seq->zh, seq->path, 0, buf, &len, &stat);
+    if (rc == ZNONODE) {
+        seq->requests++;
+        rc = zoo_create(seq->zh, seq->path, "0", 1, seq->acl, 0, NULL, 0);
+        if (rc == ZOK) {
+            seq->seen = 0;
+            seq->version = 0;
+        }
+        return rc;
+    }
+    if (rc == ZOK) {
+        rc = sequence_parse(buf, len, &seq->seen);
+        seq->version = rc == ZOK ? stat.version : -1;
+    }
+    return rc;
+}
+
+/**
+ * moves the node's value on by a block, conditioned on the version we last
+ * saw, and takes the ids in between. Losing the race to another allocator
+ * only costs a read; a connection lost with the set in flight costs the
+ * block, as we can't tell if the set went through.
+ */
+static int sequence_reserve(zkr_sequence_t *seq) {
+    char buf[SEQUENCE_VALUE_LEN];
+    struct Stat stat;
+    int rc, len, retries = 0;
+    for (;;) {
+        rc = seq->version < 0 ? sequence_read(seq) : ZOK;
+        if (rc == ZOK) {
+            len = snprintf(buf, sizeof(buf), "%lld",
+                           (long long) (seq->seen + seq->block));
+            seq->requests++;
+            rc = zoo_set2(seq->zh, seq->path, buf, len, seq->version, &stat);
+            if (rc == ZOK) {
+                seq->next = seq->seen;
+                seq->limit = seq->seen + seq->block;
+                seq->seen = seq->limit;
+                seq->version = stat.version;
+                return ZOK;
+            }
+            seq->version = -1;
+        }
+        if (rc == ZBADVERSION || rc == ZNODEEXISTS || rc == ZNONODE) {
+            // another allocator got there first
+            seq->conflicts++;
+            continue;
+        }
+        if ((rc == ZCONNECTIONLOSS || rc == ZOPERATIONTIMEOUT)
+                && retries++ < SEQUENCE_RETRIES) {
+            LOG_DEBUG(("connection loss while reserving ids, retrying"));
+            continue;
+        }
+        LOG_WARN(("could not reserve ids on %s: %s", seq->path, zerror(rc)));
+        return rc;
+    }
+}
+
+ZOOAPI int zkr_sequence_next(zkr_sequence_t *seq, int64_t *id) {
+    int rc = ZOK;
+    pthread_mutex_lock(&(seq->pmutex));
+    if (seq->next >= seq->limit) {
+        rc = sequence_reserve(seq);
+    }
+    if (rc == ZOK) {
+        *id = seq->next++;
+    }
+    pthread_mutex_unlock(&(seq->pmutex));
+    return rc;
+}
+
+ZOOAPI void zkr_sequence_destroy(zkr_sequence_t *seq) {
+    seq->path = NULL;
+    seq->acl = NULL;
+    pthread_mutex_destroy(&(seq->pmutex));
+}
@@ -0,0 +1,291 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <stdlib.h>
+#include <sys/select.h>
+#include <cppunit/TestAssert.h>
+
+
+using namespace std;
+
+#include <cstring>
+#include <list>
+
+#include <zookeeper.h>
+#include <zoo_counter.h>
+#include <zoo_sequence.h>
+
+static void yield(zhandle_t *zh, int i)
+{
+    sleep(i);
+}
+
+typedef struct evt {
+    string path;
+    int type;
+} evt_t;
+
+typedef struct watchCtx {
+private:
+    list<evt_t> events;
+public:
+    bool connected;
+    zhandle_t *zh;
+    
+    watchCtx() {
+        connected = false;
+        zh = 0;
+    }
+    ~watchCtx() {
+        if (zh) {
+            zookeeper_close(zh);
+            zh = 0;
+        }
+    }
+
+    evt_t getEvent() {
+        evt_t evt;
+        evt = events.front();
+        events.pop_front();
+        return evt;
+    }
+
+    int countEvents() {
+        int count;
+        count = events.size();
+        return count;
+    }
+
+    void putEvent(evt_t evt) {
+        events.push_back(evt);
+    }
+
+    bool waitForConnected(zhandle_t *zh) {
+        time_t expires = time(0) + 10;
+        while(!connected && time(0) < expires) {
+            yield(zh, 1);
+        }
+        return connected;
+    }
+    bool waitForDisconnected(zhandle_t *zh) {
+        time_t expires = time(0) + 15;
+        while(connected && time(0) < expires) {
+            yield(zh, 1);
+        }
+        return !connected;
+    }
+} watchctx_t; 
+
+class Zookeeper_countertest : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(Zookeeper_countertest);
+    CPPUNIT_TEST(testsequence);
+    CPPUNIT_TEST(testcounter);
+    CPPUNIT_TEST(testcounterconcurrent);
+    CPPUNIT_TEST_SUITE_END();
+
+    static void watcher(zhandle_t *, int type, int state, const char *path,void*v){
+        watchctx_t *ctx = (watchctx_t*)v;
+
+        if (state == ZOO_CONNECTED_STATE) {
+            ctx->connected = true;
+        } else {
+            ctx->connected = false;
+        }
+        if (type != ZOO_SESSION_EVENT) {
+            evt_t evt;
+            evt.path = path;
+            evt.type = type;
+            ctx->putEvent(evt);
+        }
+    }
+
+    static const char hostPorts[];
+
+    const char *getHostPorts() {
+        return hostPorts;
+    }
+
+    zhandle_t *createClient(watchctx_t *ctx) {
+        zhandle_t *zk = zookeeper_init(hostPorts, watcher, 10000, 0,
+                                       ctx, 0);
+        ctx->zh = zk;
+        sleep(1);
+        return zk;
+    }
+    
+public:
+
+#define ZKSERVER_CMD "./tests/zkServer.sh"
+
+    void setUp()
+    {
+        char cmd[1024];
+        sprintf(cmd, "%s startClean %s", ZKSERVER_CMD, getHostPorts());
+        CPPUNIT_ASSERT(system(cmd) == 0);
+    }
+    
+
+    void startServer() {
+        char cmd[1024];
+        sprintf(cmd, "%s start %s", ZKSERVER_CMD, getHostPorts());
+        CPPUNIT_ASSERT(system(cmd) == 0);
+    }
+
+    void stopServer() {
+        tearDown();
+    }
+
+    void tearDown()
+    {
+        char cmd[1024];
+        sprintf(cmd, "%s stop %s", ZKSERVER_CMD, getHostPorts());
+        CPPUNIT_ASSERT(system(cmd) == 0);
+    }
+    
+
+    void testsequence()
+    {
+        watchctx_t ctx1, ctx2;
+        zkr_sequence_t seqs[2];
+        int64_t ids[50], id;
+        char buf[32];
+        int len = sizeof(buf);
+        char* path = (char *) "/test-sequence";
+        zhandle_t *zh1 = createClient(&ctx1);
+        zhandle_t *zh2 = createClient(&ctx2);
+        int i, j;
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_sequence_init(&seqs[0], zh1, path,
+                &ZOO_OPEN_ACL_UNSAFE, 10));
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_sequence_init(&seqs[1], zh2, path,
+                &ZOO_OPEN_ACL_UNSAFE, 10));
+        // the allocators take turns, each from its own blocks
+        for (i = 0; i < 50; i++) {
+            CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_sequence_next(&seqs[i % 2],
+                    &ids[i]));
+            if (i >= 2)
+                CPPUNIT_ASSERT(ids[i] > ids[i - 2]);
+            for (j = 0; j < i; j++)
+                CPPUNIT_ASSERT(ids[i] != ids[j]);
+        }
+        CPPUNIT_ASSERT_EQUAL((int64_t) 0, ids[0]);
+        CPPUNIT_ASSERT_EQUAL((int64_t) 10, ids[1]);
+        CPPUNIT_ASSERT_EQUAL((int64_t) 1, ids[2]);
+        // 3 blocks each; taking turns, each reservation loses one race
+        // to the other allocator and costs a failed set, a read and a set
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zoo_get(zh1, path, 0, buf, &len, NULL));
+        CPPUNIT_ASSERT_EQUAL(string("60"), string(buf, len));
+        CPPUNIT_ASSERT(seqs[0].requests <= 3 * 3);
+        // a node that does not hold a number is refused
+        zkr_sequence_destroy(&seqs[0]);
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zoo_set(zh1, path, "x", 1, -1));
+        zkr_sequence_init(&seqs[0], zh1, path, &ZOO_OPEN_ACL_UNSAFE, 10);
+        CPPUNIT_ASSERT_EQUAL((int) ZBADARGUMENTS, zkr_sequence_next(&seqs[0],
+                &id));
+        zkr_sequence_destroy(&seqs[0]);
+        zkr_sequence_destroy(&seqs[1]);
+    }
+
+    void testcounter()
+    {
+        watchctx_t ctx1, ctx2;
+        zkr_counter_t counters[2];
+        int64_t value;
+        char* path = (char *) "/test-counter";
+        zhandle_t *zh1 = createClient(&ctx1);
+        zhandle_t *zh2 = createClient(&ctx2);
+        int i;
+        zkr_counter_init(&counters[0], zh1, path, &ZOO_OPEN_ACL_UNSAFE, 4);
+        zkr_counter_init(&counters[1], zh2, path, &ZOO_OPEN_ACL_UNSAFE, 4);
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_counter_get(&counters[0], &value));
+        CPPUNIT_ASSERT_EQUAL((int64_t) 0, value);
+        // both start on the same shard, so the second has to move
+        counters[0].home = counters[1].home = 0;
+        for (i = 0; i < 10; i++) {
+            CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_counter_add(&counters[0], 3));
+            CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_counter_add(&counters[1], -1));
+        }
+        CPPUNIT_ASSERT(counters[0].conflicts + counters[1].conflicts > 0);
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_counter_get(&counters[0], &value));
+        CPPUNIT_ASSERT_EQUAL((int64_t) 20, value);
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_counter_get(&counters[1], &value));
+        CPPUNIT_ASSERT_EQUAL((int64_t) 20, value);
+        zkr_counter_destroy(&counters[0]);
+        zkr_counter_destroy(&counters[1]);
+    }
+
+    struct counter_ctx {
+        zkr_counter_t counter;
+        int adds;
+        int failed;
+    };
+
+    static void *add_thread(void *arg) {
+        counter_ctx *ctx = (counter_ctx *) arg;
+        int i;
+        for (i = 0; i < ctx->adds; i++) {
+            if (zkr_counter_add(&ctx->counter, 1) != ZOK)
+                ctx->failed++;
+        }
+        return NULL;
+    }
+
+    void testcounterconcurrent()
+    {
+        const int writers = 4;
+        watchctx_t ctxs[writers + 1];
+        counter_ctx counters[writers];
+        pthread_t threads[writers];
+        zkr_counter_t reader;
+        int64_t value, last = 0;
+        char* path = (char *) "/test-counter-concurrent";
+        int i, reads = 0;
+        for (i = 0; i < writers; i++) {
+            counters[i].adds = 100;
+            counters[i].failed = 0;
+            zkr_counter_init(&counters[i].counter, createClient(&ctxs[i]),
+                             path, &ZOO_OPEN_ACL_UNSAFE, 2);
+        }
+        zkr_counter_init(&reader, createClient(&ctxs[writers]), path,
+                         &ZOO_OPEN_ACL_UNSAFE, 2);
+        for (i = 0; i < writers; i++)
+            pthread_create(&threads[i], NULL, add_thread, &counters[i]);
+        // every sum read meanwhile is one the counter had on its way up
+        while (last < writers * 100) {
+            int rc = zkr_counter_get(&reader, &value);
+            CPPUNIT_ASSERT(rc == ZOK || rc == ZBADVERSION);
+            if (rc == ZOK) {
+                CPPUNIT_ASSERT(value >= last && value <= writers * 100);
+                last = value;
+                reads++;
+            }
+        }
+        for (i = 0; i < writers; i++) {
+            pthread_join(threads[i], NULL);
+            CPPUNIT_ASSERT_EQUAL(0, counters[i].failed);
+            zkr_counter_destroy(&counters[i].counter);
+        }
+        CPPUNIT_ASSERT(reads > 0);
+        zkr_counter_destroy(&reader);
+    }
+};
+
+const char Zookeeper_countertest::hostPorts[] = "127.0.0.1:22181";
+CPPUNIT_TEST_SUITE_REGISTRATION(Zookeeper_countertest);
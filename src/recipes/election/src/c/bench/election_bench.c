@@ -0,0 +1,323 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures failover: participants spread over a few handles join an
+ * election, then the leader is stopped again and again, timing how long
+ * the next one takes to learn that it leads and counting the requests
+ * every participant sent meanwhile. The recipe is run as it is and with
+ * one participant per handle following the membership; for comparison,
+ * the same group is run the usual hand-made way, with every participant
+ * watching the children of the election's path.
+ *
+ *   zkelectionbench host:port [participants [failovers [handles]]]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <zookeeper.h>
+#include <zoo_election.h>
+
+/* a participant that watches the whole group */
+struct herd {
+    zhandle_t *zh;
+    char *path;
+    char id[128];
+    int leader;
+    int stopped;
+    long requests;
+};
+
+struct participant {
+    int index;
+    zkr_election_t election;
+    struct herd herd;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static int connected;
+static int joined;
+static int leaders;
+static int leader;
+static int failed;
+static int closing;
+
+static void watcher(zhandle_t *zh, int type, int state, const char *path,
+        void *ctx)
+{
+    if (type == ZOO_SESSION_EVENT && state == ZOO_CONNECTED_STATE) {
+        pthread_mutex_lock(&lock);
+        connected++;
+        pthread_cond_broadcast(&cond);
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void wait_for(int *counter, int value)
+{
+    pthread_mutex_lock(&lock);
+    while (*counter < value && failed == 0)
+        pthread_cond_wait(&cond, &lock);
+    pthread_mutex_unlock(&lock);
+}
+
+static void leads(int index)
+{
+    pthread_mutex_lock(&lock);
+    leader = index;
+    leaders++;
+    joined++;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&lock);
+}
+
+static void election_callback(int role, int rc, void *cbdata)
+{
+    struct participant *p = (struct participant *) cbdata;
+
+    if (role == ZKR_ELECTION_LEADER) {
+        leads(p->index);
+    } else if (role == ZKR_ELECTION_FOLLOWER || role == ZKR_ELECTION_FAILED) {
+        pthread_mutex_lock(&lock);
+        if (role == ZKR_ELECTION_FAILED && !closing) {
+            fprintf(stderr, "participant %d failed: %s\n", p->index,
+                    zerror(rc));
+            failed++;
+        }
+        joined++;
+        pthread_cond_broadcast(&cond);
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+static void herd_children(int rc, const struct String_vector *strings,
+        const void *data);
+
+static void herd_watcher(zhandle_t *zh, int type, int state, const char *path,
+        void *ctx)
+{
+    struct participant *p = (struct participant *) ctx;
+
+    if (type != ZOO_CHILD_EVENT)
+        return;
+    pthread_mutex_lock(&lock);
+    if (!p->herd.stopped) {
+        p->herd.requests++;
+        zoo_awget_children(p->herd.zh, p->herd.path, herd_watcher, p,
+                herd_children, p);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/* leads if its node comes first among all the children */
+static void herd_children(int rc, const struct String_vector *strings,
+        const void *data)
+{
+    struct participant *p = (struct participant *) data;
+    const char *lowest = NULL;
+    int i, lead;
+
+    if (rc != ZOK)
+        return;
+    for (i = 0; i < strings->count; i++) {
+        const char *seq = strrchr(strings->data[i], '-');
+        if (lowest == NULL || strcmp(seq, strrchr(lowest, '-')) < 0)
+            lowest = strings->data[i];
+    }
+    pthread_mutex_lock(&lock);
+    lead = !p->herd.stopped && !p->herd.leader && lowest != NULL
+        && strcmp(lowest, p->herd.id) == 0;
+    if (lead)
+        p->herd.leader = 1;
+    pthread_mutex_unlock(&lock);
+    if (lead)
+        leads(p->index);
+}
+
+static void herd_created(int rc, const char *value, const void *data)
+{
+    struct herd *h = (struct herd *) data;
+
+    pthread_mutex_lock(&lock);
+    if (rc == ZOK)
+        snprintf(h->id, sizeof(h->id), "%s", strrchr(value, '/') + 1);
+    else
+        failed++;
+    joined++;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&lock);
+}
+
+static void herd_deleted(int rc, const void *data)
+{
+}
+
+static long count_requests(struct participant *ps, int n, int herd)
+{
+    long requests = 0;
+    int i;
+
+    pthread_mutex_lock(&lock);
+    for (i = 0; i < n; i++)
+        requests += herd ? ps[i].herd.requests : ps[i].election.requests;
+    pthread_mutex_unlock(&lock);
+    return requests;
+}
+
+/* waits for the requests that follow a failover to die down */
+static long settled_requests(struct participant *ps, int n, int herd)
+{
+    long requests = count_requests(ps, n, herd), last;
+
+    do {
+        last = requests;
+        usleep(20000);
+        requests = count_requests(ps, n, herd);
+    } while (requests != last);
+    return requests;
+}
+
+/* mode 0 is the recipe, 1 the recipe following the membership, 2 the herd */
+static void run(zhandle_t **zhs, int handles, const char *path, int n,
+        int failovers, int mode)
+{
+    static const char *modes[] = {"predecessor", "membership", "herd"};
+    struct participant *ps = calloc(n, sizeof(*ps));
+    double join, latency = 0, worst = 0;
+    long requests = 0;
+    char buf[128];
+    int i, f;
+
+    joined = leaders = failed = 0;
+    leader = -1;
+    zoo_create(zhs[0], path, NULL, 0, &ZOO_OPEN_ACL_UNSAFE, 0, NULL, 0);
+    join = now();
+    for (i = 0; i < n; i++) {
+        ps[i].index = i;
+        if (mode == 2) {
+            ps[i].herd.zh = zhs[i % handles];
+            ps[i].herd.path = (char *) path;
+            ps[i].herd.requests = 1;
+            snprintf(buf, sizeof(buf), "%s/p%d-", path, i);
+            zoo_acreate(ps[i].herd.zh, buf, NULL, 0, &ZOO_OPEN_ACL_UNSAFE,
+                    ZOO_EPHEMERAL|ZOO_SEQUENCE, herd_created, &ps[i].herd);
+            continue;
+        }
+        snprintf(buf, sizeof(buf), "p%d", i);
+        zkr_election_init(&ps[i].election, zhs[i % handles], (char *) path,
+                &ZOO_OPEN_ACL_UNSAFE, strdup(buf), election_callback, &ps[i]);
+        if (mode == 1 && i < handles)
+            zkr_election_watch_members(&ps[i].election, NULL, NULL);
+        zkr_election_start(&ps[i].election);
+    }
+    wait_for(&joined, n);
+    if (mode == 2) {
+        // every participant watches the children once all have joined
+        for (i = 0; i < n; i++) {
+            pthread_mutex_lock(&lock);
+            ps[i].herd.requests++;
+            pthread_mutex_unlock(&lock);
+            zoo_awget_children(ps[i].herd.zh, path, herd_watcher, &ps[i],
+                    herd_children, &ps[i]);
+        }
+    }
+    wait_for(&leaders, 1);
+    join = now() - join;
+    settled_requests(ps, n, mode == 2);
+
+    for (f = 0; f < failovers && failed == 0 && f < n - 1; f++) {
+        long before = count_requests(ps, n, mode == 2);
+        double start = now(), took;
+        int old = leader;
+
+        if (mode == 2) {
+            pthread_mutex_lock(&lock);
+            ps[old].herd.stopped = 1;
+            ps[old].herd.requests++;
+            pthread_mutex_unlock(&lock);
+            snprintf(buf, sizeof(buf), "%s/%s", path, ps[old].herd.id);
+            zoo_adelete(ps[old].herd.zh, buf, -1, herd_deleted, NULL);
+        } else {
+            zkr_election_stop(&ps[old].election);
+        }
+        wait_for(&leaders, f + 2);
+        took = now() - start;
+        latency += took;
+        if (took > worst)
+            worst = took;
+        requests += settled_requests(ps, n, mode == 2) - before;
+    }
+    if (failed)
+        fprintf(stderr, "%d participants failed\n", failed);
+    printf("%12s %12d %10.3f %12.2f %12.2f %12.1f\n", modes[mode], n, join,
+            f ? latency / f * 1000 : 0, worst * 1000,
+            f ? (double) requests / f : 0);
+    fflush(stdout);
+    /* the participants are left to the handles, which hold their watches */
+}
+
+int main(int argc, char **argv)
+{
+    zhandle_t **zhs;
+    char path[64];
+    int n, failovers, handles, mode, i;
+
+    if (argc < 2) {
+        fprintf(stderr,
+                "USAGE: %s host:port [participants [failovers [handles]]]\n",
+                argv[0]);
+        return 2;
+    }
+    n = argc > 2 ? atoi(argv[2]) : 1000;
+    failovers = argc > 3 ? atoi(argv[3]) : 20;
+    handles = argc > 4 ? atoi(argv[4]) : 10;
+    zoo_set_debug_level(ZOO_LOG_LEVEL_WARN);
+    zhs = calloc(handles * 3, sizeof(*zhs));
+
+    printf("%12s %12s %10s %12s %12s %12s\n", "watches", "participants",
+            "join s", "failover ms", "worst ms", "requests");
+    for (mode = 0; mode < 3; mode++) {
+        // fresh handles, so the watches of one run don't fire in the next
+        for (i = 0; i < handles; i++)
+            zhs[mode * handles + i] = zookeeper_init(argv[1], watcher, 10000,
+                    0, 0, 0);
+        wait_for(&connected, (mode + 1) * handles);
+        snprintf(path, sizeof(path), "/zkelectionbench-%d-%d", getpid(), mode);
+        run(zhs + mode * handles, handles, strdup(path), n, failovers, mode);
+    }
+    // the nodes going with the sessions wake participants on other handles
+    pthread_mutex_lock(&lock);
+    closing = 1;
+    pthread_mutex_unlock(&lock);
+    for (i = 0; i < handles * 3; i++)
+        zookeeper_close(zhs[i]);
+    return 0;
+}
@@ -0,0 +1,206 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ZOOKEEPER_ELECTION_H_
+#define ZOOKEEPER_ELECTION_H_
+
+#include <zookeeper.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \file zoo_election.h
+ * \brief zookeeper recipe for leader election and group membership.
+ * every participant creates an ephemeral sequential node under the
+ * election's path, named after the participant; the one with the lowest
+ * sequence number leads. Every other participant watches only the node
+ * just before its own, so a leader going away wakes its successor and no
+ * one else. Participants that want the whole group can also follow its
+ * membership, which is kept in a cache and reported as changes.
+ */
+
+#define ZKR_ELECTION_FOLLOWER 0
+#define ZKR_ELECTION_LEADER 1
+#define ZKR_ELECTION_STOPPED 2
+#define ZKR_ELECTION_FAILED 3
+
+/**
+ * \brief the call back function called on a change of role
+ *
+ * the call back function is called with ZKR_ELECTION_FOLLOWER once the
+ * participant has joined behind another, with ZKR_ELECTION_LEADER when it
+ * becomes the leader and with ZKR_ELECTION_STOPPED once it has left after
+ * zkr_election_stop(). If the participant can't take part it is called
+ * with ZKR_ELECTION_FAILED and the zookeeper error code in rc; rc is ZOK
+ * otherwise.
+ * \param role the new role of the participant
+ * \param rc the zookeeper error code
+ * \param cbdata the callback data passed to zkr_election_init()
+ */
+typedef void (* zkr_election_callback) (int role, int rc, void* cbdata);
+
+/**
+ * \brief the call back function called on a change of membership
+ *
+ * \param member the node of the participant, which starts with the name
+ * it was given
+ * \param joined 1 if the participant has joined, 0 if it has left
+ * \param cbdata the callback data passed to zkr_election_watch_members()
+ */
+typedef void (* zkr_membership_callback) (const char *member, int joined,
+                                          void* cbdata);
+
+struct zkr_election {
+    zhandle_t *zh;
+    char *path;
+    struct ACL_vector *acl;
+    char *name;
+    char *id;
+    char *leader;
+    zkr_election_callback callback;
+    void *cbdata;
+    pthread_mutex_t pmutex;
+    int state;
+    int role;
+    int retries;
+    int create_rc;
+    int result;
+    /* membership, see zkr_election_watch_members() */
+    zkr_membership_callback member_callback;
+    void *member_cbdata;
+    int members_watched;
+    int member_retries;
+    struct String_vector members;
+    /* requests sent to the server, for measuring the load */
+    long requests;
+};
+
+typedef struct zkr_election zkr_election_t;
+
+/**
+ * \brief initializing a zookeeper election participant.
+ *
+ * this method instantiates a participant in the election on path. Many
+ * participants can share one handle.
+ * \param election the participant to initialize
+ * \param zh the zookeeper handle to use
+ * \param path the path in zookeeper to use for the election
+ * \param acl the acls to use in zookeeper.
+ * \param name the name of the participant, which must be valid as part of
+ * a znode name; it starts the participant's node.
+ * \param callback the callback thats called when the role changes, may be
+ * NULL.
+ * \param cbdata the callback method is called with data
+ * \return return 0 if successful.
+ */
+ZOOAPI int zkr_election_init(zkr_election_t *election, zhandle_t* zh,
+                             char* path, struct ACL_vector *acl, char* name,
+                             zkr_election_callback callback, void* cbdata);
+
+/**
+ * \brief join the election
+ *
+ * this method starts joining the election and returns without waiting;
+ * the callback tells how it went. Once this has been called, the
+ * participant must stay valid until the handle is closed.
+ * \param election the participant
+ * \return return 0 if joining was started or the participant has already
+ * joined, otherwise a zookeeper error code; the callback is not called
+ * then.
+ */
+ZOOAPI int zkr_election_start(zkr_election_t *election);
+
+/**
+ * \brief leave the election
+ *
+ * this method deletes the participant's node, or abandons joining, without
+ * waiting for the server. The callback is called with ZKR_ELECTION_STOPPED
+ * once the node is gone. It also stops the reports of membership.
+ * \param election the participant
+ * \return return 0 if leaving was started, ZSYSTEMERROR if the participant
+ * had not started, otherwise a zookeeper error code.
+ */
+ZOOAPI int zkr_election_stop(zkr_election_t *election);
+
+/**
+ * \brief return if this participant leads
+ * \param election the participant
+ * \return return true if the participant is the leader and false if not
+ */
+ZOOAPI int zkr_election_isleader(zkr_election_t *election);
+
+/**
+ * \brief return the node of the leader
+ *
+ * this method copies the node of the leader as last seen. A follower that
+ * does not watch the membership sees the leader only when its predecessor
+ * goes, so it may name a leader that has since left.
+ * \param election the participant
+ * \param buf the buffer to copy the node into
+ * \param len the size of buf
+ * \return return 0 if successful, ZNONODE if no leader has been seen or
+ * ZBADARGUMENTS if buf is too small.
+ */
+ZOOAPI int zkr_election_getleader(zkr_election_t *election, char *buf,
+                                  int len);
+
+/**
+ * \brief follow the membership of the election
+ *
+ * this method watches the children of the election's path and reports
+ * every participant that joins or leaves; those there already are reported
+ * as joined first. The list is kept in a cache, so only the changes reach
+ * the callback, and the leader named by zkr_election_getleader() stays up
+ * to date. This is one watch on the path for this participant, so only the
+ * participants that need the membership should ask for it.
+ * \param election the participant
+ * \param callback the callback thats called on changes, may be NULL.
+ * \param cbdata the callback method is called with data
+ * \return return 0 if successful, otherwise a zookeeper error code.
+ */
+ZOOAPI int zkr_election_watch_members(zkr_election_t *election,
+                                      zkr_membership_callback callback,
+                                      void *cbdata);
+
+/**
+ * \brief return the membership of the election
+ *
+ * this method copies the cached membership, in the order of the nodes. It
+ * is empty unless zkr_election_watch_members() was called.
+ * \param election the participant
+ * \param members the vector to fill, to be freed with
+ * deallocate_String_vector()
+ * \return return 0 if successful.
+ */
+ZOOAPI int zkr_election_get_members(zkr_election_t *election,
+                                    struct String_vector *members);
+
+/**
+ * \brief destroy the participant
+ * this method frees the participant, it does not leave the election.
+ * \param election the participant
+ * \return return 0 if destroyed.
+ */
+ZOOAPI int zkr_election_destroy(zkr_election_t *election);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  //ZOOKEEPER_ELECTION_H_
@@ -0,0 +1,677 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef DLL_EXPORT
+#define USE_STATIC_LIB
+#endif
+
+#if defined(__CYGWIN__)
+#define USE_IPV6
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <zookeeper_log.h>
+#include <limits.h>
+#include <zoo_election.h>
+
+/**
+ * Joining runs from the completions of asynchronous requests, as the
+ * asynchronous lock does:
+ *
+ *   CREATE         create our node and get the children, both sent at once;
+ *                  the children's completion, which comes second, decides
+ *   CREATE_PARENT  create the election's path, which was missing
+ *   LOOKUP         get the children, to find a node whose create we lost
+ *                  the answer to
+ *   CHECK          get the children and find our predecessor
+ *   WATCHING       wait for the predecessor to go, then CHECK again
+ *   LEADER         we lead, and watch our own node so as to notice if it
+ *                  goes with the session
+ *
+ * The steps run with pmutex held and return the role to report, a
+ * zookeeper error if joining failed, or ELECTION_CONTINUE. Stopping puts
+ * the state back to IDLE, and the completions of requests still in flight
+ * then stop.
+ */
+
+enum election_state {
+    ELECTION_IDLE = 0, ELECTION_CREATE, ELECTION_CREATE_PARENT,
+    ELECTION_LOOKUP, ELECTION_CHECK, ELECTION_WATCHING, ELECTION_LEADER
+};
+
+#define ELECTION_RETRIES 3
+#define ELECTION_PREFIX_LEN 48
+/* returned by a step with nothing to report; not a role, those being
+ * small and positive, nor an error, those being negative */
+#define ELECTION_CONTINUE INT_MAX
+
+struct election_stop {
+    zkr_election_t *election;
+    int retries;
+    char path[];
+};
+
+struct member_change {
+    char *member;
+    int joined;
+};
+
+static int election_create(zkr_election_t *election);
+static int election_get_children(zkr_election_t *election, int state);
+static int members_get_children(zkr_election_t *election);
+
+ZOOAPI int zkr_election_init(zkr_election_t *election, zhandle_t* zh,
+                             char* path, struct ACL_vector *acl, char* name,
+                             zkr_election_callback callback, void* cbdata) {
+    election->zh = zh;
+    election->path = path;
+    election->acl = acl;
+    election->name = name != NULL ? name : "n";
+    election->id = NULL;
+    election->leader = NULL;
+    election->callback = callback;
+    election->cbdata = cbdata;
+    election->state = ELECTION_IDLE;
+    election->role = ZKR_ELECTION_STOPPED;
+    election->retries = 0;
+    election->create_rc = ZOK;
+    election->result = ZOK;
+    election->member_callback = NULL;
+    election->member_cbdata = NULL;
+    election->members_watched = 0;
+    election->member_retries = 0;
+    election->members.count = 0;
+    election->members.data = NULL;
+    election->requests = 0;
+    pthread_mutex_init(&(election->pmutex), NULL);
+    return 0;
+}
+
+/* names our node after the participant, the session and the struct, so
+ * that we can find it again after a connection loss */
+static void election_prefix(zkr_election_t *election, char *prefix, int len) {
+    int64_t session = zoo_client_id(election->zh)->client_id;
+#if defined(__x86_64__)
+    snprintf(prefix, len, "%s-%016lx-%lx-", election->name, session,
+             (unsigned long) election);
+#else
+    snprintf(prefix, len, "%s-%016llx-%lx-", election->name, session,
+             (unsigned long) election);
+#endif
+}
+
+static int seqcmp(const void* str1, const void* str2) {
+    const char **a = (const char**)str1;
+    const char **b = (const char**) str2;
+    return strcmp(strrchr(*a, '-')+1, strrchr(*b, '-')+1);
+}
+
+static void set_leader(zkr_election_t *election, const char *leader) {
+    if (election->leader != NULL) {
+        free(election->leader);
+    }
+    election->leader = leader != NULL ? strdup(leader) : NULL;
+}
+
+/* settles on a role, returning it if it is news */
+static int election_role(zkr_election_t *election, int state, int role) {
+    election->state = state;
+    if (election->role == role) {
+        return ELECTION_CONTINUE;
+    }
+    election->role = role;
+    return role;
+}
+
+/* deletes a node we no longer want; the client wants a completion even
+ * though there is nothing to do */
+static void election_abandon_completion(int rc, const void *data) {
+    if (rc != ZOK && rc != ZNONODE) {
+        LOG_WARN(("could not delete an abandoned node: %s", zerror(rc)));
+    }
+}
+
+static int election_fail(zkr_election_t *election, int rc) {
+    LOG_WARN(("could not take part in the election on %s: %s",
+              election->path, zerror(rc)));
+    if (election->id != NULL) {
+        int len = strlen(election->path) + strlen(election->id) + 2;
+        char buf[len];
+        snprintf(buf, len, "%s/%s", election->path, election->id);
+        election->requests++;
+        zoo_adelete(election->zh, buf, -1, election_abandon_completion,
+                    NULL);
+        free(election->id);
+        election->id = NULL;
+    }
+    election->state = ELECTION_IDLE;
+    election->role = ZKR_ELECTION_FAILED;
+    election->result = rc;
+    return rc;
+}
+
+/* repeats the step after a connection loss, if it may */
+static int election_retry(zkr_election_t *election, int rc) {
+    if ((rc == ZCONNECTIONLOSS || rc == ZOPERATIONTIMEOUT)
+            && election->retries < ELECTION_RETRIES) {
+        LOG_DEBUG(("connection loss in the election, retrying"));
+        election->retries++;
+        return 1;
+    }
+    return 0;
+}
+
+/* tells the participant how the step went, without pmutex */
+static void election_notify(zkr_election_t *election, int ret) {
+    zkr_election_callback callback = election->callback;
+    if (ret == ELECTION_CONTINUE || callback == NULL) {
+        return;
+    }
+    if (ret < 0) {
+        callback(ZKR_ELECTION_FAILED, ret, election->cbdata);
+    } else {
+        callback(ret, ZOK, election->cbdata);
+    }
+}
+
+static int election_watch(zkr_election_t *election, const char *node);
+
+static void election_watcher_fn(zhandle_t* zh, int type, int state,
+                                const char* path, void *watcherCtx) {
+    zkr_election_t *election = (zkr_election_t *) watcherCtx;
+    int ret = ELECTION_CONTINUE;
+    if (type == ZOO_SESSION_EVENT && state != ZOO_EXPIRED_SESSION_STATE) {
+        return;
+    }
+    pthread_mutex_lock(&(election->pmutex));
+    if (election->state == ELECTION_WATCHING) {
+        election->retries = 0;
+        ret = election_get_children(election, ELECTION_CHECK);
+    } else if (election->state == ELECTION_LEADER && election->id != NULL) {
+        int len = strlen(election->path) + strlen(election->id) + 2;
+        char buf[len];
+        snprintf(buf, len, "%s/%s", election->path, election->id);
+        if (type == ZOO_SESSION_EVENT || strcmp(path, buf) == 0) {
+            // our node has gone, with the session or by another's hand
+            free(election->id);
+            election->id = NULL;
+            election->retries = 0;
+            ret = election_create(election);
+        }
+    }
+    pthread_mutex_unlock(&(election->pmutex));
+    election_notify(election, ret);
+}
+
+static void election_exists_completion(int rc, const struct Stat *stat,
+                                       const void *data) {
+    zkr_election_t *election = (zkr_election_t *) data;
+    int ret = ELECTION_CONTINUE;
+    pthread_mutex_lock(&(election->pmutex));
+    if (election->state == ELECTION_WATCHING && rc != ZOK) {
+        // the predecessor went before the watch was set
+        if (rc == ZNONODE || election_retry(election, rc)) {
+            ret = election_get_children(election, ELECTION_CHECK);
+        } else {
+            ret = election_fail(election, rc);
+        }
+    } else if (election->state == ELECTION_LEADER && rc != ZOK) {
+        if (rc == ZNONODE) {
+            free(election->id);
+            election->id = NULL;
+            ret = election_create(election);
+        } else if (election_retry(election, rc)) {
+            ret = election_watch(election, election->id);
+        } else {
+            ret = election_fail(election, rc);
+        }
+    }
+    pthread_mutex_unlock(&(election->pmutex));
+    election_notify(election, ret);
+}
+
+/* watches the predecessor, or our own node once we lead */
+static int election_watch(zkr_election_t *election, const char *node) {
+    int len = strlen(election->path) + strlen(node) + 2;
+    char buf[len];
+    int rc;
+    snprintf(buf, len, "%s/%s", election->path, node);
+    election->requests++;
+    rc = zoo_awexists(election->zh, buf, &election_watcher_fn, election,
+                      election_exists_completion, election);
+    return rc == ZOK ? ELECTION_CONTINUE : election_fail(election, rc);
+}
+
+/* finds our predecessor, which we watch, or finds that we lead */
+static int election_check(zkr_election_t *election,
+                          const struct String_vector *strings) {
+    char *sorted[strings->count];
+    int i, ret;
+    memcpy(sorted, strings->data, sizeof(sorted));
+    qsort(sorted, strings->count, sizeof(char*), &seqcmp);
+    for (i = 0; i < strings->count; i++) {
+        if (strcmp(sorted[i], election->id) == 0) {
+            break;
+        }
+    }
+    if (i == strings->count) {
+        // our node has gone with our previous session
+        free(election->id);
+        election->id = NULL;
+        return election_create(election);
+    }
+    set_leader(election, sorted[0]);
+    if (i == 0) {
+        LOG_DEBUG(("leading the election - %s", election->id));
+        election->state = ELECTION_LEADER;
+        ret = election_watch(election, election->id);
+        return ret != ELECTION_CONTINUE
+            ? ret : election_role(election, ELECTION_LEADER,
+                                  ZKR_ELECTION_LEADER);
+    }
+    election->state = ELECTION_WATCHING;
+    ret = election_watch(election, sorted[i - 1]);
+    return ret != ELECTION_CONTINUE
+        ? ret : election_role(election, ELECTION_WATCHING,
+                              ZKR_ELECTION_FOLLOWER);
+}
+
+static void election_create_completion(int rc, const char *value,
+                                       const void *data) {
+    zkr_election_t *election = (zkr_election_t *) data;
+    int ret = ELECTION_CONTINUE;
+    pthread_mutex_lock(&(election->pmutex));
+    if (election->state == ELECTION_CREATE) {
+        // the children's completion, which follows, acts on this
+        election->create_rc = rc;
+        if (rc == ZOK) {
+            const char *name = strrchr(value, '/');
+            election->id = strdup(name ? name + 1 : value);
+        }
+    } else if (election->state == ELECTION_CREATE_PARENT) {
+        if (rc == ZOK || rc == ZNODEEXISTS || election_retry(election, rc)) {
+            ret = election_create(election);
+        } else {
+            ret = election_fail(election, rc);
+        }
+    } else if (rc == ZOK) {
+        // stopped while the create was in flight
+        election->requests++;
+        zoo_adelete(election->zh, value, -1, election_abandon_completion,
+                    NULL);
+    }
+    pthread_mutex_unlock(&(election->pmutex));
+    election_notify(election, ret);
+}
+
+static void election_children_completion(int rc,
+                                         const struct String_vector *strings,
+                                         const void *data) {
+    zkr_election_t *election = (zkr_election_t *) data;
+    int ret = ELECTION_CONTINUE;
+    int i;
+    pthread_mutex_lock(&(election->pmutex));
+    switch (election->state) {
+    case ELECTION_CREATE:
+        if (election->create_rc == ZOK && rc == ZOK) {
+            election->retries = 0;
+            ret = election_check(election, strings);
+        } else if (election->create_rc == ZNONODE) {
+            election->state = ELECTION_CREATE_PARENT;
+            election->requests++;
+            rc = zoo_acreate(election->zh, election->path, NULL, 0,
+                             election->acl, 0, election_create_completion,
+                             election);
+            ret = rc == ZOK ? ELECTION_CONTINUE : election_fail(election, rc);
+        } else if (election->create_rc == ZOK) {
+            // we have our node; only the list is missing
+            ret = election_retry(election, rc)
+                ? election_get_children(election, ELECTION_CHECK)
+                : election_fail(election, rc);
+        } else if (election_retry(election, election->create_rc)) {
+            // we can't tell if the node was made: look for it
+            ret = election_get_children(election, ELECTION_LOOKUP);
+        } else {
+            ret = election_fail(election, election->create_rc);
+        }
+        break;
+    case ELECTION_LOOKUP:
+    case ELECTION_CHECK:
+        if (rc != ZOK) {
+            ret = election_retry(election, rc)
+                ? election_get_children(election, election->state)
+                : election_fail(election, rc);
+            break;
+        }
+        election->retries = 0;
+        if (election->state == ELECTION_LOOKUP) {
+            char prefix[strlen(election->name) + ELECTION_PREFIX_LEN];
+            election_prefix(election, prefix, sizeof(prefix));
+            for (i = 0; i < strings->count; i++) {
+                if (strncmp(prefix, strings->data[i], strlen(prefix)) == 0) {
+                    election->id = strdup(strings->data[i]);
+                    break;
+                }
+            }
+        }
+        ret = election->id != NULL ? election_check(election, strings)
+                                   : election_create(election);
+        break;
+    default:
+        // stopped while the request was in flight
+        break;
+    }
+    pthread_mutex_unlock(&(election->pmutex));
+    election_notify(election, ret);
+}
+
+static int election_get_children(zkr_election_t *election, int state) {
+    int rc;
+    election->state = state;
+    election->requests++;
+    rc = zoo_aget_children(election->zh, election->path, 0,
+                           election_children_completion, election);
+    return rc == ZOK ? ELECTION_CONTINUE : election_fail(election, rc);
+}
+
+/* sends the create of our node and, behind it, the get of the children */
+static int election_create(zkr_election_t *election) {
+    char prefix[strlen(election->name) + ELECTION_PREFIX_LEN];
+    int rc;
+    election_prefix(election, prefix, sizeof(prefix));
+    int len = strlen(election->path) + strlen(prefix) + 2;
+    char buf[len];
+    snprintf(buf, len, "%s/%s", election->path, prefix);
+    election->state = ELECTION_CREATE;
+    election->create_rc = ZOK;
+    election->requests += 2;
+    rc = zoo_acreate(election->zh, buf, NULL, 0, election->acl,
+                     ZOO_EPHEMERAL|ZOO_SEQUENCE,
+                     election_create_completion, election);
+    if (rc == ZOK) {
+        rc = zoo_aget_children(election->zh, election->path, 0,
+                               election_children_completion, election);
+    }
+    return rc == ZOK ? ELECTION_CONTINUE : election_fail(election, rc);
+}
+
+ZOOAPI int zkr_election_start(zkr_election_t *election) {
+    int rc = ZOK;
+    pthread_mutex_lock(&(election->pmutex));
+    if (election->state == ELECTION_IDLE) {
+        election->retries = 0;
+        election->role = ZKR_ELECTION_STOPPED;
+        rc = election_create(election);
+        if (rc == ELECTION_CONTINUE) {
+            rc = ZOK;
+        }
+    }
+    pthread_mutex_unlock(&(election->pmutex));
+    return rc;
+}
+
+static void election_delete_completion(int rc, const void *data) {
+    struct election_stop *stop = (struct election_stop *) data;
+    zkr_election_t *election = stop->election;
+    if ((rc == ZCONNECTIONLOSS || rc == ZOPERATIONTIMEOUT)
+            && stop->retries++ < ELECTION_RETRIES) {
+        LOG_DEBUG(("connectionloss while deleting the node"));
+        pthread_mutex_lock(&(election->pmutex));
+        election->requests++;
+        pthread_mutex_unlock(&(election->pmutex));
+        if (zoo_adelete(election->zh, stop->path, -1,
+                        election_delete_completion, stop) == ZOK) {
+            return;
+        }
+    }
+    if (rc != ZOK && rc != ZNONODE) {
+        LOG_WARN(("could not delete %s: %s", stop->path, zerror(rc)));
+    }
+    free(stop);
+    election_notify(election, ZKR_ELECTION_STOPPED);
+}
+
+ZOOAPI int zkr_election_stop(zkr_election_t *election) {
+    struct election_stop *stop = NULL;
+    int rc = ZOK;
+    pthread_mutex_lock(&(election->pmutex));
+    if (election->id != NULL) {
+        int len = strlen(election->path) + strlen(election->id) + 2;
+        stop = malloc(sizeof(*stop) + len);
+        stop->election = election;
+        stop->retries = 0;
+        snprintf(stop->path, len, "%s/%s", election->path, election->id);
+        free(election->id);
+        election->id = NULL;
+    } else if (election->state == ELECTION_IDLE) {
+        rc = ZSYSTEMERROR;
+    }
+    if (rc == ZOK) {
+        election->state = ELECTION_IDLE;
+        election->role = ZKR_ELECTION_STOPPED;
+        election->members_watched = 0;
+        deallocate_String_vector(&(election->members));
+        election->members.count = 0;
+        set_leader(election, NULL);
+    }
+    // requests are answered in order, so a start that follows this
+    // will not find the node
+    if (stop != NULL) {
+        election->requests++;
+        rc = zoo_adelete(election->zh, stop->path, -1,
+                         election_delete_completion, stop);
+        if (rc != ZOK) {
+            LOG_WARN(("could not delete %s: %s", stop->path, zerror(rc)));
+            free(stop);
+        }
+    }
+    pthread_mutex_unlock(&(election->pmutex));
+    if (rc == ZOK && stop == NULL) {
+        // joining was abandoned before our node was known
+        election_notify(election, ZKR_ELECTION_STOPPED);
+    }
+    return rc;
+}
+
+ZOOAPI int zkr_election_isleader(zkr_election_t *election) {
+    return election->state == ELECTION_LEADER;
+}
+
+ZOOAPI int zkr_election_getleader(zkr_election_t *election, char *buf,
+                                  int len) {
+    int rc = ZOK;
+    pthread_mutex_lock(&(election->pmutex));
+    if (election->leader == NULL) {
+        rc = ZNONODE;
+    } else if (strlen(election->leader) >= len) {
+        rc = ZBADARGUMENTS;
+    } else {
+        strcpy(buf, election->leader);
+    }
+    pthread_mutex_unlock(&(election->pmutex));
+    return rc;
+}
+
+static void members_watcher_fn(zhandle_t* zh, int type, int state,
+                               const char* path, void *watcherCtx) {
+    zkr_election_t *election = (zkr_election_t *) watcherCtx;
+    if (type == ZOO_SESSION_EVENT && state != ZOO_EXPIRED_SESSION_STATE) {
+        return;
+    }
+    pthread_mutex_lock(&(election->pmutex));
+    if (election->members_watched) {
+        election->member_retries = 0;
+        members_get_children(election);
+    }
+    pthread_mutex_unlock(&(election->pmutex));
+}
+
+static int members_fail(zkr_election_t *election, int rc) {
+    LOG_WARN(("could not follow the membership of %s: %s", election->path,
+              zerror(rc)));
+    election->members_watched = 0;
+    return rc;
+}
+
+static int members_retry(zkr_election_t *election, int rc) {
+    return (rc == ZCONNECTIONLOSS || rc == ZOPERATIONTIMEOUT)
+        && election->member_retries++ < ELECTION_RETRIES;
+}
+
+static void members_exists_completion(int rc, const struct Stat *stat,
+                                      const void *data) {
+    zkr_election_t *election = (zkr_election_t *) data;
+    pthread_mutex_lock(&(election->pmutex));
+    if (election->members_watched && rc != ZNONODE) {
+        // the path was made before the watch was set, or we lost the answer
+        if (rc == ZOK || members_retry(election, rc)) {
+            members_get_children(election);
+        } else {
+            members_fail(election, rc);
+        }
+    }
+    pthread_mutex_unlock(&(election->pmutex));
+}
+
+/* works out who joined and who left since the cached list, which it
+ * replaces; the names of those who left move into the changes */
+static int members_diff(zkr_election_t *election,
+                        const struct String_vector *strings,
+                        struct member_change *changes) {
+    struct String_vector *old = &(election->members);
+    struct String_vector members;
+    int i = 0, j = 0, n = 0;
+    members.count = strings->count;
+    members.data = malloc(sizeof(char*) * (strings->count + 1));
+    for (j = 0; j < strings->count; j++) {
+        members.data[j] = strdup(strings->data[j]);
+    }
+    qsort(members.data, members.count, sizeof(char*), &seqcmp);
+    j = 0;
+    while (i < old->count || j < members.count) {
+        int cmp = i == old->count ? 1 : j == members.count ? -1
+            : seqcmp(&old->data[i], &members.data[j]);
+        if (cmp < 0) {
+            changes[n].member = old->data[i];
+            changes[n++].joined = 0;
+            old->data[i++] = NULL;
+        } else if (cmp > 0) {
+            changes[n].member = strdup(members.data[j++]);
+            changes[n++].joined = 1;
+        } else {
+            i++;
+            j++;
+        }
+    }
+    deallocate_String_vector(old);
+    *old = members;
+    set_leader(election, members.count > 0 ? members.data[0] : NULL);
+    return n;
+}
+
+static void members_completion(int rc, const struct String_vector *strings,
+                               const void *data) {
+    zkr_election_t *election = (zkr_election_t *) data;
+    zkr_membership_callback callback = NULL;
+    struct member_change *changes = NULL;
+    void *cbdata = NULL;
+    int i, n = 0;
+    pthread_mutex_lock(&(election->pmutex));
+    if (!election->members_watched) {
+        // stopped while the request was in flight
+    } else if (rc == ZOK) {
+        election->member_retries = 0;
+        changes = malloc(sizeof(*changes) *
+                         (election->members.count + strings->count + 1));
+        n = members_diff(election, strings, changes);
+        callback = election->member_callback;
+        cbdata = election->member_cbdata;
+    } else if (rc == ZNONODE) {
+        // no one has joined yet: wait for the path
+        election->requests++;
+        rc = zoo_awexists(election->zh, election->path, &members_watcher_fn,
+                          election, members_exists_completion, election);
+        if (rc != ZOK) {
+            members_fail(election, rc);
+        }
+    } else if (members_retry(election, rc)) {
+        members_get_children(election);
+    } else {
+        members_fail(election, rc);
+    }
+    pthread_mutex_unlock(&(election->pmutex));
+    for (i = 0; i < n; i++) {
+        if (callback != NULL) {
+            callback(changes[i].member, changes[i].joined, cbdata);
+        }
+        free(changes[i].member);
+    }
+    free(changes);
+}
+
+static int members_get_children(zkr_election_t *election) {
+    int rc;
+    election->requests++;
+    rc = zoo_awget_children(election->zh, election->path,
+                            &members_watcher_fn, election,
+                            members_completion, election);
+    return rc == ZOK ? ZOK : members_fail(election, rc);
+}
+
+ZOOAPI int zkr_election_watch_members(zkr_election_t *election,
+                                      zkr_membership_callback callback,
+                                      void *cbdata) {
+    int rc;
+    pthread_mutex_lock(&(election->pmutex));
+    election->member_callback = callback;
+    election->member_cbdata = cbdata;
+    election->members_watched = 1;
+    election->member_retries = 0;
+    rc = members_get_children(election);
+    pthread_mutex_unlock(&(election->pmutex));
+    return rc;
+}
+
+ZOOAPI int zkr_election_get_members(zkr_election_t *election,
+                                    struct String_vector *members) {
+    int i;
+    pthread_mutex_lock(&(election->pmutex));
+    allocate_String_vector(members, election->members.count);
+    for (i = 0; i < election->members.count; i++) {
+        members->data[i] = strdup(election->members.data[i]);
+    }
+    pthread_mutex_unlock(&(election->pmutex));
+    return ZOK;
+}
+
+ZOOAPI int zkr_election_destroy(zkr_election_t *election) {
+    if (election->id)
+        free(election->id);
+    election->id = NULL;
+    set_leader(election, NULL);
+    deallocate_String_vector(&(election->members));
+    election->members.count = 0;
+    election->path = NULL;
+    election->acl = NULL;
+    election->callback = NULL;
+    election->member_callback = NULL;
+    pthread_mutex_destroy(&(election->pmutex));
+    return 0;
+}
@@ -0,0 +1,383 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <stdlib.h>
+#include <sys/select.h>
+#include <cppunit/TestAssert.h>
+
+
+using namespace std;
+
+#include <cstring>
+#include <list>
+
+#include <zookeeper.h>
+#include <zoo_election.h>
+
+static void yield(zhandle_t *zh, int i)
+{
+    sleep(i);
+}
+
+typedef struct evt {
+    string path;
+    int type;
+} evt_t;
+
+typedef struct watchCtx {
+private:
+    list<evt_t> events;
+public:
+    bool connected;
+    zhandle_t *zh;
+    
+    watchCtx() {
+        connected = false;
+        zh = 0;
+    }
+    ~watchCtx() {
+        if (zh) {
+            zookeeper_close(zh);
+            zh = 0;
+        }
+    }
+
+    evt_t getEvent() {
+        evt_t evt;
+        evt = events.front();
+        events.pop_front();
+        return evt;
+    }
+
+    int countEvents() {
+        int count;
+        count = events.size();
+        return count;
+    }
+
+    void putEvent(evt_t evt) {
+        events.push_back(evt);
+    }
+
+    bool waitForConnected(zhandle_t *zh) {
+        time_t expires = time(0) + 10;
+        while(!connected && time(0) < expires) {
+            yield(zh, 1);
+        }
+        return connected;
+    }
+    bool waitForDisconnected(zhandle_t *zh) {
+        time_t expires = time(0) + 15;
+        while(connected && time(0) < expires) {
+            yield(zh, 1);
+        }
+        return !connected;
+    }
+} watchctx_t; 
+
+class Zookeeper_electiontest : public CPPUNIT_NS::TestFixture
+{
+    CPPUNIT_TEST_SUITE(Zookeeper_electiontest);
+    CPPUNIT_TEST(testelection);
+    CPPUNIT_TEST(testfailover);
+    CPPUNIT_TEST(testmembership);
+    CPPUNIT_TEST_SUITE_END();
+
+    static void watcher(zhandle_t *, int type, int state, const char *path,void*v){
+        watchctx_t *ctx = (watchctx_t*)v;
+
+        if (state == ZOO_CONNECTED_STATE) {
+            ctx->connected = true;
+        } else {
+            ctx->connected = false;
+        }
+        if (type != ZOO_SESSION_EVENT) {
+            evt_t evt;
+            evt.path = path;
+            evt.type = type;
+            ctx->putEvent(evt);
+        }
+    }
+
+    static const char hostPorts[];
+
+    const char *getHostPorts() {
+        return hostPorts;
+    }
+
+    zhandle_t *createClient(watchctx_t *ctx) {
+        zhandle_t *zk = zookeeper_init(hostPorts, watcher, 10000, 0,
+                                       ctx, 0);
+        ctx->zh = zk;
+        sleep(1);
+        return zk;
+    }
+    
+public:
+
+#define ZKSERVER_CMD "./tests/zkServer.sh"
+
+    void setUp()
+    {
+        char cmd[1024];
+        sprintf(cmd, "%s startClean %s", ZKSERVER_CMD, getHostPorts());
+        CPPUNIT_ASSERT(system(cmd) == 0);
+    }
+    
+
+    void startServer() {
+        char cmd[1024];
+        sprintf(cmd, "%s start %s", ZKSERVER_CMD, getHostPorts());
+        CPPUNIT_ASSERT(system(cmd) == 0);
+    }
+
+    void stopServer() {
+        tearDown();
+    }
+
+    void tearDown()
+    {
+        char cmd[1024];
+        sprintf(cmd, "%s stop %s", ZKSERVER_CMD, getHostPorts());
+        CPPUNIT_ASSERT(system(cmd) == 0);
+    }
+    
+
+    struct election_ctx {
+        pthread_mutex_t *lock;
+        int roles[ZKR_ELECTION_FAILED + 1];
+        int last;
+    };
+
+    static void election_callback(int role, int rc, void *cbdata) {
+        election_ctx *ctx = (election_ctx *) cbdata;
+        pthread_mutex_lock(ctx->lock);
+        ctx->roles[role]++;
+        ctx->last = role;
+        pthread_mutex_unlock(ctx->lock);
+    }
+
+    int count_role(pthread_mutex_t *lock, election_ctx *ctxs, int n, int role) {
+        int i, count = 0;
+        pthread_mutex_lock(lock);
+        for (i = 0; i < n; i++)
+            count += ctxs[i].roles[role];
+        pthread_mutex_unlock(lock);
+        return count;
+    }
+
+    bool wait_role(pthread_mutex_t *lock, election_ctx *ctxs, int n, int role,
+                   int expected) {
+        time_t expires = time(0) + 10;
+        while (count_role(lock, ctxs, n, role) < expected && time(0) < expires)
+            usleep(1000);
+        return count_role(lock, ctxs, n, role) == expected;
+    }
+
+    void init_elections(pthread_mutex_t *lock, zkr_election_t *elections,
+                        election_ctx *ctxs, int count, zhandle_t **zhs,
+                        char *path) {
+        static char *names[] = {(char *) "a", (char *) "b", (char *) "c"};
+        int i;
+        for (i = 0; i < count; i++) {
+            ctxs[i].lock = lock;
+            memset(ctxs[i].roles, 0, sizeof(ctxs[i].roles));
+            ctxs[i].last = -1;
+            zkr_election_init(&elections[i], zhs[i], path,
+                              &ZOO_OPEN_ACL_UNSAFE, names[i % 3],
+                              election_callback, &ctxs[i]);
+        }
+    }
+
+    void testelection()
+    {
+        watchctx_t ctx;
+        const int count = 3;
+        zkr_election_t elections[count];
+        election_ctx ctxs[count];
+        pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+        char* path = (char *) "/test-election";
+        zhandle_t *zh = createClient(&ctx);
+        zhandle_t *zhs[count] = {zh, zh, zh};
+        char leader[256];
+        int i;
+        init_elections(&lock, elections, ctxs, count, zhs, path);
+        for (i = 0; i < count; i++) {
+            CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_election_start(&elections[i]));
+            // joins in order, so the first leads
+            CPPUNIT_ASSERT(wait_role(&lock, ctxs, count,
+                                     i == 0 ? ZKR_ELECTION_LEADER
+                                            : ZKR_ELECTION_FOLLOWER,
+                                     i == 0 ? 1 : i));
+        }
+        CPPUNIT_ASSERT_EQUAL(1, ctxs[0].roles[ZKR_ELECTION_LEADER]);
+        CPPUNIT_ASSERT(zkr_election_isleader(&elections[0]));
+        CPPUNIT_ASSERT(!zkr_election_isleader(&elections[1]));
+        CPPUNIT_ASSERT_EQUAL((int) ZOK,
+            zkr_election_getleader(&elections[2], leader, sizeof(leader)));
+        CPPUNIT_ASSERT_EQUAL(0, strcmp(leader, elections[0].id));
+        CPPUNIT_ASSERT_EQUAL(0, strncmp(leader, "a-", 2));
+        // the leader's successor takes over; the last follower isn't woken
+        long requests = elections[2].requests;
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_election_stop(&elections[0]));
+        CPPUNIT_ASSERT(wait_role(&lock, ctxs, count, ZKR_ELECTION_LEADER, 2));
+        CPPUNIT_ASSERT(wait_role(&lock, ctxs, count, ZKR_ELECTION_STOPPED, 1));
+        CPPUNIT_ASSERT_EQUAL(1, ctxs[1].roles[ZKR_ELECTION_LEADER]);
+        CPPUNIT_ASSERT(zkr_election_isleader(&elections[1]));
+        CPPUNIT_ASSERT(!zkr_election_isleader(&elections[0]));
+        sleep(1);
+        CPPUNIT_ASSERT_EQUAL(requests, elections[2].requests);
+        CPPUNIT_ASSERT_EQUAL(ZKR_ELECTION_FOLLOWER, ctxs[2].last);
+        // a follower that leaves hands its place to the one behind it
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_election_start(&elections[0]));
+        CPPUNIT_ASSERT(wait_role(&lock, ctxs, count, ZKR_ELECTION_FOLLOWER, 3));
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_election_stop(&elections[2]));
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_election_stop(&elections[1]));
+        CPPUNIT_ASSERT(wait_role(&lock, ctxs, count, ZKR_ELECTION_LEADER, 3));
+        CPPUNIT_ASSERT_EQUAL(2, ctxs[0].roles[ZKR_ELECTION_LEADER]);
+        CPPUNIT_ASSERT(wait_role(&lock, ctxs, count, ZKR_ELECTION_STOPPED, 3));
+        CPPUNIT_ASSERT_EQUAL(0, count_role(&lock, ctxs, count,
+                                           ZKR_ELECTION_FAILED));
+        CPPUNIT_ASSERT_EQUAL((int) ZSYSTEMERROR,
+                             zkr_election_stop(&elections[1]));
+        zookeeper_close(zh);
+        ctx.zh = 0;
+        for (i = 0; i < count; i++)
+            zkr_election_destroy(&elections[i]);
+    }
+
+    void testfailover()
+    {
+        watchctx_t ctx1, ctx2;
+        const int count = 2;
+        zkr_election_t elections[count];
+        election_ctx ctxs[count];
+        pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+        char* path = (char *) "/test-election-failover";
+        zhandle_t *zhs[count] = {createClient(&ctx1), createClient(&ctx2)};
+        int i;
+        init_elections(&lock, elections, ctxs, count, zhs, path);
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_election_start(&elections[0]));
+        CPPUNIT_ASSERT(wait_role(&lock, ctxs, count, ZKR_ELECTION_LEADER, 1));
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_election_start(&elections[1]));
+        CPPUNIT_ASSERT(wait_role(&lock, ctxs, count, ZKR_ELECTION_FOLLOWER, 1));
+        // the leader's session goes, and its node with it
+        zookeeper_close(zhs[0]);
+        ctx1.zh = 0;
+        CPPUNIT_ASSERT(wait_role(&lock, ctxs, count, ZKR_ELECTION_LEADER, 2));
+        CPPUNIT_ASSERT(zkr_election_isleader(&elections[1]));
+        CPPUNIT_ASSERT_EQUAL(0, ctxs[1].roles[ZKR_ELECTION_FAILED]);
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_election_stop(&elections[1]));
+        CPPUNIT_ASSERT(wait_role(&lock, ctxs, count, ZKR_ELECTION_STOPPED, 1));
+        for (i = 0; i < count; i++)
+            zkr_election_destroy(&elections[i]);
+    }
+
+    struct members_ctx {
+        pthread_mutex_t *lock;
+        int joined;
+        int left;
+        string last;
+    };
+
+    static void members_callback(const char *member, int joined, void *cbdata) {
+        members_ctx *ctx = (members_ctx *) cbdata;
+        pthread_mutex_lock(ctx->lock);
+        if (joined)
+            ctx->joined++;
+        else
+            ctx->left++;
+        ctx->last = member;
+        pthread_mutex_unlock(ctx->lock);
+    }
+
+    bool wait_members(members_ctx *ctx, int joined, int left) {
+        time_t expires = time(0) + 10;
+        bool done = false;
+        while (!done && time(0) < expires) {
+            pthread_mutex_lock(ctx->lock);
+            done = ctx->joined >= joined && ctx->left >= left;
+            pthread_mutex_unlock(ctx->lock);
+            if (!done)
+                usleep(1000);
+        }
+        return ctx->joined == joined && ctx->left == left;
+    }
+
+    void testmembership()
+    {
+        watchctx_t ctx;
+        const int count = 3;
+        zkr_election_t elections[count];
+        election_ctx ctxs[count];
+        members_ctx members;
+        pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+        char* path = (char *) "/test-election-members";
+        zhandle_t *zh = createClient(&ctx);
+        zhandle_t *zhs[count] = {zh, zh, zh};
+        struct String_vector strings;
+        char leader[256];
+        int i;
+        init_elections(&lock, elections, ctxs, count, zhs, path);
+        members.lock = &lock;
+        members.joined = members.left = 0;
+        // the last participant follows the group, before anyone has joined
+        CPPUNIT_ASSERT_EQUAL((int) ZOK,
+            zkr_election_watch_members(&elections[2], members_callback,
+                                       &members));
+        for (i = 0; i < count; i++)
+            CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_election_start(&elections[i]));
+        CPPUNIT_ASSERT(wait_role(&lock, ctxs, count, ZKR_ELECTION_FOLLOWER, 2));
+        CPPUNIT_ASSERT(wait_members(&members, 3, 0));
+        zkr_election_get_members(&elections[2], &strings);
+        CPPUNIT_ASSERT_EQUAL(3, strings.count);
+        for (i = 0; i < count; i++)
+            CPPUNIT_ASSERT_EQUAL(0, strcmp(strings.data[i], elections[i].id));
+        deallocate_String_vector(&strings);
+        // a follower in the middle leaves: only the change is reported
+        string middle = elections[1].id;
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_election_stop(&elections[1]));
+        CPPUNIT_ASSERT(wait_members(&members, 3, 1));
+        CPPUNIT_ASSERT(members.last == middle);
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_election_stop(&elections[0]));
+        CPPUNIT_ASSERT(wait_members(&members, 3, 2));
+        CPPUNIT_ASSERT(wait_role(&lock, ctxs, count, ZKR_ELECTION_LEADER, 2));
+        CPPUNIT_ASSERT(zkr_election_isleader(&elections[2]));
+        CPPUNIT_ASSERT_EQUAL((int) ZOK,
+            zkr_election_getleader(&elections[2], leader, sizeof(leader)));
+        CPPUNIT_ASSERT_EQUAL(0, strcmp(leader, elections[2].id));
+        zkr_election_get_members(&elections[2], &strings);
+        CPPUNIT_ASSERT_EQUAL(1, strings.count);
+        deallocate_String_vector(&strings);
+        // stopping ends the reports
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_election_stop(&elections[2]));
+        CPPUNIT_ASSERT(wait_role(&lock, ctxs, count, ZKR_ELECTION_STOPPED, 3));
+        sleep(1);
+        CPPUNIT_ASSERT(wait_members(&members, 3, 2));
+        zookeeper_close(zh);
+        ctx.zh = 0;
+        for (i = 0; i < count; i++)
+            zkr_election_destroy(&elections[i]);
+    }
+
+};
+
+const char Zookeeper_electiontest::hostPorts[] = "127.0.0.1:22181";
+CPPUNIT_TEST_SUITE_REGISTRATION(Zookeeper_electiontest);
@@ -0,0 +1,173 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures lock acquisitions per second. The synchronous lock is timed
+ * uncontended, one zkr_lock_lock() and zkr_lock_unlock() after another; the
+ * asynchronous lock is timed with contenders mutexes on one handle, each
+ * taking the lock, releasing it and queueing up again. With more contenders
+ * than acquisitions, as in the last default run of 10000 waiters, every
+ * contender takes the lock once.
+ *
+ *   zklockbench host:port [acquisitions [contenders...]]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <zookeeper.h>
+#include <zoo_lock.h>
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static int connected;
+static int acquisitions;
+static int failed;
+static int stopped;
+static int wanted;
+
+static void watcher(zhandle_t *zh, int type, int state, const char *path,
+        void *ctx)
+{
+    if (type == ZOO_SESSION_EVENT) {
+        pthread_mutex_lock(&lock);
+        connected = state == ZOO_CONNECTED_STATE;
+        pthread_cond_broadcast(&cond);
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* takes the lock, releases it and queues up again until enough are taken;
+ * the contenders still waiting then take it once more before they stop */
+static void contender_completion(int rc, void *cbdata)
+{
+    zkr_lock_mutex_t *mutex = (zkr_lock_mutex_t *) cbdata;
+    int more;
+
+    pthread_mutex_lock(&lock);
+    if (rc == 0)
+        acquisitions++;
+    else if (rc != 1)
+        failed++;
+    more = acquisitions < wanted && failed == 0;
+    if (rc != 0 && !more) {
+        stopped++;
+        pthread_cond_broadcast(&cond);
+    }
+    pthread_mutex_unlock(&lock);
+    if (rc == 0)
+        zkr_lock_aunlock(mutex);
+    else if (rc == 1 && more)
+        zkr_lock_alock(mutex);
+}
+
+static double run_async(zhandle_t *zh, const char *path, int contenders,
+        int count)
+{
+    zkr_lock_mutex_t *mutexes = calloc(contenders, sizeof(*mutexes));
+    double start;
+    int i;
+
+    acquisitions = failed = stopped = 0;
+    wanted = count;
+    for (i = 0; i < contenders; i++)
+        zkr_lock_init_cb(&mutexes[i], zh, (char *) path,
+                &ZOO_OPEN_ACL_UNSAFE, contender_completion, &mutexes[i]);
+    start = now();
+    for (i = 0; i < contenders; i++)
+        zkr_lock_alock(&mutexes[i]);
+    pthread_mutex_lock(&lock);
+    while (stopped < contenders)
+        pthread_cond_wait(&cond, &lock);
+    pthread_mutex_unlock(&lock);
+    start = now() - start;
+    if (failed)
+        fprintf(stderr, "%d acquisitions failed\n", failed);
+    /* the mutexes are left to the handle, which may still hold their watches */
+    return start;
+}
+
+static double run_sync(zhandle_t *zh, const char *path, int count)
+{
+    zkr_lock_mutex_t mutex;
+    double start;
+    int i;
+
+    zkr_lock_init(&mutex, zh, (char *) path, &ZOO_OPEN_ACL_UNSAFE);
+    start = now();
+    for (i = 0; i < count; i++) {
+        if (!zkr_lock_lock(&mutex)) {
+            fprintf(stderr, "lock not acquired\n");
+            break;
+        }
+        zkr_lock_unlock(&mutex);
+    }
+    start = now() - start;
+    zkr_lock_destroy(&mutex);
+    return start;
+}
+
+int main(int argc, char **argv)
+{
+    static const int default_contenders[] = {1, 10, 100, 10000};
+    char path[64];
+    zhandle_t *zh;
+    double seconds;
+    int count, n, i;
+
+    if (argc < 2) {
+        fprintf(stderr, "USAGE: %s host:port [acquisitions [contenders...]]\n",
+                argv[0]);
+        return 2;
+    }
+    count = argc > 2 ? atoi(argv[2]) : 2000;
+    zoo_set_debug_level(ZOO_LOG_LEVEL_WARN);
+    zh = zookeeper_init(argv[1], watcher, 10000, 0, 0, 0);
+    pthread_mutex_lock(&lock);
+    while (!connected)
+        pthread_cond_wait(&cond, &lock);
+    pthread_mutex_unlock(&lock);
+
+    printf("%12s %12s %10s %14s\n", "lock", "contenders", "seconds",
+            "acquisitions/s");
+    snprintf(path, sizeof(path), "/zklockbench-%d-sync", getpid());
+    seconds = run_sync(zh, path, count);
+    printf("%12s %12d %10.3f %14.0f\n", "sync", 1, seconds, count / seconds);
+    n = argc > 3 ? argc - 3 : 4;
+    for (i = 0; i < n; i++) {
+        int contenders = argc > 3 ? atoi(argv[i + 3]) : default_contenders[i];
+        snprintf(path, sizeof(path), "/zklockbench-%d-%d", getpid(),
+                contenders);
+        seconds = run_async(zh, path, contenders, count);
+        printf("%12s %12d %10.3f %14.0f\n", "async", contenders, seconds,
+                acquisitions / seconds);
+        fflush(stdout);
+    }
+    zookeeper_close(zh);
+    return 0;
+}
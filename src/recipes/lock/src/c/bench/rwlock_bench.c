@@ -0,0 +1,177 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compares the read-write lock with the exclusive lock under contention:
+ * contenders locks on one handle each take their lock, release it and
+ * queue up again, as exclusive mutexes and then as readers and writers in
+ * various proportions.
+ *
+ *   zkrwlockbench host:port [acquisitions [contenders]]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <zookeeper.h>
+#include <zoo_lock.h>
+#include <zoo_rwlock.h>
+
+struct contender {
+    int exclusive;
+    zkr_lock_mutex_t mutex;
+    zkr_rwlock_t rwlock;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static int connected;
+static int acquisitions;
+static int failed;
+static int stopped;
+static int wanted;
+
+static void watcher(zhandle_t *zh, int type, int state, const char *path,
+        void *ctx)
+{
+    if (type == ZOO_SESSION_EVENT) {
+        pthread_mutex_lock(&lock);
+        connected = state == ZOO_CONNECTED_STATE;
+        pthread_cond_broadcast(&cond);
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* takes the lock, releases it and queues up again until enough are taken;
+ * the contenders still waiting then take it once more before they stop */
+static void contender_completion(int rc, void *cbdata)
+{
+    struct contender *c = (struct contender *) cbdata;
+    int more;
+
+    pthread_mutex_lock(&lock);
+    if (rc == 0)
+        acquisitions++;
+    else if (rc != 1)
+        failed++;
+    more = acquisitions < wanted && failed == 0;
+    if (rc != 0 && !more) {
+        stopped++;
+        pthread_cond_broadcast(&cond);
+    }
+    pthread_mutex_unlock(&lock);
+    if (rc == 0) {
+        if (c->exclusive)
+            zkr_lock_aunlock(&c->mutex);
+        else
+            zkr_rwlock_aunlock(&c->rwlock);
+    } else if (rc == 1 && more) {
+        if (c->exclusive)
+            zkr_lock_alock(&c->mutex);
+        else
+            zkr_rwlock_alock(&c->rwlock);
+    }
+}
+
+/* writers is the percentage of contenders that write, -1 for exclusive locks */
+static double run(zhandle_t *zh, const char *path, int contenders,
+        int writers, int count)
+{
+    struct contender *cs = calloc(contenders, sizeof(*cs));
+    double start;
+    int i;
+
+    acquisitions = failed = stopped = 0;
+    wanted = count;
+    for (i = 0; i < contenders; i++) {
+        cs[i].exclusive = writers < 0;
+        if (cs[i].exclusive)
+            zkr_lock_init_cb(&cs[i].mutex, zh, (char *) path,
+                    &ZOO_OPEN_ACL_UNSAFE, contender_completion, &cs[i]);
+        else
+            zkr_rwlock_init(&cs[i].rwlock, zh, (char *) path,
+                    &ZOO_OPEN_ACL_UNSAFE,
+                    i % 100 < writers ? ZKR_RWLOCK_WRITE : ZKR_RWLOCK_READ,
+                    contender_completion, &cs[i]);
+    }
+    start = now();
+    for (i = 0; i < contenders; i++) {
+        if (cs[i].exclusive)
+            zkr_lock_alock(&cs[i].mutex);
+        else
+            zkr_rwlock_alock(&cs[i].rwlock);
+    }
+    pthread_mutex_lock(&lock);
+    while (stopped < contenders)
+        pthread_cond_wait(&cond, &lock);
+    pthread_mutex_unlock(&lock);
+    start = now() - start;
+    if (failed)
+        fprintf(stderr, "%d acquisitions failed\n", failed);
+    /* the locks are left to the handle, which may still hold their watches */
+    return start;
+}
+
+int main(int argc, char **argv)
+{
+    static const int writers[] = {-1, 0, 1, 10, 50};
+    char path[64];
+    zhandle_t *zh;
+    int count, contenders, i;
+
+    if (argc < 2) {
+        fprintf(stderr, "USAGE: %s host:port [acquisitions [contenders]]\n",
+                argv[0]);
+        return 2;
+    }
+    count = argc > 2 ? atoi(argv[2]) : 5000;
+    contenders = argc > 3 ? atoi(argv[3]) : 100;
+    zoo_set_debug_level(ZOO_LOG_LEVEL_WARN);
+    zh = zookeeper_init(argv[1], watcher, 10000, 0, 0, 0);
+    pthread_mutex_lock(&lock);
+    while (!connected)
+        pthread_cond_wait(&cond, &lock);
+    pthread_mutex_unlock(&lock);
+
+    printf("%12s %10s %10s %14s\n", "lock", "writers", "seconds",
+            "acquisitions/s");
+    for (i = 0; i < sizeof(writers) / sizeof(writers[0]); i++) {
+        double seconds;
+        snprintf(path, sizeof(path), "/zkrwlockbench-%d-%d", getpid(), i);
+        seconds = run(zh, path, contenders, writers[i], count);
+        if (writers[i] < 0)
+            printf("%12s %10s %10.3f %14.0f\n", "exclusive", "all", seconds,
+                    acquisitions / seconds);
+        else
+            printf("%12s %9d%% %10.3f %14.0f\n", "read-write", writers[i],
+                    seconds, acquisitions / seconds);
+        fflush(stdout);
+    }
+    zookeeper_close(zh);
+    return 0;
+}
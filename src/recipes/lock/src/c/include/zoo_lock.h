@@ -28,7 +28,8 @@ extern "C" {
  * \brief the call back function called on status change of lock
  * 
  * the call back funtion is called with a rc of 0 if lock is acquired and 
- * with an rc of 1 if the lock is released
+ * with an rc of 1 if the lock is released. An acquisition started by
+ * zkr_lock_alock() that fails calls it with the zookeeper error code.
  * \param rc the value to let us know if its locked or unlocked
  * \param cbdata the callback data that we passed when initializing 
  * the zookeeper lock.
@@ -43,6 +44,8 @@ typedef void (* zkr_lock_completion) (int rc, void* cbdata);
  * this api can also be used for leader election.
  */
 
+struct zkr_lock_index;
+
 struct zkr_lock_mutex {
     zhandle_t *zh;
     char *path;
@@ -53,6 +56,10 @@ struct zkr_lock_mutex {
     pthread_mutex_t pmutex;
     int isOwner;
     char* ownerid;
+    /* asynchronous acquisition, see zkr_lock_alock() */
+    int state;
+    int retries;
+    struct zkr_lock_index *index;  /* shared by the mutexes of the handle */
 };
 
 typedef struct zkr_lock_mutex zkr_lock_mutex_t;
@@ -101,6 +108,38 @@ ZOOAPI int zkr_lock_init_cb(zkr_lock_mutex_t *mutex, zhandle_t* zh,
  */
 ZOOAPI int zkr_lock_lock(zkr_lock_mutex_t *mutex);
 
+/**
+ * \brief lock the zookeeper mutex asynchronously
+ *
+ * this method starts acquiring the mutex and returns without waiting. The
+ * acquisition goes on in the completions of asynchronous requests and in a
+ * watch on the predecessor's node, so no thread is blocked while it waits
+ * and one handle can carry any number of waiting mutexes; those waiting on
+ * the same path share their listings of its children. The completion
+ * of the mutex is called with 0 once it is acquired, or with a zookeeper
+ * error code if the acquisition fails. It is called from the completion
+ * thread and may call zkr_lock_aunlock() and zkr_lock_alock(), but must not
+ * use the synchronous calls of the mutex. Once this has been called, the
+ * mutex must stay valid until the handle is closed.
+ * \param mutex the zookeeper mutex
+ * \return return 0 if the acquisition was started or is already under way,
+ * otherwise a zookeeper error code; the completion is not called then.
+ */
+ZOOAPI int zkr_lock_alock(zkr_lock_mutex_t *mutex);
+
+/**
+ * \brief unlock the zookeeper mutex asynchronously
+ *
+ * this method unlocks the mutex, or abandons an acquisition started by
+ * zkr_lock_alock(), without waiting for the server. The completion of the
+ * mutex is called with 1 once a held lock is released. The mutex may be
+ * locked again straight away.
+ * \param mutex the zookeeper mutex
+ * \return return 0 if the unlock was started, ZSYSTEMERROR if the mutex
+ * was neither held nor being acquired, otherwise a zookeeper error code.
+ */
+ZOOAPI int zkr_lock_aunlock(zkr_lock_mutex_t *mutex);
+
 /**
  * \brief unlock the zookeeper mutex
  *
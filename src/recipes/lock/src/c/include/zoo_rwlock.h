@@ -0,0 +1,146 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ZOOKEEPER_RWLOCK_H_
+#define ZOOKEEPER_RWLOCK_H_
+
+#include <zookeeper.h>
+#include <zoo_lock.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \file zoo_rwlock.h
+ * \brief zookeeper recipe for shared locks.
+ * this api implements a read-write lock on a given path in zookeeper.
+ * readers create read- nodes and writers write- nodes under the path;
+ * a reader holds the lock once no write- node comes before its own, and a
+ * writer once no node at all comes before its own. A reader watches only
+ * the nearest writer before it, so readers don't wait on one another.
+ */
+
+#define ZKR_RWLOCK_READ 0
+#define ZKR_RWLOCK_WRITE 1
+
+struct zkr_rwlock {
+    zhandle_t *zh;
+    char *path;
+    struct ACL_vector *acl;
+    int type;
+    char *id;
+    void *cbdata;
+    zkr_lock_completion completion;
+    pthread_mutex_t pmutex;
+    pthread_cond_t cond;
+    int isOwner;
+    int state;
+    int retries;
+    int create_rc;
+    int result;
+};
+
+typedef struct zkr_rwlock zkr_rwlock_t;
+
+/**
+ * \brief initializing a zookeeper read-write lock.
+ *
+ * this method instantiates one side of a read-write lock: a reader if type
+ * is ZKR_RWLOCK_READ, a writer if it is ZKR_RWLOCK_WRITE.
+ * \param rwlock the lock to initialize
+ * \param zh the zookeeper handle to use
+ * \param path the path in zookeeper to use for locking
+ * \param acl the acls to use in zookeeper.
+ * \param type ZKR_RWLOCK_READ or ZKR_RWLOCK_WRITE
+ * \param completion the callback thats called when the lock
+ * is acquired and released, may be NULL.
+ * \param cbdata the callback method is called with data
+ * \return return 0 if successful.
+ */
+ZOOAPI int zkr_rwlock_init(zkr_rwlock_t *rwlock, zhandle_t* zh, char* path,
+                           struct ACL_vector *acl, int type,
+                           zkr_lock_completion completion, void* cbdata);
+
+/**
+ * \brief lock the zookeeper read-write lock asynchronously
+ *
+ * this method starts acquiring the lock and returns without waiting, as
+ * zkr_lock_alock() does. The create of our node and the list of the
+ * others are sent together, so an uncontended acquisition costs one round
+ * trip. The completion is called with 0 once the lock is held, or with a
+ * zookeeper error code if the acquisition fails. Once this has been
+ * called, the lock must stay valid until the handle is closed.
+ * \param rwlock the read-write lock
+ * \return return 0 if the acquisition was started or is already under way,
+ * otherwise a zookeeper error code; the completion is not called then.
+ */
+ZOOAPI int zkr_rwlock_alock(zkr_rwlock_t *rwlock);
+
+/**
+ * \brief lock the zookeeper read-write lock
+ *
+ * this method acquires the lock and waits until it is held. It must not be
+ * called from a completion or a watcher.
+ * \param rwlock the read-write lock
+ * \return return 0 once the lock is held, otherwise a zookeeper error code.
+ */
+ZOOAPI int zkr_rwlock_lock(zkr_rwlock_t *rwlock);
+
+/**
+ * \brief unlock the zookeeper read-write lock asynchronously
+ *
+ * this method releases the lock, or abandons an acquisition, without
+ * waiting for the server. The completion is called with 1 once a held lock
+ * is released. The lock may be locked again straight away.
+ * \param rwlock the read-write lock
+ * \return return 0 if the unlock was started, ZSYSTEMERROR if the lock
+ * was neither held nor being acquired, otherwise a zookeeper error code.
+ */
+ZOOAPI int zkr_rwlock_aunlock(zkr_rwlock_t *rwlock);
+
+/**
+ * \brief unlock the zookeeper read-write lock
+ *
+ * this method releases the lock and waits for the server to apply it. It
+ * must not be called from a completion or a watcher.
+ * \param rwlock the read-write lock
+ * \return return 0 if successful, ZSYSTEMERROR if the lock was neither held
+ * nor being acquired, otherwise a zookeeper error code.
+ */
+ZOOAPI int zkr_rwlock_unlock(zkr_rwlock_t *rwlock);
+
+/**
+ * \brief return if this read-write lock is held
+ * \param rwlock the read-write lock
+ * \return return true if the lock is held and false if not
+ */
+ZOOAPI int zkr_rwlock_isowner(zkr_rwlock_t *rwlock);
+
+/**
+ * \brief destroy the read-write lock
+ * this method frees the lock, it does not unlock it.
+ * \param rwlock the read-write lock
+ * \return return 0 if destroyed.
+ */
+ZOOAPI int zkr_rwlock_destroy(zkr_rwlock_t *rwlock);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  //ZOOKEEPER_RWLOCK_H_
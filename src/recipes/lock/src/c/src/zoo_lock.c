@@ -55,6 +55,9 @@ ZOOAPI int zkr_lock_init(zkr_lock_mutex_t* mutex, zhandle_t* zh,
     mutex->id = NULL;
     mutex->ownerid = NULL;
     mutex->isOwner = 0;
+    mutex->state = 0;
+    mutex->retries = 0;
+    mutex->index = NULL;
     pthread_mutex_init(&(mutex->pmutex), NULL);
     return 0;
 }
@@ -70,6 +73,9 @@ ZOOAPI int zkr_lock_init_cb(zkr_lock_mutex_t *mutex, zhandle_t* zh,
     mutex->isOwner = 0;
     mutex->ownerid = NULL;
     mutex->id = NULL;
+    mutex->state = 0;
+    mutex->retries = 0;
+    mutex->index = NULL;
     pthread_mutex_init(&(mutex->pmutex), NULL);
     return 0;
 }
@@ -106,6 +112,7 @@ ZOOAPI int zkr_lock_unlock(zkr_lock_mutex_t *mutex) {
 
             free(mutex->id);
             mutex->id = NULL;
+            mutex->state = 0;
             pthread_mutex_unlock(&(mutex->pmutex));
             return 0;
         }
@@ -128,25 +135,51 @@ static void free_String_vector(struct String_vector *v) {
     }
 }
 
-static int vstrcmp(const void* str1, const void* str2) {
-    const char **a = (const char**)str1;
-    const char **b = (const char**) str2;
-    return strcmp(strrchr(*a, '-')+1, strrchr(*b, '-')+1); 
-} 
-
-static void sort_children(struct String_vector *vector) {
-    qsort( vector->data, vector->count, sizeof(char*), &vstrcmp);
+/**
+ * the sequence number the server appended to a child's name, or -1 if the
+ * name has none
+ */
+static long long child_seq(const char *name) {
+    const char *p = strrchr(name, '-');
+    long long seq = 0;
+    if (p == NULL || p[1] == '\0')
+        return -1;
+    for (p++; *p; p++) {
+        if (*p < '0' || *p > '9')
+            return -1;
+        seq = seq * 10 + (*p - '0');
+    }
+    return seq;
 }
-        
-static char* child_floor(char **sorted_data, int len, char *element) {
-    char* ret = NULL;
-    int i =0;
-    for (i=0; i < len; i++) {
-        if (strcmp(sorted_data[i], element) < 0) {
-            ret = sorted_data[i];
+
+/**
+ * finds our place among the children in one pass, parsing each sequence
+ * number once: the oldest node, which holds the lock, and the youngest of
+ * those older than ours, which we watch. Returns 1 if our node is there.
+ */
+static int child_place(const struct String_vector *vector, const char *id,
+                       char **owner, char **predecessor) {
+    long long mine = child_seq(id);
+    long long oldest = -1, ahead = -1;
+    int i, found = 0;
+    *owner = NULL;
+    *predecessor = NULL;
+    for (i = 0; i < vector->count; i++) {
+        long long seq = child_seq(vector->data[i]);
+        if (seq < 0)
+            continue;
+        if (oldest < 0 || seq < oldest) {
+            oldest = seq;
+            *owner = vector->data[i];
+        }
+        if (seq == mine) {
+            found = 1;
+        } else if (seq < mine && seq > ahead) {
+            ahead = seq;
+            *predecessor = vector->data[i];
         }
     }
-    return ret;
+    return found;
 }
 
 static void lock_watcher_fn(zhandle_t* zh, int type, int state,
@@ -191,10 +224,11 @@ static int retry_getchildren(zhandle_t *zh, char* path, struct String_vector *ve
 static char* lookupnode(struct String_vector *vector, char *prefix) {
     char *ret = NULL;
     if (vector->data) {
+        size_t len = strlen(prefix);
         int i = 0;
         for (i = 0; i < vector->count; i++) {
             char* child = vector->data[i];
-            if (strncmp(prefix, child, strlen(prefix)) == 0) {
+            if (strncmp(prefix, child, len) == 0) {
                 ret = strdup(child);
                 break;
             }
@@ -280,12 +314,12 @@ static int zkr_lock_operation(zkr_lock_mutex_t *mutex, struct timespec *ts) {
                 LOG_WARN(("could not connect to server"));
                 return ret;
             }
-            //sort this list
-            sort_children(vector);
-            owner_id = vector->data[0];
-            mutex->ownerid = strdup(owner_id);
+            char* lessthanme;
             id = mutex->id;
-            char* lessthanme = child_floor(vector->data, vector->count, id);
+            child_place(vector, id, &owner_id, &lessthanme);
+            if (mutex->ownerid)
+                free(mutex->ownerid);
+            mutex->ownerid = owner_id ? strdup(owner_id) : NULL;
             if (lessthanme != NULL) {
                 int flen = strlen(mutex->path) + strlen(lessthanme) + 2;
                 char last_child[flen];
@@ -314,9 +348,10 @@ static int zkr_lock_operation(zkr_lock_mutex_t *mutex, struct timespec *ts) {
             else {
                 // this is the case when we are the owner 
                 // of the lock
-                if (strcmp(mutex->id, owner_id) == 0) {
+                if (owner_id != NULL && strcmp(mutex->id, owner_id) == 0) {
                     LOG_DEBUG(("got the zoo lock owner - %s", mutex->id));
                     mutex->isOwner = 1;
+                    free_String_vector(vector);
                     if (mutex->completion != NULL) {
                         mutex->completion(0, mutex->cbdata);
                     }
@@ -367,6 +402,590 @@ ZOOAPI int zkr_lock_lock(zkr_lock_mutex_t *mutex) {
     return zkr_lock_isowner(mutex);
 }
 
+
+/**
+ * The asynchronous acquisition. It goes through the same steps as
+ * zkr_lock_operation(), each one issued from the completion of the one
+ * before:
+ *
+ *   CREATE    create our ephemeral sequential node
+ *   LOOKUP    get the children, to find the node of a create whose answer
+ *             was lost (creating the parent if there is none)
+ *   CHECK     find our predecessor in the index of the children, waiting
+ *             for the next listing if our node is not in it yet
+ *   WATCHING  wait for the predecessor to go, then CHECK again
+ *   OWNER     the lock is ours
+ *
+ * The steps run with pmutex held; the state goes back to IDLE when the mutex
+ * is unlocked, and the completions of requests still in flight then stop.
+ * A connection loss repeats the step at most ALOCK_RETRIES times in a row.
+ *
+ * The mutexes waiting on one path through one handle share an index of its
+ * children. A listing serves every mutex that asked for one while the
+ * listing before was in flight, and the sequence numbers are parsed once
+ * into an array sorted by them, where each mutex finds its node by binary
+ * search. The watches of the mutexes keep the index up to date: a node seen
+ * to go is marked gone. Since no node can come before ours once it is made,
+ * a listing taken after that holds all the nodes that can come before it,
+ * and a mutex woken by its predecessor finds the next one, or that the lock
+ * is its own, without listing the children again.
+ */
+
+enum alock_state {
+    ALOCK_IDLE = 0, ALOCK_LOOKUP, ALOCK_CREATE_PARENT, ALOCK_CREATE,
+    ALOCK_CHECK, ALOCK_WATCHING, ALOCK_OWNER
+};
+
+#define ALOCK_RETRIES 3
+#define ALOCK_PREFIX_LEN 48
+/* returned by a step that has issued the next request; not a completion
+ * code, those being 0, 1 and the zookeeper errors */
+#define ALOCK_CONTINUE INT_MAX
+
+struct alock_unlock {
+    zkr_lock_mutex_t *mutex;
+    int retries;
+    char path[];
+};
+
+/* the predecessor a mutex is checking, for the exists completion */
+struct alock_watch {
+    zkr_lock_mutex_t *mutex;
+    long long seq;
+};
+
+struct lock_child {
+    long long seq;
+    const char *name;
+    int gone;
+};
+
+struct mutex_list {
+    zkr_lock_mutex_t **data;
+    int count;
+    int size;
+};
+
+struct zkr_lock_index {
+    zhandle_t *zh;
+    char *path;
+    int refs;
+    struct lock_child *children;    /* by sequence number, oldest first */
+    int count;
+    int oldest;                     /* the oldest child not known to be gone */
+    char *names;                    /* where the names of the children are */
+    int listing;                    /* a listing is in flight */
+    struct mutex_list waiting;      /* the mutexes it serves */
+    struct mutex_list next;         /* those that came while it was in flight */
+    struct zkr_lock_index *link;
+};
+
+/* guards the indexes; taken with pmutex held, never the other way round */
+static pthread_mutex_t index_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct zkr_lock_index *indexes = NULL;
+
+static int alock_get_children(zkr_lock_mutex_t *mutex, int state);
+static int alock_create(zkr_lock_mutex_t *mutex);
+static void index_completion(int rc, const struct String_vector *strings,
+                             const void *data);
+
+static struct zkr_lock_index *index_get(zhandle_t *zh, const char *path) {
+    struct zkr_lock_index *index;
+    pthread_mutex_lock(&index_lock);
+    for (index = indexes; index != NULL; index = index->link) {
+        if (index->zh == zh && strcmp(index->path, path) == 0) {
+            break;
+        }
+    }
+    if (index == NULL) {
+        index = calloc(1, sizeof(*index));
+        index->zh = zh;
+        index->path = strdup(path);
+        index->link = indexes;
+        indexes = index;
+    }
+    index->refs++;
+    pthread_mutex_unlock(&index_lock);
+    return index;
+}
+
+/* drops a reference, with index_lock held */
+static void index_put(struct zkr_lock_index *index) {
+    struct zkr_lock_index **p;
+    if (--index->refs > 0) {
+        return;
+    }
+    for (p = &indexes; *p != index; p = &(*p)->link)
+        ;
+    *p = index->link;
+    free(index->path);
+    free(index->children);
+    free(index->names);
+    free(index->waiting.data);
+    free(index->next.data);
+    free(index);
+}
+
+static void mutex_list_add(struct mutex_list *list, zkr_lock_mutex_t *mutex) {
+    if (list->count == list->size) {
+        list->size = list->size ? list->size * 2 : 16;
+        list->data = realloc(list->data, list->size * sizeof(*list->data));
+    }
+    list->data[list->count++] = mutex;
+}
+
+static int childcmp(const void *c1, const void *c2) {
+    long long a = ((const struct lock_child *) c1)->seq;
+    long long b = ((const struct lock_child *) c2)->seq;
+    return a < b ? -1 : a > b;
+}
+
+/* replaces the children with a listing, parsing each name once */
+static void index_rebuild(struct zkr_lock_index *index,
+                          const struct String_vector *strings) {
+    size_t size = 0;
+    char *names;
+    int i, n = 0;
+    for (i = 0; i < strings->count; i++) {
+        size += strlen(strings->data[i]) + 1;
+    }
+    free(index->children);
+    free(index->names);
+    index->children = malloc(sizeof(*index->children) * strings->count + 1);
+    index->names = names = malloc(size + 1);
+    for (i = 0; i < strings->count; i++) {
+        long long seq = child_seq(strings->data[i]);
+        size_t len = strlen(strings->data[i]) + 1;
+        if (seq < 0) {
+            continue;
+        }
+        memcpy(names, strings->data[i], len);
+        index->children[n].seq = seq;
+        index->children[n].name = names;
+        index->children[n].gone = 0;
+        names += len;
+        n++;
+    }
+    qsort(index->children, n, sizeof(*index->children), &childcmp);
+    index->count = n;
+    index->oldest = 0;
+}
+
+/* the position of the first child not older than seq */
+static int index_find(const struct zkr_lock_index *index, long long seq) {
+    int low = 0, high = index->count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (index->children[mid].seq < seq) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static void index_gone(struct zkr_lock_index *index, long long seq) {
+    int i = index_find(index, seq);
+    if (i < index->count && index->children[i].seq == seq) {
+        index->children[i].gone = 1;
+        while (index->oldest < index->count
+               && index->children[index->oldest].gone) {
+            index->oldest++;
+        }
+    }
+}
+
+/* asks for a listing, or for the next one if one is in flight; with
+ * index_lock held */
+static int index_wait(struct zkr_lock_index *index, zkr_lock_mutex_t *mutex) {
+    int rc;
+    if (index->listing) {
+        mutex_list_add(&index->next, mutex);
+        return ZOK;
+    }
+    rc = zoo_aget_children(index->zh, index->path, 0, index_completion, index);
+    if (rc == ZOK) {
+        index->listing = 1;
+        index->refs++;
+        mutex_list_add(&index->waiting, mutex);
+    }
+    return rc;
+}
+
+static void alock_lock_prefix(zkr_lock_mutex_t *mutex, char *prefix, int len) {
+    int64_t session = zoo_client_id(mutex->zh)->client_id;
+#if defined(__x86_64__)
+    snprintf(prefix, len, "x-%016lx-%lx-", session, (unsigned long) mutex);
+#else
+    snprintf(prefix, len, "x-%016llx-%lx-", session, (unsigned long) mutex);
+#endif
+}
+
+/* deletes a node we no longer want; the client wants a completion even
+ * though there is nothing to do */
+static void alock_abandon_completion(int rc, const void *data) {
+    if (rc != ZOK && rc != ZNONODE) {
+        LOG_WARN(("could not delete an abandoned node: %s", zerror(rc)));
+    }
+}
+
+/* gives up, and our node with it: left behind, it would be in the way of
+ * every later acquisition */
+static int alock_fail(zkr_lock_mutex_t *mutex, int rc) {
+    LOG_WARN(("could not acquire the lock on %s: %s", mutex->path, zerror(rc)));
+    if (mutex->id != NULL) {
+        int len = strlen(mutex->path) + strlen(mutex->id) + 2;
+        char buf[len];
+        snprintf(buf, len, "%s/%s", mutex->path, mutex->id);
+        zoo_adelete(mutex->zh, buf, -1, alock_abandon_completion, NULL);
+        free(mutex->id);
+        mutex->id = NULL;
+    }
+    mutex->state = ALOCK_IDLE;
+    return rc;
+}
+
+/* repeats the step after a connection loss, if it may */
+static int alock_retry(zkr_lock_mutex_t *mutex, int rc) {
+    if ((rc == ZCONNECTIONLOSS || rc == ZOPERATIONTIMEOUT)
+            && mutex->retries < ALOCK_RETRIES) {
+        LOG_DEBUG(("connection loss while acquiring the lock, retrying"));
+        mutex->retries++;
+        return 1;
+    }
+    return 0;
+}
+
+/* tells the owner of the mutex how the step went, without pmutex */
+static void alock_notify(zkr_lock_mutex_t *mutex, int rc) {
+    zkr_lock_completion completion = mutex->completion;
+    if (rc != ALOCK_CONTINUE && completion != NULL) {
+        completion(rc, mutex->cbdata);
+    }
+}
+
+static void alock_exists_completion(int rc, const struct Stat *stat,
+                                    const void *data);
+
+static void alock_watcher_fn(zhandle_t* zh, int type, int state,
+                             const char* path, void *watcherCtx);
+
+/**
+ * finds our place in the index, the CHECK step. listed says that a listing
+ * taken after our node was made has been seen, so that a node missing from
+ * the index is gone rather than too new.
+ */
+static int alock_check(zkr_lock_mutex_t *mutex, int listed) {
+    struct zkr_lock_index *index = mutex->index;
+    long long mine = child_seq(mutex->id);
+    struct alock_watch *watch = NULL;
+    char *buf = NULL;
+    int i, rc = ZOK, found;
+    mutex->state = ALOCK_CHECK;
+    pthread_mutex_lock(&index_lock);
+    i = index_find(index, mine);
+    found = i < index->count && index->children[i].seq == mine;
+    if (found) {
+        if (mutex->ownerid)
+            free(mutex->ownerid);
+        mutex->ownerid = strdup(index->children[index->oldest].name);
+        while (--i >= index->oldest && index->children[i].gone)
+            ;
+        if (i >= index->oldest) {
+            const char *predecessor = index->children[i].name;
+            int len = strlen(mutex->path) + strlen(predecessor) + 2;
+            buf = malloc(len);
+            snprintf(buf, len, "%s/%s", mutex->path, predecessor);
+            watch = malloc(sizeof(*watch));
+            watch->mutex = mutex;
+            watch->seq = index->children[i].seq;
+        }
+    } else if (!listed) {
+        rc = index_wait(index, mutex);
+    }
+    pthread_mutex_unlock(&index_lock);
+    if (!found) {
+        if (listed) {
+            // our node has gone with our previous session
+            free(mutex->id);
+            mutex->id = NULL;
+            return alock_get_children(mutex, ALOCK_LOOKUP);
+        }
+        return rc == ZOK ? ALOCK_CONTINUE : alock_fail(mutex, rc);
+    }
+    if (watch == NULL) {
+        LOG_DEBUG(("got the zoo lock owner - %s", mutex->id));
+        mutex->isOwner = 1;
+        mutex->state = ALOCK_OWNER;
+        return ZOK;
+    }
+    mutex->isOwner = 0;
+    mutex->state = ALOCK_WATCHING;
+    rc = zoo_awexists(mutex->zh, buf, &alock_watcher_fn, mutex,
+                      alock_exists_completion, watch);
+    free(buf);
+    if (rc != ZOK) {
+        free(watch);
+        return alock_fail(mutex, rc);
+    }
+    return ALOCK_CONTINUE;
+}
+
+static void alock_watcher_fn(zhandle_t* zh, int type, int state,
+                             const char* path, void *watcherCtx) {
+    zkr_lock_mutex_t *mutex = (zkr_lock_mutex_t *) watcherCtx;
+    int rc = ALOCK_CONTINUE;
+    if (type == ZOO_SESSION_EVENT && state != ZOO_EXPIRED_SESSION_STATE) {
+        return;
+    }
+    pthread_mutex_lock(&(mutex->pmutex));
+    if (type == ZOO_DELETED_EVENT && mutex->index != NULL) {
+        pthread_mutex_lock(&index_lock);
+        index_gone(mutex->index, child_seq(path));
+        pthread_mutex_unlock(&index_lock);
+    }
+    if (mutex->state == ALOCK_WATCHING) {
+        mutex->retries = 0;
+        rc = alock_check(mutex, 1);
+    }
+    pthread_mutex_unlock(&(mutex->pmutex));
+    alock_notify(mutex, rc);
+}
+
+static void alock_exists_completion(int rc, const struct Stat *stat,
+                                    const void *data) {
+    struct alock_watch *watch = (struct alock_watch *) data;
+    zkr_lock_mutex_t *mutex = watch->mutex;
+    int ret = ALOCK_CONTINUE;
+    pthread_mutex_lock(&(mutex->pmutex));
+    if (rc == ZNONODE) {
+        // the predecessor went before the watch was set
+        pthread_mutex_lock(&index_lock);
+        index_gone(mutex->index, watch->seq);
+        pthread_mutex_unlock(&index_lock);
+    }
+    if (mutex->state == ALOCK_WATCHING && rc != ZOK) {
+        if (rc == ZNONODE || alock_retry(mutex, rc)) {
+            ret = alock_check(mutex, 1);
+        } else {
+            ret = alock_fail(mutex, rc);
+        }
+    }
+    pthread_mutex_unlock(&(mutex->pmutex));
+    free(watch);
+    alock_notify(mutex, ret);
+}
+
+/* serves the mutexes waiting for a listing */
+static void index_completion(int rc, const struct String_vector *strings,
+                             const void *data) {
+    struct zkr_lock_index *index = (struct zkr_lock_index *) data;
+    struct mutex_list served;
+    int i;
+    pthread_mutex_lock(&index_lock);
+    if (rc == ZOK) {
+        index_rebuild(index, strings);
+    }
+    served = index->waiting;
+    index->waiting = index->next;
+    memset(&index->next, 0, sizeof(index->next));
+    index->listing = 0;
+    if (index->waiting.count > 0) {
+        int ret = zoo_aget_children(index->zh, index->path, 0,
+                                    index_completion, index);
+        if (ret == ZOK) {
+            index->listing = 1;
+            index->refs++;
+        } else {
+            // they will hear about it in their own time
+            for (i = 0; i < index->waiting.count; i++) {
+                mutex_list_add(&served, index->waiting.data[i]);
+            }
+            index->waiting.count = 0;
+            rc = ret;
+        }
+    }
+    index_put(index);
+    pthread_mutex_unlock(&index_lock);
+    for (i = 0; i < served.count; i++) {
+        zkr_lock_mutex_t *mutex = served.data[i];
+        int ret = ALOCK_CONTINUE;
+        pthread_mutex_lock(&(mutex->pmutex));
+        if (mutex->state != ALOCK_CHECK) {
+            // unlocked while the listing was in flight
+        } else if (rc == ZOK) {
+            mutex->retries = 0;
+            ret = alock_check(mutex, 1);
+        } else if (rc == ZNONODE || alock_retry(mutex, rc)) {
+            ret = rc == ZNONODE ? alock_get_children(mutex, ALOCK_LOOKUP)
+                : alock_check(mutex, 0);
+        } else {
+            ret = alock_fail(mutex, rc);
+        }
+        pthread_mutex_unlock(&(mutex->pmutex));
+        alock_notify(mutex, ret);
+    }
+    free(served.data);
+}
+
+static void alock_create_completion(int rc, const char *value,
+                                    const void *data) {
+    zkr_lock_mutex_t *mutex = (zkr_lock_mutex_t *) data;
+    int ret = ALOCK_CONTINUE;
+    pthread_mutex_lock(&(mutex->pmutex));
+    if (mutex->state == ALOCK_CREATE_PARENT) {
+        if (rc == ZOK || rc == ZNODEEXISTS || alock_retry(mutex, rc)) {
+            ret = alock_get_children(mutex, ALOCK_LOOKUP);
+        } else {
+            ret = alock_fail(mutex, rc);
+        }
+    } else if (mutex->state == ALOCK_CREATE) {
+        if (rc == ZOK) {
+            mutex->retries = 0;
+            mutex->id = getName((char *) value);
+            ret = alock_check(mutex, 0);
+        } else if (rc == ZNONODE || alock_retry(mutex, rc)) {
+            // we can't tell if the node was made: look for it
+            ret = alock_get_children(mutex, ALOCK_LOOKUP);
+        } else {
+            ret = alock_fail(mutex, rc);
+        }
+    } else if (rc == ZOK) {
+        // unlocked while the create was in flight
+        zoo_adelete(mutex->zh, value, -1, alock_abandon_completion, NULL);
+    }
+    pthread_mutex_unlock(&(mutex->pmutex));
+    alock_notify(mutex, ret);
+}
+
+static void alock_children_completion(int rc,
+                                      const struct String_vector *strings,
+                                      const void *data) {
+    zkr_lock_mutex_t *mutex = (zkr_lock_mutex_t *) data;
+    int ret = ALOCK_CONTINUE;
+    pthread_mutex_lock(&(mutex->pmutex));
+    if (mutex->state != ALOCK_LOOKUP) {
+        // unlocked while the request was in flight
+    } else if (rc == ZOK) {
+        char prefix[ALOCK_PREFIX_LEN];
+        struct String_vector vector = *strings;
+        mutex->retries = 0;
+        alock_lock_prefix(mutex, prefix, sizeof(prefix));
+        mutex->id = lookupnode(&vector, prefix);
+        if (mutex->id != NULL) {
+            ret = alock_check(mutex, 0);
+        } else {
+            ret = alock_create(mutex);
+        }
+    } else if (rc == ZNONODE) {
+        mutex->state = ALOCK_CREATE_PARENT;
+        rc = zoo_acreate(mutex->zh, mutex->path, NULL, 0, mutex->acl, 0,
+                         alock_create_completion, mutex);
+        ret = rc == ZOK ? ALOCK_CONTINUE : alock_fail(mutex, rc);
+    } else if (alock_retry(mutex, rc)) {
+        ret = alock_get_children(mutex, ALOCK_LOOKUP);
+    } else {
+        ret = alock_fail(mutex, rc);
+    }
+    pthread_mutex_unlock(&(mutex->pmutex));
+    alock_notify(mutex, ret);
+}
+
+static int alock_get_children(zkr_lock_mutex_t *mutex, int state) {
+    int rc;
+    mutex->state = state;
+    rc = zoo_aget_children(mutex->zh, mutex->path, 0,
+                           alock_children_completion, mutex);
+    return rc == ZOK ? ALOCK_CONTINUE : alock_fail(mutex, rc);
+}
+
+static int alock_create(zkr_lock_mutex_t *mutex) {
+    char prefix[ALOCK_PREFIX_LEN];
+    int rc;
+    alock_lock_prefix(mutex, prefix, sizeof(prefix));
+    int len = strlen(mutex->path) + strlen(prefix) + 2;
+    char buf[len];
+    snprintf(buf, len, "%s/%s", mutex->path, prefix);
+    mutex->state = ALOCK_CREATE;
+    rc = zoo_acreate(mutex->zh, buf, NULL, 0, mutex->acl,
+                     ZOO_EPHEMERAL|ZOO_SEQUENCE,
+                     alock_create_completion, mutex);
+    return rc == ZOK ? ALOCK_CONTINUE : alock_fail(mutex, rc);
+}
+
+ZOOAPI int zkr_lock_alock(zkr_lock_mutex_t *mutex) {
+    int rc = ZOK;
+    pthread_mutex_lock(&(mutex->pmutex));
+    if (mutex->state == ALOCK_IDLE) {
+        mutex->retries = 0;
+        mutex->isOwner = 0;
+        if (mutex->index == NULL) {
+            mutex->index = index_get(mutex->zh, mutex->path);
+        }
+        // a node left by zkr_lock_lock() is looked up rather than made
+        // again; the check may find that it holds the lock already
+        rc = mutex->id == NULL ? alock_create(mutex) : alock_check(mutex, 0);
+        if (rc == ZOK) {
+            pthread_mutex_unlock(&(mutex->pmutex));
+            alock_notify(mutex, rc);
+            return ZOK;
+        }
+        if (rc == ALOCK_CONTINUE) {
+            rc = ZOK;
+        }
+    }
+    pthread_mutex_unlock(&(mutex->pmutex));
+    return rc;
+}
+
+static void alock_delete_completion(int rc, const void *data) {
+    struct alock_unlock *unlock = (struct alock_unlock *) data;
+    zkr_lock_mutex_t *mutex = unlock->mutex;
+    if ((rc == ZCONNECTIONLOSS || rc == ZOPERATIONTIMEOUT)
+            && unlock->retries++ < ALOCK_RETRIES) {
+        LOG_DEBUG(("connectionloss while deleting the node"));
+        if (zoo_adelete(mutex->zh, unlock->path, -1,
+                        alock_delete_completion, unlock) == ZOK) {
+            return;
+        }
+    }
+    if (rc != ZOK && rc != ZNONODE) {
+        LOG_WARN(("could not delete %s: %s", unlock->path, zerror(rc)));
+    }
+    free(unlock);
+    alock_notify(mutex, 1);
+}
+
+ZOOAPI int zkr_lock_aunlock(zkr_lock_mutex_t *mutex) {
+    int rc = ZOK;
+    pthread_mutex_lock(&(mutex->pmutex));
+    if (mutex->id != NULL) {
+        int len = strlen(mutex->path) + strlen(mutex->id) + 2;
+        struct alock_unlock *unlock = malloc(sizeof(*unlock) + len);
+        unlock->mutex = mutex;
+        unlock->retries = 0;
+        snprintf(unlock->path, len, "%s/%s", mutex->path, mutex->id);
+        // requests are answered in order, so a lock that follows
+        // this will not find the node
+        rc = zoo_adelete(mutex->zh, unlock->path, -1,
+                         alock_delete_completion, unlock);
+        if (rc == ZOK) {
+            free(mutex->id);
+            mutex->id = NULL;
+            mutex->isOwner = 0;
+            mutex->state = ALOCK_IDLE;
+        } else {
+            free(unlock);
+        }
+    } else if (mutex->state != ALOCK_IDLE) {
+        mutex->state = ALOCK_IDLE;
+    } else {
+        rc = ZSYSTEMERROR;
+    }
+    pthread_mutex_unlock(&(mutex->pmutex));
+    return rc;
+}
                     
 ZOOAPI char* zkr_lock_getpath(zkr_lock_mutex_t *mutex) {
     return mutex->path;
@@ -391,6 +1010,12 @@ ZOOAPI int zkr_lock_destroy(zkr_lock_mutex_t* mutex) {
     mutex->isOwner = 0;
     if (mutex->ownerid) 
         free(mutex->ownerid);
+    if (mutex->index) {
+        pthread_mutex_lock(&index_lock);
+        index_put(mutex->index);
+        pthread_mutex_unlock(&index_lock);
+        mutex->index = NULL;
+    }
     return 0;
 }
 
@@ -0,0 +1,475 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef DLL_EXPORT
+#define USE_STATIC_LIB
+#endif
+
+#if defined(__CYGWIN__)
+#define USE_IPV6
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <zookeeper_log.h>
+#include <time.h>
+#include <limits.h>
+#include <zoo_rwlock.h>
+
+/**
+ * The acquisition runs as the one of zkr_lock_alock() does, from the
+ * completions of asynchronous requests:
+ *
+ *   CREATE         create our node and get the children, both sent at once;
+ *                  the children's completion, which comes second, decides
+ *   CREATE_PARENT  create the lock's path, which was missing
+ *   LOOKUP         get the children, to find a node whose create we lost
+ *                  the answer to
+ *   CHECK          get the children and find the node we wait for
+ *   WATCHING       wait for that node to go, then CHECK again
+ *   OWNER          the lock is ours
+ *
+ * The steps run with pmutex held. Unlocking puts the state back to IDLE,
+ * and the completions of requests still in flight then stop.
+ */
+
+enum rwlock_state {
+    RWLOCK_IDLE = 0, RWLOCK_CREATE, RWLOCK_CREATE_PARENT, RWLOCK_LOOKUP,
+    RWLOCK_CHECK, RWLOCK_WATCHING, RWLOCK_OWNER
+};
+
+#define RWLOCK_RETRIES 3
+#define RWLOCK_PREFIX_LEN 48
+/* returned by a step that has issued the next request; not a completion
+ * code, those being 0, 1 and the zookeeper errors */
+#define RWLOCK_CONTINUE INT_MAX
+
+static const char *rwlock_types[] = {"read-", "write-"};
+
+struct rwlock_unlock {
+    zkr_rwlock_t *rwlock;
+    int retries;
+    char path[];
+};
+
+static int rwlock_create(zkr_rwlock_t *rwlock);
+static int rwlock_get_children(zkr_rwlock_t *rwlock, int state);
+
+ZOOAPI int zkr_rwlock_init(zkr_rwlock_t *rwlock, zhandle_t* zh, char* path,
+                           struct ACL_vector *acl, int type,
+                           zkr_lock_completion completion, void* cbdata) {
+    rwlock->zh = zh;
+    rwlock->path = path;
+    rwlock->acl = acl;
+    rwlock->type = type == ZKR_RWLOCK_WRITE ? ZKR_RWLOCK_WRITE : ZKR_RWLOCK_READ;
+    rwlock->id = NULL;
+    rwlock->completion = completion;
+    rwlock->cbdata = cbdata;
+    rwlock->isOwner = 0;
+    rwlock->state = RWLOCK_IDLE;
+    rwlock->retries = 0;
+    rwlock->create_rc = ZOK;
+    rwlock->result = ZOK;
+    pthread_mutex_init(&(rwlock->pmutex), NULL);
+    pthread_cond_init(&(rwlock->cond), NULL);
+    return 0;
+}
+
+/* names our nodes after the type, the session and the lock, so that we
+ * can find ours again after a connection loss */
+static void rwlock_prefix(zkr_rwlock_t *rwlock, char *prefix, int len) {
+    int64_t session = zoo_client_id(rwlock->zh)->client_id;
+#if defined(__x86_64__)
+    snprintf(prefix, len, "%s%016lx-%lx-", rwlock_types[rwlock->type],
+             session, (unsigned long) rwlock);
+#else
+    snprintf(prefix, len, "%s%016llx-%lx-", rwlock_types[rwlock->type],
+             session, (unsigned long) rwlock);
+#endif
+}
+
+static int seqcmp(const void* str1, const void* str2) {
+    const char **a = (const char**)str1;
+    const char **b = (const char**) str2;
+    return strcmp(strrchr(*a, '-')+1, strrchr(*b, '-')+1);
+}
+
+static int is_writer(const char *child) {
+    return strncmp(child, rwlock_types[ZKR_RWLOCK_WRITE],
+                   strlen(rwlock_types[ZKR_RWLOCK_WRITE])) == 0;
+}
+
+/* ends the acquisition, with the lock or without it */
+static int rwlock_done(zkr_rwlock_t *rwlock, int state, int rc) {
+    rwlock->state = state;
+    rwlock->isOwner = state == RWLOCK_OWNER;
+    rwlock->result = rc;
+    pthread_cond_broadcast(&(rwlock->cond));
+    return rc;
+}
+
+/* deletes a node we no longer want; the client wants a completion even
+ * though there is nothing to do */
+static void rwlock_abandon_completion(int rc, const void *data) {
+    if (rc != ZOK && rc != ZNONODE) {
+        LOG_WARN(("could not delete an abandoned node: %s", zerror(rc)));
+    }
+}
+
+/* gives up, and our node with it: a writer's left behind would block every
+ * later acquisition on the path */
+static int rwlock_fail(zkr_rwlock_t *rwlock, int rc) {
+    LOG_WARN(("could not acquire the lock on %s: %s", rwlock->path,
+              zerror(rc)));
+    if (rwlock->id != NULL) {
+        int len = strlen(rwlock->path) + strlen(rwlock->id) + 2;
+        char buf[len];
+        snprintf(buf, len, "%s/%s", rwlock->path, rwlock->id);
+        zoo_adelete(rwlock->zh, buf, -1, rwlock_abandon_completion, NULL);
+        free(rwlock->id);
+        rwlock->id = NULL;
+    }
+    return rwlock_done(rwlock, RWLOCK_IDLE, rc);
+}
+
+/* repeats the step after a connection loss, if it may */
+static int rwlock_retry(zkr_rwlock_t *rwlock, int rc) {
+    if ((rc == ZCONNECTIONLOSS || rc == ZOPERATIONTIMEOUT)
+            && rwlock->retries < RWLOCK_RETRIES) {
+        LOG_DEBUG(("connection loss while acquiring the lock, retrying"));
+        rwlock->retries++;
+        return 1;
+    }
+    return 0;
+}
+
+/* tells the owner of the lock how the step went, without pmutex */
+static void rwlock_notify(zkr_rwlock_t *rwlock, int rc) {
+    zkr_lock_completion completion = rwlock->completion;
+    if (rc != RWLOCK_CONTINUE && completion != NULL) {
+        completion(rc, rwlock->cbdata);
+    }
+}
+
+static void rwlock_watcher_fn(zhandle_t* zh, int type, int state,
+                              const char* path, void *watcherCtx) {
+    zkr_rwlock_t *rwlock = (zkr_rwlock_t *) watcherCtx;
+    int rc = RWLOCK_CONTINUE;
+    if (type == ZOO_SESSION_EVENT && state != ZOO_EXPIRED_SESSION_STATE) {
+        return;
+    }
+    pthread_mutex_lock(&(rwlock->pmutex));
+    if (rwlock->state == RWLOCK_WATCHING) {
+        rwlock->retries = 0;
+        rc = rwlock_get_children(rwlock, RWLOCK_CHECK);
+    }
+    pthread_mutex_unlock(&(rwlock->pmutex));
+    rwlock_notify(rwlock, rc);
+}
+
+static void rwlock_exists_completion(int rc, const struct Stat *stat,
+                                     const void *data) {
+    zkr_rwlock_t *rwlock = (zkr_rwlock_t *) data;
+    int ret = RWLOCK_CONTINUE;
+    pthread_mutex_lock(&(rwlock->pmutex));
+    if (rwlock->state == RWLOCK_WATCHING && rc != ZOK) {
+        // the node went before the watch was set
+        if (rc == ZNONODE || rwlock_retry(rwlock, rc)) {
+            ret = rwlock_get_children(rwlock, RWLOCK_CHECK);
+        } else {
+            ret = rwlock_fail(rwlock, rc);
+        }
+    }
+    pthread_mutex_unlock(&(rwlock->pmutex));
+    rwlock_notify(rwlock, ret);
+}
+
+/* finds the node we wait for: the nearest writer before ours for a reader,
+ * the nearest node of any kind for a writer */
+static int rwlock_check(zkr_rwlock_t *rwlock,
+                        const struct String_vector *strings) {
+    char *sorted[strings->count];
+    char *blocker = NULL;
+    int i, rc;
+    memcpy(sorted, strings->data, sizeof(sorted));
+    qsort(sorted, strings->count, sizeof(char*), &seqcmp);
+    for (i = 0; i < strings->count; i++) {
+        if (strcmp(sorted[i], rwlock->id) == 0) {
+            break;
+        }
+        if (rwlock->type == ZKR_RWLOCK_WRITE || is_writer(sorted[i])) {
+            blocker = sorted[i];
+        }
+    }
+    if (i == strings->count) {
+        // our node has gone with our previous session
+        free(rwlock->id);
+        rwlock->id = NULL;
+        return rwlock_create(rwlock);
+    }
+    if (blocker == NULL) {
+        LOG_DEBUG(("got the zoo rwlock - %s", rwlock->id));
+        return rwlock_done(rwlock, RWLOCK_OWNER, ZOK);
+    }
+    rwlock->state = RWLOCK_WATCHING;
+    int len = strlen(rwlock->path) + strlen(blocker) + 2;
+    char buf[len];
+    snprintf(buf, len, "%s/%s", rwlock->path, blocker);
+    rc = zoo_awexists(rwlock->zh, buf, &rwlock_watcher_fn, rwlock,
+                      rwlock_exists_completion, rwlock);
+    return rc == ZOK ? RWLOCK_CONTINUE : rwlock_fail(rwlock, rc);
+}
+
+static void rwlock_create_completion(int rc, const char *value,
+                                     const void *data) {
+    zkr_rwlock_t *rwlock = (zkr_rwlock_t *) data;
+    int ret = RWLOCK_CONTINUE;
+    pthread_mutex_lock(&(rwlock->pmutex));
+    if (rwlock->state == RWLOCK_CREATE) {
+        // the children's completion, which follows, acts on this
+        rwlock->create_rc = rc;
+        if (rc == ZOK) {
+            const char *name = strrchr(value, '/');
+            rwlock->id = strdup(name ? name + 1 : value);
+        }
+    } else if (rwlock->state == RWLOCK_CREATE_PARENT) {
+        if (rc == ZOK || rc == ZNODEEXISTS || rwlock_retry(rwlock, rc)) {
+            ret = rwlock_create(rwlock);
+        } else {
+            ret = rwlock_fail(rwlock, rc);
+        }
+    } else if (rc == ZOK) {
+        // unlocked while the create was in flight
+        zoo_adelete(rwlock->zh, value, -1, rwlock_abandon_completion, NULL);
+    }
+    pthread_mutex_unlock(&(rwlock->pmutex));
+    rwlock_notify(rwlock, ret);
+}
+
+static void rwlock_children_completion(int rc,
+                                       const struct String_vector *strings,
+                                       const void *data) {
+    zkr_rwlock_t *rwlock = (zkr_rwlock_t *) data;
+    int ret = RWLOCK_CONTINUE;
+    int i;
+    pthread_mutex_lock(&(rwlock->pmutex));
+    switch (rwlock->state) {
+    case RWLOCK_CREATE:
+        if (rwlock->create_rc == ZOK && rc == ZOK) {
+            rwlock->retries = 0;
+            ret = rwlock_check(rwlock, strings);
+        } else if (rwlock->create_rc == ZNONODE) {
+            rwlock->state = RWLOCK_CREATE_PARENT;
+            rc = zoo_acreate(rwlock->zh, rwlock->path, NULL, 0, rwlock->acl,
+                             0, rwlock_create_completion, rwlock);
+            ret = rc == ZOK ? RWLOCK_CONTINUE : rwlock_fail(rwlock, rc);
+        } else if (rwlock->create_rc == ZOK) {
+            // we have our node; only the list is missing
+            ret = rwlock_retry(rwlock, rc)
+                ? rwlock_get_children(rwlock, RWLOCK_CHECK)
+                : rwlock_fail(rwlock, rc);
+        } else if (rwlock_retry(rwlock, rwlock->create_rc)) {
+            // we can't tell if the node was made: look for it
+            ret = rwlock_get_children(rwlock, RWLOCK_LOOKUP);
+        } else {
+            ret = rwlock_fail(rwlock, rwlock->create_rc);
+        }
+        break;
+    case RWLOCK_LOOKUP:
+    case RWLOCK_CHECK:
+        if (rc != ZOK) {
+            ret = rwlock_retry(rwlock, rc)
+                ? rwlock_get_children(rwlock, rwlock->state)
+                : rwlock_fail(rwlock, rc);
+            break;
+        }
+        rwlock->retries = 0;
+        if (rwlock->state == RWLOCK_LOOKUP) {
+            char prefix[RWLOCK_PREFIX_LEN];
+            rwlock_prefix(rwlock, prefix, sizeof(prefix));
+            for (i = 0; i < strings->count; i++) {
+                if (strncmp(prefix, strings->data[i], strlen(prefix)) == 0) {
+                    rwlock->id = strdup(strings->data[i]);
+                    break;
+                }
+            }
+        }
+        ret = rwlock->id != NULL ? rwlock_check(rwlock, strings)
+                                 : rwlock_create(rwlock);
+        break;
+    default:
+        // unlocked while the request was in flight
+        break;
+    }
+    pthread_mutex_unlock(&(rwlock->pmutex));
+    rwlock_notify(rwlock, ret);
+}
+
+static int rwlock_get_children(zkr_rwlock_t *rwlock, int state) {
+    int rc;
+    rwlock->state = state;
+    rc = zoo_aget_children(rwlock->zh, rwlock->path, 0,
+                           rwlock_children_completion, rwlock);
+    return rc == ZOK ? RWLOCK_CONTINUE : rwlock_fail(rwlock, rc);
+}
+
+/* sends the create of our node and, behind it, the get of the children */
+static int rwlock_create(zkr_rwlock_t *rwlock) {
+    char prefix[RWLOCK_PREFIX_LEN];
+    int rc;
+    rwlock_prefix(rwlock, prefix, sizeof(prefix));
+    int len = strlen(rwlock->path) + strlen(prefix) + 2;
+    char buf[len];
+    snprintf(buf, len, "%s/%s", rwlock->path, prefix);
+    rwlock->state = RWLOCK_CREATE;
+    rwlock->create_rc = ZOK;
+    rc = zoo_acreate(rwlock->zh, buf, NULL, 0, rwlock->acl,
+                     ZOO_EPHEMERAL|ZOO_SEQUENCE,
+                     rwlock_create_completion, rwlock);
+    if (rc == ZOK) {
+        rc = zoo_aget_children(rwlock->zh, rwlock->path, 0,
+                               rwlock_children_completion, rwlock);
+    }
+    return rc == ZOK ? RWLOCK_CONTINUE : rwlock_fail(rwlock, rc);
+}
+
+ZOOAPI int zkr_rwlock_alock(zkr_rwlock_t *rwlock) {
+    int rc = ZOK;
+    pthread_mutex_lock(&(rwlock->pmutex));
+    if (rwlock->state == RWLOCK_IDLE) {
+        rwlock->retries = 0;
+        rwlock->isOwner = 0;
+        rc = rwlock_create(rwlock);
+        if (rc == RWLOCK_CONTINUE) {
+            rc = ZOK;
+        }
+    }
+    pthread_mutex_unlock(&(rwlock->pmutex));
+    return rc;
+}
+
+ZOOAPI int zkr_rwlock_lock(zkr_rwlock_t *rwlock) {
+    int rc = zkr_rwlock_alock(rwlock);
+    if (rc != ZOK) {
+        return rc;
+    }
+    pthread_mutex_lock(&(rwlock->pmutex));
+    while (rwlock->state != RWLOCK_OWNER && rwlock->state != RWLOCK_IDLE) {
+        pthread_cond_wait(&(rwlock->cond), &(rwlock->pmutex));
+    }
+    rc = rwlock->state == RWLOCK_OWNER ? ZOK : rwlock->result;
+    pthread_mutex_unlock(&(rwlock->pmutex));
+    return rc;
+}
+
+static void rwlock_delete_completion(int rc, const void *data) {
+    struct rwlock_unlock *unlock = (struct rwlock_unlock *) data;
+    zkr_rwlock_t *rwlock = unlock->rwlock;
+    if ((rc == ZCONNECTIONLOSS || rc == ZOPERATIONTIMEOUT)
+            && unlock->retries++ < RWLOCK_RETRIES) {
+        LOG_DEBUG(("connectionloss while deleting the node"));
+        if (zoo_adelete(rwlock->zh, unlock->path, -1,
+                        rwlock_delete_completion, unlock) == ZOK) {
+            return;
+        }
+    }
+    if (rc != ZOK && rc != ZNONODE) {
+        LOG_WARN(("could not delete %s: %s", unlock->path, zerror(rc)));
+    }
+    free(unlock);
+    rwlock_notify(rwlock, 1);
+}
+
+/* gives up our node, returning its path for the caller to delete */
+static struct rwlock_unlock *rwlock_release(zkr_rwlock_t *rwlock, int *rc) {
+    struct rwlock_unlock *unlock = NULL;
+    *rc = ZOK;
+    if (rwlock->id != NULL) {
+        int len = strlen(rwlock->path) + strlen(rwlock->id) + 2;
+        unlock = malloc(sizeof(*unlock) + len);
+        unlock->rwlock = rwlock;
+        unlock->retries = 0;
+        snprintf(unlock->path, len, "%s/%s", rwlock->path, rwlock->id);
+        free(rwlock->id);
+        rwlock->id = NULL;
+    } else if (rwlock->state == RWLOCK_IDLE) {
+        *rc = ZSYSTEMERROR;
+    }
+    if (rwlock->state != RWLOCK_IDLE) {
+        rwlock_done(rwlock, RWLOCK_IDLE, ZSYSTEMERROR);
+    }
+    return unlock;
+}
+
+ZOOAPI int zkr_rwlock_aunlock(zkr_rwlock_t *rwlock) {
+    struct rwlock_unlock *unlock;
+    int rc;
+    pthread_mutex_lock(&(rwlock->pmutex));
+    unlock = rwlock_release(rwlock, &rc);
+    // requests are answered in order, so a lock that follows this
+    // will not find the node
+    if (unlock != NULL) {
+        rc = zoo_adelete(rwlock->zh, unlock->path, -1,
+                         rwlock_delete_completion, unlock);
+        if (rc != ZOK) {
+            LOG_WARN(("could not delete %s: %s", unlock->path, zerror(rc)));
+            free(unlock);
+        }
+    }
+    pthread_mutex_unlock(&(rwlock->pmutex));
+    return rc;
+}
+
+ZOOAPI int zkr_rwlock_unlock(zkr_rwlock_t *rwlock) {
+    struct rwlock_unlock *unlock;
+    int rc;
+    pthread_mutex_lock(&(rwlock->pmutex));
+    unlock = rwlock_release(rwlock, &rc);
+    pthread_mutex_unlock(&(rwlock->pmutex));
+    if (unlock != NULL) {
+        rc = ZCONNECTIONLOSS;
+        while (rc == ZCONNECTIONLOSS && unlock->retries++ <= RWLOCK_RETRIES) {
+            rc = zoo_delete(rwlock->zh, unlock->path, -1);
+        }
+        free(unlock);
+        if (rc != ZOK && rc != ZNONODE) {
+            LOG_WARN(("not able to connect to server - giving up"));
+            return rc;
+        }
+        rc = ZOK;
+        rwlock_notify(rwlock, 1);
+    }
+    return rc;
+}
+
+ZOOAPI int zkr_rwlock_isowner(zkr_rwlock_t *rwlock) {
+    return rwlock->isOwner;
+}
+
+ZOOAPI int zkr_rwlock_destroy(zkr_rwlock_t *rwlock) {
+    if (rwlock->id)
+        free(rwlock->id);
+    rwlock->id = NULL;
+    rwlock->path = NULL;
+    rwlock->acl = NULL;
+    rwlock->completion = NULL;
+    pthread_mutex_destroy(&(rwlock->pmutex));
+    pthread_cond_destroy(&(rwlock->cond));
+    return 0;
+}
@@ -30,6 +30,7 @@ using namespace std;
 
 #include <zookeeper.h>
 #include <zoo_lock.h>
+#include <zoo_rwlock.h>
 
 static void yield(zhandle_t *zh, int i)
 {
@@ -96,6 +97,13 @@ class Zookeeper_locktest : public CPPUNIT_NS::TestFixture
 {
     CPPUNIT_TEST_SUITE(Zookeeper_locktest);
     CPPUNIT_TEST(testlock);
+    CPPUNIT_TEST(testalock);
+    CPPUNIT_TEST(testalockcontended);
+    CPPUNIT_TEST(testalockshared);
+    CPPUNIT_TEST(testalockrelock);
+    CPPUNIT_TEST(testrwlock);
+    CPPUNIT_TEST(testrwlocksync);
+    CPPUNIT_TEST(testrwlockrelock);
     CPPUNIT_TEST_SUITE_END();
 
     static void watcher(zhandle_t *, int type, int state, const char *path,void*v){
@@ -195,6 +203,385 @@ public:
         }
     }
 
+    struct alock_ctx {
+        pthread_mutex_t *lock;
+        zkr_lock_mutex_t *mutex;
+        int acquired;
+        int released;
+        int failed;
+        int remaining;
+        int *holders;
+        int *overlaps;
+    };
+
+    static void alock_completion(int rc, void *cbdata) {
+        alock_ctx *ctx = (alock_ctx *) cbdata;
+        pthread_mutex_lock(ctx->lock);
+        if (rc == 0) {
+            ctx->acquired++;
+            if (ctx->holders && ++*ctx->holders > 1)
+                ++*ctx->overlaps;
+        } else if (rc == 1) {
+            ctx->released++;
+        } else {
+            ctx->failed++;
+        }
+        pthread_mutex_unlock(ctx->lock);
+        if (ctx->remaining > 0) {
+            // release the lock to the next waiter and queue up again
+            if (rc == 0) {
+                pthread_mutex_lock(ctx->lock);
+                --*ctx->holders;
+                pthread_mutex_unlock(ctx->lock);
+                zkr_lock_aunlock(ctx->mutex);
+            } else if (rc == 1 && --ctx->remaining > 0) {
+                zkr_lock_alock(ctx->mutex);
+            }
+        }
+    }
+
+    int count_acquired(pthread_mutex_t *lock, alock_ctx *ctxs, int n) {
+        int i, acquired = 0;
+        pthread_mutex_lock(lock);
+        for (i = 0; i < n; i++)
+            acquired += ctxs[i].acquired;
+        pthread_mutex_unlock(lock);
+        return acquired;
+    }
+
+    bool wait_acquired(pthread_mutex_t *lock, alock_ctx *ctxs, int n, int expected) {
+        time_t expires = time(0) + 10;
+        while (count_acquired(lock, ctxs, n) < expected && time(0) < expires)
+            usleep(1000);
+        return count_acquired(lock, ctxs, n) == expected;
+    }
+
+    void init_alock_ctxs(pthread_mutex_t *lock, zkr_lock_mutex_t *mutexes,
+                         alock_ctx *ctxs, int count, zhandle_t *zh, char *path,
+                         int rounds, int *holders, int *overlaps) {
+        int i;
+        for (i = 0; i < count; i++) {
+            ctxs[i].lock = lock;
+            ctxs[i].mutex = &mutexes[i];
+            ctxs[i].acquired = ctxs[i].released = ctxs[i].failed = 0;
+            ctxs[i].remaining = rounds;
+            ctxs[i].holders = holders;
+            ctxs[i].overlaps = overlaps;
+            zkr_lock_init_cb(&mutexes[i], zh, path, &ZOO_OPEN_ACL_UNSAFE,
+                             alock_completion, &ctxs[i]);
+        }
+    }
+
+    void testalock()
+    {
+        watchctx_t ctx;
+        const int count = 3;
+        zkr_lock_mutex_t mutexes[count];
+        alock_ctx ctxs[count];
+        pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+        char* path = (char *) "/test-alock";
+        zhandle_t *zh = createClient(&ctx);
+        int i;
+        init_alock_ctxs(&lock, mutexes, ctxs, count, zh, path, 0, NULL, NULL);
+        for (i = 0; i < count; i++)
+            CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_lock_alock(&mutexes[i]));
+        // all three wait on the one handle; the first gets the lock
+        CPPUNIT_ASSERT(wait_acquired(&lock, ctxs, count, 1));
+        CPPUNIT_ASSERT_EQUAL(1, ctxs[0].acquired);
+        CPPUNIT_ASSERT(zkr_lock_isowner(&mutexes[0]));
+        for (i = 1; i < count; i++)
+            CPPUNIT_ASSERT(!zkr_lock_isowner(&mutexes[i]));
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_lock_aunlock(&mutexes[0]));
+        CPPUNIT_ASSERT(wait_acquired(&lock, ctxs, count, 2));
+        CPPUNIT_ASSERT_EQUAL(1, ctxs[0].released);
+        CPPUNIT_ASSERT_EQUAL(1, ctxs[1].acquired);
+        CPPUNIT_ASSERT(zkr_lock_isowner(&mutexes[1]));
+        CPPUNIT_ASSERT(!zkr_lock_isowner(&mutexes[2]));
+        // a waiter that gives up lets the one behind it through
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_lock_aunlock(&mutexes[2]));
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_lock_alock(&mutexes[0]));
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_lock_aunlock(&mutexes[1]));
+        CPPUNIT_ASSERT(wait_acquired(&lock, ctxs, count, 3));
+        CPPUNIT_ASSERT_EQUAL(2, ctxs[0].acquired);
+        CPPUNIT_ASSERT_EQUAL(0, ctxs[2].acquired);
+        CPPUNIT_ASSERT_EQUAL(0, ctxs[0].failed + ctxs[1].failed + ctxs[2].failed);
+        CPPUNIT_ASSERT_EQUAL((int) ZSYSTEMERROR, zkr_lock_aunlock(&mutexes[2]));
+        zookeeper_close(zh);
+        ctx.zh = 0;
+        for (i = 0; i < count; i++)
+            zkr_lock_destroy(&mutexes[i]);
+    }
+
+    void testalockcontended()
+    {
+        watchctx_t ctx;
+        const int count = 20;
+        const int rounds = 5;
+        zkr_lock_mutex_t mutexes[count];
+        alock_ctx ctxs[count];
+        pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+        int holders = 0, overlaps = 0;
+        char* path = (char *) "/test-alock-contended";
+        zhandle_t *zh = createClient(&ctx);
+        int i;
+        init_alock_ctxs(&lock, mutexes, ctxs, count, zh, path, rounds,
+                        &holders, &overlaps);
+        for (i = 0; i < count; i++)
+            CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_lock_alock(&mutexes[i]));
+        CPPUNIT_ASSERT(wait_acquired(&lock, ctxs, count, count * rounds));
+        CPPUNIT_ASSERT_EQUAL(0, overlaps);
+        for (i = 0; i < count; i++) {
+            CPPUNIT_ASSERT_EQUAL(rounds, ctxs[i].acquired);
+            CPPUNIT_ASSERT_EQUAL(0, ctxs[i].failed);
+        }
+        zookeeper_close(zh);
+        ctx.zh = 0;
+        for (i = 0; i < count; i++)
+            zkr_lock_destroy(&mutexes[i]);
+    }
+
+    bool wait_queued(zkr_lock_mutex_t *mutex) {
+        time_t expires = time(0) + 10;
+        while (mutex->id == NULL && time(0) < expires)
+            usleep(1000);
+        return mutex->id != NULL;
+    }
+
+    void testalockshared()
+    {
+        watchctx_t ctx1, ctx2;
+        const int count = 4;
+        zkr_lock_mutex_t mutexes[count];
+        alock_ctx ctxs[count];
+        pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+        char* path = (char *) "/test-alock-shared";
+        zhandle_t *zh1 = createClient(&ctx1);
+        zhandle_t *zh2 = createClient(&ctx2);
+        int i;
+        init_alock_ctxs(&lock, mutexes, ctxs, count, zh1, path, 0, NULL, NULL);
+        // the waiters alternate between the handles, each with its index
+        for (i = 0; i < count; i++) {
+            if (i % 2)
+                zkr_lock_init_cb(&mutexes[i], zh2, path, &ZOO_OPEN_ACL_UNSAFE,
+                                 alock_completion, &ctxs[i]);
+            CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_lock_alock(&mutexes[i]));
+            CPPUNIT_ASSERT(wait_queued(&mutexes[i]));
+        }
+        CPPUNIT_ASSERT(wait_acquired(&lock, ctxs, count, 1));
+        CPPUNIT_ASSERT_EQUAL(1, ctxs[0].acquired);
+        // the third learns that the second gave up, and watches the first
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_lock_aunlock(&mutexes[1]));
+        usleep(100000);
+        CPPUNIT_ASSERT_EQUAL(0, ctxs[2].acquired);
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_lock_aunlock(&mutexes[0]));
+        CPPUNIT_ASSERT(wait_acquired(&lock, ctxs, count, 2));
+        CPPUNIT_ASSERT_EQUAL(1, ctxs[2].acquired);
+        CPPUNIT_ASSERT(zkr_lock_isowner(&mutexes[2]));
+        // the last has not seen the first two go, and must look for them
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_lock_aunlock(&mutexes[2]));
+        CPPUNIT_ASSERT(wait_acquired(&lock, ctxs, count, 3));
+        CPPUNIT_ASSERT_EQUAL(1, ctxs[3].acquired);
+        CPPUNIT_ASSERT(zkr_lock_isowner(&mutexes[3]));
+        for (i = 0; i < count; i++)
+            CPPUNIT_ASSERT_EQUAL(0, ctxs[i].failed);
+        zookeeper_close(zh1);
+        zookeeper_close(zh2);
+        ctx1.zh = ctx2.zh = 0;
+        for (i = 0; i < count; i++)
+            zkr_lock_destroy(&mutexes[i]);
+    }
+
+    /* a lock path nobody may list, so that acquiring the lock fails once
+     * our node has been made */
+    void create_unlistable(zhandle_t *zh, const char *path) {
+        struct ACL acl = {ZOO_PERM_CREATE | ZOO_PERM_DELETE | ZOO_PERM_ADMIN,
+                          ZOO_ANYONE_ID_UNSAFE};
+        struct ACL_vector acls = {1, &acl};
+        CPPUNIT_ASSERT_EQUAL((int) ZOK,
+                zoo_create(zh, path, NULL, -1, &acls, 0, NULL, 0));
+    }
+
+    int count_children(zhandle_t *zh, const char *path) {
+        struct String_vector strings;
+        int count;
+        CPPUNIT_ASSERT_EQUAL((int) ZOK,
+                zoo_get_children(zh, path, 0, &strings));
+        count = strings.count;
+        deallocate_String_vector(&strings);
+        return count;
+    }
+
+    void testalockrelock()
+    {
+        watchctx_t ctx;
+        const int count = 3;
+        zkr_lock_mutex_t mutexes[count];
+        alock_ctx ctxs[count];
+        pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+        char* path = (char *) "/test-alock-relock";
+        char* failpath = (char *) "/test-alock-relock-failed";
+        zhandle_t *zh = createClient(&ctx);
+        int i;
+        init_alock_ctxs(&lock, mutexes, ctxs, count, zh, path, 0, NULL, NULL);
+        // a node held through zkr_lock_lock() is found to own the lock, and
+        // the completion still follows
+        CPPUNIT_ASSERT(zkr_lock_lock(&mutexes[0]));
+        CPPUNIT_ASSERT_EQUAL(1, ctxs[0].acquired);
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_lock_alock(&mutexes[1]));
+        CPPUNIT_ASSERT(wait_queued(&mutexes[1]));
+        sleep(1);
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_lock_alock(&mutexes[0]));
+        CPPUNIT_ASSERT(wait_acquired(&lock, ctxs, count, 2));
+        CPPUNIT_ASSERT_EQUAL(2, ctxs[0].acquired);
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_lock_aunlock(&mutexes[0]));
+        CPPUNIT_ASSERT(wait_acquired(&lock, ctxs, count, 3));
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_lock_aunlock(&mutexes[1]));
+
+        // a failed acquisition takes its node away, so locking again works
+        create_unlistable(zh, failpath);
+        zkr_lock_init_cb(&mutexes[2], zh, failpath, &ZOO_OPEN_ACL_UNSAFE,
+                         alock_completion, &ctxs[2]);
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_lock_alock(&mutexes[2]));
+        time_t expires = time(0) + 10;
+        while (ctxs[2].failed == 0 && time(0) < expires)
+            usleep(1000);
+        CPPUNIT_ASSERT_EQUAL(1, ctxs[2].failed);
+        CPPUNIT_ASSERT(mutexes[2].id == NULL);
+        CPPUNIT_ASSERT_EQUAL((int) ZOK,
+                zoo_set_acl(zh, failpath, -1, &ZOO_OPEN_ACL_UNSAFE));
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_lock_alock(&mutexes[2]));
+        CPPUNIT_ASSERT(wait_acquired(&lock, ctxs, count, 4));
+        CPPUNIT_ASSERT(zkr_lock_isowner(&mutexes[2]));
+        CPPUNIT_ASSERT_EQUAL(1, count_children(zh, failpath));
+        for (i = 0; i < 2; i++)
+            CPPUNIT_ASSERT_EQUAL(0, ctxs[i].failed);
+        zookeeper_close(zh);
+        ctx.zh = 0;
+        for (i = 0; i < count; i++)
+            zkr_lock_destroy(&mutexes[i]);
+    }
+
+    void testrwlock()
+    {
+        watchctx_t ctx;
+        const int count = 4;
+        // two readers, then a writer, then a reader behind the writer
+        const int types[count] = {ZKR_RWLOCK_READ, ZKR_RWLOCK_READ,
+                                  ZKR_RWLOCK_WRITE, ZKR_RWLOCK_READ};
+        zkr_rwlock_t rwlocks[count];
+        alock_ctx ctxs[count];
+        pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+        char* path = (char *) "/test-rwlock";
+        zhandle_t *zh = createClient(&ctx);
+        int i;
+        for (i = 0; i < count; i++) {
+            ctxs[i].lock = &lock;
+            ctxs[i].acquired = ctxs[i].released = ctxs[i].failed = 0;
+            ctxs[i].remaining = 0;
+            ctxs[i].holders = NULL;
+            zkr_rwlock_init(&rwlocks[i], zh, path, &ZOO_OPEN_ACL_UNSAFE,
+                            types[i], alock_completion, &ctxs[i]);
+        }
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_rwlock_alock(&rwlocks[0]));
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_rwlock_alock(&rwlocks[1]));
+        CPPUNIT_ASSERT(wait_acquired(&lock, ctxs, count, 2));
+        CPPUNIT_ASSERT(zkr_rwlock_isowner(&rwlocks[0]));
+        CPPUNIT_ASSERT(zkr_rwlock_isowner(&rwlocks[1]));
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_rwlock_alock(&rwlocks[2]));
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_rwlock_alock(&rwlocks[3]));
+        sleep(1);
+        CPPUNIT_ASSERT_EQUAL(2, count_acquired(&lock, ctxs, count));
+        // the writer waits for both readers
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_rwlock_aunlock(&rwlocks[0]));
+        sleep(1);
+        CPPUNIT_ASSERT(!zkr_rwlock_isowner(&rwlocks[2]));
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_rwlock_aunlock(&rwlocks[1]));
+        CPPUNIT_ASSERT(wait_acquired(&lock, ctxs, count, 3));
+        CPPUNIT_ASSERT(zkr_rwlock_isowner(&rwlocks[2]));
+        CPPUNIT_ASSERT(!zkr_rwlock_isowner(&rwlocks[3]));
+        // the last reader waits for the writer only
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_rwlock_aunlock(&rwlocks[2]));
+        CPPUNIT_ASSERT(wait_acquired(&lock, ctxs, count, 4));
+        CPPUNIT_ASSERT(zkr_rwlock_isowner(&rwlocks[3]));
+        for (i = 0; i < count; i++) {
+            CPPUNIT_ASSERT_EQUAL(1, ctxs[i].acquired);
+            CPPUNIT_ASSERT_EQUAL(0, ctxs[i].failed);
+        }
+        CPPUNIT_ASSERT_EQUAL(1, ctxs[0].released);
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_rwlock_unlock(&rwlocks[3]));
+        CPPUNIT_ASSERT_EQUAL((int) ZSYSTEMERROR, zkr_rwlock_unlock(&rwlocks[3]));
+        zookeeper_close(zh);
+        ctx.zh = 0;
+        for (i = 0; i < count; i++)
+            zkr_rwlock_destroy(&rwlocks[i]);
+    }
+
+    static void *rwlock_writer(void *arg) {
+        zkr_rwlock_t *writer = (zkr_rwlock_t *) arg;
+        return (void *)(long) zkr_rwlock_lock(writer);
+    }
+
+    void testrwlocksync()
+    {
+        watchctx_t ctx;
+        zkr_rwlock_t readers[2], writer;
+        char* path = (char *) "/test-rwlock-sync";
+        zhandle_t *zh = createClient(&ctx);
+        pthread_t thread;
+        void *rc;
+        int i;
+        for (i = 0; i < 2; i++) {
+            zkr_rwlock_init(&readers[i], zh, path, &ZOO_OPEN_ACL_UNSAFE,
+                            ZKR_RWLOCK_READ, NULL, NULL);
+            CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_rwlock_lock(&readers[i]));
+        }
+        zkr_rwlock_init(&writer, zh, path, &ZOO_OPEN_ACL_UNSAFE,
+                        ZKR_RWLOCK_WRITE, NULL, NULL);
+        pthread_create(&thread, NULL, rwlock_writer, &writer);
+        sleep(1);
+        CPPUNIT_ASSERT(!zkr_rwlock_isowner(&writer));
+        for (i = 0; i < 2; i++)
+            CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_rwlock_unlock(&readers[i]));
+        pthread_join(thread, &rc);
+        CPPUNIT_ASSERT_EQUAL(0L, (long) rc);
+        CPPUNIT_ASSERT(zkr_rwlock_isowner(&writer));
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_rwlock_unlock(&writer));
+        zookeeper_close(zh);
+        ctx.zh = 0;
+        for (i = 0; i < 2; i++)
+            zkr_rwlock_destroy(&readers[i]);
+        zkr_rwlock_destroy(&writer);
+    }
+
+    void testrwlockrelock()
+    {
+        watchctx_t ctx;
+        zkr_rwlock_t writer;
+        alock_ctx actx;
+        pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+        char* path = (char *) "/test-rwlock-relock";
+        zhandle_t *zh = createClient(&ctx);
+        actx.lock = &lock;
+        actx.acquired = actx.released = actx.failed = 0;
+        actx.remaining = 0;
+        actx.holders = NULL;
+        create_unlistable(zh, path);
+        zkr_rwlock_init(&writer, zh, path, &ZOO_OPEN_ACL_UNSAFE,
+                        ZKR_RWLOCK_WRITE, alock_completion, &actx);
+        CPPUNIT_ASSERT_EQUAL((int) ZNOAUTH, zkr_rwlock_lock(&writer));
+        CPPUNIT_ASSERT(writer.id == NULL);
+        // a write- node left behind would block the writer's next node
+        CPPUNIT_ASSERT_EQUAL((int) ZOK,
+                zoo_set_acl(zh, path, -1, &ZOO_OPEN_ACL_UNSAFE));
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_rwlock_alock(&writer));
+        CPPUNIT_ASSERT(wait_acquired(&lock, &actx, 1, 1));
+        CPPUNIT_ASSERT(zkr_rwlock_isowner(&writer));
+        CPPUNIT_ASSERT_EQUAL(1, count_children(zh, path));
+        CPPUNIT_ASSERT_EQUAL((int) ZOK, zkr_rwlock_unlock(&writer));
+        zookeeper_close(zh);
+        ctx.zh = 0;
+        zkr_rwlock_destroy(&writer);
+    }
 };
 
 const char Zookeeper_locktest::hostPorts[] = "127.0.0.1:22181";
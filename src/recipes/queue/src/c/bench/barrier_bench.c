@@ -0,0 +1,279 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures barriers: all workers but one arrive a millisecond apart, spread
+ * over a few handles, then the last one arrives, timing how long it takes
+ * until every worker is released and counting the requests all of them
+ * sent. The recipe's enter and leave are compared with the usual hand-made
+ * barrier, where every worker watches the children of the barrier's path and
+ * counts them on each change.
+ *
+ *   zkbarrierbench host:port [handles [workers...]]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <zookeeper.h>
+#include <zoo_barrier.h>
+
+#define ARRIVAL_GAP 1000
+
+/* a worker of the hand-made barrier */
+struct poller {
+    zhandle_t *zh;
+    const char *path;
+    int size;
+    int passed;
+    long requests;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static int connected;
+static int passed;
+static int failed;
+
+static void watcher(zhandle_t *zh, int type, int state, const char *path,
+        void *ctx)
+{
+    if (type == ZOO_SESSION_EVENT && state == ZOO_CONNECTED_STATE) {
+        pthread_mutex_lock(&lock);
+        connected++;
+        pthread_cond_broadcast(&cond);
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void barrier_completion(int rc, const void *data)
+{
+    pthread_mutex_lock(&lock);
+    if (rc == ZOK)
+        passed++;
+    else
+        failed++;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&lock);
+}
+
+static void wait_passed(int n)
+{
+    pthread_mutex_lock(&lock);
+    while (passed < n && failed == 0)
+        pthread_cond_wait(&cond, &lock);
+    pthread_mutex_unlock(&lock);
+}
+
+static void poller_children(int rc, const struct String_vector *strings,
+        const void *data);
+
+static void poller_watcher(zhandle_t *zh, int type, int state,
+        const char *path, void *ctx)
+{
+    struct poller *p = (struct poller *) ctx;
+
+    if (type != ZOO_CHILD_EVENT)
+        return;
+    pthread_mutex_lock(&lock);
+    if (!p->passed) {
+        p->requests++;
+        zoo_awget_children(p->zh, p->path, poller_watcher, p,
+                poller_children, p);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+static void poller_children(int rc, const struct String_vector *strings,
+        const void *data)
+{
+    struct poller *p = (struct poller *) data;
+
+    pthread_mutex_lock(&lock);
+    if (rc == ZOK && !p->passed && strings->count >= p->size) {
+        p->passed = 1;
+        passed++;
+        pthread_cond_broadcast(&cond);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+static void poller_created(int rc, const char *value, const void *data)
+{
+    if (rc != ZOK)
+        barrier_completion(rc, data);
+}
+
+static void poller_arrive(struct poller *p)
+{
+    char buf[128];
+
+    snprintf(buf, sizeof(buf), "%s/w-", p->path);
+    pthread_mutex_lock(&lock);
+    p->requests += 2;
+    pthread_mutex_unlock(&lock);
+    zoo_acreate(p->zh, buf, NULL, 0, &ZOO_OPEN_ACL_UNSAFE,
+            ZOO_EPHEMERAL|ZOO_SEQUENCE, poller_created, NULL);
+    zoo_awget_children(p->zh, p->path, poller_watcher, p, poller_children, p);
+}
+
+static long count_requests(zkr_barrier_t *barriers, struct poller *pollers,
+        int n)
+{
+    long requests = 0;
+    int i;
+
+    pthread_mutex_lock(&lock);
+    for (i = 0; i < n; i++)
+        requests += pollers ? pollers[i].requests : barriers[i].requests;
+    pthread_mutex_unlock(&lock);
+    return requests;
+}
+
+/* waits for the requests of the workers that have arrived to die down */
+static void settle(zkr_barrier_t *barriers, struct poller *pollers, int n)
+{
+    long requests = count_requests(barriers, pollers, n), last;
+
+    do {
+        last = requests;
+        usleep(50000);
+        requests = count_requests(barriers, pollers, n);
+    } while (requests != last);
+}
+
+static void report(const char *mode, int n, double seconds, long requests)
+{
+    printf("%12s %10d %12.2f %12ld %12.1f\n", mode, n, seconds * 1000,
+            requests, (double) requests / n);
+    fflush(stdout);
+}
+
+static void run_recipe(zhandle_t **zhs, int handles, const char *path, int n)
+{
+    zkr_barrier_t *barriers = calloc(n, sizeof(*barriers));
+    double start;
+    int i;
+
+    passed = failed = 0;
+    zoo_create(zhs[0], path, NULL, 0, &ZOO_OPEN_ACL_UNSAFE, 0, NULL, 0);
+    for (i = 0; i < n; i++)
+        zkr_barrier_init(&barriers[i], zhs[i % handles], (char *) path,
+                &ZOO_OPEN_ACL_UNSAFE, n);
+    for (i = 0; i < n - 1; i++) {
+        zkr_barrier_aenter(&barriers[i], barrier_completion, NULL);
+        usleep(ARRIVAL_GAP);
+    }
+    settle(barriers, NULL, n);
+    start = now();
+    zkr_barrier_aenter(&barriers[n - 1], barrier_completion, NULL);
+    wait_passed(n);
+    report("enter", n, now() - start, count_requests(barriers, NULL, n));
+
+    for (i = 0; i < n; i++)
+        barriers[i].requests = 0;
+    for (i = 0; i < n - 1; i++) {
+        zkr_barrier_aleave(&barriers[i], barrier_completion, NULL);
+        usleep(ARRIVAL_GAP);
+    }
+    settle(barriers, NULL, n);
+    start = now();
+    zkr_barrier_aleave(&barriers[n - 1], barrier_completion, NULL);
+    wait_passed(2 * n);
+    report("leave", n, now() - start, count_requests(barriers, NULL, n));
+    if (failed)
+        fprintf(stderr, "%d workers failed\n", failed);
+    /* the barriers are left to the handles, which may hold their watches */
+}
+
+static void run_polling(zhandle_t **zhs, int handles, const char *path, int n)
+{
+    struct poller *pollers = calloc(n, sizeof(*pollers));
+    double start;
+    int i;
+
+    passed = failed = 0;
+    zoo_create(zhs[0], path, NULL, 0, &ZOO_OPEN_ACL_UNSAFE, 0, NULL, 0);
+    for (i = 0; i < n; i++) {
+        pollers[i].zh = zhs[i % handles];
+        pollers[i].path = path;
+        pollers[i].size = n;
+    }
+    for (i = 0; i < n - 1; i++) {
+        poller_arrive(&pollers[i]);
+        usleep(ARRIVAL_GAP);
+    }
+    settle(NULL, pollers, n);
+    start = now();
+    poller_arrive(&pollers[n - 1]);
+    wait_passed(n);
+    start = now() - start;
+    settle(NULL, pollers, n);
+    report("polling", n, start, count_requests(NULL, pollers, n));
+    if (failed)
+        fprintf(stderr, "%d workers failed\n", failed);
+}
+
+int main(int argc, char **argv)
+{
+    static const int default_workers[] = {10, 100, 500};
+    zhandle_t **zhs;
+    char path[64];
+    int handles, runs, r, i;
+
+    if (argc < 2) {
+        fprintf(stderr, "USAGE: %s host:port [handles [workers...]]\n",
+                argv[0]);
+        return 2;
+    }
+    handles = argc > 2 ? atoi(argv[2]) : 10;
+    runs = argc > 3 ? argc - 3 : 3;
+    zoo_set_debug_level(ZOO_LOG_LEVEL_WARN);
+    zhs = calloc(handles, sizeof(*zhs));
+    for (i = 0; i < handles; i++)
+        zhs[i] = zookeeper_init(argv[1], watcher, 10000, 0, 0, 0);
+    pthread_mutex_lock(&lock);
+    while (connected < handles)
+        pthread_cond_wait(&cond, &lock);
+    pthread_mutex_unlock(&lock);
+
+    printf("%12s %10s %12s %12s %12s\n", "barrier", "workers",
+            "release ms", "requests", "per worker");
+    for (r = 0; r < runs; r++) {
+        int n = argc > 3 ? atoi(argv[r + 3]) : default_workers[r];
+        snprintf(path, sizeof(path), "/zkbarrierbench-%d-%d", getpid(), n);
+        run_recipe(zhs, handles, strdup(path), n);
+        snprintf(path, sizeof(path), "/zkbarrierbench-%d-%d-polling",
+                getpid(), n);
+        run_polling(zhs, handles, strdup(path), n);
+    }
+    for (i = 0; i < handles; i++)
+        zookeeper_close(zhs[i]);
+    return 0;
+}
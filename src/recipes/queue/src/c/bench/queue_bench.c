@@ -0,0 +1,243 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures how fast a queue of a given depth fills with zkr_queue_offer(),
+ * zkr_queue_aoffer() and zkr_queue_aoffer_many(), and how fast it drains
+ * with zkr_queue_take() and with zkr_queue_take_many() in batches of
+ * various sizes.
+ *
+ *   zkqueuebench host:port [depth...]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <zookeeper.h>
+#include <zoo_queue.h>
+
+#define ELEMENT_SIZE 64
+#define MAX_BATCH 128
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static int pending;
+static int connected;
+
+static void watcher(zhandle_t *zh, int type, int state, const char *path,
+        void *ctx)
+{
+    if (type == ZOO_SESSION_EVENT) {
+        pthread_mutex_lock(&lock);
+        connected = state == ZOO_CONNECTED_STATE;
+        pthread_cond_broadcast(&cond);
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+static void create_completion(int rc, const char *name, const void *data)
+{
+    if (rc != ZOK)
+        fprintf(stderr, "create failed: %s\n", zerror(rc));
+    pthread_mutex_lock(&lock);
+    if (--pending == 0)
+        pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&lock);
+}
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* fills the queue with pipelined creates, a window at a time */
+static void fill(zhandle_t *zh, const char *path, int depth)
+{
+    char node[256], element[ELEMENT_SIZE];
+    int i;
+
+    zoo_create(zh, path, 0, -1, &ZOO_OPEN_ACL_UNSAFE, 0, 0, 0);
+    snprintf(node, sizeof(node), "%s/qn-", path);
+    memset(element, 'x', sizeof(element));
+    for (i = 0; i < depth; i++) {
+        pthread_mutex_lock(&lock);
+        while (pending >= 1000)
+            pthread_cond_wait(&cond, &lock);
+        pending++;
+        pthread_mutex_unlock(&lock);
+        zoo_acreate(zh, node, element, sizeof(element), &ZOO_OPEN_ACL_UNSAFE,
+                ZOO_SEQUENCE, create_completion, 0);
+    }
+    pthread_mutex_lock(&lock);
+    while (pending > 0)
+        pthread_cond_wait(&cond, &lock);
+    pthread_mutex_unlock(&lock);
+}
+
+/* offers depth elements, batch at a time (0 for zkr_queue_aoffer(), -1 for
+ * zkr_queue_offer()) */
+static double produce(zhandle_t *zh, char *path, int depth, int batch)
+{
+    char element[ELEMENT_SIZE];
+    const char *data[MAX_BATCH];
+    int lens[MAX_BATCH];
+    zkr_queue_t queue;
+    double start;
+    int i, n;
+
+    zkr_queue_init(&queue, zh, path, &ZOO_OPEN_ACL_UNSAFE);
+    memset(element, 'x', sizeof(element));
+    for (i = 0; i < MAX_BATCH; i++) {
+        data[i] = element;
+        lens[i] = sizeof(element);
+    }
+    start = now();
+    for (i = 0; i < depth; i += n) {
+        n = batch <= 0 ? 1 : batch;
+        if (n > depth - i)
+            n = depth - i;
+        if (batch < 0) {
+            zkr_queue_offer(&queue, element, sizeof(element));
+            continue;
+        }
+        pthread_mutex_lock(&lock);
+        while (pending >= 1000)
+            pthread_cond_wait(&cond, &lock);
+        pending += n;
+        pthread_mutex_unlock(&lock);
+        if (batch == 0)
+            zkr_queue_aoffer(&queue, element, sizeof(element),
+                    create_completion, 0);
+        else
+            zkr_queue_aoffer_many(&queue, data, lens, n, create_completion, 0);
+    }
+    pthread_mutex_lock(&lock);
+    while (pending > 0)
+        pthread_cond_wait(&cond, &lock);
+    pthread_mutex_unlock(&lock);
+    start = now() - start;
+    zkr_queue_destroy(&queue);
+    return start;
+}
+
+/* drains depth elements, batch at a time (0 for zkr_queue_take()) */
+static double drain(zhandle_t *zh, char *path, int depth, int batch)
+{
+    char data[MAX_BATCH][ELEMENT_SIZE];
+    char *buffers[MAX_BATCH];
+    int lens[MAX_BATCH];
+    zkr_queue_t queue;
+    double start;
+    int taken = 0, i, count, rc;
+
+    zkr_queue_init(&queue, zh, path, &ZOO_OPEN_ACL_UNSAFE);
+    start = now();
+    while (taken < depth) {
+        if (batch == 0) {
+            lens[0] = sizeof(data[0]);
+            rc = zkr_queue_take(&queue, data[0], &lens[0]);
+            count = 1;
+        } else {
+            for (i = 0; i < batch; i++) {
+                buffers[i] = data[i];
+                lens[i] = sizeof(data[i]);
+            }
+            rc = zkr_queue_take_many(&queue, buffers, lens, batch, &count);
+        }
+        if (rc != ZOK) {
+            fprintf(stderr, "take failed: %s\n", zerror(rc));
+            exit(1);
+        }
+        taken += count;
+    }
+    start = now() - start;
+    zkr_queue_destroy(&queue);
+    return start;
+}
+
+int main(int argc, char **argv)
+{
+    static const int default_depths[] = {100, 1000, 5000};
+    static const int offer_batches[] = {-1, 0, 16, MAX_BATCH};
+    static const int batches[] = {0, 1, 16, MAX_BATCH};
+    char path[64];
+    zhandle_t *zh;
+    int d, b, ndepths;
+
+    if (argc < 2) {
+        fprintf(stderr, "USAGE: %s host:port [depth...]\n", argv[0]);
+        return 2;
+    }
+    zoo_set_debug_level(ZOO_LOG_LEVEL_WARN);
+    zh = zookeeper_init(argv[1], watcher, 10000, 0, 0, 0);
+    pthread_mutex_lock(&lock);
+    while (!connected)
+        pthread_cond_wait(&cond, &lock);
+    pthread_mutex_unlock(&lock);
+
+    ndepths = argc > 2 ? argc - 2 : 3;
+    printf("%8s %10s %10s %12s\n", "depth", "offer", "seconds", "elements/s");
+    for (d = 0; d < ndepths; d++) {
+        int depth = argc > 2 ? atoi(argv[d + 2]) : default_depths[d];
+        for (b = 0; b < sizeof(offer_batches) / sizeof(offer_batches[0]); b++) {
+            double seconds;
+            char mode[24];
+            snprintf(path, sizeof(path), "/zkqueuebench-%d", getpid());
+            seconds = produce(zh, path, depth, offer_batches[b]);
+            drain(zh, path, depth, MAX_BATCH);
+            zoo_delete(zh, path, -1);
+            if (offer_batches[b] < 0)
+                snprintf(mode, sizeof(mode), "single");
+            else if (offer_batches[b] == 0)
+                snprintf(mode, sizeof(mode), "async");
+            else
+                snprintf(mode, sizeof(mode), "many(%d)", offer_batches[b]);
+            printf("%8d %10s %10.3f %12.0f\n", depth, mode, seconds,
+                    depth / seconds);
+            fflush(stdout);
+        }
+    }
+
+    printf("\n%8s %10s %10s %12s\n", "depth", "take", "seconds", "elements/s");
+    for (d = 0; d < ndepths; d++) {
+        int depth = argc > 2 ? atoi(argv[d + 2]) : default_depths[d];
+        for (b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+            double seconds;
+            char mode[24];
+            snprintf(path, sizeof(path), "/zkqueuebench-%d", getpid());
+            fill(zh, path, depth);
+            seconds = drain(zh, path, depth, batches[b]);
+            zoo_delete(zh, path, -1);
+            if (batches[b] == 0)
+                snprintf(mode, sizeof(mode), "single");
+            else
+                snprintf(mode, sizeof(mode), "many(%d)", batches[b]);
+            printf("%8d %10s %10.3f %12.0f\n", depth, mode, seconds,
+                    depth / seconds);
+            fflush(stdout);
+        }
+    }
+    zookeeper_close(zh);
+    return 0;
+}
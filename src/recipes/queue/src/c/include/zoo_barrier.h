@@ -0,0 +1,154 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ZOOKEEPER_BARRIER_H_
+#define ZOOKEEPER_BARRIER_H_
+
+#include <zookeeper.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * \file zoo_barrier.h
+ * \brief zookeeper recipe for barriers and double barriers.
+ *
+ * a worker enters by creating one sequential node under the barrier's path,
+ * sent together with a watch on the path's "ready" node. The sequence number
+ * tells a worker whether it may be the last to arrive; only such a worker
+ * lists the children, and if all have arrived it creates "ready", which
+ * releases everyone through their watches. Leaving works the same way with
+ * nodes under "ready" and a "done" node. A barrier's path serves once; use a
+ * new path for every round.
+ */
+
+
+/**
+ * \brief signature of a completion for entering and leaving a barrier.
+ *
+ * \param rc ZOK once every worker has arrived, otherwise a zookeeper error code
+ * \param data the pointer passed to zkr_barrier_aenter() or zkr_barrier_aleave()
+ */
+typedef void (*zkr_barrier_completion_t)(int rc, const void *data);
+
+struct zkr_barrier {
+    zhandle_t *zh;
+    char *path;
+    struct ACL_vector *acl;
+    int size;
+    char *ready_path;
+    char *done_path;
+    char *node_name;                /* our node under path, once known */
+    pthread_mutex_t pmutex;
+    pthread_cond_t cond;
+    int phase;
+    int state;
+    int retries;
+    int result;
+    zkr_barrier_completion_t completion;  /* of the enter or leave under way */
+    const void *context;
+    long requests;                  /* requests sent, for measuring the load */
+};
+
+typedef struct zkr_barrier zkr_barrier_t;
+
+
+/**
+ * \brief initializes a zookeeper barrier
+ *
+ * this method instantiates one worker's side of a zookeeper barrier.
+ * \param barrier the zookeeper barrier to initialize
+ * \param zh the zookeeper handle to use
+ * \param path the path in zookeeper to use for the barrier
+ * \param acl the acl to use in zookeeper.
+ * \param size the number of workers the barrier waits for
+ * \return return 0 if successful.
+ */
+ZOOAPI int zkr_barrier_init(zkr_barrier_t *barrier, zhandle_t* zh, char* path,
+        struct ACL_vector *acl, int size);
+
+/**
+ * \brief enters a zookeeper barrier asynchronously
+ *
+ * this method registers the worker and returns without waiting. The
+ * completion is called with ZOK once size workers have entered, or with a
+ * zookeeper error code if the worker could not enter. Entering costs a worker
+ * one round trip, and the release one write by the last to arrive. Once this
+ * has been called, the barrier must stay valid until the handle is closed.
+ * \param barrier the zookeeper barrier to enter
+ * \param completion the routine to invoke once the barrier is passed, may be NULL
+ * \param context the data that will be passed to the completion routine
+ * \return returns 0 (ZOK) if the requests were sent, ZSYSTEMERROR if the
+ * barrier was entered already, otherwise a zookeeper error code; the
+ * completion will not be called then.
+ */
+ZOOAPI int zkr_barrier_aenter(zkr_barrier_t *barrier,
+        zkr_barrier_completion_t completion, const void *context);
+
+/**
+ * \brief enters a zookeeper barrier
+ *
+ * this method registers the worker and waits until size workers have
+ * entered. It must not be called from a completion or a watcher.
+ * \param barrier the zookeeper barrier to enter
+ * \return returns 0 (ZOK) once every worker has arrived, otherwise a zookeeper
+ * error code.
+ */
+ZOOAPI int zkr_barrier_enter(zkr_barrier_t *barrier);
+
+/**
+ * \brief leaves a zookeeper double barrier asynchronously
+ *
+ * this method removes the worker's node and returns without waiting. The
+ * completion is called with ZOK once size workers have left, or with a
+ * zookeeper error code. The barrier must have been entered.
+ * \param barrier the zookeeper barrier to leave
+ * \param completion the routine to invoke once every worker has left, may be NULL
+ * \param context the data that will be passed to the completion routine
+ * \return returns 0 (ZOK) if the requests were sent, ZSYSTEMERROR if the
+ * barrier was not entered, otherwise a zookeeper error code; the completion
+ * will not be called then.
+ */
+ZOOAPI int zkr_barrier_aleave(zkr_barrier_t *barrier,
+        zkr_barrier_completion_t completion, const void *context);
+
+/**
+ * \brief leaves a zookeeper double barrier
+ *
+ * this method removes the worker's node and waits until size workers have
+ * left. It must not be called from a completion or a watcher.
+ * \param barrier the zookeeper barrier to leave
+ * \return returns 0 (ZOK) once every worker has left, otherwise a zookeeper
+ * error code.
+ */
+ZOOAPI int zkr_barrier_leave(zkr_barrier_t *barrier);
+
+/**
+ * \brief destroys a zookeeper barrier
+ *
+ * this method frees the barrier, it does not leave it.
+ * \param barrier the zookeeper barrier to destroy
+ */
+ZOOAPI void zkr_barrier_destroy(zkr_barrier_t *barrier);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  //ZOOKEEPER_BARRIER_H_
@@ -41,10 +41,26 @@ struct zkr_queue {
     char *node_name;
     int node_name_length;
     char *cached_create_path;
+    int root_requested;             /* the async offers have sent a create of the root */
+    /* consumer state, see zkr_queue_take_many() */
+    int consumer;
+    struct String_vector children;  /* sorted; those before next_child are claimed */
+    int next_child;
+    void *children_latch;           /* fires when the children change */
 };
 
 typedef struct zkr_queue zkr_queue_t;
 
+/**
+ * \brief signature of a completion for the asynchronous offers.
+ *
+ * \param rc ZOK if the element was added, otherwise a zookeeper error code
+ * \param name the path of the element's znode, NULL unless rc is ZOK
+ * \param data the pointer passed to the offer
+ */
+typedef void (*zkr_queue_offer_completion_t)(int rc, const char *name,
+        const void *data);
+
 
 /**
  * \brief initializes a zookeeper queue
@@ -69,6 +85,47 @@ ZOOAPI int zkr_queue_init(zkr_queue_t *queue, zhandle_t* zh, char* path, struct
  */
 ZOOAPI int zkr_queue_offer(zkr_queue_t *queue, const char *data, int buffer_len);
 
+/**
+ * \brief adds an element to a zookeeper queue asynchronously
+ *
+ * this method is the asynchronous version of zkr_queue_offer(). The elements
+ * offered through one handle are added in the order they were offered, and
+ * their completions are called in that order. The first asynchronous offer on
+ * a queue structure sends a create of the queue's root ahead of the element;
+ * if the root is deleted afterwards the offers fail with ZNONODE.
+ * \param queue the zookeeper queue to add the element to
+ * \param data a pointer to a data buffer
+ * \param buffer_len the length of the buffer
+ * \param completion the routine to invoke when the element has been added
+ * \param context the data that will be passed to the completion routine
+ * \return returns 0 (ZOK) if the request was sent, otherwise returns a
+ * zookeeper error code and the completion will not be called.
+ */
+ZOOAPI int zkr_queue_aoffer(zkr_queue_t *queue, const char *data, int buffer_len,
+        zkr_queue_offer_completion_t completion, const void *context);
+
+/**
+ * \brief adds several elements to a zookeeper queue asynchronously
+ *
+ * this method adds the elements in order with one multi request per batch of
+ * elements, rather than one create each, so a producer can enqueue many
+ * elements per round trip. A batch is added as a whole or not at all. The
+ * ordering is that of zkr_queue_aoffer(), with which this method may be mixed.
+ * \param queue the zookeeper queue to add the elements to
+ * \param data count pointers to data buffers
+ * \param buffer_lens the lengths of the buffers
+ * \param count the number of elements
+ * \param completion the routine to invoke for each element, in order, once it
+ * has been added or has failed to be
+ * \param context the data that will be passed to the completion routine
+ * \return returns 0 (ZOK) if every element was sent, otherwise a zookeeper
+ * error code. The completion is called for every element in either case, from
+ * this call for the elements that could not be sent.
+ */
+ZOOAPI int zkr_queue_aoffer_many(zkr_queue_t *queue, const char **data,
+        const int *buffer_lens, int count,
+        zkr_queue_offer_completion_t completion, const void *context);
+
 /**
  * \brief returns the head of a zookeeper queue 
  *
@@ -102,6 +159,40 @@ ZOOAPI int zkr_queue_remove(zkr_queue_t *queue, char *buffer, int *buffer_len);
  */
 ZOOAPI int zkr_queue_take(zkr_queue_t *queue, char *buffer, int *buffer_len);
 
+/**
+ * \brief removes and returns up to max elements from the head of a zookeeper queue, blocks if necessary
+ *
+ * this method keeps the sorted list of the queue's children in the queue
+ * structure across calls and claims elements from it, so that draining the
+ * queue costs one child list per batch rather than one per element. The list
+ * is fetched again only once it has been used up, and if nothing has changed
+ * since it was fetched the method waits for a change instead. Each element is
+ * claimed by a get and a delete, pipelined with those of the other elements
+ * of the batch; an element another consumer took first is skipped.
+ *
+ * The queue structure keeps its list until it is destroyed. It must not be
+ * used by more than one thread at a time once this method has been called.
+ * \param queue the zookeeper queue to remove the elements from
+ * \param buffers max data buffers, one per element
+ * \param buffer_lens the lengths of the buffers; receive the lengths of the
+ * data written, elements that don't fit being truncated
+ * \param max the most elements to remove
+ * \param count receives the number of elements removed, at least one if
+ * successful
+ * \return returns 0 (ZOK) if successful, otherwise sets *count to 0 and
+ * returns a zookeeper error code.
+ */
+ZOOAPI int zkr_queue_take_many(zkr_queue_t *queue, char **buffers,
+        int *buffer_lens, int max, int *count);
+
+/**
+ * \brief makes zkr_queue_take() use the cached child list of zkr_queue_take_many()
+ *
+ * \param queue the zookeeper queue
+ * \param enable nonzero to take elements as zkr_queue_take_many() does
+ */
+ZOOAPI void zkr_queue_set_consumer_mode(zkr_queue_t *queue, int enable);
+
 /**
  * \brief destroys a zookeeper queue structure 
  *
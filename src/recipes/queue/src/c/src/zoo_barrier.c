@@ -0,0 +1,479 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef DLL_EXPORT
+#define USE_STATIC_LIB
+#endif
+
+#if defined(__CYGWIN__)
+#define USE_IPV6
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <zookeeper_log.h>
+#include <limits.h>
+#include <zoo_barrier.h>
+
+/*
+ * Entering and leaving each run as one phase, from the completions of
+ * asynchronous requests:
+ *
+ *   JOINING        the watch on the phase's signal node and the create of our
+ *                  sequential node, sent together
+ *   CREATE_PARENT  create the directory of the nodes, which was missing
+ *   COUNTING       list the nodes, since ours may be the last; also finds our
+ *                  node if we lost the answer to its create
+ *   RELEASING      create the signal node, which fires everyone's watch
+ *   WAITING        wait for the signal node
+ *
+ * Entering uses w- nodes under the barrier's path and "ready" as the signal;
+ * leaving d- nodes under "ready" and "done". Sequence numbers count the
+ * creates under a parent, and nothing is deleted under either directory while
+ * its phase lasts, so a node numbered size - 1 or more may be the last one.
+ * The watch is registered before our node exists, so whoever creates the
+ * signal, everyone has a watch on it by then.
+ *
+ * The steps run with pmutex held and return ZOK once the phase is passed, a
+ * zookeeper error if it failed, or BARRIER_CONTINUE.
+ */
+
+enum barrier_state {
+    BARRIER_IDLE = 0, BARRIER_JOINING, BARRIER_CREATE_PARENT, BARRIER_COUNTING,
+    BARRIER_RELEASING, BARRIER_WAITING, BARRIER_ENTERED
+};
+
+#define BARRIER_ENTER 0
+#define BARRIER_LEAVE 1
+#define BARRIER_RETRIES 3
+#define BARRIER_PREFIX_LEN 48
+/* returned by a step that has issued the next request; not a completion code */
+#define BARRIER_CONTINUE INT_MAX
+
+static const char *barrier_prefixes[] = {"w-", "d-"};
+
+static int barrier_create(zkr_barrier_t *barrier);
+
+static char *concat_path(const char *path, const char *node_name){
+    int len = strlen(path) + strlen(node_name) + 2;
+    char *buffer = (char *) malloc(len);
+    snprintf(buffer, len, "%s/%s", path, node_name);
+    return buffer;
+}
+
+ZOOAPI int zkr_barrier_init(zkr_barrier_t *barrier, zhandle_t* zh, char* path,
+        struct ACL_vector *acl, int size){
+    barrier->zh = zh;
+    barrier->path = path;
+    barrier->acl = acl;
+    barrier->size = size;
+    barrier->ready_path = concat_path(path, "ready");
+    barrier->done_path = concat_path(path, "done");
+    barrier->node_name = NULL;
+    pthread_mutex_init(&(barrier->pmutex), NULL);
+    pthread_cond_init(&(barrier->cond), NULL);
+    barrier->phase = BARRIER_ENTER;
+    barrier->state = BARRIER_IDLE;
+    barrier->retries = 0;
+    barrier->result = ZOK;
+    barrier->completion = NULL;
+    barrier->context = NULL;
+    barrier->requests = 0;
+    return 0;
+}
+
+/* the directory of the phase's nodes */
+static const char *phase_dir(zkr_barrier_t *barrier){
+    return barrier->phase == BARRIER_ENTER ? barrier->path : barrier->ready_path;
+}
+
+/* the node whose creation ends the phase */
+static const char *phase_signal(zkr_barrier_t *barrier){
+    return barrier->phase == BARRIER_ENTER ? barrier->ready_path : barrier->done_path;
+}
+
+/* names our node after the session and the barrier, so that we can find it
+ * again after a connection loss */
+static void barrier_prefix(zkr_barrier_t *barrier, char *prefix, int len){
+    int64_t session = zoo_client_id(barrier->zh)->client_id;
+#if defined(__x86_64__)
+    snprintf(prefix, len, "%s%016lx-%lx-", barrier_prefixes[barrier->phase],
+             session, (unsigned long) barrier);
+#else
+    snprintf(prefix, len, "%s%016llx-%lx-", barrier_prefixes[barrier->phase],
+             session, (unsigned long) barrier);
+#endif
+}
+
+static int barrier_waiting(zkr_barrier_t *barrier){
+    return barrier->state != BARRIER_IDLE && barrier->state != BARRIER_ENTERED;
+}
+
+static void barrier_abandon_completion(int rc, const void *data){
+    if(rc != ZOK && rc != ZNONODE){
+        LOG_WARN(("could not delete a barrier node: %s", zerror(rc)));
+    }
+}
+
+/* deletes our node under the barrier's path */
+static void barrier_delete_node(zkr_barrier_t *barrier){
+    char *node_path = concat_path(barrier->path, barrier->node_name);
+    barrier->requests++;
+    zoo_adelete(barrier->zh, node_path, -1, barrier_abandon_completion, NULL);
+    free(node_path);
+    free(barrier->node_name);
+    barrier->node_name = NULL;
+}
+
+static int barrier_pass(zkr_barrier_t *barrier){
+    barrier->state = barrier->phase == BARRIER_ENTER ? BARRIER_ENTERED : BARRIER_IDLE;
+    barrier->result = ZOK;
+    pthread_cond_broadcast(&(barrier->cond));
+    return ZOK;
+}
+
+static int barrier_fail(zkr_barrier_t *barrier, int rc){
+    LOG_WARN(("could not %s the barrier %s: %s",
+              barrier->phase == BARRIER_ENTER ? "enter" : "leave",
+              barrier->path, zerror(rc)));
+    /* a worker that can't enter must not count as arrived; one that can't
+     * leave has left its node under "ready" to the others' count */
+    if(barrier->phase == BARRIER_ENTER && barrier->node_name != NULL){
+        barrier_delete_node(barrier);
+    }
+    barrier->state = BARRIER_IDLE;
+    barrier->result = rc;
+    pthread_cond_broadcast(&(barrier->cond));
+    return rc;
+}
+
+/* repeats the step after a connection loss, if it may */
+static int barrier_retry(zkr_barrier_t *barrier, int rc){
+    if((rc == ZCONNECTIONLOSS || rc == ZOPERATIONTIMEOUT)
+            && barrier->retries < BARRIER_RETRIES){
+        LOG_DEBUG(("connection loss on the barrier, retrying"));
+        barrier->retries++;
+        return 1;
+    }
+    return 0;
+}
+
+/* releases pmutex and tells the worker how the step went */
+static void barrier_unlock_notify(zkr_barrier_t *barrier, int ret){
+    zkr_barrier_completion_t completion = barrier->completion;
+    const void *context = barrier->context;
+    pthread_mutex_unlock(&(barrier->pmutex));
+    if(ret != BARRIER_CONTINUE && completion != NULL){
+        completion(ret, context);
+    }
+}
+
+static void barrier_watcher(zhandle_t *zh, int type, int state, const char *path,
+        void *watcherCtx){
+    zkr_barrier_t *barrier = (zkr_barrier_t *) watcherCtx;
+    int ret = BARRIER_CONTINUE;
+    if(type == ZOO_SESSION_EVENT && state != ZOO_EXPIRED_SESSION_STATE){
+        return;
+    }
+    pthread_mutex_lock(&(barrier->pmutex));
+    if(barrier_waiting(barrier)){
+        if(type == ZOO_SESSION_EVENT){
+            ret = barrier_fail(barrier, ZSESSIONEXPIRED);
+        }else if(strcmp(path, phase_signal(barrier)) == 0){
+            ret = barrier_pass(barrier);
+        }
+    }
+    barrier_unlock_notify(barrier, ret);
+}
+
+static int barrier_watch(zkr_barrier_t *barrier);
+
+static void barrier_exists_completion(int rc, const struct Stat *stat,
+        const void *data){
+    zkr_barrier_t *barrier = (zkr_barrier_t *) data;
+    int ret = BARRIER_CONTINUE;
+    pthread_mutex_lock(&(barrier->pmutex));
+    if(barrier_waiting(barrier)){
+        if(rc == ZOK){
+            /* released before we arrived */
+            ret = barrier_pass(barrier);
+        }else if(rc != ZNONODE){
+            ret = barrier_retry(barrier, rc) ? barrier_watch(barrier)
+                                             : barrier_fail(barrier, rc);
+        }
+    }
+    barrier_unlock_notify(barrier, ret);
+}
+
+static int barrier_watch(zkr_barrier_t *barrier){
+    int rc;
+    barrier->requests++;
+    rc = zoo_awexists(barrier->zh, phase_signal(barrier), barrier_watcher, barrier,
+            barrier_exists_completion, barrier);
+    return rc == ZOK ? BARRIER_CONTINUE : barrier_fail(barrier, rc);
+}
+
+static void barrier_release_completion(int rc, const char *value, const void *data);
+
+static int barrier_release(zkr_barrier_t *barrier){
+    int rc;
+    barrier->state = BARRIER_RELEASING;
+    barrier->requests++;
+    rc = zoo_acreate(barrier->zh, phase_signal(barrier), NULL, 0, barrier->acl, 0,
+            barrier_release_completion, barrier);
+    return rc == ZOK ? BARRIER_CONTINUE : barrier_fail(barrier, rc);
+}
+
+static void barrier_release_completion(int rc, const char *value, const void *data){
+    zkr_barrier_t *barrier = (zkr_barrier_t *) data;
+    int ret = BARRIER_CONTINUE;
+    pthread_mutex_lock(&(barrier->pmutex));
+    if(barrier->state == BARRIER_RELEASING){
+        if(rc == ZOK || rc == ZNODEEXISTS){
+            ret = barrier_pass(barrier);
+        }else{
+            ret = barrier_retry(barrier, rc) ? barrier_release(barrier)
+                                             : barrier_fail(barrier, rc);
+        }
+    }
+    barrier_unlock_notify(barrier, ret);
+}
+
+static int barrier_count(zkr_barrier_t *barrier);
+
+/* counts the phase's nodes, finding ours first if its name is unknown */
+static void barrier_children_completion(int rc, const struct String_vector *strings,
+        const void *data){
+    zkr_barrier_t *barrier = (zkr_barrier_t *) data;
+    const char *kind = barrier_prefixes[barrier->phase];
+    int ret = BARRIER_CONTINUE;
+    int i, count = 0;
+    pthread_mutex_lock(&(barrier->pmutex));
+    if(barrier->state != BARRIER_COUNTING){
+        barrier_unlock_notify(barrier, ret);
+        return;
+    }
+    if(rc != ZOK){
+        ret = barrier_retry(barrier, rc) ? barrier_count(barrier)
+                                         : barrier_fail(barrier, rc);
+        barrier_unlock_notify(barrier, ret);
+        return;
+    }
+    barrier->retries = 0;
+    if(barrier->node_name == NULL){
+        char prefix[BARRIER_PREFIX_LEN];
+        barrier_prefix(barrier, prefix, sizeof(prefix));
+        for(i=0; i < strings->count; i++){
+            if(strncmp(strings->data[i], prefix, strlen(prefix)) == 0){
+                barrier->node_name = strdup(strings->data[i]);
+                break;
+            }
+        }
+        if(barrier->node_name == NULL){
+            barrier_unlock_notify(barrier, barrier_create(barrier));
+            return;
+        }
+    }
+    for(i=0; i < strings->count; i++){
+        if(strncmp(strings->data[i], kind, strlen(kind)) == 0){
+            count++;
+        }
+    }
+    if(count >= barrier->size){
+        ret = barrier_release(barrier);
+    }else{
+        barrier->state = BARRIER_WAITING;
+    }
+    barrier_unlock_notify(barrier, ret);
+}
+
+static int barrier_count(zkr_barrier_t *barrier){
+    int rc;
+    barrier->state = BARRIER_COUNTING;
+    barrier->requests++;
+    rc = zoo_aget_children(barrier->zh, phase_dir(barrier), 0,
+            barrier_children_completion, barrier);
+    return rc == ZOK ? BARRIER_CONTINUE : barrier_fail(barrier, rc);
+}
+
+static void barrier_parent_completion(int rc, const char *value, const void *data){
+    zkr_barrier_t *barrier = (zkr_barrier_t *) data;
+    int ret = BARRIER_CONTINUE;
+    pthread_mutex_lock(&(barrier->pmutex));
+    if(barrier->state == BARRIER_CREATE_PARENT){
+        if(rc == ZOK || rc == ZNODEEXISTS || barrier_retry(barrier, rc)){
+            ret = barrier_create(barrier);
+        }else{
+            ret = barrier_fail(barrier, rc);
+        }
+    }
+    barrier_unlock_notify(barrier, ret);
+}
+
+/* acts on the create of our node in the given phase */
+static void barrier_created(zkr_barrier_t *barrier, int phase, int rc,
+        const char *value){
+    int ret = BARRIER_CONTINUE;
+    pthread_mutex_lock(&(barrier->pmutex));
+    if(phase != barrier->phase || barrier->state == BARRIER_IDLE){
+        /* the phase ended while the create was in flight */
+        if(rc == ZOK && phase == BARRIER_ENTER){
+            barrier->requests++;
+            zoo_adelete(barrier->zh, value, -1, barrier_abandon_completion, NULL);
+        }
+    }else if(rc == ZOK){
+        if(barrier->node_name != NULL){
+            free(barrier->node_name);
+        }
+        barrier->node_name = strdup(strrchr(value, '/') + 1);
+        if(barrier->state == BARRIER_JOINING){
+            long seq = atol(strrchr(value, '-') + 1);
+            barrier->retries = 0;
+            if(seq + 1 >= barrier->size){
+                ret = barrier_count(barrier);
+            }else{
+                barrier->state = BARRIER_WAITING;
+            }
+        }
+    }else if(barrier->state == BARRIER_JOINING){
+        if(rc == ZNONODE){
+            barrier->state = BARRIER_CREATE_PARENT;
+            barrier->requests++;
+            rc = zoo_acreate(barrier->zh, phase_dir(barrier), NULL, 0, barrier->acl,
+                    0, barrier_parent_completion, barrier);
+            ret = rc == ZOK ? BARRIER_CONTINUE : barrier_fail(barrier, rc);
+        }else if(barrier_retry(barrier, rc)){
+            /* we can't tell if the node was made: look for it */
+            ret = barrier_count(barrier);
+        }else{
+            ret = barrier_fail(barrier, rc);
+        }
+    }
+    barrier_unlock_notify(barrier, ret);
+}
+
+static void barrier_enter_completion(int rc, const char *value, const void *data){
+    barrier_created((zkr_barrier_t *) data, BARRIER_ENTER, rc, value);
+}
+
+static void barrier_leave_completion(int rc, const char *value, const void *data){
+    barrier_created((zkr_barrier_t *) data, BARRIER_LEAVE, rc, value);
+}
+
+static int barrier_create(zkr_barrier_t *barrier){
+    char prefix[BARRIER_PREFIX_LEN];
+    char *node_path;
+    int rc;
+    barrier_prefix(barrier, prefix, sizeof(prefix));
+    node_path = concat_path(phase_dir(barrier), prefix);
+    barrier->state = BARRIER_JOINING;
+    barrier->requests++;
+    rc = zoo_acreate(barrier->zh, node_path, NULL, 0, barrier->acl,
+            ZOO_EPHEMERAL|ZOO_SEQUENCE,
+            barrier->phase == BARRIER_ENTER ? barrier_enter_completion
+                                            : barrier_leave_completion,
+            barrier);
+    free(node_path);
+    return rc == ZOK ? BARRIER_CONTINUE : barrier_fail(barrier, rc);
+}
+
+/* sends the watch on the signal and, behind it, the create of our node */
+static int barrier_join(zkr_barrier_t *barrier, int phase,
+        zkr_barrier_completion_t completion, const void *context){
+    int ret;
+    barrier->phase = phase;
+    barrier->completion = completion;
+    barrier->context = context;
+    barrier->retries = 0;
+    barrier->state = BARRIER_JOINING;
+    ret = barrier_watch(barrier);
+    if(ret == BARRIER_CONTINUE){
+        ret = barrier_create(barrier);
+    }
+    return ret == BARRIER_CONTINUE ? ZOK : ret;
+}
+
+ZOOAPI int zkr_barrier_aenter(zkr_barrier_t *barrier,
+        zkr_barrier_completion_t completion, const void *context){
+    int rc = ZSYSTEMERROR;
+    pthread_mutex_lock(&(barrier->pmutex));
+    if(barrier->state == BARRIER_IDLE){
+        if(barrier->node_name != NULL){
+            free(barrier->node_name);
+            barrier->node_name = NULL;
+        }
+        rc = barrier_join(barrier, BARRIER_ENTER, completion, context);
+    }
+    pthread_mutex_unlock(&(barrier->pmutex));
+    return rc;
+}
+
+ZOOAPI int zkr_barrier_enter(zkr_barrier_t *barrier){
+    int rc = zkr_barrier_aenter(barrier, NULL, NULL);
+    if(rc != ZOK){
+        return rc;
+    }
+    pthread_mutex_lock(&(barrier->pmutex));
+    while(barrier->state != BARRIER_ENTERED && barrier->state != BARRIER_IDLE){
+        pthread_cond_wait(&(barrier->cond), &(barrier->pmutex));
+    }
+    rc = barrier->state == BARRIER_ENTERED ? ZOK : barrier->result;
+    pthread_mutex_unlock(&(barrier->pmutex));
+    return rc;
+}
+
+ZOOAPI int zkr_barrier_aleave(zkr_barrier_t *barrier,
+        zkr_barrier_completion_t completion, const void *context){
+    int rc = ZSYSTEMERROR;
+    pthread_mutex_lock(&(barrier->pmutex));
+    if(barrier->state == BARRIER_ENTERED){
+        /* our w- node goes first; it is not counted any more, so the delete
+         * needn't be waited for */
+        if(barrier->node_name != NULL){
+            barrier_delete_node(barrier);
+        }
+        rc = barrier_join(barrier, BARRIER_LEAVE, completion, context);
+    }
+    pthread_mutex_unlock(&(barrier->pmutex));
+    return rc;
+}
+
+ZOOAPI int zkr_barrier_leave(zkr_barrier_t *barrier){
+    int rc = zkr_barrier_aleave(barrier, NULL, NULL);
+    if(rc != ZOK){
+        return rc;
+    }
+    pthread_mutex_lock(&(barrier->pmutex));
+    while(barrier->state != BARRIER_IDLE){
+        pthread_cond_wait(&(barrier->cond), &(barrier->pmutex));
+    }
+    rc = barrier->result;
+    pthread_mutex_unlock(&(barrier->pmutex));
+    return rc;
+}
+
+ZOOAPI void zkr_barrier_destroy(zkr_barrier_t *barrier){
+    if(barrier->node_name != NULL){
+        free(barrier->node_name);
+    }
+    free(barrier->ready_path);
+    free(barrier->done_path);
+    pthread_mutex_destroy(&(barrier->pmutex));
+    pthread_cond_destroy(&(barrier->cond));
+}
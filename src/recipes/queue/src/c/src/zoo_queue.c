@@ -94,6 +94,12 @@ ZOOAPI int zkr_queue_init(zkr_queue_t *queue, zhandle_t* zh, char* path, struct
     queue->node_name_length = strlen(queue->node_name);
     queue->cached_create_path = NULL;
     queue->acl = acl;
+    queue->root_requested = 0;
+    queue->consumer = 0;
+    queue->children.count = 0;
+    queue->children.data = NULL;
+    queue->next_child = 0;
+    queue->children_latch = NULL;
     pthread_mutex_init(&(queue->pmutex), NULL);
     zkr_queue_cache_create_path(queue);
     return 0;
@@ -129,6 +135,136 @@ ZOOAPI int zkr_queue_offer(zkr_queue_t *queue, const char *data, int buffer_len)
 }
 
 
+/**
+ * The asynchronous offers rely on the server applying the requests of a
+ * session in the order they were sent, so the sequence numbers of one
+ * producer's elements follow the order of its offers.
+ */
+
+#define OFFER_BATCH_MAX_OPS 1000
+#define OFFER_BATCH_MAX_BYTES (512*1024)
+/* "/qn-" and a ten digit sequence number */
+#define OFFER_NAME_EXTRA 16
+
+struct offer {
+    zkr_queue_offer_completion_t completion;
+    const void *context;
+};
+
+struct offer_batch {
+    struct offer offer;
+    int count;
+    int name_length;
+    zoo_op_result_t *results;
+    char *names;
+};
+
+static void root_create_completion(int rc, const char *value, const void *data){
+}
+
+/* sends a create of the root ahead of the first asynchronous offer */
+static int request_queue_root(zkr_queue_t *queue){
+    int rc;
+    if(queue->root_requested){
+        return ZOK;
+    }
+    rc = zoo_acreate(queue->zh, queue->path, NULL, 0, queue->acl, 0, root_create_completion, NULL);
+    if(rc == ZOK){
+        queue->root_requested = 1;
+    }
+    return rc;
+}
+
+static void offer_completion(int rc, const char *value, const void *data){
+    struct offer *offer = (struct offer *) data;
+    offer->completion(rc, rc == ZOK ? value : NULL, offer->context);
+    free(offer);
+}
+
+ZOOAPI int zkr_queue_aoffer(zkr_queue_t *queue, const char *data, int buffer_len,
+        zkr_queue_offer_completion_t completion, const void *context){
+    struct offer *offer;
+    int rc = request_queue_root(queue);
+    if(rc != ZOK){
+        return rc;
+    }
+    offer = (struct offer *) malloc(sizeof(struct offer));
+    offer->completion = completion;
+    offer->context = context;
+    rc = zoo_acreate(queue->zh, queue->cached_create_path, data, buffer_len, queue->acl, ZOO_SEQUENCE, offer_completion, offer);
+    if(rc != ZOK){
+        free(offer);
+    }
+    return rc;
+}
+
+static void offer_batch_completion(int rc, const void *data){
+    struct offer_batch *batch = (struct offer_batch *) data;
+    int i;
+    for(i=0; i < batch->count; i++){
+        int element_rc = rc == ZOK ? batch->results[i].err : rc;
+        /*a failed multi reports ZRUNTIMEINCONSISTENCY for the operations that weren't at fault*/
+        if(rc != ZOK && batch->results[i].err != ZOK && batch->results[i].err != ZRUNTIMEINCONSISTENCY){
+            element_rc = batch->results[i].err;
+        }
+        batch->offer.completion(element_rc, element_rc == ZOK ? batch->results[i].value : NULL, batch->offer.context);
+    }
+    free(batch->names);
+    free(batch->results);
+    free(batch);
+}
+
+/* sends the count elements from data as one multi */
+static int send_offer_batch(zkr_queue_t *queue, const char **data,
+        const int *buffer_lens, int count,
+        zkr_queue_offer_completion_t completion, const void *context){
+    struct offer_batch *batch = (struct offer_batch *) malloc(sizeof(struct offer_batch));
+    zoo_op_t ops[count];
+    int i, rc;
+
+    batch->offer.completion = completion;
+    batch->offer.context = context;
+    batch->count = count;
+    batch->name_length = strlen(queue->cached_create_path) + OFFER_NAME_EXTRA;
+    batch->results = (zoo_op_result_t *) calloc(count, sizeof(zoo_op_result_t));
+    batch->names = (char *) malloc(count * batch->name_length);
+    for(i=0; i < count; i++){
+        zoo_create_op_init(&ops[i], queue->cached_create_path, data[i], buffer_lens[i], queue->acl,
+                ZOO_SEQUENCE, batch->names + i * batch->name_length, batch->name_length);
+    }
+    rc = zoo_amulti(queue->zh, count, ops, batch->results, offer_batch_completion, batch);
+    if(rc != ZOK){
+        free(batch->names);
+        free(batch->results);
+        free(batch);
+    }
+    return rc;
+}
+
+ZOOAPI int zkr_queue_aoffer_many(zkr_queue_t *queue, const char **data,
+        const int *buffer_lens, int count,
+        zkr_queue_offer_completion_t completion, const void *context){
+    int first = 0;
+    int rc = request_queue_root(queue);
+    while(rc == ZOK && first < count){
+        int n = 0, bytes = 0;
+        while(first + n < count && n < OFFER_BATCH_MAX_OPS
+                && (n == 0 || bytes + buffer_lens[first + n] <= OFFER_BATCH_MAX_BYTES)){
+            bytes += buffer_lens[first + n];
+            n++;
+        }
+        rc = send_offer_batch(queue, data + first, buffer_lens + first, n, completion, context);
+        if(rc == ZOK){
+            first += n;
+        }
+    }
+    for(; first < count; first++){
+        completion(rc, NULL, context);
+    }
+    return rc;
+}
+
+
 ZOOAPI int zkr_queue_element(zkr_queue_t *queue, char *buffer, int *buffer_len){
     int path_length = strlen(queue->path);
     for(;;){
@@ -362,8 +498,193 @@ static void take_watcher(zhandle_t *zh, int type, int state, const char *path, v
 
 
 
+/**
+ * A batch of elements being claimed by zkr_queue_take_many(). The get and the
+ * delete of each element are sent back to back, so the server answers the
+ * get before it applies the delete; the data is ours if the delete succeeds.
+ */
+
+struct claim {
+    struct claim_batch *batch;
+    char *data;
+    int data_len;
+    int get_rc;
+    int delete_rc;
+};
+
+struct claim_batch {
+    pthread_mutex_t mutex;
+    pthread_cond_t done;
+    int pending;
+};
+
+static void claim_done(struct claim_batch *batch){
+    pthread_mutex_lock(&(batch->mutex));
+    if(--batch->pending == 0){
+        pthread_cond_signal(&(batch->done));
+    }
+    pthread_mutex_unlock(&(batch->mutex));
+}
+
+static void claim_get_completion(int rc, const char *value, int value_len,
+        const struct Stat *stat, const void *data){
+    struct claim *claim = (struct claim *) data;
+    claim->get_rc = rc;
+    if(rc == ZOK && value_len > 0){
+        claim->data = (char *) malloc(value_len);
+        memcpy(claim->data, value, value_len);
+        claim->data_len = value_len;
+    }
+    claim_done(claim->batch);
+}
+
+static void claim_delete_completion(int rc, const void *data){
+    struct claim *claim = (struct claim *) data;
+    claim->delete_rc = rc;
+    claim_done(claim->batch);
+}
+
+/* claims the next n cached children, returns the number claimed */
+static int claim_children(zkr_queue_t *queue, int n, char **buffers,
+        int *buffer_lens, int *rc){
+    struct claim claims[n];
+    struct claim_batch batch;
+    int path_length = strlen(queue->path);
+    int i, count = 0;
+
+    pthread_mutex_init(&(batch.mutex), NULL);
+    pthread_cond_init(&(batch.done), NULL);
+    batch.pending = 2*n;
+    for(i=0; i < n; i++){
+        char *child_name = queue->children.data[queue->next_child + i];
+        int child_path_length = path_length + 1 + strlen(child_name) +1;
+        char child_path[child_path_length];
+        int get_rc, delete_rc;
+        concat_path_nodename_n(child_path, child_path_length, queue->path, child_name);
+        claims[i].batch = &batch;
+        claims[i].data = NULL;
+        claims[i].data_len = 0;
+        claims[i].get_rc = claims[i].delete_rc = ZOK;
+        get_rc = zoo_aget(queue->zh, child_path, 0, claim_get_completion, &claims[i]);
+        if(get_rc != ZOK){
+            /* without the read, deleting the element would lose it */
+            claims[i].get_rc = claims[i].delete_rc = get_rc;
+            claim_done(&batch);
+            claim_done(&batch);
+            continue;
+        }
+        delete_rc = zoo_adelete(queue->zh, child_path, -1, claim_delete_completion, &claims[i]);
+        if(delete_rc != ZOK){
+            claims[i].delete_rc = delete_rc;
+            claim_done(&batch);
+        }
+    }
+    pthread_mutex_lock(&(batch.mutex));
+    while(batch.pending > 0){
+        pthread_cond_wait(&(batch.done), &(batch.mutex));
+    }
+    pthread_mutex_unlock(&(batch.mutex));
+    pthread_mutex_destroy(&(batch.mutex));
+    pthread_cond_destroy(&(batch.done));
+    queue->next_child += n;
+
+    *rc = ZOK;
+    for(i=0; i < n; i++){
+        if(claims[i].delete_rc == ZOK && claims[i].get_rc == ZOK){
+            int len = claims[i].data_len < buffer_lens[count] ? claims[i].data_len : buffer_lens[count];
+            memcpy(buffers[count], claims[i].data, len);
+            buffer_lens[count] = len;
+            count++;
+        }else if(claims[i].delete_rc != ZNONODE && claims[i].delete_rc != ZOK){
+            *rc = claims[i].delete_rc;
+        }else if(claims[i].get_rc != ZNONODE && claims[i].get_rc != ZOK){
+            *rc = claims[i].get_rc;
+        }
+        free(claims[i].data);
+    }
+    return count;
+}
+
+/* fetches the children again and arms a watch for their next change */
+static int refresh_children(zkr_queue_t *queue){
+    for(;;){
+        struct String_vector stvector;
+        take_latch_t *take_latch = create_take_latch(queue);
+        int get_children_rc = zoo_wget_children(queue->zh, queue->path, take_watcher, take_latch, &stvector);
+        switch(get_children_rc){
+            int create_queue_rc;
+        case ZOK:
+            break;
+        case ZNONODE:
+            take_latch_destroy_synchronized(take_latch);
+            create_queue_rc = create_queue_root(queue);
+            switch(create_queue_rc){
+            case ZNODEEXISTS:
+            case ZOK:
+                continue;
+            default:
+                return create_queue_rc;
+            }
+        default:
+            take_latch_destroy_synchronized(take_latch);
+            return get_children_rc;
+        }
+        sort_children(&stvector);
+        free_String_vector(&(queue->children));
+        queue->children = stvector;
+        queue->next_child = 0;
+        queue->children_latch = take_latch;
+        return ZOK;
+    }
+}
+
+ZOOAPI int zkr_queue_take_many(zkr_queue_t *queue, char **buffers,
+        int *buffer_lens, int max, int *count){
+    *count = 0;
+    if(max <= 0){
+        return ZBADARGUMENTS;
+    }
+    for(;;){
+        int rc;
+        int remaining = queue->children.count - queue->next_child;
+        if(remaining > 0){
+            int n = remaining < max ? remaining : max;
+            *count = claim_children(queue, n, buffers, buffer_lens, &rc);
+            if(*count > 0){
+                return ZOK;
+            }
+            if(rc != ZOK){
+                return rc;
+            }
+            continue;
+        }
+        /*the list is used up: wait for a change if there hasn't been one*/
+        if(queue->children_latch != NULL){
+            take_latch_t *latch = (take_latch_t *) queue->children_latch;
+            queue->children_latch = NULL;
+            take_latch_waiter_await(latch);
+        }
+        rc = refresh_children(queue);
+        if(rc != ZOK){
+            return rc;
+        }
+    }
+}
+
+ZOOAPI void zkr_queue_set_consumer_mode(zkr_queue_t *queue, int enable){
+    queue->consumer = enable;
+}
+
 ZOOAPI int zkr_queue_take(zkr_queue_t *queue, char *buffer, int *buffer_len){
     int path_length = strlen(queue->path);
+    if(queue->consumer){
+        int count;
+        int rc = zkr_queue_take_many(queue, &buffer, buffer_len, 1, &count);
+        if(rc != ZOK){
+            *buffer_len = -1;
+        }
+        return rc;
+    }
 take_attempt:    
     for(;;){
         struct String_vector stvector;
@@ -435,6 +756,10 @@ take_attempt:
 }
 
 ZOOAPI void zkr_queue_destroy(zkr_queue_t *queue){
+    if(queue->children_latch != NULL){
+        take_latch_waiter_mark_unneeded((take_latch_t *) queue->children_latch);
+    }
+    free_String_vector(&(queue->children));
     pthread_mutex_destroy(&(queue->pmutex));
     if(queue->cached_create_path != NULL){
         free(queue->cached_create_path);
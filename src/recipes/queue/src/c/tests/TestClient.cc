@@ -29,9 +29,12 @@ using namespace std;
 
 #include <cstring>
 #include <list>
+#include <string>
+#include <vector>
 
 #include <zookeeper.h>
 #include <zoo_queue.h>
+#include <zoo_barrier.h>
 
 static void yield(zhandle_t *zh, int i)
 {
@@ -124,6 +127,11 @@ extern "C" {
         }
     }
     
+    void *enter_thread_barrier(void *barrier_handle){
+        zkr_barrier_t *barrier = (zkr_barrier_t *) barrier_handle;
+        return (void *)(long) zkr_barrier_enter(barrier);
+    }
+
     int valid_test_string(void *result){
         char *result_string = (char *) result;
         return !strncmp(result_string, thread_test_string, strlen(thread_test_string));
@@ -147,6 +155,21 @@ class Zookeeper_queuetest : public CPPUNIT_NS::TestFixture
     CPPUNIT_TEST(testOfferTake4);
     CPPUNIT_TEST(testOfferTake5);
     CPPUNIT_TEST(testOfferTake6);
+    CPPUNIT_TEST(testOfferTakeMany1);
+    CPPUNIT_TEST(testOfferTakeMany2);
+    CPPUNIT_TEST(testOfferTakeMany3);
+    CPPUNIT_TEST(testTakeManyTwoConsumers);
+    CPPUNIT_TEST(testConsumerModeTake);
+    CPPUNIT_TEST(testTakeManyThreaded);
+    CPPUNIT_TEST(testAOfferTake1);
+    CPPUNIT_TEST(testAOfferTake2);
+    CPPUNIT_TEST(testAOfferManyTake1);
+    CPPUNIT_TEST(testAOfferManyTake2);
+    CPPUNIT_TEST(testAOfferManyTake3);
+    CPPUNIT_TEST(testAOfferMixed);
+    CPPUNIT_TEST(testBarrierEnter);
+    CPPUNIT_TEST(testABarrierEnter);
+    CPPUNIT_TEST(testDoubleBarrier);
     CPPUNIT_TEST_SUITE_END();
 
     static void watcher(zhandle_t *, int type, int state, const char *path,void*v){
@@ -390,6 +413,461 @@ public:
         create_n_take_m((char *)"/testOfferTake6", 12,11);
     }
 
+    void create_n_take_many_batch(char *path, int n, int batch){
+        int num_clients = 2;
+        watchctx_t ctxs[num_clients];
+        zhandle_t *zoohandles[num_clients];
+        zkr_queue_t queues[num_clients];
+
+        initializeQueuesAndHandles(num_clients, zoohandles, ctxs, queues, path);
+
+        int i;
+        int max_digits = sizeof(int)*3;
+        const char *test_string = "Hello World!";
+        int buffer_length = strlen(test_string) + max_digits + 1;
+        char correct_buffer[buffer_length];
+        char receive_buffers[batch][buffer_length];
+        char *buffers[batch];
+        int buffer_lens[batch];
+
+        for(i = 0; i < n; i++){
+            snprintf(correct_buffer, buffer_length, "%s%d", test_string,i);
+            int offer_rc = zkr_queue_offer(&queues[0], correct_buffer, buffer_length);
+            CPPUNIT_ASSERT(offer_rc == ZOK);
+        }
+        int taken = 0;
+        while(taken < n){
+            int j, count;
+            for(j = 0; j < batch; j++){
+                buffers[j] = receive_buffers[j];
+                buffer_lens[j] = buffer_length;
+            }
+            int take_rc = zkr_queue_take_many(&queues[1], buffers, buffer_lens, batch, &count);
+            CPPUNIT_ASSERT(take_rc == ZOK);
+            CPPUNIT_ASSERT(count == (n - taken < batch ? n - taken : batch));
+            for(j = 0; j < count; j++, taken++){
+                snprintf(correct_buffer, buffer_length, "%s%d", test_string, taken);
+                CPPUNIT_ASSERT(buffer_lens[j] == buffer_length);
+                CPPUNIT_ASSERT(strncmp(correct_buffer,receive_buffers[j], buffer_length)==0);
+            }
+        }
+        int receive_buffer_length = buffer_length;
+        CPPUNIT_ASSERT(zkr_queue_remove(&queues[0], receive_buffers[0], &receive_buffer_length) == ZOK);
+        CPPUNIT_ASSERT(receive_buffer_length == -1);
+
+        cleanUpQueues(num_clients,queues);
+    }
+
+    void testOfferTakeMany1(){
+        create_n_take_many_batch((char *)"/testOfferTakeMany1", 1, 1);
+    }
+
+    void testOfferTakeMany2(){
+        create_n_take_many_batch((char *)"/testOfferTakeMany2", 10, 4);
+    }
+
+    void testOfferTakeMany3(){
+        create_n_take_many_batch((char *)"/testOfferTakeMany3", 25, 25);
+    }
+
+    void testTakeManyTwoConsumers(){
+        int num_clients = 3;
+        watchctx_t ctxs[num_clients];
+        zhandle_t *zoohandles[num_clients];
+        zkr_queue_t queues[num_clients];
+        char *path=(char *)"/testTakeManyTwoConsumers";
+
+        initializeQueuesAndHandles(num_clients, zoohandles, ctxs, queues, path);
+
+        int i, n = 20, batch = 3;
+        char buffer[16];
+        char receive_buffers[batch][16];
+        char *buffers[batch];
+        int buffer_lens[batch];
+        bool seen[n];
+        for(i = 0; i < n; i++){
+            snprintf(buffer, sizeof(buffer), "%d", i);
+            CPPUNIT_ASSERT(zkr_queue_offer(&queues[0], buffer, sizeof(buffer)) == ZOK);
+            seen[i] = false;
+        }
+        // both consumers cache the same children and claim from them in turn
+        int taken = 0;
+        for(i = 0; taken < n; i++){
+            int j, count;
+            for(j = 0; j < batch; j++){
+                buffers[j] = receive_buffers[j];
+                buffer_lens[j] = sizeof(receive_buffers[j]);
+            }
+            int take_rc = zkr_queue_take_many(&queues[1 + i % 2], buffers, buffer_lens, batch, &count);
+            CPPUNIT_ASSERT(take_rc == ZOK);
+            CPPUNIT_ASSERT(count > 0);
+            for(j = 0; j < count; j++){
+                int element = atoi(receive_buffers[j]);
+                CPPUNIT_ASSERT(element >= 0 && element < n);
+                CPPUNIT_ASSERT(!seen[element]);
+                seen[element] = true;
+                taken++;
+            }
+        }
+        CPPUNIT_ASSERT(taken == n);
+
+        cleanUpQueues(num_clients,queues);
+    }
+
+    void testConsumerModeTake(){
+        zkr_queue_t *queue;
+        int num_clients = 1;
+        watchctx_t ctxs[num_clients];
+        zhandle_t *zoohandles[num_clients];
+        zkr_queue_t queues[num_clients];
+        char *path=(char *)"/testConsumerModeTake";
+
+        initializeQueuesAndHandles(num_clients, zoohandles, ctxs, queues, path);
+        queue = &queues[0];
+        zkr_queue_set_consumer_mode(queue, 1);
+
+        int i, n = 5;
+        char buffer[16], receive_buffer[16];
+        for(i = 0; i < n; i++){
+            snprintf(buffer, sizeof(buffer), "%d", i);
+            CPPUNIT_ASSERT(zkr_queue_offer(queue, buffer, sizeof(buffer)) == ZOK);
+        }
+        for(i = 0; i < n; i++){
+            int receive_buffer_length = sizeof(receive_buffer);
+            snprintf(buffer, sizeof(buffer), "%d", i);
+            CPPUNIT_ASSERT(zkr_queue_take(queue, receive_buffer, &receive_buffer_length) == ZOK);
+            CPPUNIT_ASSERT(receive_buffer_length == sizeof(receive_buffer));
+            CPPUNIT_ASSERT(strcmp(buffer, receive_buffer) == 0);
+        }
+        // an element offered after the cached list was used up is seen too
+        CPPUNIT_ASSERT(zkr_queue_offer(queue, "last", 5) == ZOK);
+        int receive_buffer_length = sizeof(receive_buffer);
+        CPPUNIT_ASSERT(zkr_queue_take(queue, receive_buffer, &receive_buffer_length) == ZOK);
+        CPPUNIT_ASSERT(strcmp("last", receive_buffer) == 0);
+
+        cleanUpQueues(num_clients,queues);
+    }
+
+    void testTakeManyThreaded(){
+        int num_clients = 1;
+        watchctx_t ctxs[num_clients];
+        zhandle_t *zoohandles[num_clients];
+        zkr_queue_t queues[num_clients];
+        char *path=(char *)"/testTakeManyThreaded";
+
+        initializeQueuesAndHandles(num_clients, zoohandles, ctxs, queues, path);
+        zkr_queue_set_consumer_mode(&queues[0], 1);
+        pthread_t take_thread;
+
+        pthread_create(&take_thread, NULL, take_thread_shared_queue, (void *) &queues[0]);
+
+        usleep(1000);
+
+        pthread_t offer_thread;
+        pthread_create(&offer_thread, NULL, offer_thread_shared_queue, (void *) &queues[0]);
+        pthread_join(offer_thread, NULL);
+
+        void *take_thread_result;
+        pthread_join(take_thread, &take_thread_result);
+        CPPUNIT_ASSERT(take_thread_result != NULL);
+        CPPUNIT_ASSERT(valid_test_string(take_thread_result));
+        free(take_thread_result);
+
+        cleanUpQueues(num_clients,queues);
+    }
+
+    struct offer_results {
+        pthread_mutex_t mutex;
+        int count;
+        int failed;
+        std::vector<std::string> names;
+    };
+
+    static void offer_completion(int rc, const char *name, const void *data){
+        offer_results *results = (offer_results *) data;
+        pthread_mutex_lock(&results->mutex);
+        results->count++;
+        if(rc == ZOK){
+            results->names.push_back(name);
+        }else{
+            results->failed++;
+        }
+        pthread_mutex_unlock(&results->mutex);
+    }
+
+    bool waitForOffers(offer_results *results, int n){
+        time_t expires = time(0) + 10;
+        for(;;){
+            pthread_mutex_lock(&results->mutex);
+            int count = results->count;
+            pthread_mutex_unlock(&results->mutex);
+            if(count >= n){
+                return true;
+            }
+            if(time(0) >= expires){
+                return false;
+            }
+            usleep(1000);
+        }
+    }
+
+    /* offers n elements asynchronously, batch at a time (0 for zkr_queue_aoffer()), then takes them in order */
+    void create_n_aoffer_take(char *path, int n, int batch){
+        int num_clients = 2;
+        watchctx_t ctxs[num_clients];
+        zhandle_t *zoohandles[num_clients];
+        zkr_queue_t queues[num_clients];
+
+        initializeQueuesAndHandles(num_clients, zoohandles, ctxs, queues, path);
+
+        int i;
+        int max_digits = sizeof(int)*3;
+        const char *test_string = "Hello World!";
+        int buffer_length = strlen(test_string) + max_digits + 1;
+        std::vector<std::string> elements(n);
+        std::vector<const char *> data(n);
+        std::vector<int> lens(n, buffer_length);
+        char correct_buffer[buffer_length];
+        char receive_buffer[buffer_length];
+        offer_results results;
+        pthread_mutex_init(&results.mutex, NULL);
+        results.count = 0;
+        results.failed = 0;
+
+        for(i = 0; i < n; i++){
+            snprintf(correct_buffer, buffer_length, "%s%d", test_string, i);
+            elements[i].assign(correct_buffer, buffer_length);
+            data[i] = elements[i].data();
+        }
+        for(i = 0; i < n; i += (batch == 0 ? 1 : batch)){
+            int offer_rc;
+            if(batch == 0){
+                offer_rc = zkr_queue_aoffer(&queues[0], data[i], lens[i], offer_completion, &results);
+            }else{
+                int count = n - i < batch ? n - i : batch;
+                offer_rc = zkr_queue_aoffer_many(&queues[0], &data[i], &lens[i], count, offer_completion, &results);
+            }
+            CPPUNIT_ASSERT(offer_rc == ZOK);
+        }
+        CPPUNIT_ASSERT(waitForOffers(&results, n));
+        CPPUNIT_ASSERT_EQUAL(0, results.failed);
+        CPPUNIT_ASSERT_EQUAL(n, (int) results.names.size());
+        for(i = 1; i < n; i++){
+            CPPUNIT_ASSERT(results.names[i-1] < results.names[i]);
+        }
+        for(i = 0; i < n; i++){
+            int receive_buffer_length = buffer_length;
+            snprintf(correct_buffer, buffer_length, "%s%d", test_string, i);
+            CPPUNIT_ASSERT(zkr_queue_take(&queues[1], receive_buffer, &receive_buffer_length) == ZOK);
+            CPPUNIT_ASSERT(receive_buffer_length == buffer_length);
+            CPPUNIT_ASSERT(strncmp(correct_buffer, receive_buffer, buffer_length) == 0);
+        }
+        pthread_mutex_destroy(&results.mutex);
+
+        cleanUpQueues(num_clients,queues);
+    }
+
+    void testAOfferTake1(){
+        create_n_aoffer_take((char *)"/testAOfferTake1", 1, 0);
+    }
+
+    void testAOfferTake2(){
+        create_n_aoffer_take((char *)"/testAOfferTake2", 50, 0);
+    }
+
+    void testAOfferManyTake1(){
+        create_n_aoffer_take((char *)"/testAOfferManyTake1", 1, 1);
+    }
+
+    void testAOfferManyTake2(){
+        create_n_aoffer_take((char *)"/testAOfferManyTake2", 50, 8);
+    }
+
+    /* more elements than fit in one multi */
+    void testAOfferManyTake3(){
+        create_n_aoffer_take((char *)"/testAOfferManyTake3", 2500, 2500);
+    }
+
+    void testAOfferMixed(){
+        int num_clients = 1;
+        watchctx_t ctxs[num_clients];
+        zhandle_t *zoohandles[num_clients];
+        zkr_queue_t queues[num_clients];
+        char *path=(char *)"/testAOfferMixed";
+
+        initializeQueuesAndHandles(num_clients, zoohandles, ctxs, queues, path);
+
+        const char *data[] = {"a", "b", "c", "d", "e", "f"};
+        int lens[] = {2, 2, 2, 2, 2, 2};
+        offer_results results;
+        pthread_mutex_init(&results.mutex, NULL);
+        results.count = 0;
+        results.failed = 0;
+
+        CPPUNIT_ASSERT(zkr_queue_aoffer(&queues[0], data[0], lens[0], offer_completion, &results) == ZOK);
+        CPPUNIT_ASSERT(zkr_queue_aoffer_many(&queues[0], &data[1], &lens[1], 3, offer_completion, &results) == ZOK);
+        CPPUNIT_ASSERT(zkr_queue_aoffer(&queues[0], data[4], lens[4], offer_completion, &results) == ZOK);
+        CPPUNIT_ASSERT(zkr_queue_offer(&queues[0], data[5], lens[5]) == ZOK);
+        CPPUNIT_ASSERT(waitForOffers(&results, 5));
+        CPPUNIT_ASSERT_EQUAL(0, results.failed);
+
+        int i;
+        for(i = 0; i < 6; i++){
+            char receive_buffer[2];
+            int receive_buffer_length = sizeof(receive_buffer);
+            CPPUNIT_ASSERT(zkr_queue_remove(&queues[0], receive_buffer, &receive_buffer_length) == ZOK);
+            CPPUNIT_ASSERT(receive_buffer_length == 2);
+            CPPUNIT_ASSERT(strcmp(receive_buffer, data[i]) == 0);
+        }
+        pthread_mutex_destroy(&results.mutex);
+
+        cleanUpQueues(num_clients,queues);
+    }
+
+    struct barrier_results {
+        pthread_mutex_t mutex;
+        int passed;
+        int failed;
+    };
+
+    static void barrier_completion(int rc, const void *data){
+        barrier_results *results = (barrier_results *) data;
+        pthread_mutex_lock(&results->mutex);
+        if(rc == ZOK){
+            results->passed++;
+        }else{
+            results->failed++;
+        }
+        pthread_mutex_unlock(&results->mutex);
+    }
+
+    int countPassed(barrier_results *results){
+        pthread_mutex_lock(&results->mutex);
+        int passed = results->passed;
+        pthread_mutex_unlock(&results->mutex);
+        return passed;
+    }
+
+    bool waitForBarriers(barrier_results *results, int n){
+        time_t expires = time(0) + 10;
+        while(countPassed(results) < n && time(0) < expires){
+            usleep(1000);
+        }
+        return countPassed(results) == n;
+    }
+
+    void testBarrierEnter(){
+        int num_clients = 3;
+        watchctx_t ctxs[num_clients];
+        zhandle_t *zoohandles[num_clients];
+        zkr_barrier_t barriers[num_clients];
+        pthread_t threads[num_clients];
+        char *path=(char *)"/testBarrierEnter";
+
+        int i;
+        for(i=0; i < num_clients; i++){
+            zoohandles[i] = createClient(&ctxs[i]);
+            zkr_barrier_init(&barriers[i], zoohandles[i], path, &ZOO_OPEN_ACL_UNSAFE, num_clients);
+            pthread_create(&threads[i], NULL, enter_thread_barrier, (void *) &barriers[i]);
+        }
+        for(i=0; i < num_clients; i++){
+            void *rc;
+            pthread_join(threads[i], &rc);
+            CPPUNIT_ASSERT_EQUAL(0L, (long) rc);
+        }
+        for(i=0; i < num_clients; i++){
+            zkr_barrier_destroy(&barriers[i]);
+        }
+    }
+
+    void testABarrierEnter(){
+        int num_clients = 1;
+        int num_workers = 5;
+        watchctx_t ctxs[num_clients];
+        zkr_barrier_t barriers[num_workers];
+        char *path=(char *)"/testABarrierEnter";
+        zhandle_t *zh = createClient(&ctxs[0]);
+        barrier_results results;
+        pthread_mutex_init(&results.mutex, NULL);
+        results.passed = 0;
+        results.failed = 0;
+
+        int i;
+        long requests = 0;
+        CPPUNIT_ASSERT(zoo_create(zh, path, NULL, 0, &ZOO_OPEN_ACL_UNSAFE, 0, NULL, 0) == ZOK);
+        for(i=0; i < num_workers; i++){
+            zkr_barrier_init(&barriers[i], zh, path, &ZOO_OPEN_ACL_UNSAFE, num_workers);
+        }
+        for(i=0; i < num_workers - 1; i++){
+            CPPUNIT_ASSERT(zkr_barrier_aenter(&barriers[i], barrier_completion, &results) == ZOK);
+        }
+        sleep(1);
+        CPPUNIT_ASSERT_EQUAL(0, countPassed(&results));
+        CPPUNIT_ASSERT(zkr_barrier_aenter(&barriers[0], barrier_completion, &results) == ZSYSTEMERROR);
+        CPPUNIT_ASSERT(zkr_barrier_aenter(&barriers[num_workers - 1], barrier_completion, &results) == ZOK);
+        CPPUNIT_ASSERT(waitForBarriers(&results, num_workers));
+        CPPUNIT_ASSERT_EQUAL(0, results.failed);
+
+        // a watch and a create each, then a list and the release by the last
+        for(i=0; i < num_workers; i++){
+            requests += barriers[i].requests;
+        }
+        CPPUNIT_ASSERT_EQUAL(2L * num_workers + 2, requests);
+        // one that comes late finds the barrier released
+        zkr_barrier_t late;
+        zkr_barrier_init(&late, zh, path, &ZOO_OPEN_ACL_UNSAFE, num_workers);
+        CPPUNIT_ASSERT(zkr_barrier_enter(&late) == ZOK);
+        zkr_barrier_destroy(&late);
+
+        for(i=0; i < num_workers; i++){
+            zkr_barrier_destroy(&barriers[i]);
+        }
+        pthread_mutex_destroy(&results.mutex);
+    }
+
+    void testDoubleBarrier(){
+        int num_clients = 1;
+        int num_workers = 3;
+        watchctx_t ctxs[num_clients];
+        zkr_barrier_t barriers[num_workers];
+        char *path=(char *)"/testDoubleBarrier";
+        zhandle_t *zh = createClient(&ctxs[0]);
+        barrier_results results;
+        pthread_mutex_init(&results.mutex, NULL);
+        results.passed = 0;
+        results.failed = 0;
+
+        int i;
+        for(i=0; i < num_workers; i++){
+            zkr_barrier_init(&barriers[i], zh, path, &ZOO_OPEN_ACL_UNSAFE, num_workers);
+            CPPUNIT_ASSERT(zkr_barrier_aleave(&barriers[i], barrier_completion, &results) == ZSYSTEMERROR);
+            CPPUNIT_ASSERT(zkr_barrier_aenter(&barriers[i], barrier_completion, &results) == ZOK);
+        }
+        CPPUNIT_ASSERT(waitForBarriers(&results, num_workers));
+
+        for(i=0; i < num_workers - 1; i++){
+            CPPUNIT_ASSERT(zkr_barrier_aleave(&barriers[i], barrier_completion, &results) == ZOK);
+        }
+        sleep(1);
+        CPPUNIT_ASSERT_EQUAL(num_workers, countPassed(&results));
+        CPPUNIT_ASSERT(zkr_barrier_leave(&barriers[num_workers - 1]) == ZOK);
+        CPPUNIT_ASSERT(waitForBarriers(&results, 2 * num_workers - 1));
+        CPPUNIT_ASSERT_EQUAL(0, results.failed);
+
+        // every worker's node under the barrier's path is gone
+        struct String_vector children;
+        CPPUNIT_ASSERT(zoo_get_children(zh, path, 0, &children) == ZOK);
+        for(i=0; i < children.count; i++){
+            CPPUNIT_ASSERT(strncmp(children.data[i], "w-", 2) != 0);
+        }
+        deallocate_String_vector(&children);
+
+        for(i=0; i < num_workers; i++){
+            zkr_barrier_destroy(&barriers[i]);
+        }
+        pthread_mutex_destroy(&results.mutex);
+    }
+
     void testTakeThreaded(){
         int num_clients = 1;
         watchctx_t ctxs[num_clients];